@@ -0,0 +1,123 @@
+/**
+ * \file bench_harris.cpp
+ *
+ * Measure the detection time per roi of the quick Harris detector.
+ *
+ *  bench_harris [--rois=200] [--image=file.pgm]
+ *  detects in rois of the sizes of the active search grid cells and larger, at each simd level
+ *  available on the machine, and prints the mean time per roi. Without image, a random texture
+ *  with bright squares is used, so that there are corners of all strengths.
+ *
+ * \ingroup rtslam
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <getopt.h>
+
+#include "kernel/timingTools.hpp"
+#include "image/roi.hpp"
+#include "rtslam/quickHarrisDetector.hpp"
+#include "rtslam/simd.hpp"
+
+using namespace jafar;
+using namespace jafar::rtslam;
+
+enum { iRois = 0, nIntOpts };
+int intOpts[nIntOpts] = {0};
+const int nFirstIntOpt = 0, nLastIntOpt = nIntOpts-1;
+
+enum { sImage = 0, nStrOpts };
+std::string strOpts[nStrOpts];
+const int nFirstStrOpt = nIntOpts, nLastStrOpt = nFirstStrOpt+nStrOpts-1;
+
+struct option long_options[] = {
+	// int options
+	{"rois", 1, 0, 0},
+	// string options
+	{"image", 1, 0, 0},
+	{0, 0, 0, 0}
+};
+
+
+static void fillScene(image::Image & img)
+{
+	for (int i = 0; i < img.height(); ++i)
+		for (int j = 0; j < img.width(); ++j)
+			img.data()[i*img.step()+j] = (unsigned char)(64 + rand() % 32);
+	for (int k = 0; k < img.width()*img.height()/400; ++k)
+	{
+		int x0 = rand() % img.width(), y0 = rand() % img.height(), size = 3 + rand() % 12, value = 128 + rand() % 128;
+		for (int i = y0; i < std::min(y0+size, img.height()); ++i)
+			for (int j = x0; j < std::min(x0+size, img.width()); ++j)
+				img.data()[i*img.step()+j] = (unsigned char)value;
+	}
+}
+
+
+int main(int argc, char* const* argv)
+{
+	intOpts[iRois] = 200;
+
+	while (1)
+	{
+		int c, option_index = 0;
+		c = getopt_long_only(argc, argv, "", long_options, &option_index);
+		if (c == -1) break;
+		if (c == 0)
+		{
+			if (option_index <= nLastIntOpt)
+			{
+				if (optarg) intOpts[option_index-nFirstIntOpt] = atoi(optarg);
+			} else
+			if (option_index <= nLastStrOpt)
+			{
+				if (optarg) strOpts[option_index-nFirstStrOpt] = optarg;
+			}
+		} else
+		{
+			std::cerr << "Unknown option " << c << std::endl;
+			return 1;
+		}
+	}
+
+	image::Image img(640, 480, CV_8U, JfrImage_CS_GRAY);
+	if (!strOpts[sImage].empty())
+	{
+		if (!img.load(strOpts[sImage], 0) || img.data() == NULL) { std::cerr << "Cannot load " << strOpts[sImage] << std::endl; return 1; }
+	} else
+	{
+		srand(4);
+		fillScene(img);
+	}
+	QuickHarrisDetector detector(5, 15.0, 10.0);
+	feat_img_pnt_ptr_t featPtr(new FeatureImagePoint());
+	kernel::Chrono chrono;
+	const int n = (intOpts[iRois] > 0 ? intOpts[iRois] : 1);
+
+	int sizes[] = {30, 60, 120};
+	simd::level_t levels[] = {simd::SCALAR, simd::SSE2, simd::AVX2};
+	const char * names[] = {"scalar", "sse2", "avx2"};
+	for (int k = 0; k < 3; ++k)
+	{
+		int size = sizes[k];
+		if (size + 2 > img.width() || size + 2 > img.height()) break;
+		std::cout << "harris " << size << "x" << size << ":";
+		for (int l = 0; l < 3 && levels[l] <= simd::detectedLevel(); ++l)
+		{
+			simd::setLevel(levels[l]);
+			chrono.reset();
+			for (int i = 0; i < n; ++i)
+			{
+				image::ConvexRoi roi(cv::Rect(1 + (i * 37) % (img.width()-size-2), 1 + (i * 23) % (img.height()-size-2), size, size));
+				detector.detectIn(img, featPtr, &roi);
+			}
+			std::cout << " " << names[l] << " " << chrono.elapsedMicrosecond() / n << " us/roi";
+		}
+		std::cout << std::endl;
+	}
+	simd::setLevel(simd::detectedLevel());
+	return 0;
+}
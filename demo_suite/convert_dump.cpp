@@ -0,0 +1,94 @@
+/**
+ * \file convert_dump.cpp
+ *
+ * Convert the data dumped by demo_slam to the packed formats.
+ *
+ *  convert_dump --data-path=data/rtslam01 [--images=0/1] [--log=rtslam.log.bin]
+ *  converts the image_NNNNNNN.pgm/.png and .time files of data-path to data-path/images.seq,
+ *  that demo_slam --replay then uses instead of the image files,
+ *  and the binary log data-path/rtslam.log.bin written by demo_slam --log-binary to the text log data-path/rtslam.log.
+ *  The images are converted by default only if no log is given.
+ *
+ * \ingroup rtslam
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <getopt.h>
+
+#include "kernel/timingTools.hpp"
+#include "rtslam/sequenceFile.hpp"
+#include "rtslam/binaryLogger.hpp"
+
+using namespace jafar;
+using namespace jafar::rtslam;
+
+enum { iImages = 0, nIntOpts };
+int intOpts[nIntOpts] = {0};
+const int nFirstIntOpt = 0, nLastIntOpt = nIntOpts-1;
+
+enum { sDataPath = 0, sLog, nStrOpts };
+std::string strOpts[nStrOpts];
+const int nFirstStrOpt = nIntOpts, nLastStrOpt = nFirstStrOpt+nStrOpts-1;
+
+struct option long_options[] = {
+	// int options
+	{"images", 2, 0, 0},
+	// string options
+	{"data-path", 1, 0, 0},
+	{"log", 1, 0, 0},
+	{0, 0, 0, 0}
+};
+
+
+int main(int argc, char* const* argv)
+{
+	intOpts[iImages] = -1;
+	strOpts[sDataPath] = ".";
+
+	while (1)
+	{
+		int c, option_index = 0;
+		c = getopt_long_only(argc, argv, "", long_options, &option_index);
+		if (c == -1) break;
+		if (c == 0)
+		{
+			if (option_index <= nLastIntOpt)
+			{
+				intOpts[option_index] = 1;
+				if (optarg) intOpts[option_index-nFirstIntOpt] = atoi(optarg);
+			} else
+			if (option_index <= nLastStrOpt)
+			{
+				if (optarg) strOpts[option_index-nFirstStrOpt] = optarg;
+			}
+		} else
+		{
+			std::cerr << "Unknown option " << c << std::endl;
+			return 1;
+		}
+	}
+
+	if (intOpts[iImages] < 0) intOpts[iImages] = strOpts[sLog].empty();
+	int r = 0;
+	kernel::Chrono chrono;
+	if (intOpts[iImages])
+	{
+		chrono.reset();
+		int n = hardware::convertImageDirectory(strOpts[sDataPath], strOpts[sDataPath] + "/images.seq");
+		if (n < 0) { std::cerr << "Cannot convert the images of " << strOpts[sDataPath] << std::endl; r = 1; }
+		else std::cout << "images: " << n << " converted to " << strOpts[sDataPath] << "/images.seq in " << chrono.elapsed() << " ms" << std::endl;
+	}
+	if (!strOpts[sLog].empty())
+	{
+		std::string binary = strOpts[sDataPath] + "/" + strOpts[sLog];
+		std::string text = binary + ".txt";
+		if (binary.size() > 4 && binary.substr(binary.size()-4) == ".bin") text = binary.substr(0, binary.size()-4);
+		chrono.reset();
+		int n = convertBinaryLog(binary, text);
+		if (n < 0) { std::cerr << "Cannot convert the log " << binary << std::endl; r = 1; }
+		else std::cout << "log: " << n << " records converted to " << text << " in " << chrono.elapsed() << " ms" << std::endl;
+	}
+	return r;
+}
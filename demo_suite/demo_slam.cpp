@@ -170,6 +170,9 @@
 #include "rtslam/hardwareSensorAdhocSimulator.hpp"
 #include "rtslam/hardwareEstimatorInertialAdhocSimulator.hpp"
 #include "rtslam/exporterSocket.hpp"
+#include "rtslam/threadPool.hpp"
+#include "rtslam/framePipeline.hpp"
+#include "rtslam/binaryLogger.hpp"
 
 
 /** ############################################################################
@@ -216,7 +219,7 @@ time_t rseed;
  * program parameters
  * ###########################################################################*/
 
-enum { iDispQt = 0, iDispGdhe, iRenderAll, iReplay, iDump, iRandSeed, iPause, iVerbose, iMap, iRobot, iCamera, iTrigger, iGps, iSimu, iExport, nIntOpts };
+enum { iDispQt = 0, iDispGdhe, iRenderAll, iReplay, iDump, iRandSeed, iPause, iVerbose, iMap, iRobot, iCamera, iTrigger, iGps, iSimu, iExport, iThreads, iPyramid, iZncc, iTrack, iBatchInit, iSync, iPipeline, iAppCache, iBatch, iLogBinary, iDumpPool, iDumpPolicy, iDumpCompress, iKfEngine, iKfSolver, iUpdate, nIntOpts };
 int intOpts[nIntOpts] = {0};
 const int nFirstIntOpt = 0, nLastIntOpt = nIntOpts-1;
 
@@ -224,7 +227,7 @@ enum { fFreq = 0, fShutter, fHeading, nFloatOpts };
 double floatOpts[nFloatOpts] = {0.0};
 const int nFirstFloatOpt = nIntOpts, nLastFloatOpt = nIntOpts+nFloatOpts-1;
 
-enum { sDataPath = 0, sConfigSetup, sConfigEstimation, sLog, nStrOpts };
+enum { sDataPath = 0, sConfigSetup, sConfigEstimation, sLog, sTrajRef, nStrOpts };
 std::string strOpts[nStrOpts];
 const int nFirstStrOpt = nIntOpts+nFloatOpts, nLastStrOpt = nIntOpts+nFloatOpts+nStrOpts-1;
 
@@ -252,6 +255,22 @@ struct option long_options[] = {
 	{"gps", 2, 0, 0},
 	{"simu", 2, 0, 0},
 	{"export", 2, 0, 0},
+	{"threads", 2, 0, 0},
+	{"pyramid", 2, 0, 0},
+	{"zncc", 2, 0, 0},
+	{"track", 2, 0, 0},
+	{"batch-init", 2, 0, 0},
+	{"sync", 2, 0, 0},
+	{"pipeline", 2, 0, 0},
+	{"app-cache", 2, 0, 0},
+	{"batch", 2, 0, 0},
+	{"log-binary", 2, 0, 0},
+	{"dump-pool", 2, 0, 0},
+	{"dump-policy", 2, 0, 0},
+	{"dump-compress", 2, 0, 0},
+	{"kf-engine", 2, 0, 0},
+	{"kf-solver", 2, 0, 0},
+	{"update", 2, 0, 0},
 	// double options
 	{"freq", 2, 0, 0}, // should be in config file
 	{"shutter", 2, 0, 0}, // should be in config file
@@ -261,6 +280,7 @@ struct option long_options[] = {
 	{"config-setup", 1, 0, 0},
 	{"config-estimation", 1, 0, 0},
 	{"log", 1, 0, 0},
+	{"traj-ref", 1, 0, 0},
 	// breaking options
 	{"help",0,0,0},
 	{"usage",0,0,0},
@@ -277,6 +297,7 @@ const int slam_priority = -20; // needs to be started as root to be < 0
 const int display_priority = 10;
 const int display_period = 100; // ms
 const unsigned N_FRAMES = 500000;
+const int batch_prefetch = 16; // images read ahead in batch replay by default
 
 
 class ConfigSetup: public kernel::KeyValueFileSaveLoad
@@ -422,8 +443,14 @@ class ConfigEstimation: public kernel::KeyValueFileSaveLoad
 
 world_ptr_t worldPtr;
 boost::scoped_ptr<kernel::DataLogger> dataLogger;
+boost::scoped_ptr<BinaryLogger> binaryLogger;
 sensor_manager_ptr_t sensorManager;
 boost::shared_ptr<ExporterAbstract> exporter;
+thread_pool_ptr_t threadPool;
+frame_pipeline_ptr_t framePipeline;
+boost::shared_ptr<ImagePointZnccMatcher> znccMatcher;
+boost::shared_ptr<DataManager_ImagePoint_Ransac> pointDataManager;
+boost::shared_ptr<hardware::HardwareSensorCamera> dumpCamera;
 #ifdef HAVE_MODULE_QDISPLAY
 display::ViewerQt *viewerQt = NULL;
 #endif
@@ -436,6 +463,13 @@ kernel::VariableCondition<int> rawdata_condition(0);
 void demo_slam_init()
 { try {
 	// preprocess options
+	if (intOpts[iBatch])
+	{ // batch replay: as fast as possible, reproducible, without display nor wait for the user
+		intOpts[iReplay] = 1; // timestamp order, not true time
+		intOpts[iDispQt] = intOpts[iDispGdhe] = 0;
+		intOpts[iRenderAll] = intOpts[iPause] = intOpts[iDump] = 0;
+		if (intOpts[iRandSeed] == 0) intOpts[iRandSeed] = 1;
+	}
 	if (intOpts[iReplay] & 1) mode = 2; else
 		if (intOpts[iDump]) mode = 1; else
 			mode = 0;
@@ -451,6 +485,8 @@ void demo_slam_init()
 		strOpts[sConfigSetup] = strOpts[sDataPath] + strOpts[sConfigSetup].substr(1);
 	if (strOpts[sConfigEstimation][0] == '@' && strOpts[sConfigEstimation][1] == '/')
 		strOpts[sConfigEstimation] = strOpts[sDataPath] + strOpts[sConfigEstimation].substr(1);
+	if (strOpts[sTrajRef].size() > 1 && strOpts[sTrajRef][0] == '@' && strOpts[sTrajRef][1] == '/')
+		strOpts[sTrajRef] = strOpts[sDataPath] + strOpts[sTrajRef].substr(1);
 	if (!(intOpts[iReplay] & 1) && intOpts[iDump])
 	{
 		boost::filesystem::remove(strOpts[sDataPath] + "/setup.cfg");
@@ -538,6 +574,22 @@ void demo_slam_init()
 		distortion = configSetup.DISTORTION;
 	}
 	
+	if (!strOpts[sLog].empty() && intOpts[iLogBinary])
+	{
+		binaryLogger.reset(new BinaryLogger(strOpts[sDataPath] + "/" + strOpts[sLog] + ".bin"));
+		time_t now = time(NULL);
+		std::string date = ctime(&now);
+		binaryLogger->writeComment(date.substr(0, date.size()-1));
+#ifndef GENOM
+		std::ostringstream oss;
+		for(int i = 0; i < nIntOpts; ++i)
+			{ oss << long_options[i+nFirstIntOpt].name << " = " << intOpts[i]; binaryLogger->writeComment(oss.str()); oss.str(""); }
+		for(int i = 0; i < nFloatOpts; ++i)
+			{ oss << long_options[i+nFirstFloatOpt].name << " = " << floatOpts[i]; binaryLogger->writeComment(oss.str()); oss.str(""); }
+		for(int i = 0; i < nStrOpts; ++i)
+			{ oss << long_options[i+nFirstStrOpt].name << " = " << strOpts[i]; binaryLogger->writeComment(oss.str()); oss.str(""); }
+#endif
+	} else
 	if (!strOpts[sLog].empty())
 	{
 		dataLogger.reset(new kernel::DataLogger(strOpts[sDataPath] + "/" + strOpts[sLog]));
@@ -603,8 +655,16 @@ void demo_slam_init()
 	// INIT : 1 map and map-manager, 2 robs, 3 sens and data-manager.
 
 	// 1. Create maps.
-	map_ptr_t mapPtr(new MapAbstract(configEstimation.MAP_SIZE));
+	map_ptr_t mapPtr(new MapAbstract(configEstimation.MAP_SIZE, 100)); // allocate for the robot and a few landmarks, grow on demand
 	mapPtr->linkToParentWorld(worldPtr);
+	mapPtr->setCompactionThreshold(0.25);
+	if (intOpts[iKfEngine]) mapPtr->filterPtr->setEngine(ExtendedKalmanFilterIndirect::BLOCKS);
+	if (intOpts[iKfSolver]) mapPtr->filterPtr->setStackedSolver(ExtendedKalmanFilterIndirect::CHOLESKY);
+	if (intOpts[iThreads] > 1)
+	{
+		threadPool.reset(new ThreadPool(intOpts[iThreads]));
+		mapPtr->filterPtr->setThreadPool(threadPool);
+	}
 	
    // 1b. Create map manager.
 	landmark_factory_ptr_t pointLmkFactory;
@@ -800,6 +860,7 @@ void demo_slam_init()
 		vec pertStd = createVector<12>(_v);
 		robPtr1_->perturbation.set_std_continuous(pertStd);
 		robPtr1_->constantPerturbation = false;
+		robPtr1_->setPreintegration(true); // one map prediction per frame instead of one per IMU reading
 
 		hardware::hardware_estimator_ptr_t hardEst1;
 		if (intOpts[iSimu] != 0)
@@ -860,11 +921,13 @@ void demo_slam_init()
 	                    0,0,0, configSetup.UNCERT_ATTITUDE,configSetup.UNCERT_ATTITUDE,configSetup.UNCERT_HEADING);
 	robPtr1->robot_pose = configSetup.ROBOT_POSE;
 	if (dataLogger) dataLogger->addLoggable(*robPtr1.get());
+	if (binaryLogger) binaryLogger->addLoggable(*robPtr1.get());
 
 	if (intOpts[iSimu] != 0)
 	{
 		simu::Robot *rob = new simu::Robot(robPtr1->id(), 6);
 		if (dataLogger) dataLogger->addLoggable(*rob);
+		if (binaryLogger) binaryLogger->addLoggable(*rob);
 		
 		switch (intOpts[iSimu]%10)
 		{
@@ -1029,6 +1092,7 @@ void demo_slam_init()
 				boost::shared_ptr<simu::MatcherSimu<image::ConvexRoi> > matcher(new simu::MatcherSimu<image::ConvexRoi>(LandmarkAbstract::POINT, 2, configEstimation.PATCH_SIZE, configEstimation.MAX_SEARCH_SIZE, configEstimation.RANSAC_LOW_INNOV, configEstimation.MATCH_TH, configEstimation.MAHALANOBIS_TH, configEstimation.RELEVANCE_TH, configEstimation.PIX_NOISE, configEstimation.PIX_NOISE*configEstimation.PIX_NOISE_SIMUFACTOR));
 
 				boost::shared_ptr<DataManager_ImagePoint_Ransac_Simu> dmPt11(new DataManager_ImagePoint_Ransac_Simu(detector, matcher, asGrid, configEstimation.N_UPDATES_TOTAL, configEstimation.N_UPDATES_RANSAC, ransac_ntries, configEstimation.N_INIT, configEstimation.N_RECOMP_GAINS));
+				if (intOpts[iBatchInit] == 1) dmPt11->setBatchInit(true);
 
 				dmPt11->linkToParentSensorSpec(senPtr11);
 				dmPt11->linkToParentMapManager(mmPoint);
@@ -1058,14 +1122,25 @@ void demo_slam_init()
 			#endif
 			#if SEGMENT_BASED != 1
 					 if (configEstimation.MULTIVIEW_DESCRIPTOR)
-							pointDescFactory.reset(new DescriptorImagePointMultiViewFactory(configEstimation.DESC_SIZE, configEstimation.DESC_SCALE_STEP, jmath::degToRad(configEstimation.DESC_ANGLE_STEP), (DescriptorImagePointMultiView::PredictionType)configEstimation.DESC_PREDICTION_TYPE));
-					 else
+					 {
+							boost::shared_ptr<DescriptorImagePointMultiViewFactory> multiViewFactory(new DescriptorImagePointMultiViewFactory(configEstimation.DESC_SIZE, configEstimation.DESC_SCALE_STEP, jmath::degToRad(configEstimation.DESC_ANGLE_STEP), (DescriptorImagePointMultiView::PredictionType)configEstimation.DESC_PREDICTION_TYPE));
+							if (intOpts[iAppCache] == 1) multiViewFactory->setPredictionCache(0.01, jmath::degToRad(0.5));
+							pointDescFactory = multiViewFactory;
+					 } else
 							pointDescFactory.reset(new DescriptorImagePointFirstViewFactory(configEstimation.DESC_SIZE));
 
 					 boost::shared_ptr<ImagePointHarrisDetector> harrisDetector(new ImagePointHarrisDetector(configEstimation.HARRIS_CONV_SIZE, configEstimation.HARRIS_TH, configEstimation.HARRIS_EDDGE, configEstimation.PATCH_SIZE, configEstimation.PIX_NOISE, pointDescFactory));
-					 boost::shared_ptr<ImagePointZnccMatcher> znccMatcher(new ImagePointZnccMatcher(configEstimation.MIN_SCORE, configEstimation.PARTIAL_POSITION, configEstimation.PATCH_SIZE, configEstimation.MAX_SEARCH_SIZE, configEstimation.RANSAC_LOW_INNOV, configEstimation.MATCH_TH, configEstimation.MAHALANOBIS_TH, configEstimation.RELEVANCE_TH, configEstimation.PIX_NOISE));
+					 znccMatcher.reset(new ImagePointZnccMatcher(configEstimation.MIN_SCORE, configEstimation.PARTIAL_POSITION, configEstimation.PATCH_SIZE, configEstimation.MAX_SEARCH_SIZE, configEstimation.RANSAC_LOW_INNOV, configEstimation.MATCH_TH, configEstimation.MAHALANOBIS_TH, configEstimation.RELEVANCE_TH, configEstimation.PIX_NOISE));
+					 if (intOpts[iPyramid] > 0) znccMatcher->setCoarseToFine(intOpts[iPyramid]);
+					 if (intOpts[iZncc] == 1) znccMatcher->setEngine(ImagePointZnccMatcher::ENGINE_INTEGRAL);
+					 if (intOpts[iTrack] == 1) znccMatcher->setPreTracking(true);
 
 					 boost::shared_ptr<DataManager_ImagePoint_Ransac> dmPt11(new DataManager_ImagePoint_Ransac(harrisDetector, znccMatcher, asGrid, configEstimation.N_UPDATES_TOTAL, configEstimation.N_UPDATES_RANSAC, ransac_ntries, configEstimation.N_INIT, configEstimation.N_RECOMP_GAINS));
+					 if (intOpts[iBatchInit] == 1) dmPt11->setBatchInit(true);
+					 if (intOpts[iUpdate] >= 0 && intOpts[iUpdate] <= 2) dmPt11->setUpdateMode(DataManager_ImagePoint_Ransac::update_mode_t(intOpts[iUpdate]));
+					 else std::cerr << "Unknown update mode " << intOpts[iUpdate] << ", using the stacked update" << std::endl;
+					 if (threadPool) dmPt11->setThreadPool(threadPool);
+					 pointDataManager = dmPt11;
 
 					 dmPt11->linkToParentSensorSpec(senPtr11);
 					 dmPt11->linkToParentMapManager(mmPoint);
@@ -1086,11 +1161,18 @@ void demo_slam_init()
 					configSetup.CAMERA_DEVICE, cv::Size(img_width,img_height), 0, 8, crop, floatOpts[fFreq], intOpts[iTrigger],
 					floatOpts[fShutter], mode, strOpts[sDataPath]));
 				hardSen11->setTimingInfos(1.0/hardSen11->getFreq(), 1.0/hardSen11->getFreq());
+				if (intOpts[iDump] == 2) hardSen11->setPackedDump(true);
+				if (intOpts[iDump])
+				{
+					hardSen11->setDumpConfig(intOpts[iDumpPool], hardware::HardwareSensorCamera::DumpPolicy(intOpts[iDumpPolicy]), intOpts[iDumpCompress]);
+					dumpCamera = hardSen11;
+				}
 				senPtr11->setHardwareSensor(hardSen11);
 				#else
 				if (intOpts[iReplay] & 1)
 				{
-					hardware::hardware_sensorext_ptr_t hardSen11(new hardware::HardwareSensorCameraFirewire(rawdata_condition, cv::Size(img_width,img_height),strOpts[sDataPath]));
+					hardware::hardware_sensorext_ptr_t hardSen11(new hardware::HardwareSensorCameraFirewire(rawdata_condition, cv::Size(img_width,img_height),strOpts[sDataPath],
+						intOpts[iBatch] > 1 ? intOpts[iBatch] : (intOpts[iBatch] ? batch_prefetch : 3)));
 					senPtr11->setHardwareSensor(hardSen11);
 				}
 				#endif
@@ -1104,11 +1186,18 @@ void demo_slam_init()
 					configSetup.CAMERA_DEVICE, cv::Size(img_width,img_height), floatOpts[fFreq], intOpts[iTrigger],
 					floatOpts[fShutter], mode, strOpts[sDataPath]));
 				hardSen11->setTimingInfos(1.0/hardSen11->getFreq(), 1.0/hardSen11->getFreq());
+				if (intOpts[iDump] == 2) hardSen11->setPackedDump(true);
+				if (intOpts[iDump])
+				{
+					hardSen11->setDumpConfig(intOpts[iDumpPool], hardware::HardwareSensorCamera::DumpPolicy(intOpts[iDumpPolicy]), intOpts[iDumpCompress]);
+					dumpCamera = hardSen11;
+				}
 				senPtr11->setHardwareSensor(hardSen11);
 				#else
 				if (intOpts[iReplay] & 1)
 				{
-					hardware::hardware_sensorext_ptr_t hardSen11(new hardware::HardwareSensorCameraUeye(rawdata_condition, cv::Size(img_width,img_height),strOpts[sDataPath]));
+					hardware::hardware_sensorext_ptr_t hardSen11(new hardware::HardwareSensorCameraUeye(rawdata_condition, cv::Size(img_width,img_height),strOpts[sDataPath],
+						intOpts[iBatch] > 1 ? intOpts[iBatch] : (intOpts[iBatch] ? batch_prefetch : 3)));
 					senPtr11->setHardwareSensor(hardSen11);
 				}
 				#endif
@@ -1117,6 +1206,11 @@ void demo_slam_init()
 			senPtr11->setIntegrationPolicy(false);
 			senPtr11->setUseForInit(false);
 			senPtr11->setNeedInit(true); // for auto exposure
+			if (intOpts[iPipeline])
+			{
+				framePipeline.reset(new FramePipeline());
+				senPtr11->setPipeline(framePipeline);
+			}
 
 		}
 	} // if (intOpts[iCamera])
@@ -1194,6 +1288,60 @@ void demo_slam_init()
 } catch (kernel::Exception &e) { std::cout << e.what(); throw e; } } // demo_slam_init
 
 
+/** ############################################################################
+ * #############################################################################
+ * Trajectories of batch replays
+ * ###########################################################################*/
+
+struct TrajectoryPoint { double t, x, y, z; };
+
+/// one line "t x y z" per frame
+void saveTrajectory(const std::string & filename, const std::vector<TrajectoryPoint> & trajectory)
+{
+	std::fstream f(filename.c_str(), std::ios_base::out);
+	f << std::setprecision(16);
+	for (size_t i = 0; i < trajectory.size(); ++i)
+		f << trajectory[i].t << " " << trajectory[i].x << " " << trajectory[i].y << " " << trajectory[i].z << "\n";
+	f.close();
+}
+
+bool loadTrajectory(const std::string & filename, std::vector<TrajectoryPoint> & trajectory)
+{
+	std::fstream f(filename.c_str(), std::ios_base::in);
+	if (!f.is_open()) return false;
+	trajectory.clear();
+	TrajectoryPoint point;
+	while (f >> point.t >> point.x >> point.y >> point.z) trajectory.push_back(point);
+	return true;
+}
+
+/**
+	Position errors of a trajectory with respect to a reference, interpolated at the dates of the trajectory.
+	Only the dates within the reference are compared, both trajectories must be sorted by date.
+	\return the number of compared positions
+*/
+unsigned trajectoryError(const std::vector<TrajectoryPoint> & trajectory, const std::vector<TrajectoryPoint> & reference,
+	double & rms, double & max, double & last)
+{
+	unsigned n = 0;
+	rms = max = last = 0.;
+	size_t j = 0;
+	for (size_t i = 0; i < trajectory.size() && reference.size() > 1; ++i)
+	{
+		const TrajectoryPoint & p = trajectory[i];
+		if (p.t < reference.front().t || p.t > reference.back().t) continue;
+		while (j+2 < reference.size() && reference[j+1].t < p.t) ++j;
+		const TrajectoryPoint & a = reference[j], & b = reference[j+1];
+		double r = (b.t > a.t ? (p.t - a.t) / (b.t - a.t) : 0.);
+		double dx = p.x - (a.x + r*(b.x-a.x)), dy = p.y - (a.y + r*(b.y-a.y)), dz = p.z - (a.z + r*(b.z-a.z));
+		last = sqrt(dx*dx + dy*dy + dz*dz);
+		rms += last*last;
+		if (last > max) max = last;
+		++n;
+	}
+	if (n) rms = sqrt(rms / n);
+	return n;
+}
 
 
 void demo_slam_main(world_ptr_t *world)
@@ -1278,6 +1426,14 @@ int n_innovation = 0;
 	// Temporal loop
 	//if (dataLogger) dataLogger->log();
 	kernel::Chrono chrono;
+	FrameTiming frameTiming;
+	bool live = (intOpts[iReplay] == 0 && intOpts[iSimu] == 0); // raw arrival dates are dates of kernel::Clock
+	bool batch = (intOpts[iBatch] != 0);
+	DurationHistogram stageData(0.5), stageMove(0.5), stageProcess, stageLog(0.1); // per stage timings of the frames, ms
+	std::vector<TrajectoryPoint> trajectory;
+	unsigned n_data_waits = 0; // the data was not read yet
+	double data_wait_time = 0.;
+	double loop_start = kernel::Clock::getTime();
 
 	for (; (*world)->t <= N_FRAMES;)
 	{
@@ -1286,29 +1442,53 @@ int n_innovation = 0;
 		bool had_data = false;
 		chrono.reset();
 
-		SensorManagerAbstract::ProcessInfo pinfo = sensorManager->getNextDataToUse();
+		double data_start = kernel::Clock::getTime();
+		std::vector<SensorManagerAbstract::ProcessInfo> group;
+		if (intOpts[iSync] > 0)
+			sensorManager->getNextDataGroupToUse(group, intOpts[iSync] * 1e-3);
+		else
+			group.push_back(sensorManager->getNextDataToUse());
+		stageData.add((kernel::Clock::getTime() - data_start) * 1000.);
+		SensorManagerAbstract::ProcessInfo pinfo = group.front();
 		bool no_more_data = pinfo.no_more_data;
 		
 		if (pinfo.sen)
 		{
 			had_data = true;
 			if (intOpts[iReplay] == 2)
-				pinfo.sen->process_fake(pinfo.id); // just to release data
-			else
+			{
+				for (size_t k = 0; k < group.size(); ++k)
+					group[k].sen->process_fake(group[k].id); // just to release data
+			} else
 			{
 				double newt = pinfo.sen->getRawTimestamp(pinfo.id);
+				double frame_start = kernel::Clock::getTime();
+				double frame_arrival = (live ? pinfo.sen->getRawArrival(pinfo.id) : -1.);
 				
 				JFR_DEBUG("************** FRAME : " << (*world)->t << " (" << std::setprecision(16) << newt << std::setprecision(6) << ") sensor " << pinfo.sen->id());
 				
 				robot_ptr_t robPtr = pinfo.sen->robotPtr();
 //std::cout << "Frame " << (*world)->t << " using sen " << pinfo.sen->id() << " at time " << std::setprecision(16) << newt << std::endl;
 				robPtr->move(newt);
+				double process_start = kernel::Clock::getTime();
+				stageMove.add((process_start - frame_start) * 1000.);
 				
 				JFR_DEBUG("Robot " << robPtr->id() << " state after move " << robPtr->state.x() << " ; euler " << quaternion::q2e(ublas::subrange(robPtr->state.x(), 3, 7)));
 				JFR_DEBUG("Robot state stdev after move " << stdevFromCov(robPtr->state.P()));
 				robot_prediction = robPtr->state.x();
 				
-				pinfo.sen->process(pinfo.id);
+				if (group.size() > 1)
+					SensorManagerAbstract::processGroup(group, threadPool.get());
+				else
+					pinfo.sen->process(pinfo.id);
+				double frame_end = kernel::Clock::getTime();
+				stageProcess.add((frame_end - process_start) * 1000.);
+				frameTiming.frameDone(frame_start, frame_end, frame_arrival);
+				if (batch)
+				{
+					TrajectoryPoint point = { newt, robPtr->state.x()(0), robPtr->state.x()(1), robPtr->state.x()(2) };
+					trajectory.push_back(point);
+				}
 				
 				JFR_DEBUG("Robot state after corrections of sensor " << pinfo.sen->id() << " : " << robPtr->state.x() << " ; euler " << quaternion::q2e(ublas::subrange(robPtr->state.x(), 3, 7)));
 				JFR_DEBUG("Robot state stdev after corrections " << stdevFromCov(robPtr->state.P()));
@@ -1333,7 +1513,7 @@ int n_innovation = 0;
 		
 
 		// wait that display has finished if render all
-		if (had_data)
+		if (had_data && !batch)
 		{
 			// get render all status
 			bool renderAll;
@@ -1359,7 +1539,7 @@ int n_innovation = 0;
 		
 		// asking for display if display has finished
 		unsigned processed_t = (had_data ? (*world)->t : (*world)->t-1);
-		if ((*world)->display_t+1 < processed_t+1)
+		if (!batch && (*world)->display_t+1 < processed_t+1)
 		{
 			boost::unique_lock<boost::mutex> display_lock((*world)->display_mutex);
 			if ((*world)->display_rendered)
@@ -1387,8 +1567,11 @@ int n_innovation = 0;
 
 		if (!had_data)
 		{
+			double wait_start = kernel::Clock::getTime();
 			rawdata_condition.wait(boost::lambda::_1 != 0);
 			rawdata_condition.set(0);
+			n_data_waits++;
+			data_wait_time += (kernel::Clock::getTime() - wait_start) * 1000.;
 		}
 		
 		bool doPause;
@@ -1401,7 +1584,7 @@ int n_innovation = 0;
 		} else
 		#endif
 		doPause = (intOpts[iPause] != 0);
-		if (doPause && had_data && !(*world)->exit())
+		if (doPause && had_data && !batch && !(*world)->exit())
 		{
 			(*world)->slam_blocked(true);
 			#ifdef HAVE_MODULE_QDISPLAY
@@ -1422,13 +1605,111 @@ int n_innovation = 0;
 		if (had_data)
 		{
 			(*world)->t++;
+			double log_start = kernel::Clock::getTime();
 			if (dataLogger) dataLogger->log();
+			if (binaryLogger) binaryLogger->log();
+			if (dataLogger || binaryLogger) stageLog.add((kernel::Clock::getTime() - log_start) * 1000.);
 		}
 	} // temporal loop
 
 
+	double loop_time = kernel::Clock::getTime() - loop_start;
+
 	average_robot_innovation /= n_innovation;
 	std::cout << "average_robot_innovation " << average_robot_innovation << std::endl;
+	if (batch)
+	{
+		std::cout << "batch replay: " << frameTiming.count() << " frames in " << loop_time << " s, " << frameTiming.count() / loop_time
+			<< " frames/s ; " << n_data_waits << " waits for data, " << data_wait_time << " ms" << std::endl;
+		std::cout << "stage data: " << stageData << std::endl;
+		std::cout << "stage move: " << stageMove << std::endl;
+		std::cout << "stage process: " << stageProcess << std::endl;
+		if (stageLog.count()) std::cout << "stage log: " << stageLog << std::endl;
+		saveTrajectory(strOpts[sDataPath] + "/trajectory_batch.txt", trajectory);
+		std::vector<TrajectoryPoint> reference;
+		if (strOpts[sTrajRef].size())
+		{
+			double rms, max, last;
+			unsigned n = 0;
+			if (loadTrajectory(strOpts[sTrajRef], reference))
+				n = trajectoryError(trajectory, reference, rms, max, last);
+			if (n)
+				std::cout << "trajectory error: rms " << rms << " m, max " << max << " m, final " << last << " m, over "
+					<< n << "/" << trajectory.size() << " frames" << std::endl;
+			else
+				std::cout << "trajectory error: no frame within the reference " << strOpts[sTrajRef] << std::endl;
+		}
+	}
+	{
+		const MapAbstract::GrowthCounters & growth = mapPtr->growthCounters();
+		const MapAbstract::CompactionCounters & compaction = mapPtr->compactionCounters();
+		std::cout << "map storage: peak " << growth.peak_capacity << " states, " << growth.n_grows << " grows, "
+			<< growth.n_shrinks << " shrinks, " << growth.total_time << " ms ; "
+			<< compaction.n_compactions << " compactions, " << compaction.n_moved_states << " states moved, "
+			<< compaction.total_time << " ms" << std::endl;
+	}
+	if (pointDataManager)
+	{
+		const DataManager_ImagePoint_Ransac::ProcessCounters & processing = pointDataManager->processCounters();
+		if (processing.n_frames)
+			std::cout << "processing: " << processing.n_frames << " frames, mean " << processing.total_time / processing.n_frames
+				<< " ms (max " << processing.max_time << " ms), of which " << processing.parallel_time / processing.n_frames
+				<< " ms in parallel matching with " << (threadPool ? threadPool->size() : 1) << " threads" << std::endl;
+	}
+	{
+		DescriptorImagePointMultiView::PredictionCounters prediction = DescriptorImagePointMultiView::predictionCounters();
+		if (prediction.n_predictions)
+		{
+			const char * types[] = {"none", "affine", "homographic"};
+			std::cout << "appearance prediction (" << types[configEstimation.DESC_PREDICTION_TYPE % 3] << "): " << prediction.n_predictions
+				<< " predictions, " << (double)prediction.warp_time / prediction.n_predictions << " us each, " << prediction.n_fallbacks
+				<< " affine fallbacks ; " << prediction.n_matched << "/" << prediction.n_matched + prediction.n_failed << " matched ("
+				<< 100. * prediction.n_matched / std::max(1ul, prediction.n_matched + prediction.n_failed) << "%)" << std::endl;
+			if (intOpts[iAppCache])
+				std::cout << "appearance cache: " << prediction.n_hits << "/" << prediction.n_predictions << " hits ("
+					<< 100. * prediction.n_hits / prediction.n_predictions << "%)" << std::endl;
+		}
+	}
+	if (frameTiming.count())
+	{
+		std::cout << "frames: " << frameTiming.count() << " frames, " << frameTiming.throughput() << " frames/s" << std::endl;
+		std::cout << "frame processing: " << frameTiming.processing() << std::endl;
+		std::cout << "frame latency: " << frameTiming.latency() << (live ? "" : " (from the start of the processing)") << std::endl;
+	}
+	if (framePipeline)
+	{
+		framePipeline->wait();
+		const FramePipeline::Counters & pipelining = framePipeline->counters();
+		std::cout << "pipeline: " << pipelining.n_tasks << " frames prepared ahead in " << pipelining.busy_time << " ms, "
+			<< pipelining.n_blocked << " waits for " << pipelining.wait_time << " ms" << std::endl;
+	}
+	if (binaryLogger)
+	{
+		const BinaryLogger::Counters & logging = binaryLogger->counters();
+		if (logging.n_records)
+			std::cout << "binary log: " << logging.n_records << " records of " << binaryLogger->recordSize() << " values, "
+				<< logging.log_time * 1000. / logging.n_records << " us each on the slam thread ; " << logging.n_flushes
+				<< " flushes in " << logging.flush_time << " ms in background" << std::endl;
+		binaryLogger.reset(); // write the last records
+	}
+	if (dumpCamera)
+	{
+		hardware::HardwareSensorCamera::DumpCounters dumping = dumpCamera->dumpCounters();
+		std::cout << "dump: " << dumping.n_written << "/" << dumping.n_queued << " images written, " << dumping.n_dropped
+			<< " dropped, " << dumping.max_queued << " max queued ; " << dumping.block_time << " ms blocked" << std::endl;
+		if (dumping.latency.count()) std::cout << "dump latency: " << dumping.latency << std::endl;
+	}
+	if (znccMatcher)
+	{
+		const ImagePointZnccMatcher::MatchCounters & matching = znccMatcher->matchCounters();
+		std::cout << "matching: " << matching.n_matches << " matches in " << matching.total_time << " ms (max "
+			<< matching.max_time << " ms) ; " << matching.n_coarse << " coarse-to-fine in " << matching.coarse_time
+			<< " ms, " << matching.n_fallbacks << " fallbacks" << std::endl;
+		if (matching.n_tracks)
+			std::cout << "pre-tracking: " << matching.n_track_hits << "/" << matching.n_tracks << " hits ("
+				<< 100. * matching.n_track_hits / matching.n_tracks << "%) in " << matching.track_time << " ms, "
+				<< matching.trackTimeSaved() << " ms saved" << std::endl;
+	}
 
 	if (exporter) exporter->stop();
 	(*world)->slam_blocked(true);
@@ -1630,11 +1911,35 @@ void demo_slam_run() {
 	* --disp-3d=0/1
 	* --render-all=0/1 (needs --replay 1)
 	* --replay=0/1/2/3 (off/on/off no slam/on true time) (needs --data-path)
-	* --dump=0/1  (needs --data-path)
+	* --batch=0/1/n (n>1: number of images read ahead, default 16) replay as fast as possible without display
+	*   nor pause, with the saved random seed, and print frames/s and per stage timings at the end. The trajectory
+	*   is saved to data-path/trajectory_batch.txt, it can be used as a reference with --traj-ref
+	* --dump=0/1/2  (needs --data-path) 2=dump the images to a single sequence file data-path/images.seq (replay detects it)
+	* --dump-pool=n -> number of preallocated images waiting to be dumped (default 100)
+	* --dump-policy=0/1/2 -> when they are all waiting: drop the new image/drop the oldest one (default)/block the slam
+	*   (blocking makes the slam wait for the disk, and the camera drops the images it is not given the time to process)
+	* --dump-compress=0/n -> dump png images compressed by n threads instead of pgm images (ignored with --dump=2)
 	* --rand-seed=0/1/n, 0=generate new one, 1=in replay use the saved one, n=use seed n
 	* --pause=0/n 0=don't, n=pause for frames>n (needs --replay 1)
 	* --log=0/1/filename -> log result in text file
+	* --log-binary=0/1 -> log to the binary file filename.bin instead, written in background
+	*   (convert it to the text format with convert_dump --log=filename.bin)
+	* --traj-ref=filename ("t x y z" lines) -> print the position error of the trajectory with --batch,
+	*   @/ is replaced by the data path
 	* --export=0/1/2 -> Off/socket/poster
+	* --threads=0/n -> number of threads for the filter covariance operations and the matching (0 or 1 = caller thread only),
+	*   the matching is only split among the threads with --zncc=1
+	* --kf-engine=0/1 -> filter covariance operations through indirect arrays/as dense products on blocks of contiguous states
+	* --kf-solver=0/1 -> stacked correction with the inverse of the innovation covariance/its Cholesky factor
+	* --update=0/1/2 -> correct the filter with one update per observation/stacked ransac inliers (default)/
+	*   one scalar update per measurement component
+	* --pyramid=0/n -> match search regions larger than n pixels coarse-to-fine (0 = off)
+	* --zncc=0/1 -> zncc engine correl/integral images
+	* --track=0/1 -> pre-track with sad the landmarks matched in the previous frame
+	* --batch-init=0/1 -> detect in all the empty cells in one sweep and initialize the new landmarks together
+	* --sync=0/n -> process together the images of the cameras whose timestamps differ by less than n ms (0 = one image at a time)
+	* --pipeline=0/1 -> build the image caches of the next frame in a background thread while the current one is processed
+	* --app-cache=0/1 -> reuse the last predicted appearance of a landmark while its zoom and rotation change by less than 1% and 0.5 deg (multiview descriptors)
 	* --verbose=0/1/2/3/4/5 -> Off/Trace/Warning/Debug/VerboseDebug/VeryVerboseDebug
 	* --data-path=/mnt/ram/rtslam
 	* --config-setup=data/setup.cfg
@@ -1668,6 +1973,9 @@ int main(int argc, char* const* argv)
 	intOpts[iVerbose] = 5;
 	intOpts[iMap] = 1;
 	intOpts[iCamera] = 1;
+	intOpts[iDumpPool] = 100;
+	intOpts[iUpdate] = 1;
+	intOpts[iDumpPolicy] = 1;
 	floatOpts[fFreq] = 60.0;
 	floatOpts[fShutter] = 0.0;
 	strOpts[sDataPath] = ".";
@@ -1718,6 +2026,11 @@ int main(int argc, char* const* argv)
 			std::cerr << "Unknown option " << c << std::endl;
 		}
 	}
+	if (intOpts[iDumpPolicy] < hardware::HardwareSensorCamera::dpDropNewest || intOpts[iDumpPolicy] > hardware::HardwareSensorCamera::dpBlock)
+	{
+		std::cerr << "Unknown dump policy " << intOpts[iDumpPolicy] << ", dropping the oldest image" << std::endl;
+		intOpts[iDumpPolicy] = hardware::HardwareSensorCamera::dpDropOldest;
+	}
 	
 	demo_slam_init();
 	demo_slam_run();
@@ -22,12 +22,43 @@
 #include "rtslam/rtSlam.hpp"
 
 #include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
 
 namespace jafar {
 	namespace rtslam {
 		using namespace jblas;
 
 
+		/**
+		 * Get the ROIs of all the empty cells of a grid, except the cells of the border, in random order.
+		 * This is the getRois() of the point and segment grids.
+		 * \param projectionsCount the number of projections in each cell of the grid
+		 * \param cell2roi the function setting the ROI of a cell, called as cell2roi(cell, roi)
+		 * \param rois the resulting ROIs
+		 * \return true if there is at least one.
+		 */
+		template<class Cell2Roi>
+		bool getEmptyCellRois(const mati & projectionsCount, Cell2Roi cell2roi, std::vector<image::ConvexRoi> & rois) {
+			rois.clear();
+			veci2 cell;
+			for (int i = 1; i < (int)projectionsCount.size1() - 1; i++) {
+				for (int j = 1; j < (int)projectionsCount.size2() - 1; j++) {
+					if (projectionsCount(i, j) == 0) {
+						cell(0) = i;
+						cell(1) = j;
+						rois.push_back(image::ConvexRoi());
+						cell2roi(cell, rois.back());
+					}
+				}
+			}
+			// random order, as getRoi() picks a random cell
+			for (int k = (int)rois.size() - 1; k > 0; k--)
+				std::swap(rois[k], rois[rtslam::rand() % (k+1)]);
+			return !rois.empty();
+		}
+
+
 		/**
 		 * Active search tesselation grid.
 		 *
@@ -157,6 +188,13 @@ namespace jafar {
 				 */
 				bool getRoi(image::ConvexRoi & roi);
 
+				/**
+				 * Get ROIs of all the empty cells, in random order.
+				 * \param rois the resulting ROIs
+				 * \return true if there is at least one.
+				 */
+				bool getRois(std::vector<image::ConvexRoi> & rois);
+
 				/**
 				 * Call this after getRoi if no point was found in the roi
 				 * in order to avoid searching again in it.
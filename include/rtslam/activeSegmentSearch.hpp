@@ -20,8 +20,10 @@
 
 #include "rtslam/gaussian.hpp"
 #include "rtslam/rtSlam.hpp"
+#include "rtslam/activeSearch.hpp"
 
 #include <iostream>
+#include <vector>
 
 namespace jafar {
    namespace rtslam {
@@ -86,6 +88,13 @@ namespace jafar {
              */
             bool getRoi(image::ConvexRoi & roi);
 
+            /**
+             * Get ROIs of all the empty cells, in random order.
+             * \param rois the resulting ROIs
+             * \return true if there is at least one.
+             */
+            bool getRois(std::vector<image::ConvexRoi> & rois);
+
             /**
              * Call this after getRoi if no point was found in the roi
              * in order to avoid searching again in it.
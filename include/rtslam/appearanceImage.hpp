@@ -49,7 +49,7 @@ namespace jafar {
 				virtual ~AppearanceImagePoint();
 				virtual AppearanceAbstract* clone();
 
-			private:
+				/// update patchSum and patchSquareSum after the patch has been modified
 				void computePatchIntegrals();
 		};
 
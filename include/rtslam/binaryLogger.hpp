@@ -0,0 +1,146 @@
+/**
+ * \file binaryLogger.hpp
+ *
+ * Loggable objects, and a binary logger that writes them without formatting on the slam thread.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef BINARYLOGGER_HPP_
+#define BINARYLOGGER_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "kernel/dataLog.hpp"
+
+#include "rtslam/framePipeline.hpp"
+
+namespace jafar {
+	namespace rtslam {
+
+		/**
+		 * Destination of the header and of the values of a Loggable.
+		 *
+		 * \ingroup rtslam
+		 */
+		class LogSink {
+			public:
+				virtual ~LogSink() {}
+				virtual void writeComment(const std::string & comment) = 0;
+				/// names of the next columns, separated by spaces
+				virtual void writeLegendTokens(const std::string & tokens) = 0;
+				virtual void writeData(double d) = 0;
+		};
+
+		/**
+		 * Sink that writes to a text kernel::DataLogger.
+		 *
+		 * \ingroup rtslam
+		 */
+		class TextLogSink: public LogSink {
+			public:
+				TextLogSink(kernel::DataLogger & log): log(log) {}
+				virtual void writeComment(const std::string & comment) { log.writeComment(comment); }
+				virtual void writeLegendTokens(const std::string & tokens) { log.writeLegendTokens(tokens); }
+				virtual void writeData(double d) { log.writeData(d); }
+			private:
+				kernel::DataLogger & log;
+		};
+
+		/**
+		 * Object that can be logged to a text kernel::DataLogger or to a BinaryLogger.
+		 * Derived classes implement logHeader() and logData(), that must always write the same
+		 * number of values.
+		 *
+		 * \ingroup rtslam
+		 */
+		class Loggable: public kernel::DataLoggable {
+			public:
+				virtual void logHeader(LogSink & log) const {}
+				virtual void logData(LogSink & log) const = 0;
+
+				virtual void writeLogHeader(kernel::DataLogger & log) const { TextLogSink sink(log); logHeader(sink); }
+				virtual void writeLogData(kernel::DataLogger & log) const { TextLogSink sink(log); logData(sink); }
+		};
+
+
+		/**
+		 * Log of Loggable objects in a binary file.
+		 *
+		 * The schema of the log is given by the headers of the loggables when the first record
+		 * is logged: the text header, that is the comments and the legend line, and the number
+		 * of values of a record. Then each call to log() appends one record of doubles to a
+		 * preallocated buffer. Full buffers are written to the file by a background thread,
+		 * so that the caller only copies values.
+		 *
+		 * File layout: "RTSLLOG1", the size of the text header (uint32) and the text header,
+		 * the number of values of a record (uint32), then the records. The numbers are in the
+		 * byte order of the machine that wrote the log. convertBinaryLog() converts it to the
+		 * text format of kernel::DataLogger.
+		 *
+		 * \ingroup rtslam
+		 */
+		class BinaryLogger {
+			public:
+				struct Counters {
+					unsigned n_records;
+					unsigned n_flushes;
+					double log_time; ///<   ms spent in log() by the caller, waits for the background thread included
+					double flush_time; ///< ms spent writing to the file by the background thread
+				};
+
+				/**
+				 * \param filename the log file, created or truncated
+				 * \param bufferRecords number of records of each of the two buffers
+				 */
+				BinaryLogger(const std::string & filename, unsigned bufferRecords = 256);
+				/// writes the buffered records and closes the file
+				~BinaryLogger();
+
+				bool isOpen() const { return file != NULL; }
+				/// comment of the header, only before the first record
+				void writeComment(const std::string & comment);
+				/// only before the first record
+				void addLoggable(const Loggable & loggable);
+				/// one record with the values of all the loggables
+				void log();
+
+				unsigned recordSize() const { return record_size; }
+				/// waits for the flush in progress
+				const Counters & counters() { flusher.wait(); return counters_; }
+
+			private:
+				class HeaderSink;
+				class RecordSink;
+
+				FILE *file;
+				std::vector<const Loggable*> loggables;
+				std::string header;
+				bool header_written; ///< the header is written at the first record, and the schema is fixed
+				unsigned record_size; ///< values per record, it can be 0 if the loggables have no columns
+				unsigned buffer_records;
+				std::vector<double> buffers[2];
+				unsigned current; ///< index of the buffer being filled
+				unsigned n_current; ///< records in the current buffer
+				bool size_warned;
+				Counters counters_;
+				FramePipeline flusher;
+
+				void writeHeader();
+				void flush(unsigned buffer, unsigned n_records);
+				/// hand the current buffer to the background thread
+				void swapBuffers();
+		};
+
+		/**
+		 * Convert a binary log to the text format of kernel::DataLogger.
+		 * \return the number of converted records, or -1 if the files cannot be opened or the binary log is invalid
+		 */
+		int convertBinaryLog(const std::string & binary_filename, const std::string & text_filename);
+
+	}
+}
+
+#endif /* BINARYLOGGER_HPP_ */
@@ -50,6 +50,25 @@ namespace jafar {
 
 			virtual void processKnown(raw_ptr_t data) = 0;
 			virtual void detectNew(raw_ptr_t data) = 0;
+			/**
+			 * Preparation of a new raw before processKnown(), that does not use the map.
+			 * It can run concurrently with the preparation of the other sensors.
+			 */
+			virtual void prepare(raw_ptr_t data) {}
+			/**
+			 * If prepare() only builds caches of the raw, it can also run in a background thread on the next
+			 * raw, while the data manager processes the current one (see FramePipeline).
+			 */
+			virtual bool canPrepareAhead() const { return false; }
+			/**
+			 * detectNew() can be split in three steps, to interleave the detections of several sensors.
+			 * beginDetection() and detectNew() are called by one thread at a time, but detectCandidates()
+			 * between them does not modify the map nor use rtslam::rand(), so that it can run concurrently
+			 * with the detections of the other sensors. detectNew() then reuses its result.
+			 * Data managers that do not split their detection do everything in detectNew().
+			 */
+			virtual void beginDetection(raw_ptr_t data) {}
+			virtual void detectCandidates(raw_ptr_t data) {}
       //virtual void process( boost::shared_ptr<RawAbstract> data ) = 0;
 
     };
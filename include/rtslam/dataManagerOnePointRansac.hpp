@@ -15,6 +15,7 @@
 
 #include "rtslam/dataManagerAbstract.hpp"
 #include "rtslam/quatTools.hpp"
+#include "rtslam/threadPool.hpp"
 
 namespace jafar {
 	namespace rtslam {
@@ -47,26 +48,43 @@ namespace jafar {
 				// Define the functions sensorSpec() and sensorSpecPtr().
 				ENABLE_ACCESS_TO_SPECIFIC_PARENT(SensorSpec, sensorSpec);
 
+			public:
+				/**
+				 * How the filter is corrected with the matched observations.
+				 */
+				typedef enum {
+					UPDATE_ITERATIVE, ///<  one correct() per observation
+					UPDATE_STACKED, ///<    ransac inliers in one correctAllStacked(), then one correct() per active search observation
+					UPDATE_SEQUENTIAL ///< one scalar update per measurement component, each observation gated against the updated state
+				} update_mode_t;
+
 			public: // public interface
-				DataManagerOnePointRansac(const boost::shared_ptr<DetectorSpec> & _detector, const boost::shared_ptr<MatcherSpec> & _matcher, const boost::shared_ptr<FeatureManagerSpec> _featMan, int n_updates_total, int n_updates_ransac, int n_tries, int n_init, int n_recomp_gains):
-					detector(_detector), matcher(_matcher), featMan(_featMan)
+				DataManagerOnePointRansac(const boost::shared_ptr<DetectorSpec> & _detector, const boost::shared_ptr<MatcherSpec> & _matcher, const boost::shared_ptr<FeatureManagerSpec> _featMan, int n_updates_total, int n_updates_ransac, int n_tries, int n_init, int n_recomp_gains, update_mode_t update_mode = UPDATE_STACKED):
+					detector(_detector), matcher(_matcher), featMan(_featMan), process_counters()
 				{
 					algorithmParams.n_updates_total = n_updates_total;
 					algorithmParams.n_updates_ransac = n_updates_ransac;
 					algorithmParams.n_tries = n_tries;
 					algorithmParams.n_init = n_init;
 					algorithmParams.n_recomp_gains = n_recomp_gains;
+					algorithmParams.update_mode = update_mode;
+					algorithmParams.batch_init = false;
 				}
 				virtual ~DataManagerOnePointRansac() {
 				}
 				void processKnown(raw_ptr_t data);
 				void detectNew(raw_ptr_t data);
+				void prepare(raw_ptr_t data) { matcher->prepare(SPTR_CAST<RawSpec>(data)); }
+				bool canPrepareAhead() const { return matcher->canPrepareAhead(); }
+				void beginDetection(raw_ptr_t data);
+				void detectCandidates(raw_ptr_t data);
 //				void process(boost::shared_ptr<RawAbstract> data);
 
 			protected: // main data members
 				boost::shared_ptr<DetectorSpec> detector;
 				boost::shared_ptr<MatcherSpec> matcher;
 				boost::shared_ptr<FeatureManagerSpec> featMan;
+				thread_pool_ptr_t pool;
 				// the list of observations sorted by information gain
 				typedef map<double, ObsList::iterator> ObservationListSorted;
 				ObservationListSorted obsListSorted;
@@ -76,6 +94,10 @@ namespace jafar {
 				ObsList obsBaseList;
 				ObsList obsFailedList;
 				RansacSetList ransacSetList;
+				// the features detected in the empty cells of candidatesRaw, by detectCandidates()
+				raw_ptr_t candidatesRaw;
+				std::vector<RoiSpec> candidateRois;
+				std::vector<boost::shared_ptr<FeatureSpec> > candidateFeats;
 
 			protected: // parameters
 				struct alg_params_t {
@@ -84,9 +106,32 @@ namespace jafar {
 						unsigned n_tries;   ///< number of RANSAC consensus tries
 						unsigned n_init;    ///< number of feature initialization
 						unsigned n_recomp_gains; ///< number of update after which infoGains are completely recomputed
+						update_mode_t update_mode; ///< how the filter is corrected
+						bool batch_init; ///< detect in all empty cells in one sweep, and initialize the new landmarks together
 				} algorithmParams;
 
 			public: // getters ans setters
+				void setUpdateMode(update_mode_t update_mode) { algorithmParams.update_mode = update_mode; }
+				update_mode_t updateMode() const { return algorithmParams.update_mode; }
+				void setBatchInit(bool batch_init) { algorithmParams.batch_init = batch_init; }
+				/**
+				 * Match the observations with a pool of threads.
+				 * The low innovation matches of each ransac try, and the projections that sort the
+				 * active search, are independent across observations and are split among the threads.
+				 * The filter updates stay in the caller thread, in the same order as without pool,
+				 * so that the results do not depend on the number of threads.
+				 * The pool is not used if the matcher is not thread safe.
+				 */
+				void setThreadPool(const thread_pool_ptr_t & _pool) { pool = _pool; }
+
+				/// Latency of processKnown() since the creation of the data manager.
+				struct ProcessCounters {
+					unsigned long n_frames; ///< number of processed frames
+					double total_time; ///< total time of processKnown() (ms)
+					double max_time; ///< longest processKnown() (ms)
+					double parallel_time; ///< total time of the phases that can be split among the threads (ms)
+				};
+				const ProcessCounters & processCounters() const { return process_counters; }
 /*				boost::shared_ptr<FeatureManagerSpec> featureManager(void) {
 					return featMan;
 				}*/
@@ -98,6 +143,9 @@ namespace jafar {
 // 					return algorithmParams_;
 // 				}
 
+			protected:
+				ProcessCounters process_counters;
+
 			protected: // helper functions
 				void projectAndCollectVisibleObs();
 				void updateVisibleObs();
@@ -106,10 +154,23 @@ namespace jafar {
 				vec updateMean(const observation_ptr_t & obsPtr);
 				void projectFromMean(vec & exp, const observation_ptr_t & obsPtr, const vec & x);
 				bool isLowInnovationInlier(const observation_ptr_t & obsPtr, const vec & exp, double lowInnTh);
-				bool isExpectedInnovationInlier( observation_ptr_t & obsPtr, double highInnTh);
+				bool isExpectedInnovationInlier(const observation_ptr_t & obsPtr, double highInnTh);
 // 				bool match(const boost::shared_ptr<RawImage> & rawPtr, const appearance_ptr_t & targetApp, image::ConvexRoi &roi, Measurement & measure, const appearance_ptr_t & app);
 				bool matchWithLowInnovation(const observation_ptr_t obsPtr, double lowInnTh);
 				bool matchWithExpectedInnovation(boost::shared_ptr<RawSpec> rawData,  observation_ptr_t obsPtr);
+				/// match obsPtr in roi, with the pre-tracking stage of the matcher if it was matched in the previous frame
+				void matchObs(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsPtr, const RoiSpec & roi);
+				void updateObs(const observation_ptr_t & obsPtr);
+				/// run task(0) ... task(n-1), with the thread pool if there is one and the matcher allows it
+				void forEachObs(std::size_t n, const ThreadPool::task_t & task);
+				/// match obsPtr with low innovation around its projection from x, \return true if it is a low innovation inlier
+				bool matchLowInnovationInlier(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsPtr, const vec & x);
+				/// task of the ransac tries, on obsVisibleList[k]
+				void lowInnovationTask(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsBasePtr, const vec & x, std::vector<char> & inliers, std::size_t k);
+				/// task of the active search, projects list[k] and \return in valid[k] whether it can be searched
+				void activeSearchTask(const ObsList & list, std::vector<char> & valid, std::size_t k);
+				/// create and initialize the landmarks of the strongest candidates
+				void initCandidates();
 
 		};
 
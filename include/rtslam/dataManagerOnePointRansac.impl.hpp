@@ -5,7 +5,11 @@
  * \author jsola
  * \ingroup rtslam
  */
+#include <algorithm>
+#include <boost/bind.hpp>
+
 #include "kernel/misc.hpp"
+#include "kernel/timingTools.hpp"
 
 #include "jmath/randomIntTmplt.hpp"
 #include "jmath/misc.hpp"
@@ -20,11 +24,10 @@
 #include "rtslam/imageTools.hpp"
 
 /*
- * STATUS: working fine, use it
  * Buffered update is faster than iterative update, but it doesn't allow
- * active search, so we use a mixed approach
+ * active search, so we use a mixed approach.
+ * The update strategy is selected at runtime with algorithmParams.update_mode.
  */
-#define BUFFERED_UPDATE 1
 
 /*
  * STATUS: working fine, use it
@@ -43,6 +46,8 @@ namespace jafar {
 		processKnown(raw_ptr_t data)
 		{
 			boost::shared_ptr<RawSpec> rawData = SPTR_CAST<RawSpec>(data);
+			kernel::Chrono total_chrono, parallel_chrono;
+			double parallel_time = 0.;
 			//###
 			//### Init, collect visible observations
 			//### 
@@ -76,81 +81,24 @@ namespace jafar {
 				current_try ++;
 				vec x_copy = updateMean(obsBasePtr);
 
-				// for each other obs
-				for(ObsList::iterator obsIter = obsVisibleList.begin(); obsIter != obsVisibleList.end(); obsIter++)
-				{
-					observation_ptr_t obsCurrentPtr = *obsIter;
-					if (obsCurrentPtr == obsBasePtr) continue; // ignore the tested observation
-
-					// get obs things
-					jblas::vec lmk = obsCurrentPtr->landmarkPtr()->state.x();
-					vec exp(obsCurrentPtr->expectation.size());
-					vec nobs(obsCurrentPtr->prior.size());
-
-					// project
-					projectFromMean(exp, obsCurrentPtr, x_copy);
+				// match each other obs, the matches only depend on x_copy and can be run in parallel
+				std::vector<char> inliers(obsVisibleList.size(), 0);
+				parallel_chrono.reset();
+				forEachObs(obsVisibleList.size(), boost::bind(&DataManagerOnePointRansac::lowInnovationTask, this,
+					rawData, boost::cref(obsBasePtr), boost::cref(x_copy), boost::ref(inliers), _1));
+				parallel_time += parallel_chrono.elapsed();
 
-					bool inlier = obsCurrentPtr->events.matched && 
-					              isLowInnovationInlier(obsCurrentPtr, exp, matcher->params.lowInnov);
-					
-					if (!inlier)
-						if (obsCurrentPtr->predictAppearance())
-						{
-							// try to match with low innovation
-							jblas::sym_mat P = jblas::identity_mat(obsCurrentPtr->expectation.size())*jmath::sqr(matcher->params.lowInnov);
-                     RoiSpec roi;
-                     if(obsCurrentPtr->expectation.P().size1() == 2) // basically DsegMatcher handles it's own roi and (due to the size4 expectation) the following roi computation fails. - TODO clean up all this, is should not mess with One point ransac
-                     {
-                        roi = RoiSpec(exp, P, 1.0);
-                        obsCurrentPtr->searchSize = roi.count();
-                     }
-							else // Segment
-							{
-								// Rough approximation, this won't be used by Dseg Matcher, only by the simulator
-								vec2 p1, p2;
-								vec2 var1, var2;
-								p1[0] = obsCurrentPtr->expectation.x()[0]; p1[1] = obsCurrentPtr->expectation.x()[1];
-								p2[0] = obsCurrentPtr->expectation.x()[2]; p2[1] = obsCurrentPtr->expectation.x()[3];
-								var1[0] = (obsCurrentPtr->expectation.P()(0,0) + matcher->params.measVar) * matcher->params.mahalanobisTh;
-								var1[1] = (obsCurrentPtr->expectation.P()(1,1) + matcher->params.measVar) * matcher->params.mahalanobisTh;
-								var2[0] = (obsCurrentPtr->expectation.P()(2,2) + matcher->params.measVar) * matcher->params.mahalanobisTh;
-								var2[1] = (obsCurrentPtr->expectation.P()(3,3) + matcher->params.measVar) * matcher->params.mahalanobisTh;
-
-								int basex = min(p1[0]-var1[0],p2[0]-var2[0]);
-								int basey = min(p1[1]-var1[1],p2[1]-var2[1]);
-								cv::Rect rect(
-									basex, basey,
-									max(p1[0]+var1[0],p2[0]+var2[0]) - basex,
-									max(p1[1]+var1[1],p2[1]+var2[1]) - basey
-								);
-								roi = RoiSpec(rect);
-							}
-							obsCurrentPtr->events.measured = true;
-							
-							matcher->match(rawData, obsCurrentPtr->predictedAppearance, roi, obsCurrentPtr->measurement, obsCurrentPtr->observedAppearance);
-							if (obsCurrentPtr->getMatchScore() > matcher->params.threshold)
-							{
-								#if PROJECT_MEAN_VISIBILITY
-								obsCurrentPtr->project();
-								#endif
-								if (isExpectedInnovationInlier(obsCurrentPtr, matcher->params.mahalanobisTh))
-								{
-									obsCurrentPtr->events.matched = true;
-								}
-							}
-							
-							inlier = obsCurrentPtr->events.matched && 
-							         isLowInnovationInlier(obsCurrentPtr, exp, matcher->params.lowInnov);
-						}
-					
-					if (inlier)
+				for (size_t k = 0; k < obsVisibleList.size(); ++k)
+				{
+					if (obsVisibleList[k] == obsBasePtr) continue; // ignore the tested observation
+					if (inliers[k])
 					{
 						// declare inlier
-						ransacSetPtr->inlierObs.push_back(obsCurrentPtr);
+						ransacSetPtr->inlierObs.push_back(obsVisibleList[k]);
 					}
 					else{
 						// declare pending
-						ransacSetPtr->pendingObs.push_back(obsCurrentPtr);
+						ransacSetPtr->pendingObs.push_back(obsVisibleList[k]);
 					}
 				} // for each other obs
 			} // for i = 0:n_tries
@@ -189,39 +137,63 @@ namespace jafar {
 					{
 						observation_ptr_t obsPtr = *obsIter;
 						
-						// 2a. add obs to buffer for EKF update
-						#if BUFFERED_UPDATE
-						mapPtr->filterPtr->stackCorrection(obsPtr->innovation, obsPtr->INN_rsl, obsPtr->ia_rsl);
-						#if RELEVANCE_TEST
-						innovation_relevance += obsPtr->computeRelevance();
-						#endif
-						#else
-						obsPtr->project();
-						obsPtr->computeInnovation();
-						#if RELEVANCE_TEST
-						if (obsPtr->computeRelevance() > jmath::sqr(matcher->params.relevanceTh))
-						#endif
+						switch (algorithmParams.update_mode)
 						{
-							obsPtr->update();
-							obsPtr->events.updated = true;
+							case UPDATE_STACKED:
+							{
+								// 2a. add obs to buffer for EKF update
+								mapPtr->filterPtr->stackCorrection(obsPtr->innovation, obsPtr->INN_rsl, obsPtr->ia_rsl);
+								#if RELEVANCE_TEST
+								innovation_relevance += obsPtr->computeRelevance();
+								#endif
+								break;
+							}
+							case UPDATE_ITERATIVE:
+							{
+								obsPtr->project();
+								obsPtr->computeInnovation();
+								#if RELEVANCE_TEST
+								if (obsPtr->computeRelevance() > jmath::sqr(matcher->params.relevanceTh))
+								#endif
+								{
+									obsPtr->update();
+									obsPtr->events.updated = true;
+								}
+								break;
+							}
+							case UPDATE_SEQUENTIAL:
+							{
+								// gate again against the state updated by the previous inliers, so that late outliers are rejected
+								obsPtr->project();
+								obsPtr->computeInnovation();
+								if (obsPtr->compatibilityTest(matcher->params.mahalanobisTh)
+								#if RELEVANCE_TEST
+								    && obsPtr->computeRelevance() > jmath::sqr(matcher->params.relevanceTh)
+								#endif
+								   )
+								{
+									obsPtr->updateSequential();
+									obsPtr->events.updated = true;
+								}
+								break;
+							}
 						}
-						#endif
 					}
 					bool do_update = false;
-					#if BUFFERED_UPDATE
 					// 3. perform buffered update
-					#if RELEVANCE_TEST
-					if (innovation_relevance > jmath::sqr(matcher->params.relevanceTh))
-					#endif
+					if (algorithmParams.update_mode == UPDATE_STACKED)
 					{
-						mapPtr->filterPtr->correctAllStacked(mapPtr->ia_used_states());
-						do_update = true;
+						#if RELEVANCE_TEST
+						if (innovation_relevance > jmath::sqr(matcher->params.relevanceTh))
+						#endif
+						{
+							mapPtr->filterPtr->correctAllStacked(mapPtr->ia_used_states());
+							do_update = true;
+						}
+						#if RELEVANCE_TEST
+						else pending_buffered_update = true;
+						#endif
 					}
-					#if RELEVANCE_TEST
-					else pending_buffered_update = true;
-					#endif
-					
-					#endif
 					
 					for(ObsList::iterator obsIter = best_set->inlierObs.begin(); obsIter != best_set->inlierObs.end(); ++obsIter)
 						if (do_update || (*obsIter)->events.updated)
@@ -251,45 +223,18 @@ namespace jafar {
 			for (unsigned i = 0; i < algorithmParams.n_recomp_gains; ++i)
 			{
 				// 4. for each obs in pending: retake algorithm from active search
-				for(ObsList::iterator obsIter = activeSearchList.begin(); obsIter != activeSearchList.end(); ++obsIter)
-				{
-					observation_ptr_t obsPtr = *obsIter;
-					// FIXME maybe don't clear events and don't rematch if already did, especially if didn't reestimate
-					obsPtr->clearFlags();
-					obsPtr->measurement.matchScore = 0;
-
-					// 1a. project
-					obsPtr->project();
-
-					// 1b. check visibility
-					obsPtr->predictVisibility();
+				std::vector<char> valid(activeSearchList.size(), 0);
+				parallel_chrono.reset();
+				forEachObs(activeSearchList.size(), boost::bind(&DataManagerOnePointRansac::activeSearchTask, this,
+					boost::cref(activeSearchList), boost::ref(valid), _1));
+				parallel_time += parallel_chrono.elapsed();
 
-					if (obsPtr->isVisible()) {
-
-						// Add to tesselation grid for active search
-						//featMan->addObs(obsPtr->expectation.x());
-						
-						/*
-						quicly check if expectation has some negative variance values,
-						to ignore the observation and prevent from crashing
-						(it means that the filter is corrupted and that we should stop
-						everything anyway)
-						*/
-						bool valid = true;
-						for (unsigned i = 0; i < obsPtr->expectation.P().size1(); ++i)
-							if (obsPtr->expectation.P()(i,i) < 0.0) { valid = false; break; }
-
-						if (valid)
-						{
-							// predict information gain
-							obsPtr->predictInfoGain();
-
-							// add to sorted list of observations
-							obsListSorted[obsPtr->expectation.infoGain] = obsIter;
-						}
-					} // visible obs
-				} // for each obs
+				// add to sorted list of observations
+				for(ObsList::iterator obsIter = activeSearchList.begin(); obsIter != activeSearchList.end(); ++obsIter)
+					if (valid[obsIter - activeSearchList.begin()])
+						obsListSorted[(*obsIter)->expectation.infoGain] = obsIter;
 
+				// the updates change the state used by the next matches, so this loop stays sequential
 				// loop only the N_UPDATES most interesting obs, from largest info gain to smallest
 				for (ObservationListSorted::reverse_iterator obsIter = obsListSorted.rbegin();
 					obsIter != obsListSorted.rend(); ++obsIter)
@@ -340,7 +285,7 @@ namespace jafar {
 								}
 								// 1d. match predicted feature in search area
 								//						kernel::Chrono match_chrono;
-								matcher->match(rawData, obsPtr->predictedAppearance, roi, obsPtr->measurement, obsPtr->observedAppearance);
+								matchObs(rawData, obsPtr, roi);
 								//						total_match_time += match_chrono.elapsedMicrosecond();
 
 								// 1e. if feature is found
@@ -366,7 +311,7 @@ namespace jafar {
 										numObs++;
 										JFR_DEBUG_SEND(" " << obsPtr->id());
 										//								kernel::Chrono update_chrono;
-										obsPtr->update();
+										updateObs(obsPtr);
 										//								total_update_time += update_chrono.elapsedMicrosecond();
 									} // obsPtr->compatibilityTest(M_TH)
 								} // obsPtr->getScoreMatchInPercent()>SC_TH
@@ -409,12 +354,170 @@ namespace jafar {
 				if (obs->events.measured) obs->counters.nSearchSinceLastInlier++;
 				if (obs->events.visible) obs->counters.nFrameSinceLastVisible = 0;
 				if (obs->events.updated) obs->counters.nSearchSinceLastInlier = 0;
+				if (obs->events.matched)
+				{
+					obs->counters.nFrameSinceLastMatch = 0;
+					// the observed appearance is overwritten by each match of the next frame
+					obs->matchedAppearance.reset(obs->observedAppearance->clone());
+				} else
+					obs->counters.nFrameSinceLastMatch++;
 			}
 
 			// clear all sets to liberate shared pointers
 			ransacSetList.clear();
 			obsBaseList.clear();
 			obsFailedList.clear();
+
+			double time = total_chrono.elapsed();
+			process_counters.n_frames++;
+			process_counters.total_time += time;
+			process_counters.parallel_time += parallel_time;
+			if (time > process_counters.max_time) process_counters.max_time = time;
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		forEachObs(std::size_t n, const ThreadPool::task_t & task)
+		{
+			if (pool && matcher->isThreadSafe())
+				pool->parallelFor(n, task);
+			else
+				for (std::size_t k = 0; k < n; ++k) task(k);
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		lowInnovationTask(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsBasePtr, const vec & x, std::vector<char> & inliers, std::size_t k)
+		{
+			if (obsVisibleList[k] != obsBasePtr)
+				inliers[k] = matchLowInnovationInlier(rawData, obsVisibleList[k], x);
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		bool DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		matchLowInnovationInlier(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsCurrentPtr, const vec & x_copy)
+		{
+			// get obs things
+			vec exp(obsCurrentPtr->expectation.size());
+
+			// project
+			projectFromMean(exp, obsCurrentPtr, x_copy);
+
+			bool inlier = obsCurrentPtr->events.matched && 
+			              isLowInnovationInlier(obsCurrentPtr, exp, matcher->params.lowInnov);
+			
+			if (!inlier)
+				if (obsCurrentPtr->predictAppearance())
+				{
+					// try to match with low innovation
+					jblas::sym_mat P = jblas::identity_mat(obsCurrentPtr->expectation.size())*jmath::sqr(matcher->params.lowInnov);
+					RoiSpec roi;
+					if(obsCurrentPtr->expectation.P().size1() == 2) // basically DsegMatcher handles it's own roi and (due to the size4 expectation) the following roi computation fails. - TODO clean up all this, is should not mess with One point ransac
+					{
+						roi = RoiSpec(exp, P, 1.0);
+						obsCurrentPtr->searchSize = roi.count();
+					}
+					else // Segment
+					{
+						// Rough approximation, this won't be used by Dseg Matcher, only by the simulator
+						vec2 p1, p2;
+						vec2 var1, var2;
+						p1[0] = obsCurrentPtr->expectation.x()[0]; p1[1] = obsCurrentPtr->expectation.x()[1];
+						p2[0] = obsCurrentPtr->expectation.x()[2]; p2[1] = obsCurrentPtr->expectation.x()[3];
+						var1[0] = (obsCurrentPtr->expectation.P()(0,0) + matcher->params.measVar) * matcher->params.mahalanobisTh;
+						var1[1] = (obsCurrentPtr->expectation.P()(1,1) + matcher->params.measVar) * matcher->params.mahalanobisTh;
+						var2[0] = (obsCurrentPtr->expectation.P()(2,2) + matcher->params.measVar) * matcher->params.mahalanobisTh;
+						var2[1] = (obsCurrentPtr->expectation.P()(3,3) + matcher->params.measVar) * matcher->params.mahalanobisTh;
+
+						int basex = min(p1[0]-var1[0],p2[0]-var2[0]);
+						int basey = min(p1[1]-var1[1],p2[1]-var2[1]);
+						cv::Rect rect(
+							basex, basey,
+							max(p1[0]+var1[0],p2[0]+var2[0]) - basex,
+							max(p1[1]+var1[1],p2[1]+var2[1]) - basey
+						);
+						roi = RoiSpec(rect);
+					}
+					obsCurrentPtr->events.measured = true;
+					
+					matchObs(rawData, obsCurrentPtr, roi);
+					if (obsCurrentPtr->getMatchScore() > matcher->params.threshold)
+					{
+						#if PROJECT_MEAN_VISIBILITY
+						obsCurrentPtr->project();
+						#endif
+						if (isExpectedInnovationInlier(obsCurrentPtr, matcher->params.mahalanobisTh))
+						{
+							obsCurrentPtr->events.matched = true;
+						}
+					}
+					
+					inlier = obsCurrentPtr->events.matched && 
+					         isLowInnovationInlier(obsCurrentPtr, exp, matcher->params.lowInnov);
+				}
+			return inlier;
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		activeSearchTask(const ObsList & list, std::vector<char> & valid, std::size_t k)
+		{
+			observation_ptr_t obsPtr = list[k];
+			// FIXME maybe don't clear events and don't rematch if already did, especially if didn't reestimate
+			obsPtr->clearFlags();
+			obsPtr->measurement.matchScore = 0;
+
+			// 1a. project
+			obsPtr->project();
+
+			// 1b. check visibility
+			obsPtr->predictVisibility();
+
+			if (obsPtr->isVisible()) {
+
+				// Add to tesselation grid for active search
+				//featMan->addObs(obsPtr->expectation.x());
+				
+				/*
+				quicly check if expectation has some negative variance values,
+				to ignore the observation and prevent from crashing
+				(it means that the filter is corrupted and that we should stop
+				everything anyway)
+				*/
+				valid[k] = true;
+				for (unsigned i = 0; i < obsPtr->expectation.P().size1(); ++i)
+					if (obsPtr->expectation.P()(i,i) < 0.0) { valid[k] = false; break; }
+
+				// predict information gain
+				if (valid[k]) obsPtr->predictInfoGain();
+			} // visible obs
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		matchObs(boost::shared_ptr<RawSpec> rawData, const observation_ptr_t & obsPtr, const RoiSpec & roi)
+		{
+			// landmarks matched in the previous frame are first pre-tracked from the appearance observed then
+			bool tracked = (obsPtr->matchedAppearance && obsPtr->counters.nFrameSinceLastMatch == 0 &&
+				matcher->track(rawData, obsPtr->matchedAppearance, obsPtr->predictedAppearance, roi, obsPtr->measurement, obsPtr->observedAppearance));
+			if (!tracked)
+				matcher->match(rawData, obsPtr->predictedAppearance, roi, obsPtr->measurement, obsPtr->observedAppearance);
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		updateObs(const observation_ptr_t & obsPtr)
+		{
+			if (algorithmParams.update_mode == UPDATE_SEQUENTIAL)
+				obsPtr->updateSequential();
+			else
+				obsPtr->update();
 		}
 
 
@@ -423,6 +526,15 @@ namespace jafar {
 		detectNew(raw_ptr_t data)
 		{
 			boost::shared_ptr<RawSpec> rawData = SPTR_CAST<RawSpec>(data);			
+			if (algorithmParams.batch_init)
+			{
+				// the first steps were already done if the sensor is processed in a group
+				if (candidatesRaw != data) beginDetection(data);
+				if (candidateFeats.size() != candidateRois.size()) detectCandidates(data);
+				initCandidates();
+				return;
+			}
+
 			updateVisibleObs();
 			obsVisibleList.clear();
 			
@@ -495,6 +607,94 @@ namespace jafar {
 			} else break; // if space in map
 		} // detect()
 
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		beginDetection(raw_ptr_t data)
+		{
+			if (!algorithmParams.batch_init) return;
+			updateVisibleObs();
+			obsVisibleList.clear();
+
+			candidatesRaw = data;
+			candidateFeats.clear();
+			if (!mapManagerPtr()->mapSpaceForInit() || !featMan->getRois(candidateRois)) candidateRois.clear();
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		detectCandidates(raw_ptr_t data)
+		{
+			if (!algorithmParams.batch_init || candidatesRaw != data) return;
+			// 1. detect the best feature of all the empty cells at once
+			if (candidateRois.empty()) candidateFeats.clear();
+			else detector->detect(SPTR_CAST<RawSpec>(data), candidateRois, candidateFeats);
+		}
+
+
+		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
+		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
+		initCandidates()
+		{
+			const std::vector<RoiSpec> & rois = candidateRois;
+			const std::vector<boost::shared_ptr<FeatureSpec> > & feats = candidateFeats;
+
+			// strongest features first
+			std::vector<std::pair<double, size_t> > order;
+			for (size_t k = 0; k < rois.size(); ++k)
+				if (feats[k]) order.push_back(std::make_pair(feats[k]->measurement.matchScore, k));
+				else featMan->setFailed(rois[k]);
+			std::sort(order.rbegin(), order.rend());
+
+			// 2. create the landmarks, with their mean only
+			ObsList group;
+			for (size_t o = 0; o < order.size() && group.size() < algorithmParams.n_init; ++o)
+			{
+				if (!mapManagerPtr()->mapSpaceForInit()) break;
+				boost::shared_ptr<FeatureSpec> featPtr = feats[order[o].second];
+
+				// 2a. Create the lmk and associated obs object.
+				observation_ptr_t obsPtr = mapManagerPtr()->createNewLandmark(shared_from_this());
+
+				// 2b. fill data for this obs
+				obsPtr->counters.nSearch = 1;
+				obsPtr->counters.nMatch = 1;
+				obsPtr->counters.nInlier = 1;
+				obsPtr->events.visible = true;
+				obsPtr->events.predicted = false;
+				obsPtr->events.measured = true;
+				obsPtr->events.matched = false;
+				obsPtr->events.updated = true;
+				obsPtr->measurement = featPtr->measurement;
+
+				// 2c. compute the landmark mean and the Jacobians of the back-projection
+				obsPtr->backProjectMean();
+
+				// 2d. Create lmk descriptor
+				detector->fillDataObs(featPtr, obsPtr);
+				if (obsPtr->updateDescriptor())
+				{
+					#if VISIBILITY_MAP
+					obsPtr->updateVisibilityMap();
+					#endif
+					featMan->addObs(obsPtr->measurement.x());
+					group.push_back(obsPtr);
+				} else
+				{
+					obsPtr->landmarkPtr()->mapManagerPtr()->unregisterLandmark(obsPtr->landmarkPtr());
+					featMan->setFailed(rois[order[o].second]);
+				}
+			}
+
+			// 3. initialize the covariances of all the new landmarks with one filter operation
+			ObservationAbstract::initializeGroup(group);
+
+			candidatesRaw.reset();
+			candidateRois.clear();
+			candidateFeats.clear();
+		}
+
 #if 0
 		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
 		void DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
@@ -619,7 +819,7 @@ namespace jafar {
 		{
 			// get map things
 			vec x_copy = mapManagerPtr()->mapPtr()->x();
-			ind_array ia_x = mapManagerPtr()->mapPtr()->ia_used_states();
+			const ind_array & ia_x = mapManagerPtr()->mapPtr()->ia_used_states();
 			sym_mat &P = mapManagerPtr()->mapPtr()->P();
 
 			// compute Kalman gain
@@ -666,7 +866,7 @@ namespace jafar {
 
 		template<class RawSpec,class SensorSpec, class FeatureSpec, class RoiSpec, class FeatureManagerSpec, class DetectorSpec, class MatcherSpec>
 		bool DataManagerOnePointRansac<RawSpec,SensorSpec,FeatureSpec,RoiSpec,FeatureManagerSpec,DetectorSpec,MatcherSpec>::
-		isExpectedInnovationInlier( observation_ptr_t & obsPtr, double highInnTh)
+		isExpectedInnovationInlier(const observation_ptr_t & obsPtr, double highInnTh)
 		{
 			obsPtr->computeInnovation();
 			return (obsPtr->compatibilityTest(highInnTh));
@@ -713,7 +913,7 @@ namespace jafar {
 					);
 					roi = RoiSpec(rect);
 				}
-				matcher->match(rawData, obsPtr->predictedAppearance, roi, obsPtr->measurement, obsPtr->observedAppearance);
+				matchObs(rawData, obsPtr, roi);
 // JFR_DEBUG("obs " << obsPtr->id() << " expected at " << obsPtr->expectation.x() << " measured with innovation " << obsPtr->measurement.x()-obsPtr->expectation.x());
 
 				return (obsPtr->getMatchScore() > matcher->params.threshold && isExpectedInnovationInlier(obsPtr, matcher->params.mahalanobisTh));
@@ -10,6 +10,7 @@
 #define DESCRIPTORIMAGEPOINTSIMU_H_
 
 #include "boost/shared_ptr.hpp"
+#include "boost/atomic.hpp"
 
 //#include "rtslam/rtSlam.hpp"
 #include "rtslam/observationAbstract.hpp"
@@ -99,6 +100,17 @@ namespace jafar {
 		 * This descriptor for image points stores appearances of the feature from
 		 * different points of view.
 		 * it can use an homography to predict the appearance
+		 *
+		 * The homographic prediction assumes that the patch lies on the plane through the landmark
+		 * that bisects the directions of view of the source view and of the current one. The corners of
+		 * the predicted patch are back-projected on this plane and projected in the source view, and the
+		 * source patch is warped with the homography between the two sets of corners. If the plane is seen
+		 * edge-on or from behind, the affine prediction is used instead.
+		 *
+		 * The last predicted appearance can be cached, with the source view and the zoom and
+		 * rotation it was warped with. While the closest view stays the same and the zoom and
+		 * rotation stay within the tolerances of the cached ones, the cached patch is copied
+		 * instead of warping the source patch again (see setPredictionCache()).
 		 */
 		class DescriptorImagePointMultiView: public DescriptorAbstract
 		{
@@ -106,6 +118,16 @@ namespace jafar {
 				typedef std::vector<FeatureView> FeatureViewList; ///< a FeatureView list
 				enum PredictionType { ptNone = 0, ptAffine, ptHomographic };
 				
+				/// counters of the predictions and of their matches, summed over all the descriptors
+				struct PredictionCounters {
+					unsigned long n_predictions; ///< affine or homographic predictions, with or without the cache
+					unsigned long n_hits; ///<        predictions copied from the cache
+					unsigned long n_fallbacks; ///<   homographic predictions that used the affine one
+					unsigned long warp_time; ///<     us spent in the predictions
+					unsigned long n_matched; ///<     observations matched and used for the update
+					unsigned long n_failed; ///<      observations measured but not matched
+				};
+				
 			protected:
 				FeatureViewList views; ///< the different views of the feature
 				FeatureView lastValidView; ///< the last valid view
@@ -115,12 +137,27 @@ namespace jafar {
 				double scaleStep; ///< the difference of scale that provokes storing of a new view, and the max difference of scale to use a view
 				double angleStep; ///< the difference of angle that provokes storing of a new view, in degrees
 				PredictionType predictionType;
+				double cacheZoomTol; ///< the max relative change of zoom to reuse the cached prediction, 0 to disable the cache
+				double cacheRotationTol; ///< the max change of rotation to reuse the cached prediction, in radians
 			private:
 				double cosAngleStep;
+				appearance_ptr_t cacheSrc; ///< the view appearance the cached prediction was warped from
+				app_img_pnt_ptr_t cacheApp; ///< the cached prediction
+				double cacheZoom, cacheRotation;
+				static boost::atomic<unsigned long> n_predictions, n_hits, n_fallbacks, warp_time, n_matched, n_failed;
 			public:
 				DescriptorImagePointMultiView(int descSize, double scaleStep, double angleStep, PredictionType predictionType);
 				virtual ~DescriptorImagePointMultiView() {}
 				
+				/**
+				 * Enable the cache of the last predicted appearance.
+				 * \param zoomTol the max relative change of zoom, 0 to disable the cache
+				 * \param rotationTol the max change of rotation, in radians
+				 */
+				void setPredictionCache(double zoomTol, double rotationTol)
+					{ cacheZoomTol = zoomTol; cacheRotationTol = rotationTol; }
+				static PredictionCounters predictionCounters();
+				
 				virtual std::string typeName() const {
 					return "Image-Point-Multi-View";
 				}
@@ -137,6 +174,14 @@ namespace jafar {
 				 */
 				inline void checkView(jblas::vec const &current_pov, double const &current_pov_norm2, jblas::vec const &lmk, FeatureView &view, double &cosClosestAngle, FeatureView* &closestView) const;
 				bool getClosestView(const observation_ptr_t & obsPtr, FeatureView* &closestView);
+				/// copy the cached prediction to app_dst if it was warped from app_src with about the same zoom and rotation
+				bool getCachedPrediction(const appearance_ptr_t & app_src, double zoom, double rotation, const app_img_pnt_ptr_t & app_dst);
+				void cachePrediction(const appearance_ptr_t & app_src, double zoom, double rotation, const app_img_pnt_ptr_t & app_dst);
+				void predictAffine(const observation_ptr_t & obsPtr, const FeatureView & view_src, const jblas::vec & lmk,
+					const app_img_pnt_ptr_t & app_src, const app_img_pnt_ptr_t & app_dst);
+				/// \return false if the homography is degenerate, and then nothing is predicted
+				bool predictHomographic(const observation_ptr_t & obsPtr, const FeatureView & view_src, const jblas::vec & lmk,
+					const app_img_pnt_ptr_t & app_src, const app_img_pnt_ptr_t & app_dst);
 		};
 		
 		class DescriptorImagePointMultiViewFactory: public DescriptorFactoryAbstract
@@ -146,11 +191,20 @@ namespace jafar {
 				double scaleStep; ///< see DescriptorImagePointMultiView::scaleStep
 				double angleStep; ///< see DescriptorImagePointMultiView::angleStep
 				DescriptorImagePointMultiView::PredictionType predictionType; ///< see DescriptorImagePointMultiView::predictionType
+				double cacheZoomTol; ///< see DescriptorImagePointMultiView::cacheZoomTol
+				double cacheRotationTol; ///< see DescriptorImagePointMultiView::cacheRotationTol
 			public:
 				DescriptorImagePointMultiViewFactory(int descSize, double scaleStep, double angleStep, DescriptorImagePointMultiView::PredictionType predictionType):
-					descSize(descSize), scaleStep(scaleStep), angleStep(angleStep), predictionType(predictionType) {}
+					descSize(descSize), scaleStep(scaleStep), angleStep(angleStep), predictionType(predictionType), cacheZoomTol(0.), cacheRotationTol(0.) {}
+				/// see DescriptorImagePointMultiView::setPredictionCache()
+				void setPredictionCache(double zoomTol, double rotationTol)
+					{ cacheZoomTol = zoomTol; cacheRotationTol = rotationTol; }
 				DescriptorAbstract *createDescriptor() 
-					{ return new DescriptorImagePointMultiView(descSize, scaleStep, angleStep, predictionType); }
+				{
+					DescriptorImagePointMultiView *desc = new DescriptorImagePointMultiView(descSize, scaleStep, angleStep, predictionType);
+					desc->setPredictionCache(cacheZoomTol, cacheRotationTol);
+					return desc;
+				}
 		};
 		
 	}
@@ -0,0 +1,141 @@
+/**
+ * \file framePipeline.hpp
+ *
+ * Background preparation of the next frames, and histograms of the frame timings.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef FRAMEPIPELINE_HPP_
+#define FRAMEPIPELINE_HPP_
+
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace jafar {
+	namespace rtslam {
+
+		class FramePipeline;
+		typedef boost::shared_ptr<FramePipeline> frame_pipeline_ptr_t;
+
+		/**
+		 * Histogram of durations in ms, with bins of fixed width and one overflow bin.
+		 *
+		 * \ingroup rtslam
+		 */
+		class DurationHistogram {
+			public:
+				/**
+				 * Constructor.
+				 * \param _binWidth the width of the bins in ms
+				 * \param nBins the number of bins, durations above nBins*binWidth go to the overflow bin
+				 */
+				DurationHistogram(double _binWidth = 5., std::size_t nBins = 40);
+
+				void add(double duration);
+
+				unsigned count() const { return n; }
+				double mean() const { return (n ? total / n : 0.); }
+				double max() const { return max_; }
+				double binWidth() const { return binWidth_; }
+				/// number of durations in each bin, the last one is the overflow bin
+				const std::vector<unsigned> & bins() const { return bins_; }
+				/**
+				 * Upper edge of the bin that contains the quantile q, or the max if it falls in the overflow bin.
+				 * \param q in [0,1]
+				 */
+				double percentile(double q) const;
+
+				/// one line with the mean, the 50, 90 and 99 percentiles and the max, then the non-empty bins
+				friend std::ostream& operator <<(std::ostream & s, DurationHistogram const & hist);
+
+			private:
+				double binWidth_;
+				std::vector<unsigned> bins_;
+				unsigned n;
+				double total, max_;
+		};
+
+		/**
+		 * Timings of the processed frames: the processing time of each frame, its latency,
+		 * and the throughput.
+		 *
+		 * \ingroup rtslam
+		 */
+		class FrameTiming {
+			public:
+				FrameTiming(double binWidth = 5., std::size_t nBins = 40);
+
+				/**
+				 * Record a processed frame. All dates are kernel::Clock dates in seconds.
+				 * \param start the date when the processing of the frame began
+				 * \param end the date when it ended
+				 * \param arrival the date when the raw arrived, or a negative value if it is not a date
+				 * of this clock (replay, simulation), then the latency is measured from \a start
+				 */
+				void frameDone(double start, double end, double arrival = -1.);
+
+				unsigned count() const { return processing_.count(); }
+				const DurationHistogram & processing() const { return processing_; }
+				const DurationHistogram & latency() const { return latency_; }
+				/// frames per second, from the start of the first frame to the end of the last one
+				double throughput() const;
+
+			private:
+				DurationHistogram processing_, latency_;
+				double first_start, last_end;
+		};
+
+		/**
+		 * One background thread that prepares the next frames while the current one is processed.
+		 *
+		 * Tasks are run in the order in which they are posted. The preparation tasks must only
+		 * build caches of the raws, and wait() must be called before the raws they use are released
+		 * to the acquisition threads (see SensorExteroAbstract::acquire()).
+		 *
+		 * \ingroup rtslam
+		 */
+		class FramePipeline {
+			public:
+				typedef boost::function<void()> task_t;
+
+				struct Counters {
+					unsigned n_tasks;
+					double busy_time; ///<   ms spent in the tasks by the background thread
+					unsigned n_blocked; ///< calls to wait() that had to wait for a task
+					double wait_time; ///<   ms spent in wait() by the caller
+				};
+
+				FramePipeline();
+				~FramePipeline();
+
+				/// queue a task for the background thread
+				void post(const task_t & task);
+				/// wait until all the posted tasks are finished
+				void wait();
+				/// the counters, consistent after a call to wait()
+				const Counters & counters() const { return counters_; }
+
+			private:
+				void workerLoop();
+
+				boost::thread * worker;
+				boost::mutex mutex;
+				boost::condition_variable task_condition; ///< notifies the worker that a task is posted
+				boost::condition_variable done_condition; ///< notifies the caller that all tasks are finished
+				std::deque<task_t> tasks;
+				bool busy;
+				bool exiting;
+				Counters counters_;
+		};
+
+	}
+}
+
+#endif /* FRAMEPIPELINE_HPP_ */
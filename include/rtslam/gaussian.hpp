@@ -328,6 +328,22 @@ namespace jafar {
 				inline void  hasNullCov(bool _hasNullCov) {
 					hasNullCov_ = _hasNullCov;
 				}
+				/**
+				 * Point a REMOTE Gaussian to other indices of the same storage.
+				 * This is used when the storage is renumbered, eg. by MapAbstract::compact().
+				 * The data is not moved: it must already be at the new indices.
+				 * \param _ia the new indirect array, of the same size.
+				 */
+				inline void  reindex(const jblas::ind_array & _ia) {
+					JFR_ASSERT(storage_ == REMOTE, "gaussian.hpp: reindex: only for remote storage.");
+					JFR_ASSERT(_ia.size() == size_, "gaussian.hpp: reindex: size mismatch.");
+					// the views keep their own copies of the indices, that ublas does not let rebind
+					jblas::ind_array & ia_x = const_cast<jblas::ind_array &>(x_.indirect());
+					jblas::ind_array & ia_P1 = const_cast<jblas::ind_array &>(P_.indirect1());
+					jblas::ind_array & ia_P2 = const_cast<jblas::ind_array &>(P_.indirect2());
+					for (size_t i = 0; i < size_; i++)
+						ia_(i) = ia_x(i) = ia_P1(i) = ia_P2(i) = _ia(i);
+				}
 				inline void  x(const jblas::vec & _x) {
 					JFR_ASSERT(_x.size() == size_, "gaussian.hpp: set_x: size mismatch.");
 					x_.assign(_x);
@@ -26,6 +26,7 @@
 #include "jmath/indirectArray.hpp"
 
 #include "rtslam/hardwareEstimatorAbstract.hpp"
+#include "rtslam/readingsFile.hpp"
 
 
 
@@ -57,8 +58,10 @@ namespace hardware {
 			std::string dump_path;
 			double realFreq;
 
+			ReadingsFileReader readings; ///< the log, loaded in background from the construction, in replay
 			boost::thread *preloadTask_thread;
 			void preloadTask(void);
+			void preloadTaskOffline(void);
 		
 		public:
 			
@@ -17,6 +17,8 @@
 #include "jmath/indirectArray.hpp"
 
 #include "rtslam/rawAbstract.hpp"
+#include "rtslam/ringBuffer.hpp"
+#include "rtslam/readingsFile.hpp"
 
 namespace jafar {
 namespace rtslam {
@@ -61,6 +63,10 @@ inline double extractRawArrival(RawVec &raw) { return raw.arrival; }
 	read the sensor, fill the ring buffer, and notify the condition variable when
 	a new reading arrives.
 	
+	The ring buffer is shared without lock between the acquisition thread (writer)
+	and the slam thread (reader), see RingIndexSpsc. mutex_data is only needed for
+	the other data shared with the acquisition thread, and to wait on the conditions.
+	
 	TODO should be improved to be able to not fail if it overflows and that it should not
 	be fatal but just throw away oldest data. 3 policies on overflow:
 	fail, ignore/loop, block (for offline)
@@ -75,10 +81,19 @@ class HardwareSensorAbstract
 		typedef ublas::vector_indirect<VecT> VecIndT;
 	
 	private:
-		int write_pos; /// next position where to write, oldest available reading
-		int read_pos;  /// oldest position not released (being read or not read at all)
-		bool buffer_full; /// when read_pos = write_pos, tells whether the buffer is full or empty
-		bool read_pos_used;  /// current read_pos is being used
+		RingIndexSpsc ring; /// read and write positions in the ring buffer
+		boost::atomic<bool> writer_waiting; /// the writer is waiting on cond_offline_freed
+		
+		void notifyFreed()
+		{
+			// if the writer saw the buffer full before the release, it holds mutex_data
+			// until it waits on the condition, so the notification cannot be lost
+			if (writer_waiting.load(boost::memory_order_seq_cst))
+			{
+				{ boost::unique_lock<boost::mutex> l(mutex_data); }
+				cond_offline_freed.notify_all();
+			}
+		}
 		
 	protected:
 		kernel::VariableCondition<int> &condition; /// to notify when new data is available
@@ -86,7 +101,7 @@ class HardwareSensorAbstract
 		boost::mutex mutex_data; /// mutex for using this object
 		boost::condition_variable cond_offline_full;
 		boost::condition_variable cond_offline_freed;
-		int data_count; /// image count since last image read
+		boost::atomic<int> data_count; /// image count since last image read
 		int last_sent_pos; /// position of the last raw sent
 		bool no_more_data;
 		double timestamps_correction;
@@ -97,57 +112,44 @@ class HardwareSensorAbstract
 		int bufferSize; /// size of the ring buffer
 		VecT buffer; /// the ring buffer
 		
+		// the locked arguments are kept for compatibility, positions don't need mutex_data anymore
 		int getWritePos(bool locked = false) {
 			if (isFull(locked)) JFR_ERROR(RtslamException, RtslamException::GENERIC_ERROR, "buffer of hardware is full"); // FIXME chose policty when full
-			// don't need to lock, because will only be used and modified by writer
-			return write_pos;
+			return ring.writePos();
 		}
 		void incWritePos(bool locked = false) {
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			++write_pos;
-			if (write_pos >= bufferSize) write_pos = 0;
-			if (write_pos == read_pos) buffer_full = true; // full
-			++data_count;
+			ring.commitWrite();
+			data_count.fetch_add(1, boost::memory_order_relaxed);
 		}
 		int getFirstUnreadPos() {
 			/// \warning check that buffer is not empty before
-			// don't need to lock, because will only be used and modified by reader
-			if (!read_pos_used) return read_pos;
-			if (read_pos != bufferSize-1) return read_pos+1; else return 0;
+			return ring.firstUnreadPos();
 		}
 		int getLastUnreadPos(bool locked = false) {
 			/// \warning check that buffer is not empty before
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			return (write_pos == 0 ? bufferSize-1 : write_pos-1);
+			return ring.lastUnreadPos();
 		}
 		/// release until id, excluding id
 		void releaseUntil(unsigned id, bool locked = false) {
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			read_pos = id;
-			read_pos_used = true;
-			if (getFirstUnreadPos() == write_pos) buffer_full = false;
-			l.unlock();
-			cond_offline_freed.notify_all();
-			// cannot be full as id is not released
+			ring.releaseUntil(id);
+			notifyFreed();
 		}
 		/// release until id, including id
 		void release(unsigned id, bool locked = false) {
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			if (id != (unsigned)(bufferSize-1)) read_pos = id+1; else read_pos = 0;
-			if (write_pos == read_pos) buffer_full = false; // empty
-			read_pos_used = false;
-			l.unlock();
-			cond_offline_freed.notify_all();
+			ring.release(id);
+			notifyFreed();
 		}
-		bool isFull(bool locked = false)
-		{
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			return (read_pos == write_pos && buffer_full);
-		}
-		bool isEmpty(bool locked = false)
+		bool isFull(bool locked = false) { return ring.isFull(); }
+		bool isEmpty(bool locked = false) { return ring.isEmpty(); }
+		/**
+			Wait until the reader releases some data if the buffer is full (offline mode).
+			@param l a lock on mutex_data, that must be locked
+		*/
+		void waitWhileFull(boost::unique_lock<boost::mutex> &l)
 		{
-			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t()); if (!locked) l.lock();
-			return (getFirstUnreadPos() == write_pos && !buffer_full);
+			writer_waiting.store(true, boost::memory_order_seq_cst);
+			while (ring.isFullSeqCst()) cond_offline_freed.wait(l);
+			writer_waiting.store(false, boost::memory_order_relaxed);
 		}
 		
 	public:
@@ -155,7 +157,7 @@ class HardwareSensorAbstract
 			@param condition to notify when new data is available
 		*/
 		HardwareSensorAbstract(kernel::VariableCondition<int> &condition, unsigned bufferSize):
-			write_pos(0), read_pos(0), buffer_full(false), read_pos_used(false),
+			ring(bufferSize), writer_waiting(false),
 		  condition(condition), index(-1),
 		  data_count(0), no_more_data(false), timestamps_correction(0.0), started(false),
 		  bufferSize(bufferSize), buffer(bufferSize)
@@ -184,9 +186,10 @@ class HardwareSensorAbstract
 		virtual void getRaw(unsigned id, T& raw); ///< will also release the raws before this one
 		virtual void observeRaw(unsigned id, T& raw); ///< get raw but doesn't release raws before
 		virtual double getRawTimestamp(unsigned id);
+		virtual double getRawArrival(unsigned id);
 		virtual int getLastUnreadRaw(T& raw); ///< will also release the raws before this one
 		virtual void getLastProcessedRaw(T& raw) { raw = buffer(last_sent_pos); } ///< for information only (display...)
-		virtual void release() { release(read_pos); }
+		virtual void release() { release(ring.readPos()); }
 		
 		friend class rtslam::SensorProprioAbstract;
 		friend class rtslam::SensorExteroAbstract;
@@ -220,6 +223,14 @@ class HardwareSensorProprioAbstract: public HardwareSensorAbstract<RawVec>
 		size_t obs_size;
 		bool full_cov;
 	protected:
+		/**
+			Replay: copy the readings of a log to the ring buffer, as many as fit at once,
+			waiting for the reader to release some when it is full, until the end of the log.
+			@param last_timestamp set to the date of the last copied reading
+			@param fill_time set to the ms spent copying, waits excluded
+			@return false if the log could not be loaded
+		*/
+		bool preloadReadings(ReadingsFileReader & readings, double & last_timestamp, double & fill_time);
 		void addQuantity(Quantity quantity) { quantities[quantity] = data_size+1; data_size += QuantityDataSizes[quantity]; obs_size += QuantityObsSizes[quantity]; }
 		void clearQuantities() { for(int i = 0; i < qNQuantity; ++i) quantities[i] = -1; data_size = obs_size = 0; }
 	public:
@@ -272,7 +283,7 @@ template<typename T>
 typename HardwareSensorAbstract<T>::VecIndT HardwareSensorAbstract<T>::getRaws(double t1, double t2)
 {
 	JFR_ASSERT(t1 <= t2, "");
-	boost::unique_lock<boost::mutex> l(mutex_data);
+	int write_pos = ring.writtenPos();
 	int i1, i2;
 	int i, j;
 
@@ -310,9 +321,8 @@ typename HardwareSensorAbstract<T>::VecIndT HardwareSensorAbstract<T>::getRaws(d
 	
 	
 	// return mat_indirect
-	read_pos = i1;
-	l.unlock();
-	cond_offline_freed.notify_all();
+	ring.setReadPos(i1);
+	notifyFreed();
 
 	if (i1 < i2)
 	{
@@ -386,6 +396,12 @@ double HardwareSensorAbstract<T>::getRawTimestamp(unsigned id)
 	return extractRawTimestamp(buffer[id]);
 }
 
+template<typename T>
+double HardwareSensorAbstract<T>::getRawArrival(unsigned id)
+{
+	return extractRawArrival(buffer[id]);
+}
+
 template<typename T>
 void HardwareSensorAbstract<T>::observeRaw(unsigned id, T& raw)
 {
@@ -404,17 +420,15 @@ void HardwareSensorAbstract<T>::getRaw(unsigned id, T& raw)
 template<typename T>
 int HardwareSensorAbstract<T>::getLastUnreadRaw(T& raw)
 {
-	boost::unique_lock<boost::mutex> l(mutex_data);
-	int missed_count = data_count-1;
-	if (data_count > 0)
+	int count = data_count.exchange(0, boost::memory_order_relaxed);
+	if (count > 0 && isEmpty()) count = 0; // committed just after the previous call, and already sent
+	int missed_count = count-1;
+	if (count > 0)
 	{
-		unsigned id = getLastUnreadPos(true);
-		releaseUntil(id, true);
+		unsigned id = getLastUnreadPos();
+		releaseUntil(id);
 		raw = buffer[id];
 		last_sent_pos = id;
-		boost::unique_lock<boost::mutex> l(mutex_data);
-		data_count = 0;
-		l.unlock();
 		index.applyAndNotify(boost::lambda::_1++);
 	}
 	if (no_more_data && missed_count == -1) return -2; else return missed_count;
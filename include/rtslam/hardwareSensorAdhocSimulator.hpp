@@ -75,6 +75,11 @@ namespace hardware {
 			{
 				return id*dt;
 			}
+		
+			virtual double getRawArrival(unsigned id)
+			{
+				return id*dt;
+			}
 
 			virtual int getLastUnreadRaw(raw_ptr_t& raw)
 			{
@@ -19,8 +19,12 @@
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include <deque>
+
 #include "rtslam/hardwareSensorAbstract.hpp"
 #include "rtslam/rawImage.hpp"
+#include "rtslam/sequenceFile.hpp"
+#include "rtslam/framePipeline.hpp"
 
 
 namespace jafar {
@@ -33,23 +37,68 @@ using triple-buffering.
 */
 class HardwareSensorCamera: public HardwareSensorExteroAbstract
 {
+	public:
+		/// what to do with a used image when all the frames of the dump pool are queued
+		enum DumpPolicy {
+			dpDropNewest = 0, ///< do not dump it
+			dpDropOldest, ///< drop the oldest queued frame, that is not being written yet
+			dpBlock ///< getRaw() waits for a free frame, so that all the used images are dumped
+		};
+		struct DumpCounters {
+			unsigned n_queued; ///< frames copied to the pool
+			unsigned n_written;
+			unsigned n_dropped; ///< used images that were not dumped
+			unsigned max_queued; ///< largest number of frames waiting to be written
+			double block_time; ///< ms waited by getRaw() for a free frame, with dpBlock
+			DurationHistogram latency; ///< ms from the copy to the pool to the end of the write
+			DumpCounters(): n_queued(0), n_written(0), n_dropped(0), max_queued(0), block_time(0.), latency(10.) {}
+		};
 	protected:
 		std::vector<IplImage*> bufferImage;
 		std::vector<rawimage_ptr_t> bufferSpecPtr;
-		std::list<rawimage_ptr_t> bufferSave;
 		unsigned index_load;
 		unsigned first_index;
 		int found_first; /// 0 = not found, 1 = found pgm, 2 = found png
 		
 		std::string dump_path;
 		
+		bool packed_dump; ///< dump to a sequence file instead of one file per image
+		SequenceFileWriter sequenceWriter;
+		SequenceFileReader sequenceReader;
+		std::vector<IplImage*> bufferHeader; ///< headers of the buffer images when they point into sequenceReader
+		
 		boost::thread *preloadTask_thread;
 		void preloadTaskOffline(void);
+		void preloadTaskSequence(void);
 		boost::thread *savePushTask_thread;
+		bool dump_stop; ///< stops savePushTask, protected by index
 		void savePushTask(void);
-		kernel::VariableCondition<size_t> saveTask_cond;
+		kernel::VariableCondition<size_t> saveTask_cond; ///< number of frames in dump_queue
 		boost::thread *saveTask_thread;
 		void saveTask(void);
+		
+		/// dump pool, preallocated at the first dumped image
+		struct DumpFrame {
+			IplImage *ipl;
+			jafarImage_ptr_t img;
+			double timestamp, arrival;
+			double date; ///< date of the copy to the pool
+		};
+		unsigned dump_pool_size;
+		DumpPolicy dump_policy;
+		unsigned dump_workers; ///< number of saveTask threads
+		std::vector<boost::thread*> dump_worker_threads; ///< the saveTask threads other than saveTask_thread
+		bool dump_compress;
+		std::vector<DumpFrame> dump_pool;
+		std::deque<unsigned> dump_queue; ///< frames to write, oldest first, protected by saveTask_cond
+		std::vector<unsigned> dump_free; ///< free frames, protected by dump_free_cond
+		kernel::VariableCondition<size_t> dump_free_cond; ///< number of free frames
+		unsigned dump_index; ///< index of the next written image file
+		boost::mutex dump_counters_mutex;
+		DumpCounters dump_counters;
+		void allocateDumpPool(int width, int height);
+		/// copy the image to a free frame of the dump pool, or apply the dump policy
+		void pushDumpFrame(const RawImage & raw);
 	
 	
 		void init(std::string dump_path, cv::Size imgSize);
@@ -57,9 +106,33 @@ class HardwareSensorCamera: public HardwareSensorExteroAbstract
 		
 		/**
 		Same as before but assumes that mode=2, and doesn't need a camera
+		@param bufferSize the number of images read ahead of the processing
 		*/
-		HardwareSensorCamera(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".");
+		HardwareSensorCamera(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".", int bufferSize = 3);
 		HardwareSensorCamera(kernel::VariableCondition<int> &condition, int bufferSize);
+		/// stops and joins the saveTask threads after they have written the queued frames
+		virtual ~HardwareSensorCamera();
+		
+		/**
+		Dump the images to the single file dump_path/images.seq (see SequenceHeader)
+		instead of one image_NNNNNNN.pgm and one .time file per image.
+		Must be called before the sensor starts. The replay reads images.seq when it exists.
+		*/
+		void setPackedDump(bool packed) { packed_dump = packed; }
+		
+		/**
+		Configure the dump of the used images, before the sensor starts.
+		The images are copied to a pool of preallocated frames, and written by background threads.
+		@param poolSize the number of frames of the pool
+		@param policy what to do when all the frames are queued
+		@param compressWorkers if > 0, write lossless compressed .png images instead of .pgm, with this number
+		of threads. Ignored with the packed dump, that is written by one thread without compression.
+		*/
+		void setDumpConfig(unsigned poolSize, DumpPolicy policy, unsigned compressWorkers = 0);
+		DumpCounters dumpCounters() { boost::unique_lock<boost::mutex> l(dump_counters_mutex); return dump_counters; }
+		
+		/// with dpBlock, also copies the image to the dump pool, waiting for a free frame
+		virtual void getRaw(unsigned id, raw_ptr_t& raw);
 };
 
 
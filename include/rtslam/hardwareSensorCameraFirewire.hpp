@@ -72,8 +72,9 @@ class HardwareSensorCameraFirewire: public HardwareSensorCamera
 #endif
 		/**
 		Same as before but assumes that mode=2, and doesn't need a camera
+		@param bufferSize the number of images read ahead of the processing
 		*/
-		HardwareSensorCameraFirewire(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".");
+		HardwareSensorCameraFirewire(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".", int bufferSize = 3);
 		
 		~HardwareSensorCameraFirewire();
 
@@ -61,8 +61,9 @@ class HardwareSensorCameraUeye: public HardwareSensorCamera
 #endif
 		/**
 		Same as before but assumes that mode=2, and doesn't need a camera
+		@param bufferSize the number of images read ahead of the processing
 		*/
-		HardwareSensorCameraUeye(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".");
+		HardwareSensorCameraUeye(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path = ".", int bufferSize = 3);
 		
 		~HardwareSensorCameraUeye();
 
@@ -32,8 +32,10 @@ namespace hardware {
 class HardwareSensorGpsGenom: public HardwareSensorProprioAbstract
 {
 	private:
+		ReadingsFileReader readings; ///< the log, loaded in background from the construction, in replay
 		boost::thread *preloadTask_thread;
 		void preloadTask(void);
+		void preloadTaskOffline(void);
 		
 #ifdef HAVE_POSTERLIB
 		POSTER_ID posterId;
@@ -27,8 +27,10 @@ namespace hardware {
 class HardwareSensorMocap: public HardwareSensorProprioAbstract
 {
 	private:
+		ReadingsFileReader readings; ///< the log, loaded in background from the construction, in replay
 		boost::thread *preloadTask_thread;
 		void preloadTask(void);
+		void preloadTaskOffline(void);
 		
 		RawVec reading;
 		int mode;
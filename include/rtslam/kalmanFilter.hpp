@@ -15,6 +15,7 @@
 #include "jmath/ixaxpy.hpp"
 #include "jmath/ublasExtra.hpp"
 #include "rtslam/innovation.hpp"
+#include "rtslam/kalmanTools.hpp"
 
 namespace jafar {
 	namespace rtslam {
@@ -26,8 +27,39 @@ namespace jafar {
 		 * \ingroup rtslam
 		 */
 		class ExtendedKalmanFilterIndirect {
+			public:
+				/**
+				 * Covariance engine.
+				 * - INDIRECT: covariance operations access P element by element through indirect arrays.
+				 * - BLOCKS: the used states are split into blocks of contiguous states (robots, sensors, landmarks)
+				 *   and covariance operations are dense products on each pair of blocks.
+				 *
+				 * Both work on the same storage and give the same results, the choice is only a matter of speed.
+				 */
+				typedef enum {
+					INDIRECT, ///< access through indirect arrays
+					BLOCKS ///<    dense kernels on contiguous blocks
+				} engine_t;
+
+				/**
+				 * Solver of the stacked innovation covariance S in correctAllStacked().
+				 * - LU_INVERSE: S is inverted with an LU decomposition, and K = -PJt * S^-1.
+				 * - CHOLESKY: S = L * L' is factored in place and only triangular solves are done,
+				 *   W = L^-1 * PJt', dx = -W' * L^-1 * z, P -= W' * W.
+				 *   S^-1 is never formed and the covariance update is a symmetric product.
+				 *   If S is not numerically positive definite, LU_INVERSE is used for this update.
+				 */
+				typedef enum {
+					LU_INVERSE, ///< explicit inverse
+					CHOLESKY ///<   triangular solves
+				} stacked_solver_t;
+
 			private:
 				size_t size_; // state size
+				engine_t engine_;
+				stacked_solver_t stackedSolver_;
+				kalman::StateBlocks blocks_x, blocks_1, blocks_2, blocks_3; ///< temporary block decompositions
+				thread_pool_ptr_t pool_; ///< worker threads for the covariance operations, or none
 //				size_t measurementSize;
 //				size_t expectationSize;
 //				size_t innovationSize;
@@ -44,6 +76,25 @@ namespace jafar {
 				size_t size(){
 					return size_;
 				}
+
+				/**
+				 * Change the size of the state, keeping the data of the first states.
+				 * The storage objects are kept, so Gaussians pointing to x() and P() stay valid
+				 * as long as their indices are below the new size. New states are cleared.
+				 * \param _size the new size.
+				 */
+				void resize(size_t _size);
+				engine_t engine() const { return engine_; }
+				void setEngine(engine_t _engine) { engine_ = _engine; }
+				stacked_solver_t stackedSolver() const { return stackedSolver_; }
+				void setStackedSolver(stacked_solver_t _solver) { stackedSolver_ = _solver; }
+				/**
+				 * Split the covariance operations among the threads of a pool.
+				 * Each thread writes its own part of P, so results do not depend on the number of threads.
+				 * \param _pool the pool, or an empty pointer to run everything in the caller thread.
+				 */
+				void setThreadPool(const thread_pool_ptr_t & _pool) { pool_ = _pool; }
+				const thread_pool_ptr_t & threadPool() const { return pool_; }
 				jblas::vec & x() {
 					return x_;
 				}
@@ -94,6 +145,16 @@ namespace jafar {
 				 */
 				void predict(const ind_array & iax, const mat & F_v, const ind_array & iav, const sym_mat & Q);
 
+				/**
+				 * Same as predict() above, with the invariant states already known,
+				 * for instance from MapAbstract::ia_used_complement().
+				 * \param ia_inv the ind_array of the used states that are not in \a iav.
+				 * \param F_v the Jacobian of the process model.
+				 * \param iav the ind_array of the process model states.
+				 * \param Q the covariances matrix of the perturbation in state-space.
+				 */
+				void predictInvariant(const ind_array & ia_inv, const mat & F_v, const ind_array & iav, const sym_mat & Q);
+
 				/**
 				 * EKF initialization from fully observable info.
 				 * This function alters the state vector structure to allocate a new element to be filtered.
@@ -120,6 +181,18 @@ namespace jafar {
 				 */
 				void initialize(const ind_array & iax, const mat & G_v, const ind_array & ia_rs, const ind_array & ia_l, const mat & G_y, const sym_mat & R, const mat & G_n, const sym_mat & N);
 
+				/**
+				 * EKF initialization with the covariance of the new states already computed.
+				 * This is used to initialize a group of landmarks with one covariance update,
+				 * by stacking their Jacobians and covariances (see ObservationAbstract::initializeGroup()).
+				 * \param iax indirect array of indices to used states, including all the new ones
+				 * \param G_rs Jacobian of the new states wrt vehicle states (robot and sensor).
+				 * \param ia_rs indirect array of indices to robot and sensor
+				 * \param ia_l indirect array of indices to the new states, in the order of the rows of G_rs
+				 * \param Q covariance of the new states due to the measurements and priors
+				 */
+				void initialize(const ind_array & iax, const mat & G_rs, const ind_array & ia_rs, const ind_array & ia_l, const sym_mat & Q);
+
 				/**
 				 * EKF reparametrization.
 				 * This function alters the state structure to modify an element that is currently being filtered.
@@ -163,12 +236,51 @@ namespace jafar {
 				 */
 				void correct(const ind_array & iax, Innovation & inn, const mat & INN_rsl, const ind_array & ia_rsl);
 
+				/**
+				 * EKF correction as a sequence of scalar updates, one per innovation component.
+				 * With \a R the measurement noise, each component k is processed with:
+				 * - s  = INN_k * P * trans(INN_k) + R(k,k)
+				 * - K  = -P * trans(INN_k) / s
+				 * - x <-- x + K * z(k)
+				 * - P <-- P + K * INN_k * P
+				 * - z(j) <-- z(j) + INN_j * K * z(k) for the next components j
+				 *
+				 * No matrix is inverted. The result is the same as correct() when R is diagonal;
+				 * otherwise z and INN_rsl are first whitened with the Cholesky factor of R.
+				 * The scalar updates of P are only propagated through the columns of ia_rsl;
+				 * P(x,x) is updated once at the end, with all the m gains, through the selected
+				 * engine as in correct().
+				 *
+				 * \param ia_x the indirect array of used indices in the map.
+				 * \param inn the Innovation.
+				 * \param INN_rsl: the Jacobian wrt the states that contributed to the innovation
+				 * \param ia_rsl: the indices to these states
+				 * \param R the measurement noise covariance
+				 */
+				void correctSequential(const ind_array & ia_x, const Innovation & inn, const mat & INN_rsl, const ind_array & ia_rsl, const sym_mat & R);
+
 				
 			protected:
+
+				/**
+				 * Covariance transformation shared by predict(), initialize() and reparametrize(), using the selected engine:
+				 * - P(out,inv) = G * P(in,inv)
+				 * - P(out,out) = G * P(in,in) * G' + Q
+				 * \param Q the covariance to add to the output block, or NULL.
+				 */
+				void ixaxpy(const ind_array & ia_inv, const mat & G, const ind_array & ia_in, const ind_array & ia_out, const sym_mat * Q);
+
+				/**
+				 * Covariance update of the correction, using the selected engine:
+				 * - P(x,x) += K * PJt_tmp'
+				 */
+				void updateP(const ind_array & ia_x);
 				
 				vec stackedInnovation_x;
 				sym_mat stackedInnovation_P;
 				sym_mat stackedInnovation_iP;
+				mat stackedInnovation_L; ///< Cholesky factor of stackedInnovation_P
+				mat stackedInnovation_W; ///< L^-1 * PJt_tmp'
 
 				struct StackedCorrection
 				{
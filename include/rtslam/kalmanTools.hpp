@@ -9,11 +9,14 @@
 #ifndef KALMANTOOLS_HPP_
 #define KALMANTOOLS_HPP_
 
+#include <vector>
+
 #include "kernel/jafarDebug.hpp"
 
 #include "jmath/jblas.hpp"
 #include "jmath/indirectArray.hpp"
 #include "rtslam/innovation.hpp"
+#include "rtslam/threadPool.hpp"
 
 namespace jafar {
 	namespace rtslam {
@@ -32,6 +35,95 @@ namespace jafar {
 				ublas::noalias(K) = - prod(prod<mat>(project(P, ia_x, ia_x1), trans(INN_x1)), inn.iP_);
 			}
 
+
+			/**
+			 * Block of contiguous states of the map.
+			 * Robots, sensors and landmarks reserve their states contiguously in the map (see MapAbstract::reserveStates()),
+			 * so an indirect array of used states is in practice a short list of such blocks.
+			 */
+			struct StateBlock {
+				size_t first; ///< index of the first state in the map
+				size_t size; ///<  number of contiguous states
+				size_t pos; ///<   position of the first state in the indirect array the block was extracted from
+				ublas::range range() const { return ublas::range(first, first + size); }
+			};
+			typedef std::vector<StateBlock> StateBlocks;
+
+			/**
+			 * Split an indirect array into blocks of contiguous states.
+			 * \param ia the indirect array
+			 * \param blocks the resulting blocks, in the order of \a ia.
+			 */
+			void splitBlocks(const ind_array & ia, StateBlocks & blocks);
+
+			/**
+			 * Block version of jmath::ixaxpy_prod().
+			 * It performs, with dense products on each pair of blocks:
+			 * - P(out,inv) = G * P(in,inv)
+			 * - P(out,out) = G * P(in,in) * G' + Q
+			 *
+			 * \param P the covariances matrix
+			 * \param inv the blocks of invariant states
+			 * \param G the Jacobian, of size out x in
+			 * \param in the blocks of input states
+			 * \param out the blocks of output states (can be the same as \a in)
+			 * \param Q the covariance to add to the output block, or NULL.
+			 * \param pool if given, the invariant blocks are split among its threads.
+			 */
+			void ixaxpy_blocks(sym_mat & P, const StateBlocks & inv, const mat & G, const StateBlocks & in,
+			                   const StateBlocks & out, const sym_mat * Q, ThreadPool * pool = NULL);
+
+			/**
+			 * Same as ixaxpy_blocks() with indirect arrays, that is jmath::ixaxpy_prod().
+			 * If a pool is given, the invariant states are split among its threads.
+			 */
+			void ixaxpy_indirect(sym_mat & P, const ind_array & ia_inv, const mat & G, const ind_array & ia_in,
+			                     const ind_array & ia_out, const sym_mat * Q, ThreadPool * pool = NULL);
+
+			/**
+			 * Block version of the covariance update of the EKF correction.
+			 * It performs P(x,x) += K * PJt', only computing the lower triangle.
+			 * \param P the covariances matrix
+			 * \param x the blocks of the used states, K and PJt rows are ordered as these blocks.
+			 * \param K the Kalman gain
+			 * \param PJt the product P(x,rsl) * INN_rsl'
+			 * \param pool if given, the block rows are split among its threads.
+			 */
+			void symUpdate_blocks(sym_mat & P, const StateBlocks & x, const mat & K, const mat & PJt, ThreadPool * pool = NULL);
+
+			/**
+			 * Symmetric rank-k update of the covariance in the EKF correction.
+			 * It performs P(x,x) += K * PJt', working directly on the indices of \a ia_x.
+			 * Only the lower triangle is computed, and the inner loops use the vectorized kernels of simd.hpp.
+			 * \param P the covariances matrix
+			 * \param ia_x the used states, K and PJt rows are ordered as these states.
+			 * \param K the Kalman gain
+			 * \param PJt the product P(x,rsl) * INN_rsl'
+			 * \param pool if given, the rows are split among its threads in chunks of equal work.
+			 */
+			void symRankUpdate(sym_mat & P, const ind_array & ia_x, const mat & K, const mat & PJt, ThreadPool * pool = NULL);
+
+			/**
+			 * In-place Cholesky factorization S = L * L'.
+			 * On output the lower triangle of \a S holds L, the strict upper triangle is set to zero.
+			 * \param S a symmetric positive definite matrix
+			 * \return false if \a S is not positive definite, in which case it is left partially factored.
+			 */
+			bool cholesky(mat & S);
+
+			/**
+			 * Forward substitution B = L^-1 * B, in place.
+			 * The rows of B are processed as contiguous vectors, so that B should have many more columns than rows.
+			 * \param L a lower triangular matrix, as given by cholesky()
+			 * \param B the right hand side, with as many rows as L
+			 */
+			void solveLower(const mat & L, mat & B);
+
+			/**
+			 * Forward substitution b = L^-1 * b, in place.
+			 */
+			void solveLower(const mat & L, vec & b);
+
 		}
 	}
 }
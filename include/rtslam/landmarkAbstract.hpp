@@ -94,6 +94,9 @@ namespace jafar {
 				geometry_t geomType;
 			public:
 				std::string categoryName() const {return "LANDMARK";}
+
+				/// patch the state and the indices of all observations of this landmark
+				virtual void remapStates(const std::vector<std::size_t> & newIndex);
 				geometry_t getGeomType() const {return geomType;}
 				virtual std::string typeName() const {return "Abstract";}
 
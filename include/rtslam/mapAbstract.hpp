@@ -12,6 +12,8 @@
 #ifndef MAPABSTRACT_HPP_
 #define MAPABSTRACT_HPP_
 
+#include <map>
+
 #include "kernel/dataLog.hpp"
 #include "jmath/jblas.hpp"
 #include "rtslam/rtSlam.hpp"
@@ -67,8 +69,11 @@ namespace jafar {
 
 				/**
 				 * Constructor
+				 * \param _max_size the maximum number of states.
+				 * \param _initial_size the number of states allocated at construction, that grows
+				 * with reserveStates() up to \a _max_size, or 0 to allocate \a _max_size states at once.
 				 */
-				MapAbstract(size_t _max_size);
+				MapAbstract(size_t _max_size, size_t _initial_size = 0);
 				MapAbstract(const ekfInd_ptr_t & ekfPtr);
 
 				/**
@@ -92,21 +97,27 @@ namespace jafar {
 				/**
 				 * Size things and map usage management
 				 */
-				size_t max_size;
-				size_t current_size;
-				jblas::vecb used_states;
+				size_t max_size; ///< maximum number of states
+				size_t current_size; ///< number of used states
+				jblas::vecb used_states; ///< only modify through reserveStates() and liberateStates()
 
 				/**
-				 * Map's indirect array is a function by now.
-				 * \return the indirect array of all used states in the map.
-				 * \todo: see how to avoid constructing this each time
+				 * The indirect array of all used states in the map, in increasing order.
+				 * It is maintained by reserveStates() and liberateStates(), and stays valid until the next call to one of them.
 				 */
-				inline jblas::ind_array ia_used_states() {
-					jblas::ind_array res;
-					res = jmath::ublasExtra::ia_set(used_states);
-					return res;
+				inline const jblas::ind_array & ia_used_states() const {
+					return ia_used_states_;
 				}
 
+				/**
+				 * The used states of the map that are not in \a _ia, in increasing order.
+				 * This is the invariant part of the map in the prediction of a robot of state indices \a _ia.
+				 * The result is cached for each set of indices (by its first index), and recomputed only
+				 * when the used states change, so it stays valid until the next call to reserveStates() or liberateStates().
+				 * \param _ia a set of used states, in increasing order.
+				 */
+				const jblas::ind_array & ia_used_complement(const jblas::ind_array & _ia);
+
 
 				jblas::vec & x();
 				jblas::sym_mat & P();
@@ -152,6 +163,58 @@ namespace jafar {
 				 */
 				void liberateStates(const jblas::ind_array & _ia);
 
+				/**
+				 * Number of states allocated in the filter, between current_size and max_size.
+				 */
+				inline std::size_t capacity() const {
+					return used_states.size();
+				}
+
+				/// Growth of the allocated states since the creation of the map.
+				struct GrowthCounters {
+					unsigned long n_grows; ///< number of times the filter was enlarged
+					unsigned long n_shrinks; ///< number of times the filter was reduced
+					std::size_t peak_capacity; ///< largest allocated size
+					double total_time; ///< total time spent resizing (ms)
+				};
+				const GrowthCounters & growthCounters() const { return growth_counters; }
+
+				/**
+				 * Fragmentation of the used states: the proportion of unused states before the last used one.
+				 */
+				double fragmentation() const;
+
+				/**
+				 * Move all used states to the beginning of the map, keeping their order,
+				 * and patch the indices held by all robots, sensors, landmarks and observations.
+				 * Compact states are accessed with better memory locality by the filter.
+				 * It must be called when no index array to the map is held outside the map objects,
+				 * eg. between the data managers' processKnown() and detectNew().
+				 * \return true if some states were moved.
+				 */
+				bool compact();
+
+				/**
+				 * Compact the map if its fragmentation is larger than the threshold given by setCompactionThreshold().
+				 * \return true if some states were moved.
+				 */
+				bool compactIfFragmented();
+
+				/**
+				 * Threshold of fragmentation() above which compactIfFragmented() compacts the map.
+				 * \param th the threshold in [0,1], 1 to never compact.
+				 */
+				void setCompactionThreshold(double th) { compaction_th = th; }
+
+				/// Cost of the compactions since the creation of the map.
+				struct CompactionCounters {
+					unsigned long n_compactions; ///< number of compactions
+					unsigned long n_moved_states; ///< total number of states moved
+					double total_time; ///< total time spent compacting (ms)
+					double last_time; ///< time of the last compaction (ms)
+				};
+				const CompactionCounters & compactionCounters() const { return compaction_counters; }
+
 				void clear();
 				void fillSeq();
 				void fillDiag();
@@ -162,7 +225,23 @@ namespace jafar {
 				virtual void writeLogData(kernel::DataLogger& log) const;
 				
 			private:
-
+				jblas::ind_array ia_used_states_; ///< indices of used_states
+				unsigned long used_states_version; ///< incremented each time used_states changes
+
+				struct ComplementCache {
+					jblas::ind_array ia;
+					jblas::ind_array complement;
+					unsigned long version;
+				};
+				std::map<std::size_t, ComplementCache> complements; ///< cached complements, by first index
+
+				double compaction_th;
+				CompactionCounters compaction_counters;
+
+				size_t initial_size; ///< allocated states at construction, 0 if the map does not grow
+				GrowthCounters growth_counters;
+				/// change the allocated states, and the size of the filter
+				void resizeStorage(size_t _capacity);
 
 		};
 
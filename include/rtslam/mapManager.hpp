@@ -112,6 +112,7 @@ namespace jafar {
 					manageDefaultDeletion();
 					manageDeletion();
 					manageReparametrization();
+					mapPtr()->compactIfFragmented();
 				}
 				
 				virtual bool isExclusive(observation_ptr_t obsPtr)
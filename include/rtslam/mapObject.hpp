@@ -12,6 +12,8 @@
 #ifndef MAPOBJECT_HPP_
 #define MAPOBJECT_HPP_
 
+#include <vector>
+
 #include "jmath/jblas.hpp"
 #include "rtslam/rtSlam.hpp"
 #include "rtslam/objectAbstract.hpp"
@@ -22,6 +24,20 @@ namespace jafar {
 	namespace rtslam {
 
 
+		/**
+		 * Renumber the indices of an indirect array.
+		 * \param ia the indices
+		 * \param newIndex the new index of each old index
+		 * \return the renumbered indices, in the same order
+		 */
+		inline jblas::ind_array remapIndices(const jblas::ind_array & ia, const std::vector<std::size_t> & newIndex) {
+			jblas::ind_array res(ia.size());
+			for (std::size_t i = 0; i < ia.size(); ++i)
+				res(i) = newIndex[ia(i)];
+			return res;
+		}
+
+
 		/**
 		 * Class for generic mappable objects.
 		 * \author jsola
@@ -84,6 +100,16 @@ namespace jafar {
 					return "MAP OBJECT";
 				}
 
+				/**
+				 * Patch all the indices to the map held by this object after the map states have been renumbered.
+				 * Derived objects holding other indices to the map must overload it and call this one.
+				 * \param newIndex the new index of each old map index.
+				 */
+				virtual void remapStates(const std::vector<std::size_t> & newIndex) {
+					if (state.storage() == Gaussian::REMOTE)
+						state.reindex(remapIndices(state.ia(), newIndex));
+				}
+
 				/**
 				 * A Map have a Reference Frame, all the objects must implements the reframe Function
 				 */
@@ -32,6 +32,7 @@ namespace jafar {
 				Measurement(size_t _size);
 
 				double matchScore; ///< matching quality score
+				double matchTime;  ///< time spent matching, in ms
 				jblas::vec2 std_est; ///< estimation of std dev based on correl max curv
 				
 				friend std::ostream& operator <<(std::ostream & s, Measurement const & m_) {
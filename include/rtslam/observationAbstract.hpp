@@ -177,6 +177,7 @@ namespace jafar {
 				Gaussian prior;
 				appearance_ptr_t predictedAppearance;
 				appearance_ptr_t observedAppearance;
+				appearance_ptr_t matchedAppearance; ///< copy of the observed appearance of the last frame where it was matched
 				jblas::sym_mat noiseCovariance;
 
 				// indirect arrays
@@ -206,6 +207,7 @@ namespace jafar {
 						int nInlier; ///< Number of times declared inlier
 						int nSearchSinceLastInlier; ///< Number of frames the landmark was searched since last time it was inlier
 						int nFrameSinceLastVisible; ///< Number of frames since last time it was visible
+						int nFrameSinceLastMatch; ///< Number of frames since last time it was matched, 0 if matched in the last processed frame
 				} counters;
 
 				/**
@@ -262,6 +264,19 @@ namespace jafar {
 				 */
 				void backProject();
 
+				/**
+				 * Back-project the landmark mean, and compute the Jacobians LMK_rs, LMK_meas and LMK_prior,
+				 * without initializing the landmark in the filter.
+				 * Use backProject() instead, or initializeGroup() afterwards.
+				 */
+				void backProjectMean();
+
+				/**
+				 * Initialize in the filter the landmarks of a group of observations of the same sensor,
+				 * that have been back-projected with backProjectMean(), with one covariance update.
+				 */
+				static void initializeGroup(const std::vector<observation_ptr_t> & obsList);
+
 				/**
 				 * Compute innovation from measurement and expectation.
 				 *
@@ -375,6 +390,8 @@ namespace jafar {
 				virtual double getMatchScore() = 0;
 
 				void update() ;
+				/// update as a sequence of scalar updates, see ExtendedKalmanFilterIndirect::correctSequential()
+				void updateSequential() ;
 #if 0
 				virtual bool voteForKillingLandmark();
 #endif
@@ -0,0 +1,57 @@
+/**
+ * \file patchWarp.hpp
+ *
+ * Homographic warping of image patches, with a fixed-point bilinear interpolation.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef PATCHWARP_HPP_
+#define PATCHWARP_HPP_
+
+#include "image/Image.hpp"
+
+namespace jafar {
+	namespace rtslam {
+		namespace patchwarp {
+
+			/**
+			 * Homography between patch coordinates, row major with H[8] = 1.
+			 * Patch coordinates are centered on the patch: the center of pixel (i,j) of a
+			 * w x h patch is (j+0.5-w/2, i+0.5-h/2).
+			 */
+			struct Homography {
+				double h[9];
+
+				void apply(double x, double y, double & xo, double & yo) const {
+					double z = h[6]*x + h[7]*y + h[8];
+					xo = (h[0]*x + h[1]*y + h[2]) / z;
+					yo = (h[3]*x + h[4]*y + h[5]) / z;
+				}
+				/// Jacobian at the origin, row major
+				void jacobianAtOrigin(double J[4]) const {
+					J[0] = h[0] - h[2]*h[6]; J[1] = h[1] - h[2]*h[7];
+					J[2] = h[3] - h[5]*h[6]; J[3] = h[4] - h[5]*h[7];
+				}
+			};
+
+			/**
+			 * Homography that maps the 4 points \a from onto the 4 points \a to.
+			 * \return false if the points are degenerate (3 of them aligned)
+			 */
+			bool fromCorners(const double from[4][2], const double to[4][2], Homography & H);
+
+			/**
+			 * Warp a patch: each pixel of \a dst takes the value of \a src at H(pixel), in patch coordinates.
+			 * The bilinear interpolation uses 8 bit weights and integer arithmetic, and the source
+			 * position of each pixel is updated incrementally along the rows.
+			 * Positions outside of \a src take the value of the closest border pixel.
+			 * \param H the homography from the patch coordinates of dst to those of src
+			 */
+			void warpBilinear(const image::Image & src, const Homography & H, image::Image & dst);
+
+		}
+	}
+}
+
+#endif /* PATCHWARP_HPP_ */
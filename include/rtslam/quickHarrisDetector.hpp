@@ -10,6 +10,8 @@
 #ifndef QUICKHARRISDETECTOR_HPP_
 #define QUICKHARRISDETECTOR_HPP_
 
+#include <vector>
+
 #include "image/Image.hpp"
 #include "image/roi.hpp"
 
@@ -54,6 +56,14 @@ namespace jafar{
 		 * Because of simplifications 1. 2. and 3., the result is sub-optimal in the sense
 		 * of Harris standards, but it gives strong corner points that can
 		 * be tracked by means of correlation (zncc for example).
+		 *
+		 * The processing data is stored as one plane per quantity, in a scratch arena
+		 * owned by the detector that only grows to the largest roi seen, so that
+		 * detecting in many rois does not allocate. The derivatives and integral images
+		 * are computed row by row with the vectorized kernels of the simd module.
+		 *
+		 * Several rois can be processed in one sweep: the derivatives and integral images
+		 * are computed once over their bounding box, and the best point is searched in each roi.
 		 */
 		class QuickHarrisDetector {
       public:
@@ -64,22 +74,36 @@ namespace jafar{
           );
         ~QuickHarrisDetector();
         virtual bool detectIn(image::Image const& image, feat_img_pnt_ptr_t featPtr, const image::ConvexRoi * roiPtr = 0 );
+        /**
+         * Detect the strongest point of each roi in one sweep.
+         * If the rois cover less than half of their bounding box, they are processed one by one.
+         * \param featPtrs the features, one per roi, that are set up where a point is found
+         * \param found whether a point was found in each roi
+         * \return the number of rois where a point was found
+         */
+        int detectIn(image::Image const& image, const std::vector<image::ConvexRoi> & rois, std::vector<feat_img_pnt_ptr_t> & featPtrs, std::vector<bool> & found);
       private:
         void quickDerivatives(const image::Image & image, image::ConvexRoi & roi);
         bool quickConvolutionWithBestPoint(const image::ConvexRoi & roi, int pixMax[2], float & scoreMax);
 
-        void writeHarrisImagesAsPPM(image::ConvexRoi & roi);
+        void writeHarrisImagesAsPPM(const image::Image & image, image::ConvexRoi & roi);
 
       private:
         int m_derivationSize, m_convolutionSize;
         float m_threshold;
         float m_edge;
+        /// planes of the processing data, m_stride values per roi row
         struct HQuickData {
-        	int im_x, im_y, im_xx, im_xy, im_yy, im_conv_xx, im_conv_xy, im_conv_yy;
-        	int int_xx, int_xy, int_yy;
-        	double im_high_curv, im_low_curv;
+        	int *im_xx, *im_xy, *im_yy, *im_conv_xx, *im_conv_xy, *im_conv_yy;
+        	int *int_xx, *int_xy, *int_yy;
+        	double *im_high_curv, *im_low_curv;
         };
-        HQuickData* m_quickData; // integral image for quick detector.
+        HQuickData m_quickData; // integral image for quick detector.
+        int m_stride;
+        int m_x0, m_y0; ///< image position of the first value of the planes
+        std::vector<char> m_arena; ///< scratch memory of the planes, grow-only
+        /// set the planes in the arena for an image area, growing it if needed
+        void setupPlanes(const image::ConvexRoi & area);
 
 			private:
 				double normCoeff;
@@ -90,10 +114,10 @@ namespace jafar{
 				int nConvCoeffs;
 				bool nConvCoeffsCenter;
 
-				HQuickData** int_upLeft;
-				HQuickData** int_upRight;
-				HQuickData** int_downLeft;
-				HQuickData** int_downRight;
+				int* int_upLeft; // offsets of the integral image corners, for each coeff
+				int* int_upRight;
+				int* int_downLeft;
+				int* int_downRight;
 		};
 	}
 }
@@ -12,8 +12,11 @@
 #include "image/Image.hpp"
 #include "rtslam/rawAbstract.hpp"
 #include "boost/shared_ptr.hpp"
+#include <vector>
+#include <boost/thread/mutex.hpp>
 //#include "fdetect/HarrisDetector.hpp"
 #include "rtslam/quickHarrisDetector.hpp"
+#include "rtslam/zncc.hpp"
 
 namespace jafar {
 	namespace rtslam {
@@ -41,6 +44,44 @@ namespace jafar {
 
 				void setJafarImage(jafarImage_ptr_t img) ;
 
+				/**
+				 * Get a level of the image pyramid.
+				 * Level 0 is img, and each level is half the size of the previous one.
+				 * The levels are built on first use and shared by all the observations of the frame.
+				 * They are rebuilt when the image or its timestamp change, because the hardware
+				 * sensors reuse their RawImage objects for the next frames.
+				 * The level is returned by pointer, so that it stays valid when another thread
+				 * makes the cache rebuild it for a new frame.
+				 * \param level the pyramid level, the image must be at least 2^level pixels wide and high.
+				 */
+				jafarImage_ptr_t pyramidLevel(unsigned level);
+
+				/**
+				 * Get the integral images of a level of the image pyramid, for zncc matching.
+				 * They are built on first use and cached like the pyramid levels, and returned
+				 * by pointer for the same reason.
+				 */
+				boost::shared_ptr<const zncc::IntegralImage> integralImage(unsigned level = 0);
+
+				/**
+				 * Downsample a gray level image by 2, each pixel of dst is the mean of a 2x2 block of src.
+				 * \param src the source image
+				 * \param dst the result, its size gives the part of src that is used (at most half the size of src)
+				 */
+				static void halfSample(const image::Image & src, image::Image & dst);
+
+			private:
+				std::vector<jafarImage_ptr_t> pyramid; ///< levels 1 and above
+				std::vector<boost::shared_ptr<zncc::IntegralImage> > integrals; ///< integral images of each level
+				const unsigned char* cache_data; ///< data of img when the cache was built
+				double cache_timestamp; ///< timestamp when the cache was built
+				boost::mutex cache_mutex;
+
+				/// clear the pyramid and the integral images if the image changed, cache_mutex must be locked
+				void checkCache();
+				/// pyramid level, cache_mutex must be locked
+				const jafarImage_ptr_t & buildPyramidLevel(unsigned level);
+
 		};
 	}
 }
@@ -15,11 +15,17 @@
 #define RAWPROCESSORS_HPP_
 
 
+#include <limits>
+#include <boost/thread/mutex.hpp>
+
 #include "correl/explorer.hpp"
+#include "kernel/timingTools.hpp"
 #include "rtslam/quickHarrisDetector.hpp"
 
 
 #include "rtslam/rawImage.hpp"
+#include "rtslam/zncc.hpp"
+#include "rtslam/simd.hpp"
 #include "rtslam/sensorPinhole.hpp"
 #include "rtslam/descriptorImagePoint.hpp"
 
@@ -28,6 +34,27 @@
 namespace jafar {
 namespace rtslam {
 
+	/**
+		Zncc matcher of image points.
+		
+		Large search regions can be matched coarse-to-fine (see setCoarseToFine()):
+		the region is first searched at a lower level of the image pyramid with a
+		downsampled patch, and the result is refined at full resolution in a small
+		region around it.
+		
+		Two zncc engines are available: the correl module one, and the rtslam one
+		(zncc::match()) that takes the window statistics from the integral images
+		cached in the RawImage, and the patch statistics from the appearance.
+		
+		Landmarks matched in the previous frame can be pre-tracked (see track()):
+		the patch observed in the previous frame is found with a fast sad search,
+		and zncc is only evaluated around it.
+		
+		With the rtslam engine, match() and track() can be called from several threads at
+		once on different observations: the counters are updated under a lock, and the image
+		caches are protected by the RawImage. The correl matcher is a single shared object
+		that is not known to be reentrant, so the matches are serial with the correl engine.
+	*/
 	class ImagePointZnccMatcher
 	{
 		private:
@@ -43,7 +70,134 @@ namespace rtslam {
 				double relevanceTh; ///< Mahalanobis distance for no information rejection
 				double measStd;       ///<       measurement noise std deviation
 				double measVar;       ///<       measurement noise variance
+				int coarseMinArea;    ///<    search regions larger than this # of pixels are matched coarse-to-fine (0 = never)
+				int coarseMaxLevel;   ///<   lowest pyramid level used for coarse-to-fine matching
+				int engine;           ///<           zncc engine, see engine_t
+				bool preTrack;        ///<        search landmarks matched in the previous frame with sad first
 			} params;
+			
+			typedef enum {
+				ENGINE_CORREL,  ///< correl::FastTranslationMatcherZncc
+				ENGINE_INTEGRAL ///< zncc::match() with integral images
+			} engine_t;
+			
+			/// matching statistics
+			struct MatchCounters {
+				unsigned n_matches;   ///< number of matches
+				unsigned n_coarse;    ///< number of coarse-to-fine matches
+				unsigned n_fallbacks; ///< number of coarse-to-fine matches that fell back to full resolution
+				double total_time;    ///< total time of matches, in ms
+				double coarse_time;   ///< total time of coarse-to-fine matches, in ms
+				double max_time;      ///< longest match, in ms
+				unsigned n_tracks;    ///< number of sad pre-tracking attempts
+				unsigned n_track_hits;///< number of pre-tracking attempts that gave the match
+				double track_time;    ///< total time of pre-tracking attempts, in ms, including the ones that failed
+				double track_hit_time;///< total time of the pre-tracking attempts that gave the match, in ms
+				MatchCounters(): n_matches(0), n_coarse(0), n_fallbacks(0), total_time(0.), coarse_time(0.), max_time(0.),
+					n_tracks(0), n_track_hits(0), track_time(0.), track_hit_time(0.) {}
+				/// time saved by pre-tracking, compared to the mean time of full searches, in ms
+				double trackTimeSaved() const
+				{
+					unsigned n_full = n_matches - n_track_hits;
+					if (n_full == 0) return 0.;
+					return n_track_hits * (total_time - track_hit_time) / n_full - track_time;
+				}
+			};
+		
+		private:
+			MatchCounters counters;
+			boost::mutex counters_mutex;
+			
+			/// size of the half size patch, that must be odd
+			static int halfOddSize(int size) { int half = size / 2; return (half % 2 ? half : half-1); }
+			
+			/// match a patch with the selected engine in a level of the image pyramid
+			double matchIn(RawImage & raw, unsigned level, const image::Image & patch, unsigned int patchSum, unsigned int patchSquareSum,
+				const image::ConvexRoi & roi, double & x, double & y, double & std_x, double & std_y)
+			{
+				if (params.engine == ENGINE_INTEGRAL)
+					return zncc::match(patch, patchSum, patchSquareSum, *raw.pyramidLevel(level), *raw.integralImage(level),
+						cv::Rect(roi.x(), roi.y(), roi.w(), roi.h()), x, y, std_x, std_y);
+				else
+					return matcher.match(patch, *raw.pyramidLevel(level), roi, x, y, std_x, std_y);
+			}
+			
+			/**
+				Search the roi at a lower resolution, and refine around the result at full resolution.
+				\return false if the coarse search failed, and nothing was matched.
+			*/
+			bool matchCoarseToFine(RawImage & raw, const AppearanceImagePoint & app, const image::ConvexRoi & roi, Measurement & measure)
+			{
+				const image::Image & patch = app.patch;
+				// choose the level so that the coarse roi is not larger than coarseMinArea, with a patch of at least 5 pixels
+				int level = 0, area = roi.count(), patchSize = std::min(patch.width(), patch.height());
+				while (level < params.coarseMaxLevel && area > params.coarseMinArea && halfOddSize(patchSize) >= 5)
+					{ ++level; area /= 4; patchSize = halfOddSize(patchSize); }
+				if (level == 0) return false;
+				
+				jafarImage_ptr_t coarsePatch;
+				for (int l = 0; l < level; ++l)
+				{
+					const image::Image & src = (l == 0 ? patch : *coarsePatch);
+					jafarImage_ptr_t half(new image::Image(halfOddSize(src.width()), halfOddSize(src.height()), src.depth(), src.colorSpace()));
+					RawImage::halfSample(src, *half);
+					coarsePatch = half;
+				}
+				
+				int scale = 1 << level;
+				cv::Rect roiRect(roi.x(), roi.y(), roi.w(), roi.h());
+				image::ConvexRoi coarseRoi(cv::Rect((int)floor(roi.x() / (double)scale), (int)floor(roi.y() / (double)scale),
+					roi.w() / scale + 1, roi.h() / scale + 1));
+				unsigned int coarseSum, coarseSquareSum;
+				zncc::patchSums(*coarsePatch, coarseSum, coarseSquareSum);
+				double x, y, std_x, std_y;
+				double score = matchIn(raw, level, *coarsePatch, coarseSum, coarseSquareSum, coarseRoi, x, y, std_x, std_y);
+				if (score < params.threshold) return false;
+				
+				// the coarse position is known within one coarse pixel, plus one pixel of patch alignment
+				int radius = scale + 1;
+				cv::Rect fineRect = cv::Rect((int)(x*scale) - radius, (int)(y*scale) - radius, 2*radius+1, 2*radius+1) & roiRect;
+				if (fineRect.width <= 0 || fineRect.height <= 0) return false;
+				image::ConvexRoi fineRoi(fineRect);
+				measure.matchScore = matchIn(raw, 0, patch, app.patchSum, app.patchSquareSum, fineRoi,
+					measure.x()(0), measure.x()(1), measure.std_est(0), measure.std_est(1));
+				return true;
+			}
+			
+			/**
+				Search the center of a patch in a rectangle of the image, with the sum of absolute differences.
+				The rows of each position are accumulated until they exceed the best sum.
+				\return false if the rectangle has no position where the patch is inside the image.
+			*/
+			static bool searchSad(const image::Image & img, const image::Image & patch, const cv::Rect & rect, int & xBest, int & yBest)
+			{
+				int w = patch.width(), h = patch.height(), hw = (w-1)/2, hh = (h-1)/2;
+				int xMin = std::max(rect.x, hw), xMax = std::min(rect.x + rect.width, img.width() - w + hw + 1);
+				int yMin = std::max(rect.y, hh), yMax = std::min(rect.y + rect.height, img.height() - h + hh + 1);
+				if (xMin >= xMax || yMin >= yMax) return false;
+				unsigned int best = std::numeric_limits<unsigned int>::max();
+				for (int yc = yMin; yc < yMax; ++yc)
+					for (int xc = xMin; xc < xMax; ++xc)
+					{
+						const unsigned char * pix = img.data() + (yc - hh) * img.step() + xc - hw;
+						unsigned int sum = 0;
+						for (int i = 0; i < h && sum < best; ++i)
+							sum += simd::sad(pix + i * img.step(), patch.data() + i * patch.step(), w);
+						if (sum < best) { best = sum; xBest = xc; yBest = yc; }
+					}
+				return true;
+			}
+			
+			/// add the patch offset to the measure, and extract the observed appearance at the measured position
+			void fillObserved(const boost::shared_ptr<RawImage> & rawPtr, const AppearanceImagePoint & targetApp, Measurement & measure, AppearanceImagePoint & app)
+			{
+				measure.x() += targetApp.offset.x();
+				measure.P() += targetApp.offset.P(); // no cross terms
+				rawPtr->img->extractPatch(app.patch, (int)measure.x()(0), (int)measure.x()(1), app.patch.width(), app.patch.height());
+				app.offset.x()(0) = measure.x()(0) - ((int)(measure.x()(0)) + 0.5);
+				app.offset.x()(1) = measure.x()(1) - ((int)(measure.x()(1)) + 0.5);
+				app.offset.P() = measure.P();
+			}
 
 		public:
 			ImagePointZnccMatcher(double minScore, double partialPosition, int patchSize, int maxSearchSize, double lowInnov, double threshold, double mahalanobisTh, double relevanceTh, double measStd):
@@ -59,6 +213,94 @@ namespace rtslam {
 				params.relevanceTh = relevanceTh;
 				params.measStd = measStd;
 				params.measVar = measStd * measStd;
+				params.coarseMinArea = 0;
+				params.coarseMaxLevel = 2;
+				params.engine = ENGINE_CORREL;
+				params.preTrack = false;
+			}
+			
+			/**
+				Enable coarse-to-fine matching.
+				\param minArea search regions larger than this # of pixels are matched coarse-to-fine (0 = never)
+				\param maxLevel lowest pyramid level used
+			*/
+			void setCoarseToFine(int minArea, int maxLevel = 2)
+				{ params.coarseMinArea = minArea; params.coarseMaxLevel = maxLevel; }
+			const MatchCounters & matchCounters() const { return counters; }
+			void setEngine(engine_t engine) { params.engine = engine; }
+			void setPreTracking(bool enable) { params.preTrack = enable; }
+			/// match() and track() can run concurrently on different observations, with the rtslam engine only
+			bool isThreadSafe() const { return params.engine == ENGINE_INTEGRAL; }
+			
+			/**
+				Build the image caches that the matches of a new frame will use, before the matches
+				and concurrently with the other sensors, instead of in the first match that needs them.
+			*/
+			void prepare(const boost::shared_ptr<RawImage> & rawPtr)
+			{
+				if (params.engine == ENGINE_INTEGRAL) rawPtr->integralImage(0);
+				if (params.coarseMinArea > 0)
+					for (int level = 1; level <= params.coarseMaxLevel; ++level)
+						if (params.engine == ENGINE_INTEGRAL) rawPtr->integralImage(level); else rawPtr->pyramidLevel(level);
+			}
+			/// prepare() only builds caches of the raw, so it can run on the next raw during the matches of the current one
+			bool canPrepareAhead() const { return true; }
+			
+			/**
+				Pre-tracking of a landmark that was matched in the previous frame.
+				The patch observed in the previous frame is searched in the roi with the sum of
+				absolute differences, and the predicted patch is then matched with zncc in the 3x3
+				window around the best position only.
+				\param prevApp the appearance observed in the previous frame, it can be the same object as app
+				\return true if the zncc score passes the threshold, else nothing is measured
+				and the full match() must be used.
+			*/
+			bool track(const boost::shared_ptr<RawImage> & rawPtr, const appearance_ptr_t & prevApp, const appearance_ptr_t & targetApp, const image::ConvexRoi & roi, Measurement & measure, appearance_ptr_t & app)
+			{
+				if (!params.preTrack) return false;
+				app_img_pnt_ptr_t prevAppSpec = SPTR_CAST<AppearanceImagePoint>(prevApp);
+				app_img_pnt_ptr_t targetAppSpec = SPTR_CAST<AppearanceImagePoint>(targetApp);
+				app_img_pnt_ptr_t appSpec = SPTR_CAST<AppearanceImagePoint>(app);
+				
+				kernel::Chrono chrono;
+				cv::Rect roiRect(roi.x(), roi.y(), roi.w(), roi.h());
+				int x0, y0;
+				bool found = searchSad(*rawPtr->img, prevAppSpec->patch, roiRect, x0, y0);
+				if (found)
+				{
+					if (params.engine == ENGINE_INTEGRAL) targetAppSpec->computePatchIntegrals();
+					image::ConvexRoi window(cv::Rect(x0-1, y0-1, 3, 3) & roiRect);
+					double x, y, std_x, std_y;
+					double score = matchIn(*rawPtr, 0, targetAppSpec->patch, targetAppSpec->patchSum, targetAppSpec->patchSquareSum,
+						window, x, y, std_x, std_y);
+					found = (score > params.threshold);
+					if (found)
+					{
+						measure.std(params.measStd);
+						measure.matchScore = score;
+						measure.x()(0) = x; measure.x()(1) = y;
+						measure.std_est(0) = std_x; measure.std_est(1) = std_y;
+					}
+				}
+				double time = chrono.elapsed();
+				{
+					boost::unique_lock<boost::mutex> lock(counters_mutex);
+					counters.n_tracks++;
+					counters.track_time += time;
+					if (found)
+					{
+						counters.n_matches++;
+						counters.n_track_hits++;
+						counters.total_time += time;
+						counters.track_hit_time += time;
+						if (time > counters.max_time) counters.max_time = time;
+					}
+				}
+				if (!found) return false;
+				
+				measure.matchTime = time;
+				fillObserved(rawPtr, *targetAppSpec, measure, *appSpec);
+				return true;
 			}
 
 			void match(const boost::shared_ptr<RawImage> & rawPtr, const appearance_ptr_t & targetApp, const image::ConvexRoi & roi, Measurement & measure, appearance_ptr_t & app)
@@ -66,15 +308,28 @@ namespace rtslam {
 				app_img_pnt_ptr_t targetAppSpec = SPTR_CAST<AppearanceImagePoint>(targetApp);
 				app_img_pnt_ptr_t appSpec = SPTR_CAST<AppearanceImagePoint>(app);
 				
+				kernel::Chrono chrono;
 				measure.std(params.measStd);
-				measure.matchScore = matcher.match(targetAppSpec->patch, *(rawPtr->img),
-					roi, measure.x()(0), measure.x()(1), measure.std_est(0), measure.std_est(1));
-				measure.x() += targetAppSpec->offset.x();
-				measure.P() += targetAppSpec->offset.P(); // no cross terms
-				rawPtr->img->extractPatch(appSpec->patch, (int)measure.x()(0), (int)measure.x()(1), appSpec->patch.width(), appSpec->patch.height());
-				appSpec->offset.x()(0) = measure.x()(0) - ((int)(measure.x()(0)) + 0.5);
-				appSpec->offset.x()(1) = measure.x()(1) - ((int)(measure.x()(1)) + 0.5);
-				appSpec->offset.P() = measure.P();
+				// the predicted patch is written by the descriptor, so its statistics are computed here, once per match
+				if (params.engine == ENGINE_INTEGRAL) targetAppSpec->computePatchIntegrals();
+				bool coarse = (params.coarseMinArea > 0 && roi.count() > params.coarseMinArea);
+				bool fallback = false;
+				if (!coarse || !matchCoarseToFine(*rawPtr, *targetAppSpec, roi, measure))
+				{
+					measure.matchScore = matchIn(*rawPtr, 0, targetAppSpec->patch, targetAppSpec->patchSum, targetAppSpec->patchSquareSum,
+						roi, measure.x()(0), measure.x()(1), measure.std_est(0), measure.std_est(1));
+					fallback = coarse;
+				}
+				measure.matchTime = chrono.elapsed();
+				{
+					boost::unique_lock<boost::mutex> lock(counters_mutex);
+					counters.n_matches++;
+					counters.total_time += measure.matchTime;
+					if (coarse) { counters.n_coarse++; counters.coarse_time += measure.matchTime; }
+					if (fallback) counters.n_fallbacks++;
+					if (measure.matchTime > counters.max_time) counters.max_time = measure.matchTime;
+				}
+				fillObserved(rawPtr, *targetAppSpec, measure, *appSpec);
 			}
 	};
 
@@ -106,23 +361,47 @@ namespace rtslam {
 				params.measVar = measStd * measStd;
 			}
 
+		private:
+			void extractAppearance(const boost::shared_ptr<RawImage> & rawData, const boost::shared_ptr<FeatureImagePoint> & featPtr)
+			{
+				vec pix = featPtr->measurement.x();
+				boost::shared_ptr<AppearanceImagePoint> appPtr = SPTR_CAST<AppearanceImagePoint>(featPtr->appearancePtr);
+				rawData->img->extractPatch(appPtr->patch, (int)pix(0), (int)pix(1), params.patchSize, params.patchSize);
+				appPtr->offset.x()(0) = pix(0) - ((int)pix(0) + 0.5);
+				appPtr->offset.x()(1) = pix(1) - ((int)pix(1) + 0.5);
+				appPtr->offset.P() = jblas::zero_mat(2); // by definition this is our landmark projection
+			}
+
+		public:
 			bool detect(const boost::shared_ptr<RawImage> & rawData, const image::ConvexRoi &roi, boost::shared_ptr<FeatureImagePoint> & featPtr)
 			{
 				featPtr.reset(new FeatureImagePoint(params.patchSize, params.patchSize, CV_8U));
 				featPtr->measurement.std(params.measStd);
 				if (detector.detectIn(*(rawData->img.get()), featPtr, &roi))
 				{
-					// extract appearance
-					vec pix = featPtr->measurement.x();
-					boost::shared_ptr<AppearanceImagePoint> appPtr = SPTR_CAST<AppearanceImagePoint>(featPtr->appearancePtr);
-					rawData->img->extractPatch(appPtr->patch, (int)pix(0), (int)pix(1), params.patchSize, params.patchSize);
-					appPtr->offset.x()(0) = pix(0) - ((int)pix(0) + 0.5);
-					appPtr->offset.x()(1) = pix(1) - ((int)pix(1) + 0.5);
-					appPtr->offset.P() = jblas::zero_mat(2); // by definition this is our landmark projection
-
+					extractAppearance(rawData, featPtr);
 					return true;
 				} else return false;
 			}
+
+			/**
+				Detect the best point of several rois, in one sweep of the Harris detector.
+				\param featPtrs the features, one per roi, null where nothing was found
+			*/
+			void detect(const boost::shared_ptr<RawImage> & rawData, const std::vector<image::ConvexRoi> & rois, std::vector<boost::shared_ptr<FeatureImagePoint> > & featPtrs)
+			{
+				featPtrs.resize(rois.size());
+				for (size_t k = 0; k < rois.size(); ++k)
+				{
+					featPtrs[k].reset(new FeatureImagePoint(params.patchSize, params.patchSize, CV_8U));
+					featPtrs[k]->measurement.std(params.measStd);
+				}
+				std::vector<feat_img_pnt_ptr_t> feats(featPtrs.begin(), featPtrs.end());
+				std::vector<bool> found;
+				detector.detectIn(*(rawData->img.get()), rois, feats, found);
+				for (size_t k = 0; k < rois.size(); ++k)
+					if (found[k]) extractAppearance(rawData, featPtrs[k]); else featPtrs[k].reset();
+			}
 			
 			void fillDataObs(const boost::shared_ptr<FeatureImagePoint> & featPtr, boost::shared_ptr<ObservationAbstract> & obsPtr)
 			{
@@ -290,13 +290,29 @@ namespace rtslam {
             params.measStd = measStd;
          }
 
+         /// the preprocessed image is built by the first match of each frame, so matches must run one at a time
+         bool isThreadSafe() const { return false; }
+
+         /// preprocess the image for the matches of a new frame, before the matches and concurrently with the other sensors
+         void prepare(const boost::shared_ptr<RawImage> & rawPtr)
+         {
+            if(rawPtr != lastDsegImage.lock())
+            {
+               matcher.preprocessImage(*(rawPtr->img),preprocDsegImage);
+               lastDsegImage = rawPtr;
+            }
+         }
+
+         /// the preprocessed image belongs to the matcher, so it cannot be built during the matches of the previous frame
+         bool canPrepareAhead() const { return false; }
+
+         /// no pre-tracking of segments, match() is always used
+         bool track(const boost::shared_ptr<RawImage> & rawPtr, const appearance_ptr_t & prevApp, const appearance_ptr_t & targetApp, const image::ConvexRoi & roi, Measurement & measure, appearance_ptr_t & app)
+            { return false; }
+
          void match(const boost::shared_ptr<RawImage> & rawPtr, const appearance_ptr_t & targetApp, const image::ConvexRoi & roi, Measurement & measure, appearance_ptr_t & app)
 			{
-				if(rawPtr != lastDsegImage.lock())
-				{
-					matcher.preprocessImage(*(rawPtr->img),preprocDsegImage);
-					lastDsegImage = rawPtr;
-				}
+				prepare(rawPtr);
 
 				app_img_seg_ptr_t targetAppSpec = SPTR_CAST<AppearanceImageSegment>(targetApp);
 				app_img_seg_ptr_t appSpec = SPTR_CAST<AppearanceImageSegment>(app);
@@ -385,6 +401,14 @@ namespace rtslam {
             params.measVar = measStd * measStd;
          }
 
+			/// detect in several rois, one by one ; featPtrs are null where nothing was found
+			void detect(const boost::shared_ptr<RawImage> & rawData, const std::vector<image::ConvexRoi> & rois, std::vector<boost::shared_ptr<FeatureImageSegment> > & featPtrs)
+			{
+				featPtrs.resize(rois.size());
+				for (size_t k = 0; k < rois.size(); ++k)
+					if (!detect(rawData, rois[k], featPtrs[k])) featPtrs[k].reset();
+			}
+
 			bool detect(const boost::shared_ptr<RawImage> & rawData, const image::ConvexRoi &roi, boost::shared_ptr<FeatureImageSegment> & featPtr)
          {
             bool ret = false;
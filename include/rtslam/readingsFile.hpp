@@ -0,0 +1,110 @@
+/**
+ * \file readingsFile.hpp
+ *
+ * Bulk loading of the text logs of readings of the proprioceptive sensors, for replay.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef READINGSFILE_HPP_
+#define READINGSFILE_HPP_
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+
+#include <boost/thread/thread.hpp>
+
+namespace jafar {
+namespace rtslam {
+namespace hardware {
+
+/**
+	Header of the cache of a readings log, written next to it as <log>.cache.
+
+	It is followed by the values of all the readings, row after row, in the byte order of
+	the machine that wrote it. The cache is only used if the size and the modification
+	date of the text log are the ones recorded in the header.
+*/
+struct ReadingsCacheHeader
+{
+	char magic[8]; ///< "RTSLRDG1"
+	uint32_t n_columns;
+	uint32_t reserved;
+	uint64_t n_rows;
+	uint64_t text_size; ///< size of the text log
+	int64_t text_mtime; ///< modification date of the text log
+	char reserved2[24];
+};
+
+/**
+	Load a whole log of readings, as written by the preload tasks in dump mode: one reading
+	per line, either in the ublas format "[n](v0,v1,...)" or as numbers separated by spaces.
+
+	The text is mapped and parsed without streams, then the values are written to the cache
+	<log>.cache so that the next replays of the same log only read binary values. Lines that
+	do not have the expected number of values, such as an incomplete last line, are skipped.
+
+	The load can run in a background thread (loadInBackground()), so that the logs of
+	several sensors are read at the same time, while the rest of the slam is set up.
+
+	\ingroup rtslam
+*/
+class ReadingsFileReader
+{
+	public:
+		ReadingsFileReader(): n_columns(0), n_skipped(0), load_time(0.), from_cache(false), loaded(false), load_thread(NULL) {}
+		~ReadingsFileReader() { wait(); }
+
+		/**
+			Load the log, from its cache when it is valid.
+			\param n_columns the number of values of a reading
+			\param use_cache read and write the cache
+			\return false if the log cannot be read
+		*/
+		bool load(const std::string & path, unsigned n_columns, bool use_cache = true);
+		/// start load() in a background thread
+		void loadInBackground(const std::string & path, unsigned n_columns, bool use_cache = true);
+		/// wait for the end of the background load, \return the result of load()
+		bool wait();
+
+		size_t rows() const { return n_columns ? values.size() / n_columns : 0; }
+		unsigned columns() const { return n_columns; }
+		const double* row(size_t k) const { return &values[k * n_columns]; }
+		/// number of lines that did not have the expected number of values
+		unsigned skipped() const { return n_skipped; }
+		/// ms spent in load()
+		double loadTime() const { return load_time; }
+		/// the values were read from the cache
+		bool fromCache() const { return from_cache; }
+		/// the number of readings, the load time and where they were read from
+		friend std::ostream& operator <<(std::ostream & s, ReadingsFileReader const & reader);
+
+	private:
+		std::vector<double> values;
+		unsigned n_columns;
+		unsigned n_skipped;
+		double load_time;
+		bool from_cache;
+		bool loaded;
+		boost::thread *load_thread;
+
+		bool loadCache(const std::string & cache_path, uint64_t text_size, int64_t text_mtime);
+		void saveCache(const std::string & cache_path, uint64_t text_size, int64_t text_mtime);
+		bool parseText(const char *begin, const char *end);
+		void backgroundLoad(std::string path, unsigned n_columns, bool use_cache) { load(path, n_columns, use_cache); }
+};
+
+/**
+	Parse a decimal number in [p, end), with the syntax of strtod.
+	When the significant digits fit in the mantissa of a double and the decimal exponent is
+	at most 22, the number is converted with a single exact floating point operation, else
+	by strtod, so that the result is always the correctly rounded value.
+	\return the end of the number, or p if there is no number at p
+*/
+const char* parseReadingValue(const char *p, const char *end, double & value);
+
+}}}
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * \file ringBuffer.hpp
+ *
+ * Read and write positions of the ring buffers of hardware sensors.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef RINGBUFFER_HPP_
+#define RINGBUFFER_HPP_
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace jafar {
+namespace rtslam {
+namespace hardware {
+
+/**
+	Positions of a ring buffer with one writer (producer) thread and one
+	reader (consumer) thread, without lock.
+
+	The storage itself is not managed here, only the positions: the writer
+	fills the slot writePos() and then calls commitWrite() ; the reader gets the
+	slots between firstUnreadPos() and lastUnreadPos(), and gives them back
+	with releaseUntil() or release().
+
+	Both counters run in [0, 2*size), so that a full buffer (size slots between
+	the counters) is not confused with an empty one, and they are each written
+	by one thread only.
+	Committing a write has release semantics and checking for data has acquire
+	semantics, so that the reader sees the slot content written before the commit ;
+	and conversely for releasing slots and checking that the buffer is full.
+
+	Methods are split between writer and reader side, and each must only be
+	called from its own thread.
+
+	@ingroup rtslam
+*/
+class RingIndexSpsc
+{
+	private:
+		const int size_;
+		boost::atomic<int> write_count; /// next slot to write, modified by the writer only
+		boost::atomic<int> read_count;  /// oldest slot not released, modified by the reader only
+		bool read_used; /// the slot read_count is being used, reader only
+
+		int pos(int count) const { return (count < size_ ? count : count - size_); }
+		int next(int count) const { return (count+1 == 2*size_ ? 0 : count+1); }
+		int dist(int to, int from) const { return (to >= from ? to - from : to - from + 2*size_); }
+		/**
+			Count of position id, among the written slots that are not released.
+			@return false if id is not one of them: it was released, or is not written yet
+		*/
+		bool countOf(int id, int & count) const
+		{
+			int r = read_count.load(boost::memory_order_relaxed);
+			int w = write_count.load(boost::memory_order_acquire);
+			int d = (id >= pos(r) ? id - pos(r) : id - pos(r) + size_);
+			if (d < 0 || d >= dist(w, r)) return false;
+			count = r + d;
+			if (count >= 2*size_) count -= 2*size_;
+			return true;
+		}
+
+	public:
+		RingIndexSpsc(int size): size_(size), write_count(0), read_count(0), read_used(false) {}
+		int size() const { return size_; }
+
+		// writer side
+		bool isFull() const
+			{ return dist(write_count.load(boost::memory_order_relaxed), read_count.load(boost::memory_order_acquire)) == size_; }
+		/// same as isFull(), as part of a sequentially consistent handshake with the reader (see HardwareSensorAbstract::waitWhileFull)
+		bool isFullSeqCst() const
+			{ return dist(write_count.load(boost::memory_order_relaxed), read_count.load(boost::memory_order_seq_cst)) == size_; }
+		int writePos() const { return pos(write_count.load(boost::memory_order_relaxed)); }
+		void commitWrite() { write_count.store(next(write_count.load(boost::memory_order_relaxed)), boost::memory_order_release); }
+
+		// reader side
+		int readPos() const { return pos(read_count.load(boost::memory_order_relaxed)); }
+		/// position after the last committed slot
+		int writtenPos() const { return pos(write_count.load(boost::memory_order_acquire)); }
+		bool isEmpty() const
+		{
+			int r = read_count.load(boost::memory_order_relaxed);
+			if (read_used) r = next(r);
+			return (write_count.load(boost::memory_order_acquire) == r);
+		}
+		int firstUnreadPos() const
+		{
+			/// \warning check that buffer is not empty before
+			int r = readPos();
+			if (!read_used) return r;
+			return (r+1 == size_ ? 0 : r+1);
+		}
+		int lastUnreadPos() const
+		{
+			/// \warning check that buffer is not empty before
+			int w = writtenPos();
+			return (w == 0 ? size_-1 : w-1);
+		}
+		/**
+			Move the oldest slot not released to id, leaving its used status unchanged.
+			id must be a written slot that is not released, else nothing is changed.
+		*/
+		void setReadPos(int id) { int c; if (countOf(id, c)) read_count.store(c, boost::memory_order_seq_cst); }
+		/// release until id, excluding id
+		void releaseUntil(int id) { int c; if (countOf(id, c)) { read_used = true; read_count.store(c, boost::memory_order_seq_cst); } }
+		/// release until id, including id
+		void release(int id) { int c; if (countOf(id, c)) { read_used = false; read_count.store(next(c), boost::memory_order_seq_cst); } }
+};
+
+
+/**
+	Same as RingIndexSpsc, with all positions protected by a mutex.
+	This is how hardware sensors used to share their ring buffer, and it is
+	kept as a reference to check and benchmark the lock-free version.
+
+	@ingroup rtslam
+*/
+class RingIndexLocked
+{
+	private:
+		const int size_;
+		int write_pos; /// next position where to write, oldest available reading
+		int read_pos;  /// oldest position not released (being read or not read at all)
+		bool buffer_full; /// when read_pos = write_pos, tells whether the buffer is full or empty
+		bool read_pos_used;  /// current read_pos is being used
+		mutable boost::mutex mutex;
+
+		int firstUnreadPosLocked() const
+		{
+			if (!read_pos_used) return read_pos;
+			return (read_pos != size_-1 ? read_pos+1 : 0);
+		}
+
+	public:
+		RingIndexLocked(int size): size_(size), write_pos(0), read_pos(0), buffer_full(false), read_pos_used(false) {}
+		int size() const { return size_; }
+
+		// writer side
+		bool isFull() const
+			{ boost::unique_lock<boost::mutex> l(mutex); return (read_pos == write_pos && buffer_full); }
+		bool isFullSeqCst() const { return isFull(); }
+		int writePos() const { return write_pos; }
+		void commitWrite()
+		{
+			boost::unique_lock<boost::mutex> l(mutex);
+			++write_pos;
+			if (write_pos >= size_) write_pos = 0;
+			if (write_pos == read_pos) buffer_full = true;
+		}
+
+		// reader side
+		int readPos() const { return read_pos; }
+		int writtenPos() const { boost::unique_lock<boost::mutex> l(mutex); return write_pos; }
+		bool isEmpty() const
+			{ boost::unique_lock<boost::mutex> l(mutex); return (firstUnreadPosLocked() == write_pos && !buffer_full); }
+		int firstUnreadPos() const { boost::unique_lock<boost::mutex> l(mutex); return firstUnreadPosLocked(); }
+		int lastUnreadPos() const
+			{ boost::unique_lock<boost::mutex> l(mutex); return (write_pos == 0 ? size_-1 : write_pos-1); }
+		void setReadPos(int id) { boost::unique_lock<boost::mutex> l(mutex); read_pos = id; }
+		void releaseUntil(int id)
+		{
+			boost::unique_lock<boost::mutex> l(mutex);
+			read_pos = id;
+			read_pos_used = true;
+			if (firstUnreadPosLocked() == write_pos) buffer_full = false;
+		}
+		void release(int id)
+		{
+			boost::unique_lock<boost::mutex> l(mutex);
+			read_pos = (id != size_-1 ? id+1 : 0);
+			if (write_pos == read_pos) buffer_full = false;
+			read_pos_used = false;
+		}
+};
+
+}}}
+
+#endif
@@ -17,6 +17,7 @@
 #include "kernel/jafarDebug.hpp"
 #include "kernel/IdFactory.hpp"
 #include "kernel/dataLog.hpp"
+#include "rtslam/binaryLogger.hpp"
 #include "kernel/timingTools.hpp"
 #include "jmath/jblas.hpp"
 
@@ -44,7 +45,7 @@ namespace jafar {
 		 * \ingroup rtslam
 		 */
 		class RobotAbstract: public MapObject, public ChildOf<MapAbstract> , public boost::enable_shared_from_this<
-		    RobotAbstract>, public ParentOf<SensorAbstract>, public kernel::DataLoggable {
+		    RobotAbstract>, public ParentOf<SensorAbstract>, public Loggable {
 
 				friend ostream& operator <<(ostream & s, RobotAbstract const & rob);
 
@@ -104,6 +105,12 @@ namespace jafar {
 					return "ROBOT";
 				}
 
+				virtual void remapStates(const std::vector<std::size_t> & newIndex) {
+					MapObject::remapStates(newIndex);
+					if (state.storage() == Gaussian::REMOTE)
+						pose.reindex(remapIndices(pose.ia(), newIndex));
+				}
+
 
 				static IdFactory robotIds;
 
@@ -134,6 +141,8 @@ namespace jafar {
 				jblas::mat XNEW_x; ///<         Jacobian wrt state
 				jblas::mat XNEW_pert; ///<      Jacobian wrt perturbation
 				jblas::sym_mat Q; ///<          Process noise covariances matrix in state space, Q = XNEW_pert * perturbation.P * trans(XNEW_pert);
+				jblas::mat PREINT_x; ///<       Jacobian accumulated over the current pre-integration interval
+				jblas::sym_mat PREINT_Q; ///<   Process noise accumulated over the current pre-integration interval
 				
 				jblas::vec origin_sensors; ///< origin to get the initial state position at 0 / absolute sensors
 				jblas::vec origin_export; ///< origin of the exported position in absolute coordinates
@@ -180,7 +189,10 @@ namespace jafar {
 						if (!constantPerturbation)
 							computeStatePerturbation();
 
-						mapPtr()->filterPtr->predict(mapPtr()->ia_used_states(), XNEW_x, state.ia(), Q); // P = F*P*F' + Q
+						if (preintegrating)
+							accumulatePrediction(); // F_acc = F*F_acc ; Q_acc = F*Q_acc*F' + Q
+						else
+							mapPtr()->filterPtr->predictInvariant(mapPtr()->ia_used_complement(state.ia()), XNEW_x, state.ia(), Q); // P = F*P*F' + Q
 					}
 				}
 
@@ -221,6 +233,32 @@ namespace jafar {
 				virtual void move(double time);
 				void move_fake(double time);
 
+				/**
+				 * Enable or disable pre-integration of the motion.
+				 * When enabled, move(double) does not run one filter prediction per reading of the hardware estimator.
+				 * Instead it chains the robot Jacobians and process noises of all the readings between two
+				 * exteroceptive updates, and updates the map covariance with one single prediction.
+				 * The result is numerically equivalent to the per-reading prediction.
+				 */
+				void setPreintegration(bool enable) { preintegration = enable; }
+				bool getPreintegration() const { return preintegration; }
+
+				/**
+				 * Start a pre-integration interval.
+				 * Subsequent calls to move() update the robot state but only accumulate the Jacobian \a PREINT_x
+				 * and the process noise \a PREINT_Q, without touching the map covariances matrix.
+				 */
+				void beginPreintegration();
+				/**
+				 * Close a pre-integration interval.
+				 * It performs the single filter prediction:
+				 * - Pvv <-- PREINT_x * Pvv * PREINT_x' + PREINT_Q
+				 * - Pvm <-- PREINT_x * Pvm
+				 *
+				 * where PREINT_x = F_n*...*F_1 and PREINT_Q = F_n*(...(F_2*Q_1*F_2' + Q_2)...)*F_n' + Q_n.
+				 */
+				void endPreintegration();
+
 				/**
 				 * Compute robot process noise \a Q in state space.
 				 * This function is called by move() at each iteration if constantPerturbation is \b false.
@@ -232,8 +270,8 @@ namespace jafar {
 				void computeStatePerturbation();
 
 
-				virtual void writeLogHeader(kernel::DataLogger& log) const;
-				virtual void writeLogData(kernel::DataLogger& log) const;
+				virtual void logHeader(LogSink & log) const;
+				virtual void logData(LogSink & log) const;
 
 			protected:
 
@@ -272,6 +310,16 @@ namespace jafar {
 				virtual void init_func(const vec & _x, const vec & _u, const vec & _U, vec & _xnew) {}
 				virtual void init_func(const vec & _x, const vec & _u, vec & _xnew) {}
 
+				/**
+				 * Chain the last step Jacobian \a XNEW_x and noise \a Q into \a PREINT_x and \a PREINT_Q.
+				 */
+				void accumulatePrediction();
+
+			private:
+				bool preintegration; ///< pre-integration mode is enabled
+				bool preintegrating; ///< a pre-integration interval is in progress
+				size_t preint_steps; ///< number of steps accumulated in the current interval
+
 
 		};
 
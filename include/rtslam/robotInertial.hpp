@@ -166,8 +166,8 @@ namespace jafar {
 					}
 				}
 
-				virtual void writeLogHeader(kernel::DataLogger& log) const;
-				virtual void writeLogData(kernel::DataLogger& log) const;
+				virtual void logHeader(LogSink & log) const;
+				virtual void logData(LogSink & log) const;
 
 			protected:
 				/**
@@ -113,8 +113,8 @@ namespace jafar {
 					return size_perturbation();
 				}
 				
-				virtual void writeLogHeader(kernel::DataLogger& log) const;
-				virtual void writeLogData(kernel::DataLogger& log) const;
+				virtual void logHeader(LogSink & log) const;
+				virtual void logData(LogSink & log) const;
 				
 
 			protected:
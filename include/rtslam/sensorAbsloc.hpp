@@ -65,6 +65,11 @@ namespace jafar {
 					inns(0), dats(0), absolute(absolute), first(true)
 				{}
 				~SensorAbsloc() { delete innovation; delete measurement; }
+
+				virtual void remapStates(const std::vector<std::size_t> & newIndex) {
+					SensorProprioAbstract::remapStates(newIndex);
+					ia_rs = remapIndices(ia_rs, newIndex);
+				}
 				virtual void setHardwareSensor(hardware::hardware_sensorprop_ptr_t hardwareSensorPtr_)
 				{
 					hardwareSensorPtr = hardwareSensorPtr_;
@@ -268,7 +273,7 @@ namespace jafar {
 						INN_rs = -EXP_rs;
 
 						map_ptr_t mapPtr = robotPtr()->mapPtr();
-						ind_array ia_x = mapPtr->ia_used_states();
+						const ind_array & ia_x = mapPtr->ia_used_states();
 						mapPtr->filterPtr->correct(ia_x,*innovation,INN_rs,ia_rs);
 					}
 
@@ -25,6 +25,7 @@
 #include "rtslam/mapObject.hpp"
 #include "rtslam/robotAbstract.hpp"
 #include "rtslam/hardwareSensorAbstract.hpp"
+#include "rtslam/framePipeline.hpp"
 #include <boost/smart_ptr.hpp>
 
 namespace jafar {
@@ -79,6 +80,7 @@ namespace jafar {
 				virtual int queryAvailableRaws(RawInfos &infos) = 0; ///< get information about the available raws and the estimated dates for next one
 				virtual int queryNextAvailableRaw(RawInfo &info) = 0; ///< get information about the next available raw
 				virtual double getRawTimestamp(unsigned id) = 0;
+				virtual double getRawArrival(unsigned id) = 0; ///< the arrival date of an unread or the last processed raw
 				virtual void process(unsigned id) = 0; ///< process the given raw and throw away the previous unprocessed ones \return innovation
 				virtual void process_fake(unsigned id) = 0; ///< don't do any predict or update, but let the data acquisition run smoothly
 				virtual void discard(unsigned id) = 0; ///< discard a data without using it
@@ -95,6 +97,13 @@ namespace jafar {
 					return "SENSOR";
 				}
 
+				virtual void remapStates(const std::vector<std::size_t> & newIndex) {
+					MapObject::remapStates(newIndex);
+					if (isInFilter)
+						pose.reindex(remapIndices(pose.ia(), newIndex));
+					ia_globalPose = remapIndices(ia_globalPose, newIndex);
+				}
+
 				static IdFactory sensorIds;
 				void setId() { id(sensorIds.getId()); }
 				
@@ -166,6 +175,7 @@ namespace jafar {
 				virtual int queryNextAvailableRaw(RawInfo &info)
 					{ return hardwareSensorPtr->getNextRawInfo(info); }
 				virtual double getRawTimestamp(unsigned id) { return hardwareSensorPtr->getRawTimestamp(id); } 
+				virtual double getRawArrival(unsigned id) { return hardwareSensorPtr->getRawArrival(id); }
 				//process(id) will do the filtering, so it is specific to each hardware
 				void process_fake(unsigned id) { hardwareSensorPtr->getRaw(id, reading); robotPtr()->move_fake(reading.data(0)); }
 				void discard(unsigned id) { hardwareSensorPtr->getRaw(id, reading); }
@@ -201,6 +211,9 @@ namespace jafar {
 			
 				hardware::hardware_sensorext_ptr_t hardwareSensorPtr;
 				raw_ptr_t rawPtr;
+				frame_pipeline_ptr_t pipeline;
+			
+				void prepareAhead(raw_ptr_t raw); ///< prepare() of the data managers that can prepare ahead, in the pipeline thread
 			
 			public:
 				
@@ -215,6 +228,8 @@ namespace jafar {
 
 				void setHardwareSensor(hardware::hardware_sensorext_ptr_t hardwareSensorPtr_)
 					{ hardwareSensorPtr = hardwareSensorPtr_; }
+				/// prepare the next raw in the background thread of \a pipeline while the current one is processed
+				void setPipeline(frame_pipeline_ptr_t pipeline_) { pipeline = pipeline_; }
 				virtual void start() { hardwareSensorPtr->start(); }
 				
 //				virtual int acquireRaw() = 0;
@@ -226,9 +241,28 @@ namespace jafar {
 				virtual int queryNextAvailableRaw(RawInfo &info)
 					{ return hardwareSensorPtr->getNextRawInfo(info); }
 				virtual double getRawTimestamp(unsigned id) { return hardwareSensorPtr->getRawTimestamp(id); } 
+				virtual double getRawArrival(unsigned id) { return hardwareSensorPtr->getRawArrival(id); }
 				void process(unsigned id);
-				void process_fake(unsigned id) { hardwareSensorPtr->getRaw(id, rawPtr); robotPtr()->move_fake(rawPtr->timestamp); rawCounter++; }
-				void discard(unsigned id) { hardwareSensorPtr->getRaw(id, rawPtr); }
+				/**
+				 * The steps of process(), so that the steps of several sensors can be interleaved
+				 * (see SensorManagerAbstract::processGroup()).
+				 * acquire() and detectCandidates() do not modify the map, and can run concurrently with the
+				 * same steps of other sensors. observeKnown() and observeNew() correct the filter and
+				 * create landmarks, so they must be called by one thread at a time.
+				 */
+				void acquire(unsigned id); ///< get the raw, release the previous ones, and prepare it for the data managers
+				/**
+				 * Post to the pipeline the preparation of the unread raw that should be processed next: the oldest one
+				 * if the sensor integrates all its raws, else the newest one. It is called after acquire(), and the
+				 * next acquire() waits for the preparation to finish before releasing any raw.
+				 * Nothing is done without a pipeline or if no data manager can prepare ahead.
+				 */
+				void prepareNext();
+				void observeKnown(); ///< processKnown(), map management and beginDetection() of each data manager, with the acquired raw
+				void detectCandidates(); ///< detectCandidates() of each data manager, with the acquired raw
+				void observeNew(); ///< detectNew() of each data manager, with the acquired raw
+				void process_fake(unsigned id) { if (pipeline) pipeline->wait(); hardwareSensorPtr->getRaw(id, rawPtr); robotPtr()->move_fake(rawPtr->timestamp); rawCounter++; }
+				void discard(unsigned id) { if (pipeline) pipeline->wait(); hardwareSensorPtr->getRaw(id, rawPtr); }
 		};
 
 	}
@@ -13,7 +13,12 @@
 #ifndef SENSOR_MANAGER_HPP_
 #define SENSOR_MANAGER_HPP_
 
+#include <vector>
+#include <cmath>
+#include <boost/bind.hpp>
+
 #include "rtslam/sensorAbstract.hpp"
+#include "rtslam/threadPool.hpp"
 
 namespace jafar {
 namespace rtslam {
@@ -71,6 +76,70 @@ namespace rtslam {
 			return pinfo;
 		}
 		
+		/**
+			Get the next data to use, and the data of the other exteroceptive sensors taken at about the same date,
+			to process them together with processGroup().
+			The first data of the group is the one given by getNextDataToUse(). For each other exteroceptive
+			sensor, the unread data closest to its timestamp is added if it is within the tolerance, in the order
+			of the robot and sensor lists.
+			During initialization, or if the first data is not exteroceptive, the group has only one data.
+			\param group the resulting group
+			\param tolerance the largest timestamp difference with the first data, in seconds
+			*/
+		void getNextDataGroupToUse(std::vector<ProcessInfo> & group, double tolerance)
+		{
+			group.clear();
+			group.push_back(getNextDataToUse());
+			const ProcessInfo & first = group.front();
+			if (!all_init || !first.sen || first.sen->kind != SensorAbstract::EXTEROCEPTIVE) return;
+			double t0 = first.sen->getRawTimestamp(first.id);
+			
+			RawInfos infos;
+			for (MapAbstract::RobotList::iterator robIter = mapPtr->robotList().begin();
+				robIter != mapPtr->robotList().end(); ++robIter)
+			{
+				for (RobotAbstract::SensorList::iterator senIter = (*robIter)->sensorList().begin();
+					senIter != (*robIter)->sensorList().end(); ++senIter)
+				{
+					if (*senIter == first.sen || (*senIter)->kind != SensorAbstract::EXTEROCEPTIVE) continue;
+					(*senIter)->queryAvailableRaws(infos);
+					int best = -1;
+					for (size_t i = 0; i < infos.available.size(); ++i)
+					{
+						double dt = std::fabs(infos.available[i].timestamp - t0);
+						if (dt <= tolerance && (best < 0 || dt < std::fabs(infos.available[best].timestamp - t0))) best = i;
+					}
+					if (best >= 0) group.push_back(ProcessInfo(*senIter, infos.available[best].id));
+				}
+			}
+		}
+		
+		/**
+			Process a group of exteroceptive data given by getNextDataGroupToUse(), the robot having been moved
+			to the date of the first one.
+			The steps that do not modify the map, the preparation of the raws and the detection of candidate
+			features, run concurrently with one sensor per task. The filter corrections and the landmark
+			initializations are done in the order of the group, so that the result does not depend on
+			the number of threads.
+			The next raws of the sensors that have a pipeline are prepared in its background thread during the
+			processing of the group.
+			All the known landmarks are observed by all the sensors before any new landmark is initialized,
+			so a landmark initialized by one sensor is only searched by the others from the next group.
+			\param pool the thread pool, or NULL to process the steps in the caller thread
+			*/
+		static void processGroup(const std::vector<ProcessInfo> & group, ThreadPool * pool)
+		{
+			std::vector<SensorExteroAbstract*> sens(group.size());
+			for (size_t k = 0; k < group.size(); ++k)
+				sens[k] = PTR_CAST<SensorExteroAbstract*>(group[k].sen.get());
+			
+			forEach(pool, group.size(), boost::bind(&SensorManagerAbstract::acquireTask, boost::cref(group), boost::cref(sens), _1));
+			for (size_t k = 0; k < group.size(); ++k) sens[k]->prepareNext();
+			for (size_t k = 0; k < group.size(); ++k) sens[k]->observeKnown();
+			forEach(pool, group.size(), boost::bind(&SensorManagerAbstract::detectCandidatesTask, boost::cref(sens), _1));
+			for (size_t k = 0; k < group.size(); ++k) sens[k]->observeNew();
+		}
+		
 		/**
 			@return 0 if no more sensor to init, 1 if needs to wait for data to init, 2 if returned correctly a data for init
 			*/
@@ -112,6 +181,14 @@ namespace rtslam {
 			
 			if (hasSensorMissingData) return 1; else return 0;
 		}
+		
+		private:
+			static void forEach(ThreadPool * pool, size_t n, const ThreadPool::task_t & task)
+				{ if (pool) pool->parallelFor(n, task); else for (size_t k = 0; k < n; ++k) task(k); }
+			static void acquireTask(const std::vector<ProcessInfo> & group, const std::vector<SensorExteroAbstract*> & sens, size_t k)
+				{ sens[k]->acquire(group[k].id); }
+			static void detectCandidatesTask(const std::vector<SensorExteroAbstract*> & sens, size_t k)
+				{ sens[k]->detectCandidates(); }
 	};
 
 	
@@ -0,0 +1,129 @@
+/**
+ * \file sequenceFile.hpp
+ *
+ * Packed file of the images of one camera, for dump and replay.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef SEQUENCEFILE_HPP_
+#define SEQUENCEFILE_HPP_
+
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+#include "image/Image.hpp"
+
+namespace jafar {
+namespace rtslam {
+namespace hardware {
+
+/**
+	Layout of a sequence file.
+
+	A header of 64 bytes (SequenceHeader) is followed by one record per frame. All records
+	have the same size, so that the index of the frames is implicit: frame k is at
+	header_size + k * record_size, and the number of frames is given by the file size.
+	A record is a SequenceRecord of 16 bytes followed by the rows of pixels with the
+	step of the header, padded to a multiple of 16 bytes so that the pixels of all frames
+	are aligned on 16 bytes in a mapped file. A last record that was not completely written
+	is ignored.
+
+	The numbers are stored in the byte order of the machine that wrote the file.
+*/
+struct SequenceHeader
+{
+	char magic[8]; ///< "RTSLSEQ1"
+	uint32_t version;
+	uint32_t width, height, step; ///< size of the images, and bytes per row
+	uint32_t depth; ///< bytes per pixel, only 1 (gray levels) is supported
+	uint64_t record_size; ///< bytes per frame, record header included
+	char reserved[24];
+};
+
+struct SequenceRecord
+{
+	double timestamp;
+	double arrival;
+};
+
+/**
+	Append the images of a camera to a sequence file.
+
+	\ingroup rtslam
+*/
+class SequenceFileWriter
+{
+	public:
+		SequenceFileWriter(): file(NULL), n(0), record_size(0) {}
+		~SequenceFileWriter() { close(); }
+
+		/**
+			Create the file, or truncate it, for images of the given size.
+			\return false if the file cannot be created
+		*/
+		bool open(const std::string & path, int width, int height, int step);
+		bool isOpen() const { return file != NULL; }
+		/// append a frame, whose size must be the one given to open()
+		bool append(const image::Image & img, double timestamp, double arrival);
+		/// write the buffered frames to the file
+		void flush() { if (file) fflush(file); }
+		void close();
+		unsigned count() const { return n; }
+
+	private:
+		FILE *file;
+		unsigned n;
+		SequenceHeader header;
+		uint64_t record_size;
+};
+
+/**
+	Read a sequence file through a memory mapping, so that the images of the frames
+	can be used in place, without copy nor decoding.
+	The mapping is private and writable, so that writing to an image does not modify
+	the file (the written pages are copied by the system).
+
+	\ingroup rtslam
+*/
+class SequenceFileReader
+{
+	public:
+		SequenceFileReader(): data(NULL), size(0), n(0) {}
+		~SequenceFileReader() { close(); }
+
+		/// \return false if the file does not exist or is not a sequence file
+		bool open(const std::string & path);
+		bool isOpen() const { return data != NULL; }
+		void close();
+
+		unsigned count() const { return n; }
+		int width() const { return header().width; }
+		int height() const { return header().height; }
+		int step() const { return header().step; }
+		double timestamp(unsigned k) const { return record(k)->timestamp; }
+		double arrival(unsigned k) const { return record(k)->arrival; }
+		/// the rows of pixels of frame k, with step()
+		unsigned char* pixels(unsigned k) const { return (unsigned char*)(record(k) + 1); }
+
+	private:
+		unsigned char *data;
+		size_t size;
+		unsigned n;
+
+		const SequenceHeader & header() const { return *(const SequenceHeader*)data; }
+		SequenceRecord* record(unsigned k) const
+			{ return (SequenceRecord*)(data + sizeof(SequenceHeader) + k * header().record_size); }
+};
+
+/**
+	Convert the images of a dump directory, image_NNNNNNN.pgm or .png with their .time files,
+	to a sequence file.
+	\return the number of converted images, or -1 if the sequence file cannot be created
+*/
+int convertImageDirectory(const std::string & dump_path, const std::string & sequence_path);
+
+}}}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * \file simd.hpp
+ *
+ * Runtime detection of the vector instruction sets available on the cpu,
+ * and small vectorized kernels with a scalar fallback.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#include <cstddef>
+
+namespace jafar {
+	namespace rtslam {
+		namespace simd {
+
+			/**
+			 * Instruction set used by the vectorized kernels.
+			 */
+			typedef enum {
+				SCALAR, ///< plain C++
+				SSE2, ///<   128 bits vectors
+				AVX2 ///<    256 bits vectors and fused multiply-add
+			} level_t;
+
+			/**
+			 * The best instruction set supported by the cpu, detected at the first call.
+			 */
+			level_t detectedLevel();
+
+			/**
+			 * The instruction set currently used by the kernels.
+			 * It is the detected one, unless it has been lowered with setLevel().
+			 */
+			level_t level();
+
+			/**
+			 * Force the instruction set used by the kernels, eg for benchmarking or debugging.
+			 * It cannot be set higher than detectedLevel().
+			 * It can be changed while other threads run kernels, a kernel that already
+			 * started finishes with the previous level.
+			 */
+			void setLevel(level_t _level);
+
+			/**
+			 * y[0:n] += a * x[0:n]
+			 */
+			void axpy(double a, const double * x, double * y, std::size_t n);
+
+			/**
+			 * sum of a[i]*b[i] for i in [0:n], for 8 bits unsigned values.
+			 * The result is exact as long as n < 66051.
+			 */
+			unsigned int dot(const unsigned char * a, const unsigned char * b, std::size_t n);
+
+			/**
+			 * sum of |a[i]-b[i]| for i in [0:n], for 8 bits unsigned values.
+			 */
+			unsigned int sad(const unsigned char * a, const unsigned char * b, std::size_t n);
+
+			/**
+			 * Products of the image derivatives with the [-1 0 1] masks, on n pixels of a row:
+			 * with dx = pix[j+1]-pix[j-1] and dy = pix[j+step]-pix[j-step],
+			 * xx[j] = dx*dx, xy[j] = dx*dy, yy[j] = dy*dy for j in [0:n].
+			 */
+			void gradientProducts(const unsigned char * pix, std::ptrdiff_t step, std::size_t n, int * xx, int * xy, int * yy);
+
+			/**
+			 * Row of an integral image: dst[j] = above[j] + sum of src[0:j+1], for j in [0:n].
+			 * above can be null for the first row. Sums wrap around on overflow.
+			 */
+			void integralRow(const int * src, const int * above, int * dst, std::size_t n);
+
+		}
+	}
+}
+
+#endif /* SIMD_HPP_ */
@@ -295,6 +295,16 @@ namespace simu {
 				delete noise;
 			}
 
+			/// the simulation noise is drawn from one generator, so matches must run one at a time to be repeatable
+			bool isThreadSafe() const { return false; }
+			/// nothing to prepare in simulation
+			void prepare(const boost::shared_ptr<RawSimu> & rawPtr) {}
+			bool canPrepareAhead() const { return false; }
+
+			/// no pre-tracking in simulation, match() is always used
+			bool track(const boost::shared_ptr<RawSimu> & rawPtr, const appearance_ptr_t & prevApp, const appearance_ptr_t & targetApp, const RoiSpec & roi, Measurement & measure, appearance_ptr_t & app)
+				{ return false; }
+
 			bool match(const boost::shared_ptr<RawSimu> & rawPtr, const appearance_ptr_t & targetApp, const RoiSpec & roi, Measurement & measure, appearance_ptr_t & app)
 			{
 				if (noise == NULL)
@@ -413,6 +423,14 @@ namespace simu {
 				params.simuMeasStd = simuMeasStd;
 			}
 
+			/// detect in several rois, one by one ; featPtrs are null where nothing was found
+			void detect(const boost::shared_ptr<RawSimu> & rawData, const std::vector<RoiSpec> & rois, std::vector<boost::shared_ptr<FeatureSimu> > & featPtrs)
+			{
+				featPtrs.resize(rois.size());
+				for (size_t k = 0; k < rois.size(); ++k)
+					if (!detect(rawData, rois[k], featPtrs[k])) featPtrs[k].reset();
+			}
+
 			bool detect(const boost::shared_ptr<RawSimu> & rawData, const RoiSpec &roi, boost::shared_ptr<FeatureSimu> & featPtr)
 			{
 				if (noise == NULL)
@@ -15,6 +15,7 @@
 #define SIMUOBJECTS_HPP_
 
 #include "kernel/dataLog.hpp"
+#include "rtslam/binaryLogger.hpp"
 #include "jmath/jblas.hpp"
 
 namespace jafar {
@@ -48,7 +49,7 @@ namespace simu {
 	};
 	typedef std::vector<Waypoint> Trajectory;
 	
-	class MobileObject: public simu::MapObject, public kernel::DataLoggable
+	class MobileObject: public simu::MapObject, public Loggable
 	{
 		private:
 			mutable double _t;
@@ -155,12 +156,12 @@ namespace simu {
 			}
 		
 		
-			virtual void writeLogHeader(kernel::DataLogger& log) const
+			virtual void logHeader(LogSink & log) const
 			{
 				log.writeLegendTokens("simu_x simu_y simu_z");
 				log.writeLegendTokens("simu_yaw simu_pitch simu_roll");
 			}
-			virtual void writeLogData(kernel::DataLogger& log) const
+			virtual void logData(LogSink & log) const
 			{
 				jblas::vec pose = getPose(_t);
 				for(int i = 0 ; i < 6 ; ++i) log.writeData(pose(i));
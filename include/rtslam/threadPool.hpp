@@ -0,0 +1,81 @@
+/**
+ * \file threadPool.hpp
+ *
+ * A fixed pool of worker threads to split heavy computations.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/exception_ptr.hpp>
+
+namespace jafar {
+	namespace rtslam {
+
+		class ThreadPool;
+		typedef boost::shared_ptr<ThreadPool> thread_pool_ptr_t;
+
+		/**
+		 * Pool of worker threads.
+		 *
+		 * The threads are created once at construction and wait for jobs, so that
+		 * no thread is spawned when a job is run.
+		 * A job is a set of \a n independent tasks, task(0) ... task(n-1), run by parallelFor().
+		 * The caller thread takes part in the job, and parallelFor() returns when all tasks are done.
+		 *
+		 * Which thread runs which task is not deterministic, so for deterministic results
+		 * each task must only depend on its index and write to its own output.
+		 *
+		 * \ingroup rtslam
+		 */
+		class ThreadPool {
+			public:
+				typedef boost::function<void(std::size_t)> task_t;
+
+				/**
+				 * Constructor.
+				 * \param _size the total number of threads running a job, including the caller thread.
+				 */
+				ThreadPool(std::size_t _size);
+				~ThreadPool();
+
+				std::size_t size() const { return workers.size() + 1; }
+
+				/**
+				 * Run task(i) for all i in [0,n), and wait until all are finished.
+				 * Calls to parallelFor() must not be nested, and must come from one thread at a time.
+				 * If tasks throw, the remaining tasks are still run, and the first exception is
+				 * rethrown by parallelFor() once all tasks are finished. A kernel::Exception is
+				 * rethrown as a copy of its kernel::Exception part.
+				 */
+				void parallelFor(std::size_t n, const task_t & task);
+
+			private:
+				void workerLoop();
+				void runTasks();
+
+				std::vector<boost::thread*> workers;
+				boost::mutex mutex;
+				boost::condition_variable job_condition; ///< notifies workers that a job is available
+				boost::condition_variable done_condition; ///< notifies the caller that all tasks are finished
+				const task_t * job_task;
+				std::size_t job_size; ///<    number of tasks of the current job
+				std::size_t job_next; ///<    next task to run
+				std::size_t job_pending; ///< tasks not finished yet
+				unsigned long job_id; ///<    incremented at each job
+				boost::exception_ptr job_error; ///< first exception thrown by a task of the current job
+				bool exiting;
+		};
+
+	}
+}
+
+#endif /* THREADPOOL_HPP_ */
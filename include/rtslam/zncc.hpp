@@ -0,0 +1,90 @@
+/**
+ * \file zncc.hpp
+ *
+ * Zncc matching of image patches, with integral images for the image statistics.
+ *
+ * \ingroup rtslam
+ */
+
+#ifndef ZNCC_HPP_
+#define ZNCC_HPP_
+
+#include <vector>
+#include "image/Image.hpp"
+
+namespace jafar {
+	namespace rtslam {
+		namespace zncc {
+
+			/**
+			 * Integral images of I and I^2.
+			 *
+			 * The tables are kept in 32 bits and overflow on large images, but the sums
+			 * are computed modulo 2^32 and so are exact for windows whose true sums fit
+			 * in 32 bits, that is more than 60000 pixels.
+			 *
+			 * \ingroup rtslam
+			 */
+			class IntegralImage {
+				public:
+					IntegralImage(): width_(0), height_(0), stride_(1) {}
+
+					void compute(const image::Image & img);
+
+					int width() const { return width_; }
+					int height() const { return height_; }
+
+					/// sum of the pixels in [x,x+w[ x [y,y+h[
+					unsigned int sum(int x, int y, int w, int h) const { return window(sum_, x, y, w, h); }
+					/// sum of the squared pixels in [x,x+w[ x [y,y+h[
+					unsigned int squareSum(int x, int y, int w, int h) const { return window(sqsum_, x, y, w, h); }
+
+				private:
+					int width_, height_, stride_;
+					std::vector<unsigned int> sum_, sqsum_; ///< (width+1) x (height+1) tables, first row and column are 0
+
+					unsigned int window(const std::vector<unsigned int> & table, int x, int y, int w, int h) const {
+						const unsigned int * top = &table[y * stride_ + x];
+						const unsigned int * bottom = top + h * stride_;
+						return bottom[w] - bottom[0] - top[w] + top[0];
+					}
+			};
+
+			/**
+			 * Sums of the pixels and of the squared pixels of a patch.
+			 */
+			void patchSums(const image::Image & patch, unsigned int & sum, unsigned int & squareSum);
+
+			/**
+			 * Zncc score of a patch on one position of an image.
+			 * \param patch the patch
+			 * \param patchSum the sum of the patch pixels
+			 * \param patchSquareSum the sum of the squared patch pixels
+			 * \param img the image
+			 * \param integral the integral images of img
+			 * \param x0,y0 the image position of the upper left pixel of the patch
+			 */
+			double score(const image::Image & patch, unsigned int patchSum, unsigned int patchSquareSum,
+				const image::Image & img, const IntegralImage & integral, int x0, int y0);
+
+			/**
+			 * Search the best zncc score of a patch in a region of an image.
+			 * The statistics of the image windows come from the integral images, and the
+			 * cross term is computed with simd::dot(), so each position costs one
+			 * multiply-accumulate pass on the patch.
+			 * \param region the pixels where to search the center of the patch, clipped to the image
+			 * \param x,y the best position with subpixel interpolation, in the convention where
+			 * the center of pixel (i,j) is (i+0.5,j+0.5)
+			 * \param std_x,std_y the std deviation estimated from the curvature of the score peak (distance where
+			 * the score drops by 10%, at most one pixel)
+			 * \return the best score, or -1 if the region has no valid position
+			 */
+			double match(const image::Image & patch, unsigned int patchSum, unsigned int patchSquareSum,
+				const image::Image & img, const IntegralImage & integral, const cv::Rect & region,
+				double & x, double & y, double & std_x, double & std_y);
+
+		}
+	}
+}
+
+#endif /* ZNCC_HPP_ */
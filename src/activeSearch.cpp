@@ -130,6 +130,13 @@ namespace jafar {
 				return false;
 		}
 
+		/**
+		 * Get ROIs of all empty cells
+		 */
+		bool ActiveSearchGrid::getRois(std::vector<image::ConvexRoi> & rois) {
+			return getEmptyCellRois(projectionsCount, boost::bind(&ActiveSearchGrid::cell2roi, this, _1, _2), rois);
+		}
+
 		void ActiveSearchGrid::setFailed(const image::ConvexRoi & roi)
 		{
 			vec2 p; p(0) = roi.x()+roi.w()/2; p(1) = roi.y()+roi.h()/2;
@@ -165,6 +165,10 @@ namespace jafar {
             return false;
       }
 
+      bool ActiveSegmentSearchGrid::getRois(std::vector<image::ConvexRoi> & rois) {
+         return getEmptyCellRois(projectionsCount, boost::bind(&ActiveSegmentSearchGrid::cell2roi, this, _1, _2), rois);
+      }
+
       void ActiveSegmentSearchGrid::setFailed(const image::ConvexRoi & roi)
       {
 			vec4 p;
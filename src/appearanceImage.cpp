@@ -6,6 +6,7 @@
  */
 
 #include "rtslam/appearanceImage.hpp"
+#include "rtslam/zncc.hpp"
 #include "image/Image.hpp"
 #include "jmath/ublasExtra.hpp"
 
@@ -34,14 +35,7 @@ namespace jafar {
 		}
 
 		void AppearanceImagePoint::computePatchIntegrals(){
-			patchSum = 0;
-			patchSquareSum = 0;
-			uchar* pix = patch.data();
-			for (int u = 0; u < patch.width()*patch.height(); u++){
-				patchSum += *pix;
-				patchSquareSum += (*pix) * (*pix);
-				pix ++;
-			}
+			zncc::patchSums(patch, patchSum, patchSquareSum);
 		}
 
 		
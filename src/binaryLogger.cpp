@@ -0,0 +1,185 @@
+/**
+ * \file binaryLogger.cpp
+ * \ingroup rtslam
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+
+#include "kernel/timingTools.hpp"
+#include "rtslam/binaryLogger.hpp"
+
+namespace jafar {
+	namespace rtslam {
+
+		static const char logMagic[8] = { 'R','T','S','L','L','O','G','1' };
+
+
+		/*
+		 * Builds the text header as kernel::DataLogger writes it, and counts the columns.
+		 */
+		class BinaryLogger::HeaderSink: public LogSink {
+			public:
+				std::ostringstream text;
+				unsigned n_columns;
+				HeaderSink(): n_columns(0) {}
+				virtual void writeComment(const std::string & comment) { text << "# " << comment << "\n"; }
+				virtual void writeLegendTokens(const std::string & tokens)
+				{
+					std::istringstream iss(tokens);
+					std::string token;
+					while (iss >> token) { text << token << " "; ++n_columns; }
+				}
+				virtual void writeData(double d) {}
+		};
+
+		/*
+		 * Copies the values of one record to the buffer, and counts them.
+		 */
+		class BinaryLogger::RecordSink: public LogSink {
+			public:
+				double *pos, *end;
+				unsigned n;
+				RecordSink(double *begin, double *end): pos(begin), end(end), n(0) {}
+				virtual void writeComment(const std::string & comment) {}
+				virtual void writeLegendTokens(const std::string & tokens) {}
+				virtual void writeData(double d) { if (pos != end) *pos++ = d; ++n; }
+		};
+
+
+		BinaryLogger::BinaryLogger(const std::string & filename, unsigned bufferRecords):
+			header_written(false), record_size(0), buffer_records(bufferRecords > 0 ? bufferRecords : 1), current(0), n_current(0), size_warned(false)
+		{
+			memset(&counters_, 0, sizeof(counters_));
+			file = fopen(filename.c_str(), "wb");
+			if (!file) std::cerr << "BinaryLogger: cannot create " << filename << std::endl;
+		}
+
+
+		BinaryLogger::~BinaryLogger()
+		{
+			if (file && record_size && n_current) swapBuffers();
+			flusher.wait();
+			if (file) fclose(file);
+		}
+
+
+		void BinaryLogger::writeComment(const std::string & comment)
+		{
+			if (header_written) { std::cerr << "BinaryLogger: comments can only be written before the first record" << std::endl; return; }
+			header += "# " + comment + "\n";
+		}
+
+
+		void BinaryLogger::addLoggable(const Loggable & loggable)
+		{
+			if (header_written) { std::cerr << "BinaryLogger: loggables can only be added before the first record" << std::endl; return; }
+			loggables.push_back(&loggable);
+		}
+
+
+		void BinaryLogger::writeHeader()
+		{
+			HeaderSink sink;
+			for (size_t i = 0; i < loggables.size(); ++i) loggables[i]->logHeader(sink);
+			sink.text << "\n";
+			header += sink.text.str();
+			header_written = true;
+			record_size = sink.n_columns;
+			for (int b = 0; b < 2; ++b) buffers[b].resize((size_t)buffer_records * record_size);
+
+			uint32_t header_size = header.size(), n_columns = record_size;
+			bool ok = (fwrite(logMagic, sizeof(logMagic), 1, file) == 1);
+			ok = ok && (fwrite(&header_size, sizeof(header_size), 1, file) == 1);
+			ok = ok && (fwrite(header.data(), 1, header.size(), file) == header.size());
+			ok = ok && (fwrite(&n_columns, sizeof(n_columns), 1, file) == 1);
+			if (!ok) std::cerr << "BinaryLogger: cannot write the header" << std::endl;
+		}
+
+
+		void BinaryLogger::log()
+		{
+			if (!file) return;
+			kernel::Chrono chrono;
+			if (!header_written) writeHeader();
+			if (!record_size) return; // nothing to log
+
+			double *record = &buffers[current][(size_t)n_current * record_size];
+			RecordSink sink(record, record + record_size);
+			for (size_t i = 0; i < loggables.size(); ++i) loggables[i]->logData(sink);
+			if (sink.n != record_size)
+			{
+				// keep the schema, pad with zeros or drop the extra values
+				std::fill(sink.pos, sink.end, 0.);
+				if (!size_warned) std::cerr << "BinaryLogger: record of " << sink.n << " values instead of " << record_size << std::endl;
+				size_warned = true;
+			}
+			++n_current;
+			++counters_.n_records;
+			if (n_current == buffer_records) swapBuffers();
+			counters_.log_time += chrono.elapsedMicrosecond() * 1e-3;
+		}
+
+
+		void BinaryLogger::swapBuffers()
+		{
+			// the other buffer is free once its flush is done
+			flusher.wait();
+			flusher.post(boost::bind(&BinaryLogger::flush, this, current, n_current));
+			current = 1 - current;
+			n_current = 0;
+		}
+
+
+		void BinaryLogger::flush(unsigned buffer, unsigned n_records)
+		{
+			kernel::Chrono chrono;
+			size_t n = (size_t)n_records * record_size;
+			if (fwrite(&buffers[buffer][0], sizeof(double), n, file) != n)
+				std::cerr << "BinaryLogger: cannot write " << n_records << " records" << std::endl;
+			++counters_.n_flushes;
+			counters_.flush_time += chrono.elapsedMicrosecond() * 1e-3;
+		}
+
+
+		int convertBinaryLog(const std::string & binary_filename, const std::string & text_filename)
+		{
+			FILE *in = fopen(binary_filename.c_str(), "rb");
+			if (!in) return -1;
+			char magic[8];
+			uint32_t header_size = 0, n_columns = 0;
+			std::string header;
+			bool ok = (fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, logMagic, sizeof(magic)) == 0);
+			ok = ok && (fread(&header_size, sizeof(header_size), 1, in) == 1);
+			if (ok) { header.resize(header_size); ok = (header_size == 0 || fread(&header[0], 1, header_size, in) == header_size); }
+			ok = ok && (fread(&n_columns, sizeof(n_columns), 1, in) == 1);
+			FILE *out = (ok ? fopen(text_filename.c_str(), "w") : NULL);
+			if (!out)
+			{
+				if (!ok) std::cerr << "convertBinaryLog: " << binary_filename << " is not a binary log" << std::endl;
+				fclose(in);
+				return -1;
+			}
+
+			fwrite(header.data(), 1, header.size(), out);
+			std::vector<double> record(n_columns);
+			int n = 0;
+			// an incomplete last record is ignored, and a log without columns has no records
+			while (n_columns > 0 && fread(&record[0], sizeof(double), n_columns, in) == n_columns)
+			{
+				for (unsigned i = 0; i < n_columns; ++i) fprintf(out, "%.17g ", record[i]);
+				fputc('\n', out);
+				++n;
+			}
+			fclose(in);
+			fclose(out);
+			return n;
+		}
+
+	}
+}
@@ -11,6 +11,10 @@
 #include "rtslam/descriptorImagePoint.hpp"
 #include "rtslam/rawImage.hpp"
 #include "rtslam/quatTools.hpp"
+#include "rtslam/sensorPinhole.hpp"
+#include "rtslam/pinholeTools.hpp"
+#include "rtslam/patchWarp.hpp"
+#include "kernel/timingTools.hpp"
 
 namespace jafar {
 	namespace rtslam {
@@ -127,23 +131,69 @@ app_dst->patch.save(buffer);
 		 **************************************************************************/
 
 
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::n_predictions(0);
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::n_hits(0);
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::n_fallbacks(0);
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::warp_time(0);
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::n_matched(0);
+		boost::atomic<unsigned long> DescriptorImagePointMultiView::n_failed(0);
+
 		DescriptorImagePointMultiView::DescriptorImagePointMultiView(int descSize, double scaleStep, double angleStep, PredictionType predictionType):
 			DescriptorAbstract(),
 			lastObsFailed(false), descSize(descSize), scaleStep(scaleStep), angleStep(angleStep),
-			predictionType(predictionType), cosAngleStep(cos(angleStep))
+			predictionType(predictionType), cacheZoomTol(0.), cacheRotationTol(0.), cosAngleStep(cos(angleStep)),
+			cacheZoom(0.), cacheRotation(0.)
+		{
+		}
+
+		DescriptorImagePointMultiView::PredictionCounters DescriptorImagePointMultiView::predictionCounters()
+		{
+			PredictionCounters counters;
+			counters.n_predictions = n_predictions.load(boost::memory_order_relaxed);
+			counters.n_hits = n_hits.load(boost::memory_order_relaxed);
+			counters.n_fallbacks = n_fallbacks.load(boost::memory_order_relaxed);
+			counters.warp_time = warp_time.load(boost::memory_order_relaxed);
+			counters.n_matched = n_matched.load(boost::memory_order_relaxed);
+			counters.n_failed = n_failed.load(boost::memory_order_relaxed);
+			return counters;
+		}
+
+		bool DescriptorImagePointMultiView::getCachedPrediction(const appearance_ptr_t & app_src, double zoom, double rotation, const app_img_pnt_ptr_t & app_dst)
+		{
+			if (cacheZoomTol <= 0. || !cacheApp || app_src != cacheSrc) return false;
+			if (cacheApp->patch.width() != app_dst->patch.width() || cacheApp->patch.height() != app_dst->patch.height()) return false;
+			double dRotation = fabs(rotation - cacheRotation);
+			if (dRotation > M_PI) dRotation = 2*M_PI - dRotation;
+			if (fabs(zoom - cacheZoom) > cacheZoomTol * cacheZoom || dRotation > cacheRotationTol) return false;
+			cacheApp->patch.copy(app_dst->patch, 0, 0, 0, 0);
+			app_dst->offset = cacheApp->offset;
+			return true;
+		}
+
+		void DescriptorImagePointMultiView::cachePrediction(const appearance_ptr_t & app_src, double zoom, double rotation, const app_img_pnt_ptr_t & app_dst)
 		{
+			if (cacheZoomTol <= 0.) return;
+			if (!cacheApp || cacheApp->patch.width() != app_dst->patch.width() || cacheApp->patch.height() != app_dst->patch.height())
+				cacheApp.reset(new AppearanceImagePoint(app_dst->patch.width(), app_dst->patch.height(), app_dst->patch.depth()));
+			app_dst->patch.copy(cacheApp->patch, 0, 0, 0, 0);
+			cacheApp->offset = app_dst->offset;
+			cacheSrc = app_src;
+			cacheZoom = zoom;
+			cacheRotation = rotation;
 		}
 		
 		bool DescriptorImagePointMultiView::addObservation(const observation_ptr_t & obsPtr)
 		{
 			if (obsPtr->events.updated)
 			{
+				n_matched.fetch_add(1, boost::memory_order_relaxed);
 				int res = lastValidView.initFromObs(obsPtr, descSize);
 				lastObsFailed = false;
 				return res;
 			}
 			else if (obsPtr->events.predicted && obsPtr->events.measured && !obsPtr->events.matched)
 			{
+				n_failed.fetch_add(1, boost::memory_order_relaxed);
 				lastObsFailed = true;
 				return false;
 			}
@@ -172,65 +222,121 @@ app_dst->patch.save(buffer);
 					app_dst->offset.x()(0) = app_src->offset.x()(0) + ((app_src->patch.width()-app_dst->patch.width())%2) * 0.5;
 					app_dst->offset.x()(1) = app_src->offset.x()(1) + ((app_src->patch.height()-app_dst->patch.height())%2) * 0.5;
 					app_dst->offset.P() = app_src->offset.P();
+					break;
 				}
-				case ptAffine:
+				case ptHomographic:
 				{
-					double zoom, rotation;
-					quaternion::getZoomRotation(view_src->senPose, obsPtr->sensorPtr()->globalPose(), lmk, zoom, rotation);
-					app_src->patch.rotateScale(jmath::radToDeg(rotation), zoom, app_dst->patch);
-					
-					double alpha = zoom * cos(rotation);
-					double beta  = zoom * sin(rotation);
-					app_dst->offset.x()(0) = alpha*app_src->offset.x()(0) +  beta*app_src->offset.x()(1);
-					app_dst->offset.x()(1) = -beta*app_src->offset.x()(0) + alpha*app_src->offset.x()(1);
-					// this is an approximation for angle, but it's ok
-					app_dst->offset.P()(0,0) = alpha*app_src->offset.P()(0,0) +  beta*app_src->offset.P()(1,1);
-					app_dst->offset.P()(1,1) = -beta*app_src->offset.P()(0,0) + alpha*app_src->offset.P()(1,1);
+					n_predictions.fetch_add(1, boost::memory_order_relaxed);
+					kernel::Chrono chrono;
+					bool valid = predictHomographic(obsPtr, *view_src, lmk, app_src, app_dst);
+					warp_time.fetch_add((unsigned long)chrono.elapsedMicrosecond(), boost::memory_order_relaxed);
+					if (valid) break;
+					// the patch plane is seen from behind or edge-on, use the affine prediction
+					n_fallbacks.fetch_add(1, boost::memory_order_relaxed);
+					predictAffine(obsPtr, *view_src, lmk, app_src, app_dst);
+					break;
 				}
-				case ptHomographic:
+				case ptAffine:
 				{
-#if 0 
-// TODO get the 3D corners, rotate them, project them, compute homography, apply homography
-					int appw = app_dst->patch.width(), apph = app_dst->patch.height();
-					CvPoint2D32f corners_dst[4] = {{0.5,0.5},{appw-0.5,0.5},{0.5,apph-0.5},{appw-0.5,apph-0.5}};
-					
-					jblas::vec corners_space[4], corner(2), nobs(1); nobs(0) = ublas::norm_2(obsPtr->landmarkPtr->;
-					
-					for(int i = 0; i < 4; ++i)
-					{
-						corner(0) = obsPtr->expectation.x()(0) - offset(0); //FIXME check sign offset
-						view_src->model->backProject_func(view_src->senPose, view_src->measurement, nobs, corners_space[i]);
-						
-					}
-					
-					
-					
-					
-						
-					jblas::vec3 normal_dst = sensorPose3d_dst - featurePose3d_dst;
-					normal_dst /= norm_2(normal_dst);
-					jblas::vec3 normal_src = sensorPose3d_src - featurePose3d_src;
-					normal_src /= norm_2(normal_src);
-					jblas::vec3 normal_goal = (normal_dst+normal_src)/2;
-					normal_goal /= norm_2(normal_goal);			
-						
-						
-					// estimate the transformation
-					CvPoint2D32f src[4] = {{corners[0][0](0),corners[0][0](1)},{corners[0][1](0),corners[0][1](1)},
-							{corners[1][0](0),corners[1][0](1)},{corners[1][1](0),corners[1][1](1)}};
-					CvPoint2D32f dst[4] = {{0,0},{fwd,0},{0,fhd},{fwd,fhd}};
-					CvMat *homography = cvCreateMat(3, 3, CV_32F);
-					cvGetPerspectiveTransform(src, dst, homography);
-
-					// apply the transformation
-					cv::warpPerspective(*featureAppearance_src, *featureAppearance_dst, homography, featureAppearance_dst->size());
-					cvReleaseMat(&homography);
-#endif
+					n_predictions.fetch_add(1, boost::memory_order_relaxed);
+					kernel::Chrono chrono;
+					predictAffine(obsPtr, *view_src, lmk, app_src, app_dst);
+					warp_time.fetch_add((unsigned long)chrono.elapsedMicrosecond(), boost::memory_order_relaxed);
+					break;
 				}
 			}
 			
 			return true;
 		}
+
+		void DescriptorImagePointMultiView::predictAffine(const observation_ptr_t & obsPtr, const FeatureView & view_src, const jblas::vec & lmk,
+			const app_img_pnt_ptr_t & app_src, const app_img_pnt_ptr_t & app_dst)
+		{
+			double zoom, rotation;
+			quaternion::getZoomRotation(view_src.senPose, obsPtr->sensorPtr()->globalPose(), lmk, zoom, rotation);
+			if (getCachedPrediction(view_src.appearancePtr, zoom, rotation, app_dst))
+			{
+				n_hits.fetch_add(1, boost::memory_order_relaxed);
+				return;
+			}
+			app_src->patch.rotateScale(jmath::radToDeg(rotation), zoom, app_dst->patch);
+			
+			double alpha = zoom * cos(rotation);
+			double beta  = zoom * sin(rotation);
+			app_dst->offset.x()(0) = alpha*app_src->offset.x()(0) +  beta*app_src->offset.x()(1);
+			app_dst->offset.x()(1) = -beta*app_src->offset.x()(0) + alpha*app_src->offset.x()(1);
+			// this is an approximation for angle, but it's ok
+			app_dst->offset.P()(0,0) = alpha*app_src->offset.P()(0,0) +  beta*app_src->offset.P()(1,1);
+			app_dst->offset.P()(1,1) = -beta*app_src->offset.P()(0,0) + alpha*app_src->offset.P()(1,1);
+			cachePrediction(view_src.appearancePtr, zoom, rotation, app_dst);
+		}
+
+		bool DescriptorImagePointMultiView::predictHomographic(const observation_ptr_t & obsPtr, const FeatureView & view_src, const jblas::vec & lmk,
+			const app_img_pnt_ptr_t & app_src, const app_img_pnt_ptr_t & app_dst)
+		{
+			pinhole_ptr_t sen_dst = SPTR_CAST<SensorPinhole>(obsPtr->sensorPtr());
+			pinhole_ptr_t sen_src = SPTR_CAST<SensorPinhole>(view_src.obsModelPtr->sensorPtr());
+			jblas::vec7 pose_dst = sen_dst->globalPose();
+			const jblas::vec7 & pose_src = view_src.senPose;
+			jblas::vec3 pnt = ublas::subrange(lmk, 0, 3);
+			jblas::vec3 c_dst = ublas::subrange(pose_dst, 0, 3);
+			jblas::vec3 c_src = ublas::subrange(pose_src, 0, 3);
+
+			// the patch is on the plane through the landmark that bisects the two directions of view
+			jblas::vec3 normal = (c_dst - pnt) / ublas::norm_2(c_dst - pnt) + (c_src - pnt) / ublas::norm_2(c_src - pnt);
+			double normal_norm = ublas::norm_2(normal);
+			if (normal_norm < 1e-6) return false;
+			normal /= normal_norm;
+
+			// the landmark is at the center of both patches
+			jblas::vec3 v_dst = quaternion::eucToFrame(pose_dst, pnt);
+			jblas::vec3 v_src = quaternion::eucToFrame(pose_src, pnt);
+			if (v_dst(2) <= 0. || v_src(2) <= 0.) return false;
+			jblas::vec2 center_dst = pinhole::projectPoint(sen_dst->params.intrinsic, sen_dst->params.distortion, v_dst);
+			jblas::vec2 center_src = pinhole::projectPoint(sen_src->params.intrinsic, sen_src->params.distortion, v_src);
+
+			// back-project the corners of the predicted patch on the plane, and project them in the source view
+			double hw = app_dst->patch.width() * 0.5, hh = app_dst->patch.height() * 0.5;
+			double corners_dst[4][2] = {{-hw,-hh},{hw,-hh},{-hw,hh},{hw,hh}}, corners_src[4][2];
+			double plane_dist = ublas::inner_prod(normal, pnt - c_dst);
+			for (int k = 0; k < 4; ++k)
+			{
+				jblas::vec2 pix;
+				pix(0) = center_dst(0) + corners_dst[k][0];
+				pix(1) = center_dst(1) + corners_dst[k][1];
+				jblas::vec3 ray = quaternion::eucFromFrame(pose_dst,
+					pinhole::backprojectPoint(sen_dst->params.intrinsic, sen_dst->params.correction, pix, 1.0)) - c_dst;
+				double ray_dist = ublas::inner_prod(normal, ray);
+				if (fabs(ray_dist) < 1e-9 || plane_dist / ray_dist <= 0.) return false;
+				jblas::vec3 corner = c_dst + (plane_dist / ray_dist) * ray;
+				jblas::vec3 v = quaternion::eucToFrame(pose_src, corner);
+				if (v(2) <= 0.) return false;
+				pix = pinhole::projectPoint(sen_src->params.intrinsic, sen_src->params.distortion, v);
+				corners_src[k][0] = pix(0) - center_src(0);
+				corners_src[k][1] = pix(1) - center_src(1);
+			}
+			patchwarp::Homography H;
+			if (!patchwarp::fromCorners(corners_dst, corners_src, H)) return false;
+			double J[4];
+			H.jacobianAtOrigin(J);
+			double det = J[0]*J[3] - J[1]*J[2];
+			if (fabs(det) < 1e-6) return false;
+
+			patchwarp::warpBilinear(app_src->patch, H, app_dst->patch);
+
+			// offset and its covariance, through the local linear map from the source to the predicted patch
+			double Ji[4] = { J[3]/det, -J[1]/det, -J[2]/det, J[0]/det };
+			double ox = app_src->offset.x()(0) - H.h[2], oy = app_src->offset.x()(1) - H.h[5];
+			app_dst->offset.x()(0) = Ji[0]*ox + Ji[1]*oy;
+			app_dst->offset.x()(1) = Ji[2]*ox + Ji[3]*oy;
+			jblas::sym_mat P = app_src->offset.P();
+			double a = Ji[0]*P(0,0) + Ji[1]*P(1,0), b = Ji[0]*P(0,1) + Ji[1]*P(1,1);
+			double c = Ji[2]*P(0,0) + Ji[3]*P(1,0), d = Ji[2]*P(0,1) + Ji[3]*P(1,1);
+			app_dst->offset.P()(0,0) = a*Ji[0] + b*Ji[1];
+			app_dst->offset.P()(0,1) = a*Ji[2] + b*Ji[3];
+			app_dst->offset.P()(1,1) = c*Ji[2] + d*Ji[3];
+			return true;
+		}
 		
 		bool DescriptorImagePointMultiView::isPredictionValid(const observation_ptr_t & obsPtr)
 		{
@@ -0,0 +1,138 @@
+/**
+ * \file framePipeline.cpp
+ * \ingroup rtslam
+ */
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "kernel/timingTools.hpp"
+#include "rtslam/framePipeline.hpp"
+
+namespace jafar {
+	namespace rtslam {
+
+		DurationHistogram::DurationHistogram(double _binWidth, std::size_t nBins) :
+			binWidth_(_binWidth), bins_(nBins + 1, 0), n(0), total(0.), max_(0.)
+		{}
+
+		void DurationHistogram::add(double duration)
+		{
+			std::size_t bin = (duration > 0. ? (std::size_t)(duration / binWidth_) : 0);
+			bins_[std::min(bin, bins_.size() - 1)]++;
+			n++;
+			total += duration;
+			if (duration > max_) max_ = duration;
+		}
+
+		double DurationHistogram::percentile(double q) const
+		{
+			if (n == 0) return 0.;
+			unsigned rank = (unsigned)(q * n + 0.5), cumul = 0;
+			if (rank < 1) rank = 1;
+			for (std::size_t bin = 0; bin + 1 < bins_.size(); ++bin)
+			{
+				cumul += bins_[bin];
+				if (cumul >= rank) return std::min((bin + 1) * binWidth_, max_);
+			}
+			return max_;
+		}
+
+		std::ostream& operator <<(std::ostream & s, DurationHistogram const & hist)
+		{
+			s << "mean " << hist.mean() << " ms, p50 " << hist.percentile(0.5) << " ms, p90 " << hist.percentile(0.9)
+				<< " ms, p99 " << hist.percentile(0.99) << " ms, max " << hist.max() << " ms ;";
+			for (std::size_t bin = 0; bin < hist.bins_.size(); ++bin)
+			{
+				if (hist.bins_[bin] == 0) continue;
+				if (bin + 1 < hist.bins_.size()) s << " [" << bin * hist.binWidth_ << "," << (bin + 1) * hist.binWidth_ << "[:";
+				else s << " [" << bin * hist.binWidth_ << ",inf[:";
+				s << hist.bins_[bin];
+			}
+			return s;
+		}
+
+
+		FrameTiming::FrameTiming(double binWidth, std::size_t nBins) :
+			processing_(binWidth, nBins), latency_(binWidth, nBins), first_start(-1.), last_end(-1.)
+		{}
+
+		void FrameTiming::frameDone(double start, double end, double arrival)
+		{
+			if (first_start < 0.) first_start = start;
+			last_end = end;
+			processing_.add((end - start) * 1000.);
+			latency_.add((end - (arrival >= 0. ? arrival : start)) * 1000.);
+		}
+
+		double FrameTiming::throughput() const
+		{
+			if (count() == 0 || last_end <= first_start) return 0.;
+			return count() / (last_end - first_start);
+		}
+
+
+		FramePipeline::FramePipeline() :
+			busy(false), exiting(false)
+		{
+			counters_.n_tasks = 0;
+			counters_.busy_time = 0.;
+			counters_.n_blocked = 0;
+			counters_.wait_time = 0.;
+			worker = new boost::thread(boost::bind(&FramePipeline::workerLoop, this));
+		}
+
+		FramePipeline::~FramePipeline()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				exiting = true;
+			}
+			task_condition.notify_all();
+			worker->join();
+			delete worker;
+		}
+
+		void FramePipeline::post(const task_t & task)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				tasks.push_back(task);
+			}
+			task_condition.notify_all();
+		}
+
+		void FramePipeline::wait()
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			if (!busy && tasks.empty()) return;
+			kernel::Chrono chrono;
+			while (busy || !tasks.empty()) done_condition.wait(lock);
+			counters_.n_blocked++;
+			counters_.wait_time += chrono.elapsed();
+		}
+
+		void FramePipeline::workerLoop()
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (true)
+			{
+				while (!exiting && tasks.empty()) task_condition.wait(lock);
+				if (tasks.empty()) return; // exiting, and the posted tasks are done
+				task_t task = tasks.front();
+				tasks.pop_front();
+				busy = true;
+				lock.unlock();
+				kernel::Chrono chrono;
+				task();
+				double time = chrono.elapsed();
+				lock.lock();
+				busy = false;
+				counters_.n_tasks++;
+				counters_.busy_time += time;
+				if (tasks.empty()) done_condition.notify_all();
+			}
+		}
+
+	}
+}
@@ -11,6 +11,7 @@
 #include <boost/bind.hpp>
 
 #include "kernel/jafarMacro.hpp"
+#include "kernel/timingTools.hpp"
 #include "jmath/misc.hpp"
 #include "jmath/indirectArray.hpp"
 
@@ -20,6 +21,35 @@ namespace jafar {
 namespace rtslam {
 namespace hardware {
 
+	void HardwareEstimatorMti::preloadTaskOffline(void)
+	{ try {
+		const unsigned n_columns = buffer.size2();
+		double fill_time = 0.;
+		bool ok = readings.wait();
+		kernel::Chrono chrono;
+		size_t k = 0;
+		
+		while (true)
+		{
+			boost::unique_lock<boost::mutex> l(mutex_data);
+			if (write_position == read_position) cond_offline.notify_all();
+			if (!ok || k == readings.rows()) { cond_offline.notify_all(); break; }
+			while (write_position == read_position) cond_data.wait(l);
+			// copy all the readings that fit before the read position at once
+			chrono.reset();
+			for(; k < readings.rows() && write_position != read_position; ++k)
+			{
+				const double *row = readings.row(k);
+				for(unsigned j = 0; j < n_columns; ++j) buffer(write_position, j) = row[j];
+				buffer(write_position,0) += timestamps_correction;
+				++write_position; if (write_position >= bufferSize) write_position = 0;
+			}
+			fill_time += chrono.elapsedMicrosecond() * 1e-3;
+		}
+		if (ok) std::cout << "MTI replay: " << readings << ", " << fill_time << " ms copying to the buffer" << std::endl;
+		
+	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+
 	void HardwareEstimatorMti::preloadTask(void)
 	{ try {
 #ifdef HAVE_MTI
@@ -29,43 +59,32 @@ namespace hardware {
 		//double date = 0.;
 		jblas::vec row(10);
 		std::fstream f;
-		if (mode == 1 || mode == 2)
+		if (mode == 1)
 		{
 			std::ostringstream oss; oss << dump_path << "/MTI.log";
-			f.open(oss.str().c_str(), (mode == 1 ? std::ios_base::out : std::ios_base::in));
+			f.open(oss.str().c_str(), std::ios_base::out);
 		}
 		
 		while (true)
 		{
 			boost::unique_lock<boost::mutex> l(mutex_data, boost::defer_lock_t());
-			if (mode == 2)
-			{
-				f >> row;
-				l.lock();
-				if (write_position == read_position) cond_offline.notify_all();
-				if (f.eof()) { cond_offline.notify_all(); f.close(); return; }
-				while (write_position == read_position) cond_data.wait(l);
-// std::cout << "MTI preload: put at write_position " << write_position << " (read_position " << read_position << ") ts " << std::setprecision(16) << row(0) << std::endl;
-			} else
-			{
 #ifdef HAVE_MTI
-				//if (!emptied_buffers) date = kernel::Clock::getTime();
-				if (!mti->read(&data)) continue;
-				//if (!emptied_buffers) { date = kernel::Clock::getTime()-date; if (date < 0.002) continue; else emptied_buffers = true; }
-				l.lock();
-				if (write_position == read_position) JFR_ERROR(RtslamException, RtslamException::BUFFER_OVERFLOW, "Data not read: Increase MTI buffer size !");
-				row(0) = data.TIMESTAMP_FILTERED;
-				row(1) = data.ACC[0];
-				row(2) = data.ACC[1];
-				row(3) = data.ACC[2];
-				row(4) = data.GYR[0];
-				row(5) = data.GYR[1];
-				row(6) = data.GYR[2];
-				row(7) = data.MAG[0];
-				row(8) = data.MAG[1];
-				row(9) = data.MAG[2];
+			//if (!emptied_buffers) date = kernel::Clock::getTime();
+			if (!mti->read(&data)) continue;
+			//if (!emptied_buffers) { date = kernel::Clock::getTime()-date; if (date < 0.002) continue; else emptied_buffers = true; }
+			l.lock();
+			if (write_position == read_position) JFR_ERROR(RtslamException, RtslamException::BUFFER_OVERFLOW, "Data not read: Increase MTI buffer size !");
+			row(0) = data.TIMESTAMP_FILTERED;
+			row(1) = data.ACC[0];
+			row(2) = data.ACC[1];
+			row(3) = data.ACC[2];
+			row(4) = data.GYR[0];
+			row(5) = data.GYR[1];
+			row(6) = data.GYR[2];
+			row(7) = data.MAG[0];
+			row(8) = data.MAG[1];
+			row(9) = data.MAG[2];
 #endif
-			}
 			ublas::matrix_row<jblas::mat>(buffer, write_position) = row;
 			buffer(write_position,0) += timestamps_correction;
 			++write_position; if (write_position >= bufferSize) write_position = 0;
@@ -78,7 +97,7 @@ namespace hardware {
 			}
 		}
 		
-		if (mode == 1 || mode == 2)
+		if (mode == 1)
 			f.close();
 		
 	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
@@ -126,6 +145,8 @@ namespace hardware {
 		} else
 		{
 			realFreq = trigger_freq;
+			// parse the log while the rest is set up
+			readings.loadInBackground(dump_path + "/MTI.log", 10);
 		}
 		
 	}
@@ -144,12 +165,17 @@ namespace hardware {
 		started = true;
 		for(int i = 0; i < bufferSize; ++i) buffer(i,0) = -1.;
 		// start acquire task
-		preloadTask_thread = new boost::thread(boost::bind(&HardwareEstimatorMti::preloadTask,this));
 		if (mode == 2)
 		{ // wait that log has been read before first frame
+			// locked before the task starts so that its notification cannot be missed
+			kernel::Chrono chrono;
 			boost::unique_lock<boost::mutex> l(mutex_data);
+			preloadTask_thread = new boost::thread(boost::bind(&HardwareEstimatorMti::preloadTaskOffline,this));
 			cond_offline.wait(l);
+			std::cout << " done in " << chrono.elapsed() << " ms." << std::endl;
+			return;
 		}
+		preloadTask_thread = new boost::thread(boost::bind(&HardwareEstimatorMti::preloadTask,this));
 		std::cout << " done." << std::endl;
 	}
 	
@@ -6,6 +6,9 @@
  */
 
 
+#include <algorithm>
+
+#include "kernel/timingTools.hpp"
 #include "rtslam/hardwareSensorAbstract.hpp"
 
 namespace jafar {
@@ -17,4 +20,37 @@ namespace hardware {
   const int HardwareSensorProprioAbstract::QuantityObsSizes [qNQuantity] = { 3, 4, 3, 3, 3, 3, 3, 3, 3, 3 };
 
 
+	bool HardwareSensorProprioAbstract::preloadReadings(ReadingsFileReader & readings, double & last_timestamp, double & fill_time)
+	{
+		bool ok = readings.wait();
+		const unsigned n_columns = readings.columns();
+		kernel::Chrono chrono;
+		size_t k = 0;
+		fill_time = 0.;
+		
+		while (true)
+		{
+			{
+				boost::unique_lock<boost::mutex> l(mutex_data);
+				if (isFull(true)) cond_offline_full.notify_all();
+				if (!ok || k == readings.rows()) { no_more_data = true; cond_offline_full.notify_all(); return ok; }
+				waitWhileFull(l);
+			}
+			// fill all the free positions at once, the ring buffer does not need the mutex
+			chrono.reset();
+			for(; k < readings.rows() && !isFull(); ++k)
+			{
+				const double *row = readings.row(k);
+				RawVec & raw = buffer(getWritePos());
+				raw.data.resize(n_columns, false);
+				std::copy(row, row + n_columns, raw.data.begin());
+				raw.data(0) += timestamps_correction;
+				last_timestamp = row[0];
+				incWritePos();
+			}
+			fill_time += chrono.elapsedMicrosecond() * 1e-3;
+		}
+	}
+
+
 }}}
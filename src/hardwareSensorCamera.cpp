@@ -8,6 +8,8 @@
 #include <algorithm>
 #include <sstream>
 #include <fstream>
+#include <iomanip>
+#include <cstring>
 
 #if 0
 // creates conflict with boost sandbox with boost 1.42 in debug
@@ -26,16 +28,49 @@ namespace jafar {
 namespace rtslam {
 namespace hardware {
 
+	/// queued to stop a saveTask thread
+	static const unsigned dumpStopSlot = ~0u;
+
+
+	void HardwareSensorCamera::preloadTaskSequence(void)
+	{ try {
+		bufferHeader.resize(bufferSize, NULL);
+		for(unsigned k = 0; k < sequenceReader.count(); ++k)
+		{
+			boost::unique_lock<boost::mutex> l(mutex_data);
+			waitWhileFull(l);
+			l.unlock();
+			int buff_write = getWritePos();
+			// point the slot image to the mapped pixels, they are only read from the disk when used
+			if (bufferHeader[buff_write] == NULL)
+				bufferHeader[buff_write] = cvCreateImageHeader(cvSize(sequenceReader.width(), sequenceReader.height()), 8, 1);
+			cvSetData(bufferHeader[buff_write], sequenceReader.pixels(k), sequenceReader.step());
+			bufferSpecPtr[buff_write]->setJafarImage(jafarImage_ptr_t(new image::Image(bufferHeader[buff_write])));
+			bufferSpecPtr[buff_write]->timestamp = sequenceReader.timestamp(k);
+			bufferSpecPtr[buff_write]->arrival = sequenceReader.arrival(k);
+			incWritePos();
+			condition.setAndNotify(1);
+		}
+		boost::unique_lock<boost::mutex> l(mutex_data);
+		no_more_data = true;
+	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+
 
 	void HardwareSensorCamera::preloadTaskOffline(void)
 	{ try {
+		if (sequenceReader.open(dump_path + "/images.seq"))
+		{
+			std::cout << "Replaying " << sequenceReader.count() << " images from " << dump_path << "/images.seq" << std::endl;
+			preloadTaskSequence();
+			return;
+		}
 		int ndigit = 0;
 
 		while(true)
 		{
 			// acquire the image
 			boost::unique_lock<boost::mutex> l(mutex_data);
-			while (isFull(true)) cond_offline_freed.wait(l);
+			waitWhileFull(l);
 			l.unlock();
 			int buff_write = getWritePos();
 			while (true)
@@ -92,55 +127,190 @@ namespace hardware {
 		}
 		//remove(bdump_path / "*.pgm"); // FIXME possible ?
 		#else
-		std::ostringstream oss; oss << "mkdir -p " << dump_path << " ; rm -f " << dump_path << "/*.pgm ; rm -f " << dump_path << "/*.time" << std::endl;
+		std::ostringstream oss; oss << "mkdir -p " << dump_path << " ; rm -f " << dump_path << "/*.pgm ; rm -f " << dump_path << "/*.png ; rm -f " << dump_path << "/*.time ; rm -f " << dump_path << "/images.seq" << std::endl;
 		int r = system(oss.str().c_str());
 		if (!r) {} // don't care
 		#endif
 		
 		while (true)
 		{
-			index.wait(boost::lambda::_1 != last_processed_index);
-			// push image to file for saving
+			index.wait(boost::lambda::_1 != last_processed_index || boost::lambda::var(dump_stop), false);
+			bool stop = dump_stop;
+			int new_index = index.var;
+			index.unlock();
+			if (stop) break;
+			// with dpBlock the images are pushed by getRaw()
+			if (dump_policy != dpBlock)
+			{
+				if (new_index - last_processed_index > 1)
+				{
+					// this thread was late, the images it missed may already be overwritten
+					boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+					dump_counters.n_dropped += new_index - last_processed_index - 1;
+				}
+				pushDumpFrame(*bufferSpecPtr[last_sent_pos]);
+			}
+			last_processed_index = new_index;
+		}
+	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+	
+	
+	void HardwareSensorCamera::allocateDumpPool(int width, int height)
+	{
+		dump_pool.resize(dump_pool_size);
+		dump_free.clear();
+		for(unsigned i = 0; i < dump_pool_size; ++i)
+		{
+			dump_pool[i].ipl = cvCreateImage(cvSize(width, height), 8, 1);
+			dump_pool[i].img.reset(new image::Image(dump_pool[i].ipl));
+			dump_free.push_back(dump_pool_size-1-i);
+		}
+		dump_free_cond.setAndNotify(dump_pool_size);
+		
+		// the constructor of the derived class started one saveTask thread
+		unsigned workers = (packed_dump ? 1 : dump_workers);
+		for(unsigned i = 1; i < workers; ++i)
+			dump_worker_threads.push_back(new boost::thread(boost::bind(&HardwareSensorCamera::saveTask, this)));
+	}
+	
+	
+	void HardwareSensorCamera::pushDumpFrame(const RawImage & raw)
+	{
+		if (dump_pool.empty()) allocateDumpPool(raw.img->width(), raw.img->height());
+		if (raw.img->width() != dump_pool[0].img->width() || raw.img->height() != dump_pool[0].img->height())
+		{
+			std::cerr << "HardwareSensorCamera: cannot dump an image of a different size" << std::endl;
+			boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+			dump_counters.n_dropped++;
+			return;
+		}
+		
+		// get a free frame
+		int slot = -1;
+		if (dump_policy == dpBlock)
+		{
+			double wait_start = kernel::Clock::getTime();
+			dump_free_cond.wait(boost::lambda::_1 != 0, false);
+			boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+			dump_counters.block_time += (kernel::Clock::getTime() - wait_start) * 1000.;
+		} else
+			dump_free_cond.lock();
+		if (dump_free_cond.var > 0)
+		{
+			slot = dump_free.back();
+			dump_free.pop_back();
+			dump_free_cond.var--;
+		}
+		dump_free_cond.unlock();
+		if (slot < 0 && dump_policy == dpDropOldest)
+		{
+			// reuse the oldest frame that is not being written yet
 			saveTask_cond.lock();
-			bufferSave.push_front(rawimage_ptr_t(static_cast<RawImage*>(bufferSpecPtr[last_sent_pos]->clone())));
-			saveTask_cond.var++;
+			if (!dump_queue.empty() && dump_queue.front() != dumpStopSlot)
+			{
+				slot = dump_queue.front();
+				dump_queue.pop_front();
+				saveTask_cond.var--;
+			}
 			saveTask_cond.unlock();
-			saveTask_cond.notify();
-			last_processed_index = index();
+			boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+			dump_counters.n_dropped++;
+			if (slot < 0) return;
+		} else
+		if (slot < 0)
+		{
+			boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+			dump_counters.n_dropped++;
+			return;
 		}
-	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+		
+		// copy the image
+		DumpFrame & frame = dump_pool[slot];
+		const int width = frame.img->width();
+		for(int i = 0; i < frame.img->height(); ++i)
+			memcpy(frame.img->data() + i*frame.img->step(), raw.img->data() + i*raw.img->step(), width);
+		frame.timestamp = raw.timestamp;
+		frame.arrival = raw.arrival;
+		frame.date = kernel::Clock::getTime();
+		
+		// queue it
+		saveTask_cond.lock();
+		dump_queue.push_back(slot);
+		saveTask_cond.var++;
+		size_t queued = saveTask_cond.var;
+		saveTask_cond.unlock();
+		saveTask_cond.notify();
+		boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+		dump_counters.n_queued++;
+		if (queued > dump_counters.max_queued) dump_counters.max_queued = queued;
+	}
 	
 	
 	void HardwareSensorCamera::saveTask(void)
 	{ try {
-		
-		int save_index = index();
-		int remain = 0, prev_remain = 0;
-		
 		while (true)
 		{
-			// wait for and get next data to save
+			// wait for and get next data to save, the image files are numbered in the order of the queue
 			saveTask_cond.wait(boost::lambda::_1 != 0, false);
-			rawimage_ptr_t image = bufferSave.back();
-			bufferSave.pop_back();
+			unsigned slot = dump_queue.front();
+			dump_queue.pop_front();
 			saveTask_cond.var--;
-			remain = saveTask_cond.var;
+			if (slot == dumpStopSlot) { saveTask_cond.unlock(); break; }
+			size_t remain = saveTask_cond.var;
+			unsigned save_index = dump_index++;
 			saveTask_cond.unlock();
+			DumpFrame & frame = dump_pool[slot];
 			
-			std::ostringstream oss; oss << dump_path << "/image_" << std::setw(7) << std::setfill('0') << save_index;
-			image->img->save(oss.str() + std::string(".pgm"));
-			std::fstream f; f.open((oss.str() + std::string(".time")).c_str(), std::ios_base::out); 
-			f << std::setprecision(20) << image->timestamp << std::endl; f.close();
-			
-			if (remain > prev_remain || (remain == 0 && prev_remain != 0))
-				std::cout << save_index << ": " << remain << " in queue." << std::endl;
-			prev_remain = remain;
+			if (packed_dump)
+			{
+				if (!sequenceWriter.isOpen() && !sequenceWriter.open(dump_path + "/images.seq", frame.img->width(), frame.img->height(), frame.img->width()))
+					{ std::cerr << "Cannot create " << dump_path << "/images.seq, dumping image files instead" << std::endl; packed_dump = false; }
+				else
+				{
+					sequenceWriter.append(*frame.img, frame.timestamp, frame.arrival);
+					// keep the file complete up to the last image when the queue is empty
+					if (remain == 0) sequenceWriter.flush();
+				}
+			}
+			if (!packed_dump)
+			{
+				std::ostringstream oss; oss << dump_path << "/image_" << std::setw(7) << std::setfill('0') << save_index;
+				frame.img->save(oss.str() + std::string(dump_compress ? ".png" : ".pgm"));
+				std::fstream f; f.open((oss.str() + std::string(".time")).c_str(), std::ios_base::out); 
+				f << std::setprecision(20) << frame.timestamp << std::endl; f.close();
+			}
+			double latency = (kernel::Clock::getTime() - frame.date) * 1000.;
 			
-			++save_index;
+			// give the frame back
+			dump_free_cond.lock();
+			dump_free.push_back(slot);
+			dump_free_cond.var++;
+			dump_free_cond.unlock();
+			dump_free_cond.notify();
+			boost::unique_lock<boost::mutex> l(dump_counters_mutex);
+			dump_counters.n_written++;
+			dump_counters.latency.add(latency);
 		}
 	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
 	
 	
+	void HardwareSensorCamera::setDumpConfig(unsigned poolSize, DumpPolicy policy, unsigned compressWorkers)
+	{
+		dump_pool_size = (poolSize > 0 ? poolSize : 1);
+		dump_policy = policy;
+		dump_compress = (compressWorkers > 0);
+		dump_workers = (compressWorkers > 0 ? compressWorkers : 1);
+	}
+	
+	
+	void HardwareSensorCamera::getRaw(unsigned id, raw_ptr_t& raw)
+	{
+		HardwareSensorExteroAbstract::getRaw(id, raw);
+		if (savePushTask_thread && dump_policy == dpBlock)
+			pushDumpFrame(*bufferSpecPtr[id]);
+	}
+	
+	
 	void HardwareSensorCamera::init(std::string dump_path, cv::Size imgSize)
 	{
 		this->dump_path = dump_path;
@@ -159,18 +329,64 @@ namespace hardware {
 		found_first = 0;
 		first_index = 0;
 		index_load = 0;
+		packed_dump = false;
+		preloadTask_thread = savePushTask_thread = saveTask_thread = NULL;
+		setDumpConfig(100, dpBlock);
+		dump_index = 0;
+		dump_stop = false;
 	}
 
 	
-	HardwareSensorCamera::HardwareSensorCamera(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path):
-		HardwareSensorExteroAbstract(condition, 3), saveTask_cond(0)
+	HardwareSensorCamera::HardwareSensorCamera(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path, int bufferSize):
+		HardwareSensorExteroAbstract(condition, bufferSize), saveTask_cond(0), dump_free_cond(0)
 	{
 		init(dump_path, imgSize);
 	}
 
 	HardwareSensorCamera::HardwareSensorCamera(kernel::VariableCondition<int> &condition, int bufferSize):
-		HardwareSensorExteroAbstract(condition, bufferSize), saveTask_cond(0)
-	{}
+		HardwareSensorExteroAbstract(condition, bufferSize), packed_dump(false), saveTask_cond(0), dump_free_cond(0)
+	{
+		preloadTask_thread = savePushTask_thread = saveTask_thread = NULL;
+		setDumpConfig(100, dpBlock);
+		dump_index = 0;
+		dump_stop = false;
+	}
+
+	HardwareSensorCamera::~HardwareSensorCamera()
+	{
+		// stop pushing frames before stopping the threads that write them
+		if (savePushTask_thread)
+		{
+			index.lock();
+			dump_stop = true;
+			index.unlock();
+			index.notify();
+			savePushTask_thread->join();
+			delete savePushTask_thread;
+		}
+		
+		// one stop slot per thread, after the frames that are still queued
+		std::vector<boost::thread*> workers = dump_worker_threads;
+		if (saveTask_thread) workers.push_back(saveTask_thread);
+		for(unsigned i = 0; i < workers.size(); ++i)
+		{
+			saveTask_cond.lock();
+			dump_queue.push_back(dumpStopSlot);
+			saveTask_cond.var++;
+			saveTask_cond.unlock();
+			saveTask_cond.notify();
+		}
+		for(unsigned i = 0; i < workers.size(); ++i)
+		{
+			workers[i]->join();
+			delete workers[i];
+		}
+		for(unsigned i = 0; i < dump_pool.size(); ++i)
+		{
+			dump_pool[i].img.reset();
+			cvReleaseImage(&dump_pool[i].ipl);
+		}
+	}
 
 	
 
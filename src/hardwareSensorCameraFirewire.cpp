@@ -228,9 +228,11 @@ namespace hardware {
 	}
 		
 	
-	HardwareSensorCameraFirewire::HardwareSensorCameraFirewire(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path):
-		HardwareSensorCamera(condition, imgSize, dump_path)
-	{}
+	HardwareSensorCameraFirewire::HardwareSensorCameraFirewire(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path, int bufferSize):
+		HardwareSensorCamera(condition, imgSize, dump_path, bufferSize)
+	{
+		mode = 2;
+	}
 	
 
 #ifdef HAVE_VIAM
@@ -102,9 +102,11 @@ namespace hardware {
 	}
 		
 	
-	HardwareSensorCameraUeye::HardwareSensorCameraUeye(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path):
-		HardwareSensorCamera(condition, imgSize, dump_path)
-	{}
+	HardwareSensorCameraUeye::HardwareSensorCameraUeye(kernel::VariableCondition<int> &condition, cv::Size imgSize, std::string dump_path, int bufferSize):
+		HardwareSensorCamera(condition, imgSize, dump_path, bufferSize)
+	{
+		mode = 2;
+	}
 	
 
 #ifdef HAVE_UEYE
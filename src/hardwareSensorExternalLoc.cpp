@@ -57,7 +57,7 @@ namespace hardware {
 				boost::unique_lock<boost::mutex> l(mutex_data);
 				if (isFull(true)) cond_offline_full.notify_all();
 				if (f.eof()) { no_more_data = true; cond_offline_full.notify_all(); f.close(); return; }
-				while (isFull(true)) cond_offline_freed.wait(l);
+				waitWhileFull(l);
 				
 			} else
 			{
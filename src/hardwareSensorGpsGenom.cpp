@@ -22,6 +22,14 @@ namespace rtslam {
 namespace hardware {
 
 
+	void HardwareSensorGpsGenom::preloadTaskOffline(void)
+	{ try {
+		double fill_time;
+		if (preloadReadings(readings, last_timestamp, fill_time))
+			std::cout << "GPS replay: " << readings << ", " << fill_time << " ms copying to the buffer" << std::endl;
+	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+	
+	
 	void HardwareSensorGpsGenom::preloadTask(void)
 	{ try {
 		char data[256];
@@ -33,58 +41,47 @@ namespace hardware {
 		double *pos; float *var;
 		
 		std::fstream f;
-		if (mode == 1 || mode == 2)
+		if (mode == 1)
 		{
 			std::ostringstream oss; oss << dump_path << "/GPS.log";
-			f.open(oss.str().c_str(), (mode == 1 ? std::ios_base::out : std::ios_base::in));
+			f.open(oss.str().c_str(), std::ios_base::out);
 		}
 		
 		while (true)
 		{
-			if (mode == 2)
-			{
-				f >> reading.data;
-				boost::unique_lock<boost::mutex> l(mutex_data);
-				if (isFull(true)) cond_offline_full.notify_all();
-				if (f.eof()) { no_more_data = true; cond_offline_full.notify_all(); f.close(); return; }
-				while (isFull(true)) cond_offline_freed.wait(l);
-				
-			} else
-			{
 #ifdef HAVE_POSTERLIB
-				while (true) // wait for new data
+			while (true) // wait for new data
+			{
+				usleep(1000);
+				if (posterIoctl(posterId, FIO_GETDATE, &h2timestamp) != ERROR)
 				{
-					usleep(1000);
-					if (posterIoctl(posterId, FIO_GETDATE, &h2timestamp) != ERROR)
+					if (h2timestamp.ntick != prev_ntick)
 					{
-						if (h2timestamp.ntick != prev_ntick)
+						prev_ntick = h2timestamp.ntick;
+						if (posterRead(posterId, 0, data, 256) != ERROR)
 						{
-							prev_ntick = h2timestamp.ntick;
-							if (posterRead(posterId, 0, data, 256) != ERROR)
+							date = (double*)(data+80+44);
+							if (*date != prev_date)
 							{
-								date = (double*)(data+80+44);
-								if (*date != prev_date)
-								{
-									prev_date = *date;
-									break;
-								}
+								prev_date = *date;
+								break;
 							}
 						}
 					}
 				}
-#endif
-				reading.arrival = kernel::Clock::getTime();
-				pos = (double*)(data+16);
-				var = (float*)(data+48);
-				reading.data(0) = *date;
-				reading.data(1) = pos[1]; // swap
-				reading.data(2) = pos[0];
-				reading.data(3) = pos[2];
-				reading.data(4) = var[1]; // swap
-				reading.data(5) = var[0];
-				reading.data(6) = var[2];
-				//std::cout << "GPS poster : " << std::setprecision(15) << reading.data << std::endl;
 			}
+#endif
+			reading.arrival = kernel::Clock::getTime();
+			pos = (double*)(data+16);
+			var = (float*)(data+48);
+			reading.data(0) = *date;
+			reading.data(1) = pos[1]; // swap
+			reading.data(2) = pos[0];
+			reading.data(3) = pos[2];
+			reading.data(4) = var[1]; // swap
+			reading.data(5) = var[0];
+			reading.data(6) = var[2];
+			//std::cout << "GPS poster : " << std::setprecision(15) << reading.data << std::endl;
 			
 			int buff_write = getWritePos();
 			buffer(buff_write).data = reading.data;
@@ -108,6 +105,8 @@ namespace hardware {
 		addQuantity(qPos);
 		//addQuantity(qAbsVel);
 		reading.resize(readingSize());
+		// parse the log while the rest is set up
+		if (mode == 2) readings.loadInBackground(dump_path + "/GPS.log", readingSize());
 		// configure
 		if (mode == 0 || mode == 1)
 		{
@@ -132,13 +131,16 @@ namespace hardware {
 		if (started) { std::cout << "Warning: This HardwareSensorGpsGenom has already been started" << std::endl; return; }
 		started = true;
 		last_timestamp = kernel::Clock::getTime();
-		preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorGpsGenom::preloadTask,this));
-		
 		if (mode == 2)
 		{ // wait that log has been read before first frame
+			// locked before the task starts so that its notification cannot be missed
+			kernel::Chrono chrono;
 			boost::unique_lock<boost::mutex> l(mutex_data);
+			preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorGpsGenom::preloadTaskOffline,this));
 			cond_offline_full.wait(l);
-		}
+			std::cout << "GPS replay ready in " << chrono.elapsed() << " ms" << std::endl;
+		} else
+			preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorGpsGenom::preloadTask,this));
 	}
 	
 }}}
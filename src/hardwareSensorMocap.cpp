@@ -18,30 +18,28 @@ namespace rtslam {
 namespace hardware {
 
 
+	void HardwareSensorMocap::preloadTaskOffline(void)
+	{ try {
+		double fill_time;
+		if (preloadReadings(readings, last_timestamp, fill_time))
+			std::cout << "mocap replay: " << readings << ", " << fill_time << " ms copying to the buffer" << std::endl;
+	} catch (kernel::Exception &e) { std::cout << e.what(); throw e; } }
+	
+	
 	void HardwareSensorMocap::preloadTask(void)
 	{ try {
 
 		std::fstream f;
-		if (mode == 1 || mode == 2)
+		if (mode == 1)
 		{
 			std::ostringstream oss; oss << dump_path << "/mocap.log";
-			f.open(oss.str().c_str(), (mode == 1 ? std::ios_base::out : std::ios_base::in));
+			f.open(oss.str().c_str(), std::ios_base::out);
 		}
 		
 		while (true)
 		{
-			if (mode == 2)
-			{
-				f >> reading.data;
-				boost::unique_lock<boost::mutex> l(mutex_data);
-				if (isFull(true)) cond_offline_full.notify_all();
-				if (f.eof()) { no_more_data = true; cond_offline_full.notify_all(); f.close(); return; }
-				while (isFull(true)) cond_offline_freed.wait(l);
-			} else
-			{
-				// TODO read data from sensor and put it in reading
-				reading.arrival = kernel::Clock::getTime();
-			}
+			// TODO read data from sensor and put it in reading
+			reading.arrival = kernel::Clock::getTime();
 			
 			int buff_write = getWritePos();
 			buffer(buff_write).data = reading.data;
@@ -65,6 +63,8 @@ namespace hardware {
 		addQuantity(qPos);
 		addQuantity(qOriEuler); // using euler x/y/z because the sensors work with euler and the uncertainty is provided with euler)
 		reading.resize(readingSize());
+		// parse the log while the rest is set up
+		if (mode == 2) readings.loadInBackground(dump_path + "/mocap.log", readingSize());
 		// configure
 		if (mode == 0 || mode == 1)
 		{
@@ -78,13 +78,16 @@ namespace hardware {
 		if (started) { std::cout << "Warning: This HardwareSensorMocap has already been started" << std::endl; return; }
 		started = true;
 		last_timestamp = kernel::Clock::getTime();
-		preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorMocap::preloadTask,this));
-		
 		if (mode == 2)
 		{ // wait that log has been read before first frame
+			// locked before the task starts so that its notification cannot be missed
+			kernel::Chrono chrono;
 			boost::unique_lock<boost::mutex> l(mutex_data);
+			preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorMocap::preloadTaskOffline,this));
 			cond_offline_full.wait(l);
-		}
+			std::cout << "mocap replay ready in " << chrono.elapsed() << " ms" << std::endl;
+		} else
+			preloadTask_thread = new boost::thread(boost::bind(&HardwareSensorMocap::preloadTask,this));
 	}
 	
 }}}
@@ -19,39 +19,91 @@ namespace jafar {
 		using namespace jmath::ublasExtra;
 
 		ExtendedKalmanFilterIndirect::ExtendedKalmanFilterIndirect(size_t _size) :
-			size_(_size), x_(size_), P_(size_)
+			size_(_size), engine_(INDIRECT), stackedSolver_(LU_INVERSE), x_(size_), P_(size_)
 		{
 			x_.clear();
 			P_.clear();
 		}
 
+		void ExtendedKalmanFilterIndirect::resize(size_t _size)
+		{
+			if (_size == size_) return;
+			size_t old_size = size_;
+			x_.resize(_size, true);
+			P_.resize(_size, true);
+			size_ = _size;
+			// new elements are not initialized by ublas
+			for (size_t i = old_size; i < size_; ++i) {
+				x_(i) = 0.0;
+				for (size_t j = 0; j <= i; ++j)
+					P_(i, j) = 0.0;
+			}
+		}
+
+		void ExtendedKalmanFilterIndirect::ixaxpy(const ind_array & ia_inv, const mat & G, const ind_array & ia_in,
+		    const ind_array & ia_out, const sym_mat * Q)
+		{
+			if (engine_ == BLOCKS)
+			{
+				kalman::splitBlocks(ia_inv, blocks_1);
+				kalman::splitBlocks(ia_in, blocks_2);
+				kalman::splitBlocks(ia_out, blocks_3);
+				kalman::ixaxpy_blocks(P_, blocks_1, G, blocks_2, blocks_3, Q, pool_.get());
+			} else
+				kalman::ixaxpy_indirect(P_, ia_inv, G, ia_in, ia_out, Q, pool_.get());
+		}
+
 		void ExtendedKalmanFilterIndirect::predict(const ind_array & ia_x, const mat & F_v, const ind_array & ia_v,
 		    const mat & F_u, const sym_mat & U)
 		{
 			ind_array ia_invariant = ublasExtra::ia_complement(ia_x, ia_v);
-			ixaxpy_prod(P_, ia_invariant, F_v, ia_v, ia_v, prod_JPJt(U, F_u));
+			sym_mat Q = prod_JPJt(U, F_u);
+			ixaxpy(ia_invariant, F_v, ia_v, ia_v, &Q);
 		}
 
 		void ExtendedKalmanFilterIndirect::predict(const ind_array & ia_x, const mat & F_v, const ind_array & ia_v,
 		    const sym_mat & Q)
 		{
 			ind_array ia_inv = ublasExtra::ia_complement(ia_x, ia_v);
-			ixaxpy_prod(P_, ia_inv, F_v, ia_v, ia_v, Q);
+			ixaxpy(ia_inv, F_v, ia_v, ia_v, &Q);
+		}
+
+		void ExtendedKalmanFilterIndirect::predictInvariant(const ind_array & ia_inv, const mat & F_v, const ind_array & ia_v,
+		    const sym_mat & Q)
+		{
+			ixaxpy(ia_inv, F_v, ia_v, ia_v, &Q);
 		}
 
 		void ExtendedKalmanFilterIndirect::initialize(const ind_array & ia_x, const mat & G_v, const ind_array & ia_rs, const ind_array & ia_l, const mat & G_y, const sym_mat & R){
 			ind_array ia_invariant = ia_complement(ia_x, ia_l);
-			ixaxpy_prod(P_, ia_invariant, G_v, ia_rs, ia_l, prod_JPJt(R, G_y));
+			sym_mat Q = prod_JPJt(R, G_y);
+			ixaxpy(ia_invariant, G_v, ia_rs, ia_l, &Q);
 		}
 
 		void ExtendedKalmanFilterIndirect::initialize(const ind_array & ia_x, const mat & G_v, const ind_array & ia_rs, const ind_array & ia_l, const mat & G_y, const sym_mat & R, const mat & G_n, const sym_mat & N){
 			ind_array ia_invariant = ia_complement(ia_x, ia_l);
-			ixaxpy_prod(P_, ia_invariant, G_v, ia_rs, ia_l, prod_JPJt(R, G_y) + prod_JPJt(N, G_n));
+			sym_mat Q = prod_JPJt(R, G_y) + prod_JPJt(N, G_n);
+			ixaxpy(ia_invariant, G_v, ia_rs, ia_l, &Q);
+		}
+
+		void ExtendedKalmanFilterIndirect::initialize(const ind_array & ia_x, const mat & G_rs, const ind_array & ia_rs, const ind_array & ia_l, const sym_mat & Q){
+			ind_array ia_invariant = ia_complement(ia_x, ia_l);
+			ixaxpy(ia_invariant, G_rs, ia_rs, ia_l, &Q);
 		}
 
 		void ExtendedKalmanFilterIndirect::reparametrize(const ind_array & ia_x, const mat & J_l, const ind_array & ia_old, const ind_array & ia_new){
 			ind_array ia_invariant = ia_complement(ia_x, ia_union(ia_old,ia_new));
-			ixaxpy_prod(P_, ia_invariant, J_l, ia_old, ia_new);
+			ixaxpy(ia_invariant, J_l, ia_old, ia_new, NULL);
+		}
+
+		void ExtendedKalmanFilterIndirect::updateP(const ind_array & ia_x)
+		{
+			if (engine_ == BLOCKS)
+			{
+				kalman::splitBlocks(ia_x, blocks_x);
+				kalman::symUpdate_blocks(P_, blocks_x, K, PJt_tmp, pool_.get());
+			} else
+				kalman::symRankUpdate(P_, ia_x, K, PJt_tmp, pool_.get()); // P(x,x) += K * PJt_tmp'
 		}
 
 		void ExtendedKalmanFilterIndirect::computeKalmanGain(const ind_array & ia_x, Innovation & inn, const mat & INN_rsl, const ind_array & ia_rsl){
@@ -69,7 +121,66 @@ namespace jafar {
 
 			// mean and covariances update:
 			ublas::project(x_, ia_x) += prod(K, inn.x());
-			ublas::project(P_, ia_x, ia_x) += prod<sym_mat> (K, trans(PJt_tmp));
+			updateP(ia_x);
+		}
+
+		void ExtendedKalmanFilterIndirect::correctSequential(const ind_array & ia_x, const Innovation & inn, const mat & INN_rsl,
+		    const ind_array & ia_rsl, const sym_mat & R)
+		{
+			size_t m = INN_rsl.size1(), nrsl = ia_rsl.size();
+			vec z = inn.x();
+			mat INN = INN_rsl;
+			vec Rdiag(m);
+
+			// whiten the components if they are correlated
+			bool diagonal = true;
+			for (size_t i = 0; i < m && diagonal; ++i)
+				for (size_t j = 0; j < i; ++j)
+					if (R(i, j) != 0.0) { diagonal = false; break; }
+			if (diagonal)
+				for (size_t k = 0; k < m; ++k) Rdiag(k) = R(k, k);
+			else
+			{
+				mat L = R;
+				if (!kalman::cholesky(L))
+				{
+					JFR_DEBUG("correctSequential: measurement noise is not positive definite, skipping update");
+					return;
+				}
+				kalman::solveLower(L, INN);
+				kalman::solveLower(L, z);
+				for (size_t k = 0; k < m; ++k) Rdiag(k) = 1.0;
+			}
+
+			// the scalar updates are only applied to the columns of the states of the innovation,
+			// their gains and the columns of P they used are collected for one rank-m update of P
+			PJt_tmp.resize(ia_x.size(), m, false);
+			K.resize(ia_x.size(), m, false);
+			mat PJt_rsl(nrsl, m);
+			vec s(m), dx_rsl(nrsl);
+			for (size_t k = 0; k < m; ++k)
+			{
+				ublas::matrix_row<mat> INN_k(INN, k);
+				ublas::matrix_column<mat> PJt_k(PJt_tmp, k), PJt_rsl_k(PJt_rsl, k);
+				ublas::noalias(PJt_k) = prod(project(P_, ia_x, ia_rsl), INN_k);
+				ublas::noalias(PJt_rsl_k) = prod(project(P_, ia_rsl, ia_rsl), INN_k);
+				// P of the previous components: P + sum_j K_j * PJt_j'
+				for (size_t j = 0; j < k; ++j)
+				{
+					double c = ublas::inner_prod(ublas::column(PJt_rsl, j), INN_k);
+					PJt_k += ublas::column(K, j) * c;
+					PJt_rsl_k -= ublas::column(PJt_rsl, j) * (c / s(j));
+				}
+				s(k) = ublas::inner_prod(INN_k, PJt_rsl_k) + Rdiag(k);
+				ublas::noalias(ublas::column(K, k)) = - PJt_k / s(k);
+
+				// mean update, and propagation to the next components of the innovation
+				ublas::project(x_, ia_x) += ublas::column(K, k) * z(k);
+				ublas::noalias(dx_rsl) = - PJt_rsl_k * (z(k) / s(k));
+				for (size_t j = k + 1; j < m; ++j)
+					z(j) += ublas::inner_prod(ublas::row(INN, j), dx_rsl);
+			}
+			updateP(ia_x);
 		}
 
 
@@ -121,6 +232,25 @@ namespace jafar {
 			
 			// 2 compute Kalman gain
 // JFR_DEBUG("correctAllStacked: stackedInnovation_P " << stackedInnovation_P);
+			if (stackedSolver_ == CHOLESKY)
+			{
+				stackedInnovation_L = stackedInnovation_P;
+				if (kalman::cholesky(stackedInnovation_L))
+				{
+					// W = L^-1 * PJt' and z = L^-1 * inn, so that K * inn = -W' * z and K * PJt' = -W' * W
+					stackedInnovation_W = trans(PJt_tmp);
+					kalman::solveLower(stackedInnovation_L, stackedInnovation_W);
+					kalman::solveLower(stackedInnovation_L, stackedInnovation_x);
+					ublas::noalias(PJt_tmp) = trans(stackedInnovation_W);
+					ublas::noalias(K) = - PJt_tmp;
+					// 3 correct
+					ublas::noalias(ublas::project(x_, ia_x)) += prod(K, stackedInnovation_x);
+					updateP(ia_x);
+					corrStack.clear();
+					return;
+				}
+				JFR_DEBUG("correctAllStacked: stacked innovation covariance is not positive definite, using LU inverse");
+			}
 			ublasExtra::lu_inv(stackedInnovation_P, stackedInnovation_iP);
 // JFR_DEBUG("correctAllStacked: stackedInnovation_iP " << stackedInnovation_iP);
 // JFR_DEBUG("correctAllStacked: PJt_tmp " << PJt_tmp);
@@ -130,7 +260,7 @@ namespace jafar {
 // JFR_DEBUG("correctAllStacked: dx " << prod(K, stackedInnovation_x));
 			// 3 correct
 			ublas::noalias(ublas::project(x_, ia_x)) += prod(K, stackedInnovation_x);
-			ublas::project(P_, ia_x, ia_x) += prod<sym_mat>(K, trans(PJt_tmp)); // noalias crashes
+			updateP(ia_x);
 			
 			corrStack.clear();
 		}
@@ -0,0 +1,280 @@
+/**
+ * \file kalmanTools.cpp
+ * \ingroup rtslam
+ */
+
+#include "rtslam/kalmanTools.hpp"
+#include "rtslam/simd.hpp"
+#include "jmath/ixaxpy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+
+namespace jafar {
+	namespace rtslam {
+		namespace kalman {
+			using namespace std;
+
+			void splitBlocks(const ind_array & ia, StateBlocks & blocks) {
+				blocks.clear();
+				for (size_t i = 0; i < ia.size(); ++i) {
+					if (blocks.empty() || ia(i) != blocks.back().first + blocks.back().size) {
+						StateBlock b;
+						b.first = ia(i); b.size = 1; b.pos = i;
+						blocks.push_back(b);
+					} else
+						blocks.back().size++;
+				}
+			}
+
+
+			/*
+			 * Cross-variances with the invariant blocks [b_begin,b_end): P(out,b) = G * P(in,b).
+			 * All of P(in,b) is read before writing P(out,b) so that in and out can be the same.
+			 */
+			static void ixaxpy_blocks_cross(sym_mat & P, const StateBlocks & inv, size_t b_begin, size_t b_end,
+			                                const mat & G, const StateBlocks & in, const StateBlocks & out)
+			{
+				size_t nout = G.size1();
+				mat C;
+				for (size_t ib = b_begin; ib < b_end; ++ib) {
+					const StateBlock & b = inv[ib];
+					C.resize(nout, b.size, false);
+					C.clear();
+					for (StateBlocks::const_iterator a = in.begin(); a != in.end(); ++a)
+						ublas::noalias(C) += ublas::prod(ublas::subrange(G, 0, nout, a->pos, a->pos + a->size),
+						                                 ublas::project(P, a->range(), b.range()));
+					for (StateBlocks::const_iterator o = out.begin(); o != out.end(); ++o)
+						ublas::project(P, o->range(), b.range()) = ublas::subrange(C, o->pos, o->pos + o->size, 0, b.size);
+				}
+			}
+
+			/*
+			 * Bounds of nchunks chunks of [0,n), of equal size.
+			 */
+			static void splitRange(size_t n, size_t nchunks, std::vector<size_t> & bounds)
+			{
+				bounds.resize(nchunks + 1);
+				for (size_t t = 0; t <= nchunks; ++t)
+					bounds[t] = n * t / nchunks;
+			}
+
+			/*
+			 * Bounds of nchunks chunks of the rows [0,n) of a lower triangle, of equal area.
+			 */
+			static void splitTriangle(size_t n, size_t nchunks, std::vector<size_t> & bounds)
+			{
+				bounds.resize(nchunks + 1);
+				for (size_t t = 0; t <= nchunks; ++t)
+					bounds[t] = (size_t)(n * sqrt((double)t / nchunks) + 0.5);
+				bounds[nchunks] = n;
+			}
+
+			static void runChunk(const boost::function<void(size_t, size_t)> & f, const std::vector<size_t> & bounds, size_t t)
+			{
+				f(bounds[t], bounds[t + 1]);
+			}
+
+			/*
+			 * Run f(begin,end) on each chunk, in parallel if a pool is given.
+			 */
+			static void forChunks(ThreadPool * pool, const std::vector<size_t> & bounds, const boost::function<void(size_t, size_t)> & f)
+			{
+				size_t nchunks = bounds.size() - 1;
+				if (pool)
+					pool->parallelFor(nchunks, boost::bind(&runChunk, boost::cref(f), boost::cref(bounds), _1));
+				else
+					for (size_t t = 0; t < nchunks; ++t) f(bounds[t], bounds[t + 1]);
+			}
+
+			static size_t numChunks(ThreadPool * pool, size_t n)
+			{
+				if (!pool) return 1;
+				return std::max<size_t>(1, std::min(pool->size(), n));
+			}
+
+
+			void ixaxpy_blocks(sym_mat & P, const StateBlocks & inv, const mat & G, const StateBlocks & in,
+			                   const StateBlocks & out, const sym_mat * Q, ThreadPool * pool)
+			{
+				size_t nin = G.size2();
+
+				// cross-variances with invariant states, split by invariant blocks
+				std::vector<size_t> bounds;
+				splitRange(inv.size(), numChunks(pool, inv.size()), bounds);
+				forChunks(pool, bounds, boost::bind(&ixaxpy_blocks_cross, boost::ref(P), boost::cref(inv), _1, _2,
+				                                    boost::cref(G), boost::cref(in), boost::cref(out)));
+
+				// output block: P(out,out) = G * P(in,in) * G' + Q
+				mat Pin(nin, nin);
+				for (StateBlocks::const_iterator a1 = in.begin(); a1 != in.end(); ++a1)
+					for (StateBlocks::const_iterator a2 = in.begin(); a2 != in.end(); ++a2)
+						ublas::subrange(Pin, a1->pos, a1->pos + a1->size, a2->pos, a2->pos + a2->size) =
+						    ublas::project(P, a1->range(), a2->range());
+				mat Pout = ublas::prod(G, ublas::prod<mat>(Pin, ublas::trans(G)));
+				if (Q) Pout += *Q;
+				for (StateBlocks::const_iterator o1 = out.begin(); o1 != out.end(); ++o1)
+					for (StateBlocks::const_iterator o2 = out.begin(); o2 != out.end(); ++o2)
+						ublas::project(P, o1->range(), o2->range()) =
+						    ublas::subrange(Pout, o1->pos, o1->pos + o1->size, o2->pos, o2->pos + o2->size);
+			}
+
+
+			/*
+			 * Cross-variances with the invariant states of positions [c_begin,c_end) in ia_inv: P(out,c) = G * P(in,c).
+			 */
+			static void ixaxpy_indirect_cross(sym_mat & P, const ind_array & ia_inv, size_t c_begin, size_t c_end,
+			                                  const mat & G, const ind_array & ia_in, const ind_array & ia_out)
+			{
+				ind_array ia_c(c_end - c_begin);
+				for (size_t c = c_begin; c < c_end; ++c) ia_c(c - c_begin) = ia_inv(c);
+				mat C = ublas::prod(G, ublas::project(P, ia_in, ia_c));
+				ublas::project(P, ia_out, ia_c) = C;
+			}
+
+			void ixaxpy_indirect(sym_mat & P, const ind_array & ia_inv, const mat & G, const ind_array & ia_in,
+			                     const ind_array & ia_out, const sym_mat * Q, ThreadPool * pool)
+			{
+				if (!pool || pool->size() == 1) {
+					if (Q) ixaxpy_prod(P, ia_inv, G, ia_in, ia_out, *Q);
+					else ixaxpy_prod(P, ia_inv, G, ia_in, ia_out);
+					return;
+				}
+
+				// cross-variances with invariant states, split by columns
+				std::vector<size_t> bounds;
+				splitRange(ia_inv.size(), numChunks(pool, ia_inv.size()), bounds);
+				forChunks(pool, bounds, boost::bind(&ixaxpy_indirect_cross, boost::ref(P), boost::cref(ia_inv), _1, _2,
+				                                    boost::cref(G), boost::cref(ia_in), boost::cref(ia_out)));
+
+				// output block: P(out,out) = G * P(in,in) * G' + Q
+				mat Pout = ublas::prod(G, ublas::prod<mat>(ublas::project(P, ia_in, ia_in), ublas::trans(G)));
+				if (Q) Pout += *Q;
+				ublas::project(P, ia_out, ia_out) = Pout;
+			}
+
+
+			/*
+			 * Rows of blocks [i_begin,i_end) of the block update.
+			 */
+			static void symUpdate_blocks_rows(sym_mat & P, const StateBlocks & x, size_t i_begin, size_t i_end,
+			                                  const mat & K, const mat & PJt)
+			{
+				size_t m = K.size2();
+				for (size_t i = i_begin; i < i_end; ++i) {
+					const StateBlock & bi = x[i];
+					ublas::matrix_range<const mat> K_i(K, ublas::range(bi.pos, bi.pos + bi.size), ublas::range(0, m));
+					for (StateBlocks::const_iterator bj = x.begin(); bj != x.end(); ++bj) {
+						if (bj->first > bi.first) continue; // lower triangle only
+						ublas::matrix_range<const mat> PJt_j(PJt, ublas::range(bj->pos, bj->pos + bj->size), ublas::range(0, m));
+						if (bj->first == bi.first) {
+							// diagonal block: P(r,c) and P(c,r) share storage, update each element once
+							for (size_t r = 0; r < bi.size; ++r)
+								for (size_t c = 0; c <= r; ++c)
+									P(bi.first + r, bi.first + c) += ublas::inner_prod(ublas::row(K_i, r), ublas::row(PJt_j, c));
+						} else
+							ublas::project(P, bi.range(), bj->range()) += ublas::prod(K_i, ublas::trans(PJt_j));
+					}
+				}
+			}
+
+			void symUpdate_blocks(sym_mat & P, const StateBlocks & x, const mat & K, const mat & PJt, ThreadPool * pool)
+			{
+				// each block row only writes its own elements of the lower triangle
+				std::vector<size_t> bounds;
+				splitRange(x.size(), numChunks(pool, x.size()), bounds);
+				forChunks(pool, bounds, boost::bind(&symUpdate_blocks_rows, boost::ref(P), boost::cref(x), _1, _2,
+				                                    boost::cref(K), boost::cref(PJt)));
+			}
+
+
+			/*
+			 * Rows [i_begin,i_end) of the rank-k update.
+			 */
+			static void symRankUpdate_rows(sym_mat & P, const ind_array & ia_x, size_t i_begin, size_t i_end,
+			                               const mat & K, const std::vector<double> & PJtT)
+			{
+				size_t n = ia_x.size(), m = K.size2();
+				std::vector<double> acc(n);
+				// row i of the lower triangle: acc(0:i) = sum_k K(i,k) * PJt(0:i,k)
+				for (size_t i = i_begin; i < i_end; ++i) {
+					std::fill(acc.begin(), acc.begin() + i + 1, 0.0);
+					for (size_t k = 0; k < m; ++k)
+						simd::axpy(K(i, k), &PJtT[k * n], &acc[0], i + 1);
+					size_t ii = ia_x(i);
+					for (size_t j = 0; j <= i; ++j)
+						P(ii, ia_x(j)) += acc[j];
+				}
+			}
+
+			void symRankUpdate(sym_mat & P, const ind_array & ia_x, const mat & K, const mat & PJt, ThreadPool * pool)
+			{
+				size_t n = ia_x.size(), m = K.size2();
+				JFR_ASSERT(K.size1() == n && PJt.size1() == n && PJt.size2() == m, "symRankUpdate: sizes mismatch");
+				if (n == 0) return;
+
+				// transpose PJt so that the coefficients of all states for one column are contiguous
+				std::vector<double> PJtT(m * n);
+				for (size_t j = 0; j < n; ++j)
+					for (size_t k = 0; k < m; ++k)
+						PJtT[k * n + j] = PJt(j, k);
+
+				// each row only writes its own elements of the lower triangle
+				std::vector<size_t> bounds;
+				splitTriangle(n, numChunks(pool, n), bounds);
+				forChunks(pool, bounds, boost::bind(&symRankUpdate_rows, boost::ref(P), boost::cref(ia_x), _1, _2,
+				                                    boost::cref(K), boost::cref(PJtT)));
+			}
+
+
+
+			bool cholesky(mat & S)
+			{
+				size_t n = S.size1();
+				JFR_ASSERT(S.size2() == n, "cholesky: matrix is not square");
+				for (size_t j = 0; j < n; ++j) {
+					double d = S(j, j);
+					for (size_t k = 0; k < j; ++k) d -= S(j, k) * S(j, k);
+					if (!(d > 0.0)) return false; // also catches NaN
+					d = sqrt(d);
+					S(j, j) = d;
+					for (size_t i = j + 1; i < n; ++i) {
+						double s = S(i, j);
+						for (size_t k = 0; k < j; ++k) s -= S(i, k) * S(j, k);
+						S(i, j) = s / d;
+					}
+					for (size_t i = 0; i < j; ++i) S(i, j) = 0.0;
+				}
+				return true;
+			}
+
+			void solveLower(const mat & L, mat & B)
+			{
+				size_t m = L.size1(), n = B.size2();
+				JFR_ASSERT(B.size1() == m, "solveLower: sizes mismatch");
+				if (n == 0) return;
+				// row i of B: B(i,:) = (B(i,:) - sum_k<i L(i,k) * B(k,:)) / L(i,i), on contiguous rows
+				for (size_t i = 0; i < m; ++i) {
+					double * Bi = &B(i, 0);
+					for (size_t k = 0; k < i; ++k)
+						if (L(i, k) != 0.0) simd::axpy(-L(i, k), &B(k, 0), Bi, n);
+					double inv = 1.0 / L(i, i);
+					for (size_t j = 0; j < n; ++j) Bi[j] *= inv;
+				}
+			}
+
+			void solveLower(const mat & L, vec & b)
+			{
+				size_t m = L.size1();
+				JFR_ASSERT(b.size() == m, "solveLower: sizes mismatch");
+				for (size_t i = 0; i < m; ++i) {
+					double s = b(i);
+					for (size_t k = 0; k < i; ++k) s -= L(i, k) * b(k);
+					b(i) = s / L(i, i);
+				}
+			}
+
+		}
+	}
+}
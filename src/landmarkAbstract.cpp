@@ -61,6 +61,16 @@ namespace jafar {
 //			cout << "Deleted landmark: " << id() << ": " << typeName() << endl;
 		}
 
+		void LandmarkAbstract::remapStates(const std::vector<std::size_t> & newIndex) {
+			if (state.storage() != Gaussian::REMOTE) return;
+			MapObject::remapStates(newIndex);
+			for (ObservationList::iterator obsIter = observationList().begin(); obsIter != observationList().end(); obsIter++)
+			{
+				observation_ptr_t obsPtr = *obsIter;
+				obsPtr->ia_rsl = remapIndices(obsPtr->ia_rsl, newIndex);
+			}
+		}
+
 #if 0
 		bool LandmarkAbstract::needToDie(DecisionMethod dieMet){
 			switch (dieMet) {
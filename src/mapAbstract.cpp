@@ -14,6 +14,11 @@
 #include "rtslam/robotAbstract.hpp"
 #include "rtslam/landmarkAbstract.hpp"
 #include "rtslam/observationAbstract.hpp"
+#include "rtslam/sensorAbstract.hpp"
+#include "rtslam/mapManager.hpp"
+#include "kernel/timingTools.hpp"
+
+#include <algorithm>
 
 namespace jafar {
 	namespace rtslam {
@@ -25,15 +30,40 @@ namespace jafar {
 		/**
 		 * Constructor
 		 */
-		MapAbstract::MapAbstract(size_t _max_size) :
-			state(7), max_size(_max_size), current_size(0), used_states(max_size) {
+		MapAbstract::MapAbstract(size_t _max_size, size_t _initial_size) :
+			state(7), max_size(_max_size), current_size(0),
+			    used_states(_initial_size > 0 ? std::min(_initial_size, _max_size) : _max_size),
+			    ia_used_states_(0), used_states_version(0), compaction_th(1.0),
+			    initial_size(_initial_size > 0 ? std::min(_initial_size, _max_size) : 0) {
 			used_states.clear();
-			filterPtr.reset(new ExtendedKalmanFilterIndirect(_max_size));
+			compaction_counters.n_compactions = compaction_counters.n_moved_states = 0;
+			compaction_counters.total_time = compaction_counters.last_time = 0.0;
+			growth_counters.n_grows = growth_counters.n_shrinks = 0;
+			growth_counters.peak_capacity = used_states.size();
+			growth_counters.total_time = 0.0;
+			filterPtr.reset(new ExtendedKalmanFilterIndirect(used_states.size()));
 		}
 		MapAbstract::MapAbstract(const ekfInd_ptr_t & ekfPtr) :
 			state(7), filterPtr(ekfPtr), max_size(ekfPtr->size()), current_size(0),
-			    used_states(ekfPtr->size()) {
+			    used_states(ekfPtr->size()), ia_used_states_(0), used_states_version(0), compaction_th(1.0),
+			    initial_size(0) {
 			used_states.clear();
+			compaction_counters.n_compactions = compaction_counters.n_moved_states = 0;
+			compaction_counters.total_time = compaction_counters.last_time = 0.0;
+			growth_counters.n_grows = growth_counters.n_shrinks = 0;
+			growth_counters.peak_capacity = used_states.size();
+			growth_counters.total_time = 0.0;
+		}
+
+		void MapAbstract::resizeStorage(size_t _capacity) {
+			kernel::Chrono chrono;
+			size_t old_capacity = capacity();
+			filterPtr->resize(_capacity);
+			used_states.resize(_capacity, true);
+			for (size_t i = old_capacity; i < _capacity; ++i) used_states(i) = false;
+			if (_capacity > old_capacity) growth_counters.n_grows++; else growth_counters.n_shrinks++;
+			growth_counters.peak_capacity = std::max(growth_counters.peak_capacity, _capacity);
+			growth_counters.total_time += chrono.elapsed();
 		}
 
 		jblas::vec & MapAbstract::x() {
@@ -51,8 +81,24 @@ namespace jafar {
 
 		jblas::ind_array MapAbstract::reserveStates(const std::size_t N) {
 			if (unusedStates(N)) {
+				// grow geometrically so that the copies are amortized
+				if (capacity() - current_size < N)
+					resizeStorage(std::min(max_size, std::max(2 * capacity(), current_size + N)));
 				jblas::ind_array res = jmath::ublasExtra::ia_pushfront(used_states, N);
 				current_size += N;
+
+				// merge the new states into the sorted used states
+				std::vector<size_t> added(res.begin(), res.end());
+				std::sort(added.begin(), added.end());
+				jblas::ind_array ia(ia_used_states_.size() + added.size());
+				size_t i = 0, j = 0, k = 0;
+				while (i < ia_used_states_.size() || j < added.size())
+					if (j == added.size() || (i < ia_used_states_.size() && ia_used_states_(i) < added[j]))
+						ia(k++) = ia_used_states_(i++);
+					else
+						ia(k++) = added[j++];
+				ia_used_states_ = ia;
+				used_states_version++;
 				return res;
 			} else {
 				jblas::ind_array res(0);
@@ -84,13 +130,110 @@ namespace jafar {
 		}
 
 		void MapAbstract::liberateStates(const jblas::ind_array & _ia) {
+			size_t n_liberated = 0;
 			for (size_t i = 0; i < _ia.size(); i++) {
 				int j = _ia(i);
 				if (used_states(j) == true) {
 					used_states(j) = false;
 					current_size -= 1;
+					n_liberated++;
 				}
 			}
+			if (n_liberated == 0) return;
+
+			// remove the liberated states from the sorted used states
+			jblas::ind_array ia(ia_used_states_.size() - n_liberated);
+			size_t k = 0;
+			for (size_t i = 0; i < ia_used_states_.size(); ++i)
+				if (used_states(ia_used_states_(i))) ia(k++) = ia_used_states_(i);
+			ia_used_states_ = ia;
+			used_states_version++;
+		}
+
+		double MapAbstract::fragmentation() const {
+			if (current_size == 0) return 0.0;
+			size_t span = ia_used_states_(ia_used_states_.size() - 1) + 1;
+			return 1.0 - (double)current_size / span;
+		}
+
+		bool MapAbstract::compactIfFragmented() {
+			if (compaction_th >= 1.0 || fragmentation() <= compaction_th) return false;
+			return compact();
+		}
+
+		bool MapAbstract::compact() {
+			size_t n = ia_used_states_.size();
+			if (n == 0 || ia_used_states_(n - 1) == n - 1) return false; // already compact
+			kernel::Chrono chrono;
+
+			// new index of each old index; the order is kept so newIndex[i] <= i
+			std::vector<size_t> newIndex(capacity(), capacity());
+			for (size_t k = 0; k < n; ++k) newIndex[ia_used_states_(k)] = k;
+
+			// move the data in place: P(k,l) only reads P(ia(k),ia(l)) with ia(k) >= k and ia(l) >= l,
+			// which is in a row not written yet, or is the element itself
+			jblas::vec & x_ = x();
+			jblas::sym_mat & P_ = P();
+			size_t n_moved = 0;
+			for (size_t k = 0; k < n; ++k) {
+				size_t ok = ia_used_states_(k);
+				if (ok == k) continue;
+				n_moved++;
+				x_(k) = x_(ok);
+				for (size_t l = 0; l <= k; ++l)
+					P_(k, l) = P_(ok, ia_used_states_(l));
+			}
+
+			// used states
+			for (size_t i = 0; i < capacity(); ++i) used_states(i) = (i < n);
+			ia_used_states_ = jmath::ublasExtra::ia_set(0, n);
+			used_states_version++;
+
+			// patch all indices to the map
+			for (RobotList::iterator robIter = robotList().begin(); robIter != robotList().end(); ++robIter) {
+				robot_ptr_t robPtr = *robIter;
+				robPtr->remapStates(newIndex);
+				for (RobotAbstract::SensorList::iterator senIter = robPtr->sensorList().begin(); senIter != robPtr->sensorList().end(); ++senIter)
+					(*senIter)->remapStates(newIndex);
+			}
+			for (MapManagerList::iterator mmIter = mapManagerList().begin(); mmIter != mapManagerList().end(); ++mmIter) {
+				map_manager_ptr_t mmPtr = *mmIter;
+				for (MapManagerAbstract::LandmarkList::iterator lmkIter = mmPtr->landmarkList().begin(); lmkIter != mmPtr->landmarkList().end(); ++lmkIter)
+					(*lmkIter)->remapStates(newIndex);
+			}
+
+			// give back memory when the map is much smaller than the allocated states
+			if (initial_size > 0 && 4 * n < capacity() && capacity() > initial_size)
+				resizeStorage(std::max(2 * n, initial_size));
+
+			compaction_counters.n_compactions++;
+			compaction_counters.n_moved_states += n_moved;
+			compaction_counters.last_time = chrono.elapsed();
+			compaction_counters.total_time += compaction_counters.last_time;
+			return true;
+		}
+
+		const jblas::ind_array & MapAbstract::ia_used_complement(const jblas::ind_array & _ia) {
+			size_t key = (_ia.size() > 0 ? _ia(0) : max_size);
+			std::map<size_t, ComplementCache>::iterator it = complements.find(key);
+			if (it != complements.end() && it->second.version == used_states_version && it->second.ia.size() == _ia.size()
+			    && std::equal(_ia.begin(), _ia.end(), it->second.ia.begin()))
+				return it->second.complement;
+
+			ComplementCache & cache = complements[key];
+			cache.ia = _ia;
+			cache.version = used_states_version;
+			std::vector<size_t> complement;
+			complement.reserve(ia_used_states_.size());
+			for (size_t i = 0, j = 0; i < ia_used_states_.size(); ++i) {
+				// both are sorted
+				while (j < _ia.size() && _ia(j) < ia_used_states_(i)) ++j;
+				if (j < _ia.size() && _ia(j) == ia_used_states_(i)) continue;
+				complement.push_back(ia_used_states_(i));
+			}
+			cache.complement = jblas::ind_array(complement.size());
+			for (size_t i = 0; i < complement.size(); ++i) cache.complement(i) = complement[i];
+			return cache.complement;
 		}
 
 
@@ -100,22 +243,22 @@ namespace jafar {
 		}
 
 		void MapAbstract::fillSeq() {
-			for (size_t i = 0; i < max_size; i++) {
+			for (size_t i = 0; i < capacity(); i++) {
 				x(i) = i;
-				for (size_t j = 0; j < max_size; j++)
+				for (size_t j = 0; j < capacity(); j++)
 					P(i, j) = i + 100 * j;
 			}
 		}
 
 		void MapAbstract::fillDiag() {
-			for (size_t i = 0; i < max_size; i++) {
+			for (size_t i = 0; i < capacity(); i++) {
 				x(i) = i;
 				P(i, i) = 1;
 			}
 		}
 
 		void MapAbstract::fillDiagSeq() {
-			for (size_t i = 0; i < max_size; i++) {
+			for (size_t i = 0; i < capacity(); i++) {
 				x(i) = i;
 				P(i, i) = i;
 			}
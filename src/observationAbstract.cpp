@@ -6,6 +6,7 @@
  */
 
 #include "kernel/jafarDebug.hpp"
+#include "jmath/ublasExtra.hpp"
 
 #include "rtslam/observationAbstract.hpp"
 #include "rtslam/sensorAbstract.hpp"
@@ -169,6 +170,22 @@ namespace jafar {
 		}
 
 		void ObservationAbstract::backProject(){
+			backProjectMean();
+
+			// Initialize in map
+			landmarkPtr()->mapManagerPtr()->mapPtr()->filterPtr
+			  ->initialize(
+				       landmarkPtr()->mapManagerPtr()->mapPtr()->ia_used_states(),
+					LMK_rs,
+					sensorPtr()->ia_globalPose,
+					landmarkPtr()->state.ia(),
+					LMK_meas,
+					measurement.P(),
+					LMK_prior,
+					prior.P());
+		}
+
+		void ObservationAbstract::backProjectMean(){
 			vec7 sg;
 
 			// Get global sensor pose
@@ -183,18 +200,37 @@ namespace jafar {
 			landmarkPtr()->state.x(lmk);
 
 			LMK_rs = ublas::prod(LMK_sg, SG_rs);
+		}
 
-			// Initialize in map
-			landmarkPtr()->mapManagerPtr()->mapPtr()->filterPtr
-			  ->initialize(
-				       landmarkPtr()->mapManagerPtr()->mapPtr()->ia_used_states(),
-					LMK_rs,
-					sensorPtr()->ia_globalPose,
-					landmarkPtr()->state.ia(),
-					LMK_meas,
-					measurement.P(),
-					LMK_prior,
-					prior.P());
+		void ObservationAbstract::initializeGroup(const std::vector<observation_ptr_t> & obsList){
+			if (obsList.empty()) return;
+			const observation_ptr_t & first = obsList.front();
+			const ind_array & ia_rs = first->sensorPtr()->ia_globalPose;
+			map_ptr_t mapPtr = first->landmarkPtr()->mapManagerPtr()->mapPtr();
+
+			size_t n = 0;
+			for (size_t k = 0; k < obsList.size(); ++k)
+				n += obsList[k]->landmarkPtr()->state.size();
+
+			// stacked Jacobians wrt robot and sensor, and block diagonal covariance of the landmarks
+			mat G_rs(n, ia_rs.size());
+			sym_mat Q(n); Q.clear();
+			ind_array ia_l(n);
+			size_t i = 0;
+			for (size_t k = 0; k < obsList.size(); ++k)
+			{
+				const ObservationAbstract & obs = *obsList[k];
+				JFR_ASSERT(obs.sensorPtr() == first->sensorPtr(), "observations of a group must come from the same sensor");
+				const ind_array & ia = obs.landmarkPtr()->state.ia();
+				size_t s = ia.size();
+				ublas::subrange(G_rs, i, i+s, 0, ia_rs.size()) = obs.LMK_rs;
+				ublas::subrange(Q, i, i+s, i, i+s) = jmath::ublasExtra::prod_JPJt(obs.measurement.P(), obs.LMK_meas)
+					+ jmath::ublasExtra::prod_JPJt(obs.prior.P(), obs.LMK_prior);
+				for (size_t j = 0; j < s; ++j) ia_l(i+j) = ia(j);
+				i += s;
+			}
+
+			mapPtr->filterPtr->initialize(mapPtr->ia_used_states(), G_rs, ia_rs, ia_l, Q);
 		}
 
 		void ObservationAbstract::computeInnovation() {
@@ -243,9 +279,15 @@ namespace jafar {
 
 		void ObservationAbstract::update() {
 			map_ptr_t mapPtr = sensorPtr()->robotPtr()->mapPtr();
-			ind_array ia_x = mapPtr->ia_used_states();
+			const ind_array & ia_x = mapPtr->ia_used_states();
 			mapPtr->filterPtr->correct(ia_x,innovation,INN_rsl,ia_rsl) ;
 		}
+
+		void ObservationAbstract::updateSequential() {
+			map_ptr_t mapPtr = sensorPtr()->robotPtr()->mapPtr();
+			const ind_array & ia_x = mapPtr->ia_used_states();
+			mapPtr->filterPtr->correctSequential(ia_x,innovation,INN_rsl,ia_rsl,jblas::sym_mat(measurement.P())) ;
+		}
 #if 0
 		bool ObservationAbstract::voteForKillingLandmark(){
 			// kill big ellipses
@@ -0,0 +1,90 @@
+/**
+ * \file patchWarp.cpp
+ * \ingroup rtslam
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "rtslam/patchWarp.hpp"
+
+namespace jafar {
+	namespace rtslam {
+		namespace patchwarp {
+
+			bool fromCorners(const double from[4][2], const double to[4][2], Homography & H)
+			{
+				// A * [h0 .. h7] = b, two equations per point
+				double A[8][9];
+				for (int k = 0; k < 4; ++k)
+				{
+					double x = from[k][0], y = from[k][1], xo = to[k][0], yo = to[k][1];
+					double * r0 = A[2*k], * r1 = A[2*k+1];
+					r0[0] = x; r0[1] = y; r0[2] = 1.; r0[3] = 0.; r0[4] = 0.; r0[5] = 0.; r0[6] = -x*xo; r0[7] = -y*xo; r0[8] = xo;
+					r1[0] = 0.; r1[1] = 0.; r1[2] = 0.; r1[3] = x; r1[4] = y; r1[5] = 1.; r1[6] = -x*yo; r1[7] = -y*yo; r1[8] = yo;
+				}
+				// gaussian elimination with partial pivoting
+				for (int c = 0; c < 8; ++c)
+				{
+					int pivot = c;
+					for (int r = c+1; r < 8; ++r) if (fabs(A[r][c]) > fabs(A[pivot][c])) pivot = r;
+					if (fabs(A[pivot][c]) < 1e-12) return false;
+					if (pivot != c) for (int j = 0; j < 9; ++j) std::swap(A[c][j], A[pivot][j]);
+					for (int r = c+1; r < 8; ++r)
+					{
+						double f = A[r][c] / A[c][c];
+						for (int j = c; j < 9; ++j) A[r][j] -= f * A[c][j];
+					}
+				}
+				for (int c = 7; c >= 0; --c)
+				{
+					double s = A[c][8];
+					for (int j = c+1; j < 8; ++j) s -= A[c][j] * H.h[j];
+					H.h[c] = s / A[c][c];
+				}
+				H.h[8] = 1.;
+				return true;
+			}
+
+
+			/*
+			 * Integer position with 8 bits of fraction, clamped so that the 2x2 neighborhood is inside [0,size).
+			 */
+			static inline void fixedPosition(double s, int size, int & i, int & a)
+			{
+				if (s <= 0.) { i = 0; a = 0; return; }
+				if (s >= size-1) { i = size-2; a = 256; return; }
+				int f = (int)(s * 256.);
+				i = f >> 8; a = f & 255;
+			}
+
+			void warpBilinear(const image::Image & src, const Homography & H, image::Image & dst)
+			{
+				const int ws = src.width(), hs = src.height(), wd = dst.width(), hd = dst.height();
+				const int step = src.step();
+				const double * h = H.h;
+				// src pixel coordinates are patch coordinates shifted by half the size, minus the pixel center
+				const double sx0 = ws * 0.5 - 0.5, sy0 = hs * 0.5 - 0.5;
+				const double x0 = 0.5 - wd * 0.5;
+				for (int i = 0; i < hd; ++i)
+				{
+					double y = i + 0.5 - hd * 0.5;
+					double nx = h[0]*x0 + h[1]*y + h[2], ny = h[3]*x0 + h[4]*y + h[5], nz = h[6]*x0 + h[7]*y + h[8];
+					unsigned char * out = dst.data() + i * dst.step();
+					for (int j = 0; j < wd; ++j, nx += h[0], ny += h[3], nz += h[6])
+					{
+						double iz = 1. / nz;
+						int ix, ax, iy, ay;
+						fixedPosition(nx * iz + sx0, ws, ix, ax);
+						fixedPosition(ny * iz + sy0, hs, iy, ay);
+						const unsigned char * p = src.data() + iy * step + ix;
+						int top = p[0] * (256-ax) + p[1] * ax;
+						int bottom = p[step] * (256-ax) + p[step+1] * ax;
+						out[j] = (unsigned char)((top * (256-ay) + bottom * ay + 32768) >> 16);
+					}
+				}
+			}
+
+		}
+	}
+}
@@ -8,6 +8,7 @@
 #include "jmath/misc.hpp"
 #include "image/roi.hpp"
 #include "rtslam/quickHarrisDetector.hpp"
+#include "rtslam/simd.hpp"
 
 
 namespace jafar {
@@ -22,7 +23,7 @@ namespace jafar {
 #endif
 			) :
 			m_derivationSize(1), m_convolutionSize(convolutionBoxSize),
-			    m_threshold(threshold), m_edge(edge)
+			    m_threshold(threshold), m_edge(edge), m_stride(0), m_x0(0), m_y0(0)
 		{
 			shift_conv = (m_convolutionSize - 1) / 2;
 #if GAUSSIAN_MASK_APPROX
@@ -76,10 +77,10 @@ namespace jafar {
 			
 			delete[] sumConvCoeffs;
 			
-			int_upLeft = new HQuickData*[nConvCoeffs];
-			int_upRight = new HQuickData*[nConvCoeffs];
-			int_downLeft = new HQuickData*[nConvCoeffs];
-			int_downRight = new HQuickData*[nConvCoeffs];
+			int_upLeft = new int[nConvCoeffs];
+			int_upRight = new int[nConvCoeffs];
+			int_downLeft = new int[nConvCoeffs];
+			int_downRight = new int[nConvCoeffs];
 #else
 			normCoeff = jmath::sqr(shift_conv*2+1);
 #endif
@@ -111,14 +112,12 @@ namespace jafar {
 			int pixBest[2];
 			float scoreBest;
 
-			m_quickData = new HQuickData[localRoi.w() * localRoi.h()]; // processing data structure with integral convolution images
+			setupPlanes(localRoi); // processing data structure with integral convolution images
 
 			quickDerivatives(image, localRoi);
 			bool success =
 			    quickConvolutionWithBestPoint(localRoi, pixBest, scoreBest);
-			// writeHarrisImagesAsPPM(localRoi);
-
-			delete[] m_quickData;
+			// writeHarrisImagesAsPPM(image, localRoi);
 
 			if (success) {
 				featPtr->setup(pixBest[0]+0.5, pixBest[1]+0.5, scoreBest);
@@ -127,19 +126,65 @@ namespace jafar {
 			return success;
 		}
 
-		void QuickHarrisDetector::quickDerivatives(
-		    const jafar::image::Image & image, image::ConvexRoi & roi) {
-			const uchar* pix_center;
-			const uchar* pix_right;
-			const uchar* pix_left;
-			const uchar* pix_down;
-			const uchar* pix_up;
+		int QuickHarrisDetector::detectIn(const jafar::image::Image & image, const std::vector<image::ConvexRoi> & rois,
+		    std::vector<feat_img_pnt_ptr_t> & featPtrs, std::vector<bool> & found) {
+			found.assign(rois.size(), false);
+			if (rois.empty()) return 0;
+
+			// bounding box of the rois
+			int xMin = rois[0].x(), yMin = rois[0].y(), xMax = xMin + rois[0].w(), yMax = yMin + rois[0].h();
+			long area = 0;
+			for (size_t k = 0; k < rois.size(); ++k) {
+				xMin = std::min(xMin, rois[k].x()); xMax = std::max(xMax, rois[k].x() + rois[k].w());
+				yMin = std::min(yMin, rois[k].y()); yMax = std::max(yMax, rois[k].y() + rois[k].h());
+				area += (long)rois[k].w() * rois[k].h();
+			}
+
+			int nFound = 0;
+			if (2 * area < (long)(xMax - xMin) * (yMax - yMin)) {
+				// scattered rois, the sweep would mostly process pixels that are not searched
+				for (size_t k = 0; k < rois.size(); ++k)
+					if ((found[k] = detectIn(image, featPtrs[k], &rois[k]))) nFound++;
+				return nFound;
+			}
 
-			HQuickData* int_center;
-			HQuickData* int_up;
-			HQuickData* int_upLeft;
-			HQuickData* int_left;
+			image::ConvexRoi box(cv::Rect(xMin, yMin, xMax - xMin, yMax - yMin));
+			setupPlanes(box);
+			quickDerivatives(image, box);
+			for (size_t k = 0; k < rois.size(); ++k) {
+				int pixBest[2];
+				float scoreBest;
+				if (quickConvolutionWithBestPoint(rois[k], pixBest, scoreBest)) {
+					featPtrs[k]->setup(pixBest[0]+0.5, pixBest[1]+0.5, scoreBest);
+					found[k] = true;
+					nFound++;
+				}
+			}
+			return nFound;
+		}
 
+		void QuickHarrisDetector::setupPlanes(const image::ConvexRoi & area)
+		{
+			const size_t align = 32;
+			m_x0 = area.x();
+			m_y0 = area.y();
+			m_stride = (area.w() + 7) & ~7; // rows of a multiple of 32 bytes, so that all planes are aligned
+			size_t n = (size_t)m_stride * area.h();
+			size_t size = n * (9 * sizeof(int) + 2 * sizeof(double)) + align;
+			if (m_arena.size() < size) m_arena.resize(size);
+
+			char* ptr = &m_arena[0];
+			ptr += (align - (size_t)ptr % align) % align;
+			int** intPlanes[9] = { &m_quickData.im_xx, &m_quickData.im_xy, &m_quickData.im_yy,
+				&m_quickData.im_conv_xx, &m_quickData.im_conv_xy, &m_quickData.im_conv_yy,
+				&m_quickData.int_xx, &m_quickData.int_xy, &m_quickData.int_yy };
+			for (int k = 0; k < 9; ++k) { *intPlanes[k] = (int*)ptr; ptr += n * sizeof(int); }
+			m_quickData.im_high_curv = (double*)ptr; ptr += n * sizeof(double);
+			m_quickData.im_low_curv = (double*)ptr;
+		}
+
+		void QuickHarrisDetector::quickDerivatives(
+		    const jafar::image::Image & image, image::ConvexRoi & roi) {
 			// dead zone due to derivative mask [-1 0 1]
 			int shift_derv = 1; // = (3-1)/2
 
@@ -150,65 +195,22 @@ namespace jafar {
 			// FIXME take into account possible convex part of roi x(i) and w(i) by moving this into the loop
 			int jMin = roi.x() + shift_derv;
 			int jMax = roi.x() + roi.w() - shift_derv;
-
-			int i, j; // i, j: image coordinates
-			int ri; // ri: vertical roi coordinate
-			for (i = iMin; i < iMax; i++) {
-				ri = i - roi.y();
-
-				pix_center = image.data() + (i * image.step()) + jMin;
-				pix_right = pix_center + 1;
-				pix_left = pix_center - 1;
-				pix_down = pix_center + image.step();
-				pix_up = pix_center - image.step();
-
-				int_center = m_quickData + (ri * roi.w()) + shift_derv;
-				int_up = int_center - roi.w();
-				int_upLeft = int_up - 1;
-				int_left = int_center - 1;
-
-				for (j = jMin; j < jMax; j++) {
-					// Build x and y derivatives, and their products: xx, xy and yy.
-					int_center->im_x = *pix_right - *pix_left;
-					int_center->im_y = *pix_down - *pix_up;
-					int_center->im_xx = int_center->im_x * int_center->im_x;
-					int_center->im_xy = int_center->im_x * int_center->im_y;
-					int_center->im_yy = int_center->im_y * int_center->im_y;
-
-					// build integral images of the 3 derivative products, xx, xy and yy:
-					if (i == iMin && j == jMin) {
-						int_center->int_xx = int_center->im_xx;
-						int_center->int_xy = int_center->im_xy;
-						int_center->int_yy = int_center->im_yy;
-					} else if (i == iMin) {
-						int_center->int_xx = int_center->im_xx + int_left->int_xx;
-						int_center->int_xy = int_center->im_xy + int_left->int_xy;
-						int_center->int_yy = int_center->im_yy + int_left->int_yy;
-					} else if (j == jMin) {
-						int_center->int_xx = int_center->im_xx + int_up->int_xx;
-						int_center->int_xy = int_center->im_xy + int_up->int_xy;
-						int_center->int_yy = int_center->im_yy + int_up->int_yy;
-					} else {
-						int_center->int_xx = int_center->im_xx + int_up->int_xx
-						    + int_left->int_xx - int_upLeft->int_xx;
-						int_center->int_xy = int_center->im_xy + int_up->int_xy
-						    + int_left->int_xy - int_upLeft->int_xy;
-						int_center->int_yy = int_center->im_yy + int_up->int_yy
-						    + int_left->int_yy - int_upLeft->int_yy;
-					}
-					// Advance all pointers
-					pix_center++;
-					pix_right++;
-					pix_left++;
-					pix_up++;
-					pix_down++;
-
-					int_center++;
-					int_up++;
-					int_left++;
-					int_upLeft++;
-
-				}
+			if (jMax <= jMin) return;
+			size_t n = jMax - jMin;
+
+			HQuickData & d = m_quickData;
+			for (int i = iMin; i < iMax; i++) {
+				int center = (i - m_y0) * m_stride + (jMin - m_x0); // first pixel of the row in the planes
+				int up = (i == iMin ? -1 : center - m_stride);
+
+				// Build x and y derivatives, and their products: xx, xy and yy.
+				simd::gradientProducts(image.data() + (i * image.step()) + jMin, image.step(), n,
+				    d.im_xx + center, d.im_xy + center, d.im_yy + center);
+
+				// build integral images of the 3 derivative products, xx, xy and yy:
+				simd::integralRow(d.im_xx + center, (up < 0 ? 0 : d.int_xx + up), d.int_xx + center, n);
+				simd::integralRow(d.im_xy + center, (up < 0 ? 0 : d.int_xy + up), d.int_xy + center, n);
+				simd::integralRow(d.im_yy + center, (up < 0 ? 0 : d.int_yy + up), d.int_yy + center, n);
 			}
 
 		}
@@ -226,14 +228,22 @@ namespace jafar {
 			int rjMin = shift_derv_conv;
 			int rjMax = roi.w() - shift_derv_conv;
 
-			// data structure pointers
-			HQuickData* int_center;
+			// data structure planes, and offsets of the integral image corners from the center
+			HQuickData & d = m_quickData;
+			int int_center;
 #if GAUSSIAN_MASK_APPROX
+			for(int i = 0; i < nConvCoeffs; ++i)
+			{
+				int_upLeft[i] = - (shift_convs[i] * (m_stride+1));
+				int_upRight[i] = - (shift_convs[i] * (m_stride-1));
+				int_downLeft[i] = shift_convs[i] * (m_stride-1);
+				int_downRight[i] = shift_convs[i] * (m_stride+1);
+			}
 #else
-			HQuickData* int_upLeft;
-			HQuickData* int_upRight;
-			HQuickData* int_downLeft;
-			HQuickData* int_downRight;
+			int int_upLeft = - (shift_conv * m_stride) - shift_conv;
+			int int_upRight = - (shift_conv * m_stride) + shift_conv;
+			int int_downLeft = (shift_conv * m_stride) - shift_conv;
+			int int_downRight = (shift_conv * m_stride) + shift_conv;
 #endif
 
 			float im_low_curv_max = 0.; // maximum smallest eigenvalue
@@ -245,92 +255,62 @@ namespace jafar {
 
 			for (ri = riMin; ri < riMax; ri++) {
 
-				int_center = m_quickData + (ri * roi.w()) + rjMin;
-
-#if GAUSSIAN_MASK_APPROX
-				for(int i = 0; i < nConvCoeffs; ++i)
-				{
-					int_upLeft[i] = int_center - (shift_convs[i] * (roi.w()+1));
-					int_upRight[i] = int_center - (shift_convs[i] * (roi.w()-1));
-					int_downLeft[i] = int_center + (shift_convs[i] * (roi.w()-1));
-					int_downRight[i] = int_center + (shift_convs[i] * (roi.w()+1));
-				}
-#else
-				int_upLeft = int_center - (shift_conv * roi.w()) - shift_conv;
-				int_upRight = int_center - (shift_conv * roi.w()) + shift_conv;
-				int_downLeft = int_center + (shift_conv * roi.w()) - shift_conv;
-				int_downRight = int_center + (shift_conv * roi.w()) + shift_conv;
-#endif
+				int_center = ((roi.y() - m_y0 + ri) * m_stride) + (roi.x() - m_x0 + rjMin);
 
 				for (rj = rjMin; rj < rjMax; rj++) {
 
 #if GAUSSIAN_MASK_APPROX
-					int_center->im_conv_xx = int_center->im_conv_xy = int_center->im_conv_yy = 0.;
+					d.im_conv_xx[int_center] = d.im_conv_xy[int_center] = d.im_conv_yy[int_center] = 0.;
 					for(int i = 0; i < nConvCoeffs; ++i)
 					{
-						int_center->im_conv_xx += convCoeffs[i]*(
-							int_downRight[i]->int_xx - int_upRight[i]->int_xx -
-							int_downLeft[i]->int_xx + int_upLeft[i]->int_xx);
-						int_center->im_conv_xy += convCoeffs[i]*(
-							int_downRight[i]->int_xy - int_upRight[i]->int_xy -
-							int_downLeft[i]->int_xy + int_upLeft[i]->int_xy);
-						int_center->im_conv_yy += convCoeffs[i]*(
-							int_downRight[i]->int_yy - int_upRight[i]->int_yy -
-							int_downLeft[i]->int_yy + int_upLeft[i]->int_yy);
+						d.im_conv_xx[int_center] += convCoeffs[i]*(
+							d.int_xx[int_center+int_downRight[i]] - d.int_xx[int_center+int_upRight[i]] -
+							d.int_xx[int_center+int_downLeft[i]] + d.int_xx[int_center+int_upLeft[i]]);
+						d.im_conv_xy[int_center] += convCoeffs[i]*(
+							d.int_xy[int_center+int_downRight[i]] - d.int_xy[int_center+int_upRight[i]] -
+							d.int_xy[int_center+int_downLeft[i]] + d.int_xy[int_center+int_upLeft[i]]);
+						d.im_conv_yy[int_center] += convCoeffs[i]*(
+							d.int_yy[int_center+int_downRight[i]] - d.int_yy[int_center+int_upRight[i]] -
+							d.int_yy[int_center+int_downLeft[i]] + d.int_yy[int_center+int_upLeft[i]]);
 					} 
 					if (nConvCoeffsCenter)
 					{
-						int_center->im_conv_xx += convCoeffs[nConvCoeffs]*int_center->im_xx;
-						int_center->im_conv_xy += convCoeffs[nConvCoeffs]*int_center->im_xy;
-						int_center->im_conv_yy += convCoeffs[nConvCoeffs]*int_center->im_yy;
+						d.im_conv_xx[int_center] += convCoeffs[nConvCoeffs]*d.im_xx[int_center];
+						d.im_conv_xy[int_center] += convCoeffs[nConvCoeffs]*d.im_xy[int_center];
+						d.im_conv_yy[int_center] += convCoeffs[nConvCoeffs]*d.im_yy[int_center];
 					}
 #else
-					int_center->im_conv_xx = int_downRight->int_xx - int_upRight->int_xx
-					    - int_downLeft->int_xx + int_upLeft->int_xx;
-					int_center->im_conv_xy = int_downRight->int_xy - int_upRight->int_xy
-					    - int_downLeft->int_xy + int_upLeft->int_xy;
-					int_center->im_conv_yy = int_downRight->int_yy - int_upRight->int_yy
-					    - int_downLeft->int_yy + int_upLeft->int_yy;
+					d.im_conv_xx[int_center] = d.int_xx[int_center+int_downRight] - d.int_xx[int_center+int_upRight]
+					    - d.int_xx[int_center+int_downLeft] + d.int_xx[int_center+int_upLeft];
+					d.im_conv_xy[int_center] = d.int_xy[int_center+int_downRight] - d.int_xy[int_center+int_upRight]
+					    - d.int_xy[int_center+int_downLeft] + d.int_xy[int_center+int_upLeft];
+					d.im_conv_yy[int_center] = d.int_yy[int_center+int_downRight] - d.int_yy[int_center+int_upRight]
+					    - d.int_yy[int_center+int_downLeft] + d.int_yy[int_center+int_upLeft];
 #endif
 					
 					// get eigenvalues: EIG/eig = I_xx + I_yy +/- sqrt((Ixx - I_yy)^2 + 4*I_xy^2)
-					sm = int_center->im_conv_xx + int_center->im_conv_yy;
-					df = int_center->im_conv_xx - int_center->im_conv_yy;
+					sm = d.im_conv_xx[int_center] + d.im_conv_yy[int_center];
+					df = d.im_conv_xx[int_center] - d.im_conv_yy[int_center];
 
 					sr = sqrt((double) ((double) df * (double) df + 4
-					    * ((double) int_center->im_conv_xy)
-					    * ((double) int_center->im_conv_xy)));
+					    * ((double) d.im_conv_xy[int_center])
+					    * ((double) d.im_conv_xy[int_center])));
 
-					int_center->im_high_curv = (double) sm + sr; // Smallest eigenvalue.
-					int_center->im_low_curv = (double) sm - sr; // Largest eigenvalue.
+					d.im_high_curv[int_center] = (double) sm + sr; // Smallest eigenvalue.
+					d.im_low_curv[int_center] = (double) sm - sr; // Largest eigenvalue.
 
 					// detect and write pixel corresponding to strongest corner, with score.
-					corner_ratio = int_center->im_high_curv / int_center->im_low_curv; // CAUTION should be high/low
+					corner_ratio = d.im_high_curv[int_center] / d.im_low_curv[int_center]; // CAUTION should be high/low
 					if (corner_ratio < m_edge) {
-						if (int_center->im_low_curv > im_low_curv_max) {
-							im_low_curv_max = int_center->im_low_curv;
-							im_high_curv_max = int_center->im_high_curv;
+						if (d.im_low_curv[int_center] > im_low_curv_max) {
+							im_low_curv_max = d.im_low_curv[int_center];
+							im_high_curv_max = d.im_high_curv[int_center];
 							pixMax[0] = roi.x() + rj;
 							pixMax[1] = roi.y() + ri;
 						}
 					}
 
 					int_center++;
-#if GAUSSIAN_MASK_APPROX
-					for(int i = 0; i < nConvCoeffs; ++i)
-					{
-						int_upLeft[i]++;
-						int_upRight[i]++;
-						int_downLeft[i]++;
-						int_downRight[i]++;
-					}
-#else
-					int_upLeft++;
-					int_upRight++;
-					int_downLeft++;
-					int_downRight++;
-#endif
-
 				}
 			}
 
@@ -349,7 +329,7 @@ reject:
   |
 */
 			
-			int_center = m_quickData + ((pixMax[1]-roi.y()) * roi.w()) + (pixMax[0]-roi.x());
+			int_center = ((pixMax[1]-m_y0) * m_stride) + (pixMax[0]-m_x0);
 			
 			int indexes[8][2] = {{-1,-1},{-1,0},{-1,1},{0,1},{1,1},{1,0},{1,-1},{0,-1}};
 			int radius = m_convolutionSize/2;
@@ -361,9 +341,9 @@ reject:
 			bool firstpeaked = false;
 			for(int i = 0; i < 8; ++i)
 			{
-				int_upLeft = int_center + indexes[i][1] * roi.w() + indexes[i][0];
+				int neighbor = int_center + indexes[i][1] * m_stride + indexes[i][0];
 				
-				if (int_upLeft->im_high_curv > thres)
+				if (d.im_high_curv[neighbor] > thres)
 				{
 					if (i == 0) firstpeaked = true; else
 					if (i == 7) lastpeaked = lastpeaked || firstpeaked;
@@ -372,17 +352,17 @@ reject:
 					
 				} else
 					lastpeaked = false;
-std::cout << "  high " << int_upLeft->im_high_curv << " "  << " low " << int_upLeft->im_low_curv << std::endl;
+std::cout << "  high " << d.im_high_curv[neighbor] << " "  << " low " << d.im_low_curv[neighbor] << std::endl;
 			}
 			bool ok = (npeaks == 1 || npeaks == 2 || npeaks == 4);
 			
-			std::cout << "  high " << int_center->im_high_curv << " low " << int_center->im_low_curv << " npeaks " << npeaks << " ok " << ok << std::endl;
+			std::cout << "  high " << d.im_high_curv[int_center] << " low " << d.im_low_curv[int_center] << " npeaks " << npeaks << " ok " << ok << std::endl;
 #endif
 			return (scoreMax > m_threshold);
 
 		}
 
-		void QuickHarrisDetector::writeHarrisImagesAsPPM(image::ConvexRoi & roi) {
+		void QuickHarrisDetector::writeHarrisImagesAsPPM(const image::Image & image, image::ConvexRoi & roi) {
 			FILE *pFile_x = fopen("/home/jsola/im_x.ppm", "w");
 			FILE *pFile_y = fopen("/home/jsola/im_y.ppm", "w");
 			FILE *pFile_xx = fopen("/home/jsola/im_xx.ppm", "w");
@@ -390,7 +370,7 @@ std::cout << "  high " << int_upLeft->im_high_curv << " "  << " low " << int_upL
 			FILE *pFile_yy = fopen("/home/jsola/im_yy.ppm", "w");
 			FILE *pFile_min = fopen("/home/jsola/im_min.ppm", "w");
 			FILE *pFile_max = fopen("/home/jsola/im_max.ppm", "w");
-			HQuickData * ptr = m_quickData;
+			HQuickData & d = m_quickData;
 			if (pFile_x != NULL) {
 				fprintf(pFile_x, "P2\n%d %d\n255\n", roi.w(), roi.h());
 				fprintf(pFile_y, "P2\n%d %d\n255\n", roi.w(), roi.h());
@@ -399,21 +379,33 @@ std::cout << "  high " << int_upLeft->im_high_curv << " "  << " low " << int_upL
 				fprintf(pFile_yy, "P2\n%d %d\n255\n", roi.w(), roi.h());
 				fprintf(pFile_min, "P2\n%d %d\n255\n", roi.w(), roi.h());
 				fprintf(pFile_max, "P2\n%d %d\n255\n", roi.w(), roi.h());
-				for (int i = 0; i < (roi.h() * roi.w()); i++) {
-					fprintf(pFile_x, "%d ", 128 + (ptr->im_x) / 2);
-					fprintf(pFile_y, "%d ", 128 + (ptr->im_y) / 2);
-					fprintf(pFile_xx, "%d ", 128 + (ptr->im_conv_xx) / 2048);
-					fprintf(pFile_xy, "%d ", 128 + (ptr->im_conv_xy) / 2048);
-					fprintf(pFile_yy, "%d ", 128 + (ptr->im_conv_yy) / 2048);
-					fprintf(pFile_min, "%d ", (unsigned char) (ptr->im_low_curv / 1024));
-					fprintf(pFile_max, "%d ", (unsigned char) (ptr->im_high_curv / 2048));
-					ptr++;
-				}
+				for (int ri = 0; ri < roi.h(); ri++)
+					for (int rj = 0; rj < roi.w(); rj++) {
+						// the derivatives are not stored in the planes, only their products, so they are computed again
+						int ii = roi.y() + ri, jj = roi.x() + rj;
+						int dx = 0, dy = 0;
+						if (ii > 0 && ii < image.height()-1 && jj > 0 && jj < image.width()-1) {
+							int step = image.step();
+							const unsigned char* pix = image.data() + ii * step + jj;
+							dx = pix[1] - pix[-1];
+							dy = pix[step] - pix[-step];
+						}
+						int i = ri * m_stride + rj;
+						fprintf(pFile_x, "%d ", 128 + dx / 2);
+						fprintf(pFile_y, "%d ", 128 + dy / 2);
+						fprintf(pFile_xx, "%d ", 128 + (d.im_conv_xx[i]) / 2048);
+						fprintf(pFile_xy, "%d ", 128 + (d.im_conv_xy[i]) / 2048);
+						fprintf(pFile_yy, "%d ", 128 + (d.im_conv_yy[i]) / 2048);
+						fprintf(pFile_min, "%d ", (unsigned char) (d.im_low_curv[i] / 1024));
+						fprintf(pFile_max, "%d ", (unsigned char) (d.im_high_curv[i] / 2048));
+					}
 				fclose(pFile_x);
 				fclose(pFile_y);
 				fclose(pFile_xx);
 				fclose(pFile_xy);
 				fclose(pFile_yy);
+				fclose(pFile_min);
+				fclose(pFile_max);
 			}
 		}
 
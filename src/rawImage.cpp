@@ -38,7 +38,7 @@ namespace jafar {
 			return s;
 		}
 
-		RawImage::RawImage(){
+		RawImage::RawImage(): cache_data(NULL), cache_timestamp(0.0) {
 		}
 
 		RawAbstract* RawImage::clone()
@@ -54,6 +54,60 @@ namespace jafar {
 		
 		void RawImage::setJafarImage(jafarImage_ptr_t img_) {
 			this->img = img_;
+			cache_data = NULL;
+		}
+
+		void RawImage::halfSample(const image::Image & src, image::Image & dst) {
+			for (int i = 0; i < dst.height(); ++i)
+			{
+				const uchar* up = src.data() + 2 * i * src.step();
+				const uchar* down = up + src.step();
+				uchar* out = dst.data() + i * dst.step();
+				for (int j = 0; j < dst.width(); ++j, up += 2, down += 2)
+					out[j] = (up[0] + up[1] + down[0] + down[1] + 2) >> 2;
+			}
+		}
+
+		void RawImage::checkCache() {
+			if (cache_data != img->data() || cache_timestamp != timestamp)
+			{
+				pyramid.clear();
+				integrals.clear();
+				cache_data = img->data();
+				cache_timestamp = timestamp;
+			}
+		}
+
+		jafarImage_ptr_t RawImage::pyramidLevel(unsigned level) {
+			if (level == 0) return img;
+			boost::unique_lock<boost::mutex> l(cache_mutex);
+			checkCache();
+			return buildPyramidLevel(level);
+		}
+
+		boost::shared_ptr<const zncc::IntegralImage> RawImage::integralImage(unsigned level) {
+			boost::unique_lock<boost::mutex> l(cache_mutex);
+			checkCache();
+			if (integrals.size() <= level) integrals.resize(level+1);
+			if (!integrals[level])
+			{
+				integrals[level].reset(new zncc::IntegralImage());
+				integrals[level]->compute(*buildPyramidLevel(level));
+			}
+			return integrals[level];
+		}
+
+		const jafarImage_ptr_t & RawImage::buildPyramidLevel(unsigned level) {
+			if (level == 0) return img;
+			while (pyramid.size() < level)
+			{
+				const image::Image & src = (pyramid.empty() ? *img : *pyramid.back());
+				JFR_ASSERT(src.width() >= 2 && src.height() >= 2, "RawImage::pyramidLevel: image too small for this level");
+				jafarImage_ptr_t dst(new image::Image(src.width() / 2, src.height() / 2, src.depth(), src.colorSpace()));
+				halfSample(src, *dst);
+				pyramid.push_back(dst);
+			}
+			return pyramid[level-1];
 		}
 
 	} // namespace rtslam
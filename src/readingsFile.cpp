@@ -0,0 +1,243 @@
+/**
+ * \file readingsFile.cpp
+ * \ingroup rtslam
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include "kernel/timingTools.hpp"
+#include "rtslam/readingsFile.hpp"
+
+namespace jafar {
+namespace rtslam {
+namespace hardware {
+
+	static const char readingsMagic[8] = { 'R','T','S','L','R','D','G','1' };
+
+	// powers of ten that are exact doubles
+	static const double exactPowers10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+
+	const char* parseReadingValue(const char *p, const char *end, double & value)
+	{
+		const char *start = p;
+		bool negative = false;
+		if (p != end && (*p == '-' || *p == '+')) { negative = (*p == '-'); ++p; }
+
+		// significant digits, up to 19 fit in the mantissa
+		uint64_t mantissa = 0;
+		int n_digits = 0, exponent = 0;
+		bool any_digit = false, truncated = false;
+		for(; p != end && *p >= '0' && *p <= '9'; ++p)
+		{
+			any_digit = true;
+			if (n_digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) ++n_digits; }
+			else { ++exponent; if (*p != '0') truncated = true; }
+		}
+		if (p != end && *p == '.')
+		{
+			for(++p; p != end && *p >= '0' && *p <= '9'; ++p)
+			{
+				any_digit = true;
+				if (n_digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) ++n_digits; --exponent; }
+				else if (*p != '0') truncated = true;
+			}
+		}
+		if (!any_digit)
+		{
+			// inf and nan, left to strtod
+			if (p == end || !(*p == 'i' || *p == 'I' || *p == 'n' || *p == 'N')) return start;
+			while (p != end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))) ++p;
+			truncated = true;
+		} else
+		if (p != end && (*p == 'e' || *p == 'E'))
+		{
+			const char *q = p + 1;
+			bool exp_negative = false;
+			if (q != end && (*q == '-' || *q == '+')) { exp_negative = (*q == '-'); ++q; }
+			if (q != end && *q >= '0' && *q <= '9')
+			{
+				int e = 0;
+				for(; q != end && *q >= '0' && *q <= '9'; ++q) if (e < 10000) e = e * 10 + (*q - '0');
+				exponent += (exp_negative ? -e : e);
+				p = q;
+			}
+		}
+
+		if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			// one exact operation, correctly rounded
+			double d = (double)mantissa;
+			d = (exponent < 0 ? d / exactPowers10[-exponent] : d * exactPowers10[exponent]);
+			value = (negative ? -d : d);
+			return p;
+		}
+		// strtod needs a terminated string, and the mapped log is not
+		char buffer[128];
+		if (p - start < (int)sizeof(buffer))
+		{
+			memcpy(buffer, start, p - start);
+			buffer[p - start] = 0;
+			value = strtod(buffer, NULL);
+		} else
+			value = strtod(std::string(start, p).c_str(), NULL);
+		return p;
+	}
+
+
+	bool ReadingsFileReader::parseText(const char *begin, const char *end)
+	{
+		const char *p = begin;
+		while (p != end)
+		{
+			const char *line_end = (const char*)memchr(p, '\n', end - p);
+			if (!line_end) line_end = end;
+			// skip the size of the ublas format
+			while (p != line_end && (*p == ' ' || *p == '\t')) ++p;
+			if (p != line_end && *p == '[')
+			{
+				const char *q = (const char*)memchr(p, ']', line_end - p);
+				p = (q ? q + 1 : line_end);
+			}
+			size_t row_start = values.size();
+			unsigned n = 0;
+			bool valid = true;
+			while (true)
+			{
+				while (p != line_end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == '(' || *p == ')')) ++p;
+				if (p == line_end) break;
+				double v;
+				const char *q = parseReadingValue(p, line_end, v);
+				if (q == p) { valid = false; break; }
+				if (n < n_columns) values.push_back(v);
+				++n;
+				p = q;
+			}
+			if (!valid || n != n_columns)
+			{
+				values.resize(row_start);
+				if (n > 0 || !valid) ++n_skipped;
+			}
+			p = (line_end == end ? end : line_end + 1);
+		}
+		return true;
+	}
+
+
+	bool ReadingsFileReader::loadCache(const std::string & cache_path, uint64_t text_size, int64_t text_mtime)
+	{
+		FILE *f = fopen(cache_path.c_str(), "rb");
+		if (!f) return false;
+		ReadingsCacheHeader header;
+		bool ok = (fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, readingsMagic, sizeof(readingsMagic)) == 0 &&
+		           header.n_columns == n_columns && header.text_size == text_size && header.text_mtime == text_mtime);
+		if (ok)
+		{
+			values.resize(header.n_rows * n_columns);
+			ok = (values.empty() || fread(&values[0], sizeof(double), values.size(), f) == values.size());
+		}
+		fclose(f);
+		if (!ok) values.clear();
+		return ok;
+	}
+
+
+	void ReadingsFileReader::saveCache(const std::string & cache_path, uint64_t text_size, int64_t text_mtime)
+	{
+		ReadingsCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, readingsMagic, sizeof(readingsMagic));
+		header.n_columns = n_columns;
+		header.n_rows = rows();
+		header.text_size = text_size;
+		header.text_mtime = text_mtime;
+
+		// written under another name and renamed, so that a cache is never read incomplete
+		std::string tmp_path = cache_path + ".tmp";
+		FILE *f = fopen(tmp_path.c_str(), "wb");
+		if (!f) return; // read-only data directory, no cache
+		bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+		ok = ok && (values.empty() || fwrite(&values[0], sizeof(double), values.size(), f) == values.size());
+		ok = (fclose(f) == 0) && ok;
+		if (ok) ok = (rename(tmp_path.c_str(), cache_path.c_str()) == 0);
+		if (!ok) remove(tmp_path.c_str());
+	}
+
+
+	bool ReadingsFileReader::load(const std::string & path, unsigned n_columns, bool use_cache)
+	{
+		kernel::Chrono chrono;
+		this->n_columns = n_columns;
+		values.clear();
+		n_skipped = 0;
+		from_cache = false;
+		loaded = false;
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) { std::cerr << "ReadingsFileReader: cannot open " << path << std::endl; return false; }
+		struct stat st;
+		if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+		std::string cache_path = path + ".cache";
+
+		if (use_cache && loadCache(cache_path, st.st_size, st.st_mtime))
+			from_cache = true;
+		else
+		{
+			// a reading is about 10 values of 20 characters
+			values.reserve(st.st_size / 20 + n_columns);
+			if (st.st_size > 0)
+			{
+				void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (map == MAP_FAILED) { ::close(fd); std::cerr << "ReadingsFileReader: cannot map " << path << std::endl; return false; }
+				madvise(map, st.st_size, MADV_SEQUENTIAL);
+				parseText((const char*)map, (const char*)map + st.st_size);
+				munmap(map, st.st_size);
+			}
+			if (use_cache) saveCache(cache_path, st.st_size, st.st_mtime);
+		}
+		::close(fd);
+		load_time = chrono.elapsedMicrosecond() * 1e-3;
+		loaded = true;
+		return true;
+	}
+
+
+	void ReadingsFileReader::loadInBackground(const std::string & path, unsigned n_columns, bool use_cache)
+	{
+		wait();
+		load_thread = new boost::thread(boost::bind(&ReadingsFileReader::backgroundLoad, this, path, n_columns, use_cache));
+	}
+
+
+	std::ostream& operator <<(std::ostream & s, ReadingsFileReader const & reader)
+	{
+		s << reader.rows() << " readings loaded in " << reader.loadTime() << " ms from the " << (reader.fromCache() ? "cache" : "text log");
+		if (reader.skipped()) s << " (" << reader.skipped() << " lines skipped)";
+		return s;
+	}
+
+
+	bool ReadingsFileReader::wait()
+	{
+		if (load_thread)
+		{
+			load_thread->join();
+			delete load_thread;
+			load_thread = NULL;
+		}
+		return loaded;
+	}
+
+}}}
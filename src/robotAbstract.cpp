@@ -51,7 +51,10 @@ namespace jafar {
 			XNEW_x(_size_state, _size_state),
 			XNEW_pert(_size_state, _size_pert),
 			Q(_size_state, _size_state),
-			origin_sensors(3), origin_export(3), robot_pose(6)
+			PREINT_x(_size_state, _size_state),
+			PREINT_Q(_size_state, _size_state),
+			origin_sensors(3), origin_export(3), robot_pose(6),
+			preintegration(false), preintegrating(false), preint_steps(0)
 		{
 			constantPerturbation = false;
 			category = ROBOT;
@@ -70,7 +73,10 @@ namespace jafar {
 			XNEW_x(_size_state, _size_state),
 			XNEW_pert(_size_state, _size_pert),
 			Q(_size_state, _size_state),
-			origin_sensors(3), origin_export(3), robot_pose(6)
+			PREINT_x(_size_state, _size_state),
+			PREINT_Q(_size_state, _size_state),
+			origin_sensors(3), origin_export(3), robot_pose(6),
+			preintegration(false), preintegrating(false), preint_steps(0)
 		{
 			constantPerturbation = true;
 			category = ROBOT;
@@ -126,6 +132,26 @@ namespace jafar {
 //JFR_DEBUG("Q " << Q);
 		}
 
+		void RobotAbstract::beginPreintegration() {
+			PREINT_x.assign(jblas::identity_mat(state.size()));
+			PREINT_Q.clear();
+			preint_steps = 0;
+			preintegrating = true;
+		}
+
+		void RobotAbstract::accumulatePrediction() {
+			PREINT_Q = jmath::ublasExtra::prod_JPJt(PREINT_Q, XNEW_x) + Q;
+			PREINT_x = ublas::prod(XNEW_x, PREINT_x);
+			preint_steps++;
+		}
+
+		void RobotAbstract::endPreintegration() {
+			preintegrating = false;
+			if (preint_steps == 0 || !mapPtr()->filterPtr) return;
+			mapPtr()->filterPtr->predictInvariant(mapPtr()->ia_used_complement(state.ia()), PREINT_x, state.ia(), PREINT_Q); // P = F*P*F' + Q
+			preint_steps = 0;
+		}
+
 		void RobotAbstract::move(double time){
 			bool firstmove = false;
 			if (self_time < 0.) { firstmove = true; self_time = time; }
@@ -168,6 +194,8 @@ namespace jafar {
 					
 					double a, cur_time = self_time, after_time, prev_time = readings(0, 0), next_time, average_time;
 					prev_u = ublas::subrange(ublas::matrix_row<mat_indirect>(readings, 0),1,readings.size2());
+					
+					if (preintegration) beginPreintegration();
 				
 					for(size_t i = 0; i < readings.size1(); i++)
 					{
@@ -190,6 +218,7 @@ namespace jafar {
 						prev_time = cur_time = next_time;
 						prev_u = next_u;
 					}
+					if (preintegration) endPreintegration();
 					dt_or_dx = time - self_time;
 				}
 			} else
@@ -209,18 +238,18 @@ namespace jafar {
 		}
 		
 
-		void RobotAbstract::writeLogHeader(kernel::DataLogger& log) const
+		void RobotAbstract::logHeader(LogSink & log) const
 		{
 			std::ostringstream oss; oss << "Robot " << id();
 			log.writeComment(oss.str());
 			log.writeLegendTokens("time");
 			for(size_t i = 0; i < state.x().size(); ++i)
-				{ oss.str(""); oss << "x" << i; log.writeLegend(oss.str()); }
+				{ oss.str(""); oss << "x" << i; log.writeLegendTokens(oss.str()); }
 			for(size_t i = 0; i < state.x().size(); ++i)
-				{ oss.str(""); oss << "sig" << i; log.writeLegend(oss.str()); }
+				{ oss.str(""); oss << "sig" << i; log.writeLegendTokens(oss.str()); }
 		}
 		
-		void RobotAbstract::writeLogData(kernel::DataLogger& log) const
+		void RobotAbstract::logData(LogSink & log) const
 		{
 			log.writeData(self_time);
 			for(size_t i = 0; i < state.x().size(); ++i)
@@ -159,7 +159,7 @@ namespace jafar {
 		}
 
 
-		void RobotConstantVelocity::writeLogHeader(kernel::DataLogger& log) const
+		void RobotConstantVelocity::logHeader(LogSink & log) const
 		{
 			std::ostringstream oss; oss << "Robot " << id();
 			log.writeComment(oss.str());
@@ -178,7 +178,7 @@ namespace jafar {
 			log.writeLegendTokens("sig_vyaw sig_vpitch sig_vroll");
 		}
 		
-		void RobotConstantVelocity::writeLogData(kernel::DataLogger& log) const
+		void RobotConstantVelocity::logData(LogSink & log) const
 		{
 			jblas::vec euler_x(3);
 			jblas::sym_mat euler_P(3,3);
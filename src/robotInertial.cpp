@@ -373,7 +373,7 @@ namespace jafar {
 		}
 		
 		
-		void RobotInertial::writeLogHeader(kernel::DataLogger& log) const
+		void RobotInertial::logHeader(LogSink & log) const
 		{
 			std::ostringstream oss; oss << "Robot " << id();
 			log.writeComment(oss.str());
@@ -397,7 +397,7 @@ namespace jafar {
 			log.writeLegendTokens("sig_gx sig_gy sig_gz");
 		}
 		
-		void RobotInertial::writeLogData(kernel::DataLogger& log) const
+		void RobotInertial::logData(LogSink & log) const
 		{
 			jblas::vec euler_x(3);
 			jblas::sym_mat euler_P(3,3);
@@ -196,7 +196,7 @@ namespace jafar {
 			unsplitState(p, q, _xnew); //FIXME temporary solution to copy the initial state
 		}
 		
-		void RobotOdometry::writeLogHeader(kernel::DataLogger& log) const
+		void RobotOdometry::logHeader(LogSink & log) const
 		{
 			std::ostringstream oss; oss << "Robot " << id();
 			log.writeComment(oss.str());
@@ -213,7 +213,7 @@ namespace jafar {
 
 		}
 		
-		void RobotOdometry::writeLogData(kernel::DataLogger& log) const
+		void RobotOdometry::logData(LogSink & log) const
 		{
 			jblas::vec euler_x(3);
 			jblas::sym_mat euler_P(3,3);
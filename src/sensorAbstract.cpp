@@ -7,6 +7,7 @@
 
 #include "boost/assign/std/vector.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/bind.hpp"
 #include "jmath/indirectArray.hpp"
 #include "rtslam/sensorAbstract.hpp"
 #include "rtslam/robotAbstract.hpp"
@@ -131,8 +132,8 @@ namespace jafar {
 		void SensorExteroAbstract::process(unsigned id)
 		{
 			// get data
-			hardwareSensorPtr->getRaw(id, rawPtr);
-			rawCounter++;
+			acquire(id);
+			prepareNext();
 			
 			// observe
 			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
@@ -146,6 +147,60 @@ namespace jafar {
 			//hardwareSensorPtr->release();
 		}
 
+		void SensorExteroAbstract::acquire(unsigned id)
+		{
+			if (pipeline) pipeline->wait(); // the raw being prepared must not be released
+			hardwareSensorPtr->getRaw(id, rawPtr);
+			rawCounter++;
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+				(*dmaIter)->prepare(rawPtr);
+		}
+
+		void SensorExteroAbstract::prepareNext()
+		{
+			if (!pipeline) return;
+			bool ahead = false;
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+				if ((*dmaIter)->canPrepareAhead()) { ahead = true; break; }
+			if (!ahead) return;
+
+			RawInfos infos;
+			queryAvailableRaws(infos);
+			if (infos.available.size() == 0) return;
+			raw_ptr_t raw;
+			hardwareSensorPtr->observeRaw(integrate_all ? infos.available.front().id : infos.available.back().id, raw);
+			pipeline->post(boost::bind(&SensorExteroAbstract::prepareAhead, this, raw));
+		}
+
+		void SensorExteroAbstract::prepareAhead(raw_ptr_t raw)
+		{
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+				if ((*dmaIter)->canPrepareAhead()) (*dmaIter)->prepare(raw);
+		}
+
+		void SensorExteroAbstract::observeKnown()
+		{
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+			{
+				data_manager_ptr_t dmaPtr = *dmaIter;
+				dmaPtr->processKnown(rawPtr);
+				dmaPtr->mapManagerPtr()->manage();
+				dmaPtr->beginDetection(rawPtr);
+			}
+		}
+
+		void SensorExteroAbstract::detectCandidates()
+		{
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+				(*dmaIter)->detectCandidates(rawPtr);
+		}
+
+		void SensorExteroAbstract::observeNew()
+		{
+			for (DataManagerList::iterator dmaIter = dataManagerList().begin(); dmaIter != dataManagerList().end(); ++dmaIter)
+				(*dmaIter)->detectNew(rawPtr);
+		}
+
 
 	}
 }
@@ -0,0 +1,159 @@
+/**
+ * \file sequenceFile.cpp
+ * \ingroup rtslam
+ */
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "rtslam/sequenceFile.hpp"
+
+namespace jafar {
+namespace rtslam {
+namespace hardware {
+
+	static const char sequenceMagic[8] = { 'R','T','S','L','S','E','Q','1' };
+	static const uint32_t sequenceVersion = 1;
+
+
+	bool SequenceFileWriter::open(const std::string & path, int width, int height, int step)
+	{
+		close();
+		file = fopen(path.c_str(), "wb");
+		if (!file) return false;
+		// large buffer, so that one frame is written with few system calls
+		setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, sequenceMagic, sizeof(sequenceMagic));
+		header.version = sequenceVersion;
+		header.width = width; header.height = height; header.step = step;
+		header.depth = 1;
+		record_size = (sizeof(SequenceRecord) + (uint64_t)height * step + 15) & ~(uint64_t)15;
+		header.record_size = record_size;
+		n = 0;
+		if (fwrite(&header, sizeof(header), 1, file) != 1) { close(); return false; }
+		return true;
+	}
+
+
+	bool SequenceFileWriter::append(const image::Image & img, double timestamp, double arrival)
+	{
+		if (!file || img.width() != (int)header.width || img.height() != (int)header.height) return false;
+
+		SequenceRecord record = { timestamp, arrival };
+		bool ok = (fwrite(&record, sizeof(record), 1, file) == 1);
+		const size_t row = header.width;
+		static const char zeros[16] = { 0 };
+		for (unsigned i = 0; ok && i < header.height; ++i)
+		{
+			ok = (fwrite(img.data() + i * img.step(), 1, row, file) == row);
+			if (ok && header.step > row) ok = (fwrite(zeros, 1, header.step - row, file) == header.step - row);
+		}
+		size_t padding = record_size - sizeof(record) - (uint64_t)header.height * header.step;
+		if (ok && padding) ok = (fwrite(zeros, 1, padding, file) == padding);
+		if (ok) ++n;
+		return ok;
+	}
+
+
+	void SequenceFileWriter::close()
+	{
+		if (file) fclose(file);
+		file = NULL;
+	}
+
+
+	bool SequenceFileReader::open(const std::string & path)
+	{
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SequenceHeader)) { ::close(fd); return false; }
+		size = st.st_size;
+		// private writable mapping: the images can be modified in place without changing the file
+		void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (map == MAP_FAILED) { size = 0; return false; }
+		data = (unsigned char*)map;
+
+		const SequenceHeader & h = header();
+		if (memcmp(h.magic, sequenceMagic, sizeof(sequenceMagic)) != 0 || h.version != sequenceVersion || h.depth != 1 ||
+		    h.step < h.width || h.record_size < sizeof(SequenceRecord) + (uint64_t)h.height * h.step)
+		{
+			std::cerr << "SequenceFileReader: " << path << " is not a valid sequence file" << std::endl;
+			close();
+			return false;
+		}
+		n = (size - sizeof(SequenceHeader)) / h.record_size;
+		madvise(data, size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+
+	void SequenceFileReader::close()
+	{
+		if (data) munmap(data, size);
+		data = NULL; size = 0; n = 0;
+	}
+
+
+	int convertImageDirectory(const std::string & dump_path, const std::string & sequence_path)
+	{
+		// list the dumped images, with any number of digits, sorted by index
+		std::vector<std::pair<unsigned, std::string> > files;
+		DIR *dir = opendir(dump_path.c_str());
+		if (!dir) return -1;
+		while (struct dirent *entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if (name.size() < 11 || name.compare(0, 6, "image_") != 0) continue;
+			std::string ext = name.substr(name.size()-4);
+			std::string digits = name.substr(6, name.size()-10);
+			if ((ext != ".pgm" && ext != ".png") || digits.find_first_not_of("0123456789") != std::string::npos) continue;
+			files.push_back(std::make_pair((unsigned)atoi(digits.c_str()), name));
+		}
+		closedir(dir);
+		std::sort(files.begin(), files.end());
+
+		SequenceFileWriter writer;
+		for (size_t k = 0; k < files.size(); ++k)
+		{
+			// skip the same index saved in another format
+			if (k > 0 && files[k].first == files[k-1].first) continue;
+			std::string stem = dump_path + "/" + files[k].second.substr(0, files[k].second.size()-4);
+			image::Image img;
+			if (!img.load(dump_path + "/" + files[k].second, 0) || img.data() == NULL)
+			{
+				std::cerr << "convertImageDirectory: cannot load " << files[k].second << ", stopping there" << std::endl;
+				break;
+			}
+			double timestamp = 0.;
+			std::fstream f((stem + ".time").c_str(), std::ios_base::in);
+			f >> timestamp; f.close();
+
+			if (!writer.isOpen() && !writer.open(sequence_path, img.width(), img.height(), img.width())) return -1;
+			if (!writer.append(img, timestamp, timestamp))
+			{
+				std::cerr << "convertImageDirectory: cannot append " << files[k].second << std::endl;
+				break;
+			}
+		}
+		writer.close();
+		return writer.count();
+	}
+
+
+}}}
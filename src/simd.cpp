@@ -0,0 +1,346 @@
+/**
+ * \file simd.cpp
+ * \ingroup rtslam
+ */
+
+#include <boost/atomic.hpp>
+
+#include "rtslam/simd.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+namespace jafar {
+	namespace rtslam {
+		namespace simd {
+
+			static level_t detect()
+			{
+#if SIMD_X86
+				__builtin_cpu_init();
+				if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return AVX2;
+				if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+				return SCALAR;
+			}
+
+			// read by the kernels from any thread (thread pool, frame pipeline)
+			static boost::atomic<int> current_level(detectedLevel());
+
+			level_t detectedLevel()
+			{
+				static level_t detected = detect();
+				return detected;
+			}
+
+			level_t level()
+			{
+				return (level_t)current_level.load(boost::memory_order_relaxed);
+			}
+
+			void setLevel(level_t _level)
+			{
+				current_level.store(_level > detectedLevel() ? detectedLevel() : _level, boost::memory_order_relaxed);
+			}
+
+
+			static void axpy_scalar(double a, const double * x, double * y, std::size_t n)
+			{
+				for (std::size_t i = 0; i < n; ++i) y[i] += a * x[i];
+			}
+
+#if SIMD_X86
+			__attribute__((target("sse2")))
+			static void axpy_sse2(double a, const double * x, double * y, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m128d va = _mm_set1_pd(a);
+				for (; i + 4 <= n; i += 4) {
+					__m128d y0 = _mm_loadu_pd(y + i), y1 = _mm_loadu_pd(y + i + 2);
+					y0 = _mm_add_pd(y0, _mm_mul_pd(va, _mm_loadu_pd(x + i)));
+					y1 = _mm_add_pd(y1, _mm_mul_pd(va, _mm_loadu_pd(x + i + 2)));
+					_mm_storeu_pd(y + i, y0); _mm_storeu_pd(y + i + 2, y1);
+				}
+				for (; i < n; ++i) y[i] += a * x[i];
+			}
+
+			__attribute__((target("avx2,fma")))
+			static void axpy_avx2(double a, const double * x, double * y, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m256d va = _mm256_set1_pd(a);
+				for (; i + 8 <= n; i += 8) {
+					__m256d y0 = _mm256_loadu_pd(y + i), y1 = _mm256_loadu_pd(y + i + 4);
+					y0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), y0);
+					y1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i + 4), y1);
+					_mm256_storeu_pd(y + i, y0); _mm256_storeu_pd(y + i + 4, y1);
+				}
+				for (; i < n; ++i) y[i] += a * x[i];
+			}
+#endif
+
+			static unsigned int dot_scalar(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				unsigned int sum = 0;
+				for (std::size_t i = 0; i < n; ++i) sum += a[i] * b[i];
+				return sum;
+			}
+
+#if SIMD_X86
+			// the 8 bits values are widened to 16 bits, and pmaddwd multiplies and adds pairs into 32 bits
+			__attribute__((target("sse2")))
+			static unsigned int dot_sse2(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128();
+				for (; i + 16 <= n; i += 16) {
+					__m128i va = _mm_loadu_si128((const __m128i*)(a + i)), vb = _mm_loadu_si128((const __m128i*)(b + i));
+					acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+					acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+				}
+				for (; i + 8 <= n; i += 8) {
+					__m128i va = _mm_loadl_epi64((const __m128i*)(a + i)), vb = _mm_loadl_epi64((const __m128i*)(b + i));
+					acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+				}
+				acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+				acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+				unsigned int sum = _mm_cvtsi128_si32(acc);
+				for (; i < n; ++i) sum += a[i] * b[i];
+				return sum;
+			}
+
+			__attribute__((target("avx2")))
+			static unsigned int dot_avx2(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m256i acc = _mm256_setzero_si256();
+				for (; i + 16 <= n; i += 16) {
+					__m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+					__m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+					acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+				}
+				__m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+				for (; i + 8 <= n; i += 8) {
+					__m128i va = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(a + i)));
+					__m128i vb = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(b + i)));
+					acc4 = _mm_add_epi32(acc4, _mm_madd_epi16(va, vb));
+				}
+				acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1,0,3,2)));
+				acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2,3,0,1)));
+				unsigned int sum = _mm_cvtsi128_si32(acc4);
+				for (; i < n; ++i) sum += a[i] * b[i];
+				return sum;
+			}
+#endif
+
+			static unsigned int sad_scalar(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				unsigned int sum = 0;
+				for (std::size_t i = 0; i < n; ++i) sum += (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+				return sum;
+			}
+
+#if SIMD_X86
+			// psadbw sums the absolute differences of 8 bytes into each 64 bits half
+			__attribute__((target("sse2")))
+			static unsigned int sad_sse2(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m128i acc = _mm_setzero_si128();
+				for (; i + 16 <= n; i += 16)
+					acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+				for (; i + 8 <= n; i += 8)
+					acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadl_epi64((const __m128i*)(a + i)), _mm_loadl_epi64((const __m128i*)(b + i))));
+				unsigned int sum = _mm_cvtsi128_si32(_mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc)));
+				for (; i < n; ++i) sum += (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+				return sum;
+			}
+
+			__attribute__((target("avx2")))
+			static unsigned int sad_avx2(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				std::size_t i = 0;
+				__m256i acc = _mm256_setzero_si256();
+				for (; i + 32 <= n; i += 32)
+					acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+				__m128i acc2 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+				for (; i + 16 <= n; i += 16)
+					acc2 = _mm_add_epi64(acc2, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+				for (; i + 8 <= n; i += 8)
+					acc2 = _mm_add_epi64(acc2, _mm_sad_epu8(_mm_loadl_epi64((const __m128i*)(a + i)), _mm_loadl_epi64((const __m128i*)(b + i))));
+				unsigned int sum = _mm_cvtsi128_si32(_mm_add_epi64(acc2, _mm_unpackhi_epi64(acc2, acc2)));
+				for (; i < n; ++i) sum += (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+				return sum;
+			}
+#endif
+
+			unsigned int sad(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				switch (level())
+				{
+#if SIMD_X86
+					case AVX2: return sad_avx2(a, b, n);
+					case SSE2: return sad_sse2(a, b, n);
+#endif
+					default: return sad_scalar(a, b, n);
+				}
+			}
+
+			static void gradientProducts_scalar(const unsigned char * pix, std::ptrdiff_t step, std::size_t n, int * xx, int * xy, int * yy)
+			{
+				for (std::size_t j = 0; j < n; ++j)
+				{
+					int dx = pix[j+1] - pix[j-1], dy = pix[j+step] - pix[j-step];
+					xx[j] = dx * dx; xy[j] = dx * dy; yy[j] = dy * dy;
+				}
+			}
+
+#if SIMD_X86
+			// the 16 bits derivatives are multiplied into 32 bits with the low and high halves of the products
+			__attribute__((target("sse2")))
+			static void gradientProducts_sse2(const unsigned char * pix, std::ptrdiff_t step, std::size_t n, int * xx, int * xy, int * yy)
+			{
+				std::size_t j = 0;
+				__m128i zero = _mm_setzero_si128();
+				for (; j + 8 <= n; j += 8) {
+					__m128i dx = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pix + j + 1)), zero),
+					                           _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pix + j - 1)), zero));
+					__m128i dy = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pix + j + step)), zero),
+					                           _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pix + j - step)), zero));
+					__m128i lo, hi;
+					lo = _mm_mullo_epi16(dx, dx); hi = _mm_mulhi_epi16(dx, dx);
+					_mm_storeu_si128((__m128i*)(xx + j), _mm_unpacklo_epi16(lo, hi));
+					_mm_storeu_si128((__m128i*)(xx + j + 4), _mm_unpackhi_epi16(lo, hi));
+					lo = _mm_mullo_epi16(dx, dy); hi = _mm_mulhi_epi16(dx, dy);
+					_mm_storeu_si128((__m128i*)(xy + j), _mm_unpacklo_epi16(lo, hi));
+					_mm_storeu_si128((__m128i*)(xy + j + 4), _mm_unpackhi_epi16(lo, hi));
+					lo = _mm_mullo_epi16(dy, dy); hi = _mm_mulhi_epi16(dy, dy);
+					_mm_storeu_si128((__m128i*)(yy + j), _mm_unpacklo_epi16(lo, hi));
+					_mm_storeu_si128((__m128i*)(yy + j + 4), _mm_unpackhi_epi16(lo, hi));
+				}
+				gradientProducts_scalar(pix + j, step, n - j, xx + j, xy + j, yy + j);
+			}
+
+			__attribute__((target("avx2")))
+			static void gradientProducts_avx2(const unsigned char * pix, std::ptrdiff_t step, std::size_t n, int * xx, int * xy, int * yy)
+			{
+				std::size_t j = 0;
+				for (; j + 8 <= n; j += 8) {
+					__m256i dx = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pix + j + 1))),
+					                              _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pix + j - 1))));
+					__m256i dy = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pix + j + step))),
+					                              _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(pix + j - step))));
+					_mm256_storeu_si256((__m256i*)(xx + j), _mm256_mullo_epi32(dx, dx));
+					_mm256_storeu_si256((__m256i*)(xy + j), _mm256_mullo_epi32(dx, dy));
+					_mm256_storeu_si256((__m256i*)(yy + j), _mm256_mullo_epi32(dy, dy));
+				}
+				gradientProducts_scalar(pix + j, step, n - j, xx + j, xy + j, yy + j);
+			}
+#endif
+
+			void gradientProducts(const unsigned char * pix, std::ptrdiff_t step, std::size_t n, int * xx, int * xy, int * yy)
+			{
+				switch (level())
+				{
+#if SIMD_X86
+					case AVX2: gradientProducts_avx2(pix, step, n, xx, xy, yy); break;
+					case SSE2: gradientProducts_sse2(pix, step, n, xx, xy, yy); break;
+#endif
+					default: gradientProducts_scalar(pix, step, n, xx, xy, yy); break;
+				}
+			}
+
+
+			// the sums wrap around like the unsigned ones, as the vector versions do
+			static void integralRow_scalar(const int * src, const int * above, int * dst, std::size_t n, unsigned int carry)
+			{
+				for (std::size_t j = 0; j < n; ++j)
+				{
+					carry += (unsigned int)src[j];
+					dst[j] = (int)(carry + (above ? (unsigned int)above[j] : 0u));
+				}
+			}
+
+#if SIMD_X86
+			// prefix sum of 4 values with two shifted additions, plus the carry of the previous values
+			__attribute__((target("sse2")))
+			static void integralRow_sse2(const int * src, const int * above, int * dst, std::size_t n)
+			{
+				std::size_t j = 0;
+				__m128i carry = _mm_setzero_si128();
+				for (; j + 4 <= n; j += 4) {
+					__m128i x = _mm_loadu_si128((const __m128i*)(src + j));
+					x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+					x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+					x = _mm_add_epi32(x, carry);
+					carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3,3,3,3));
+					if (above) x = _mm_add_epi32(x, _mm_loadu_si128((const __m128i*)(above + j)));
+					_mm_storeu_si128((__m128i*)(dst + j), x);
+				}
+				integralRow_scalar(src + j, (above ? above + j : 0), dst + j, n - j, (unsigned int)_mm_cvtsi128_si32(carry));
+			}
+
+			// same on 8 values, the carry of the low lane is moved to the high lane
+			__attribute__((target("avx2")))
+			static void integralRow_avx2(const int * src, const int * above, int * dst, std::size_t n)
+			{
+				std::size_t j = 0;
+				__m256i carry = _mm256_setzero_si256(), last = _mm256_set1_epi32(7);
+				for (; j + 8 <= n; j += 8) {
+					__m256i x = _mm256_loadu_si256((const __m256i*)(src + j));
+					x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+					x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+					__m256i lane = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3,3,3,3));
+					x = _mm256_add_epi32(x, _mm256_permute2x128_si256(lane, lane, 0x08));
+					x = _mm256_add_epi32(x, carry);
+					carry = _mm256_permutevar8x32_epi32(x, last);
+					if (above) x = _mm256_add_epi32(x, _mm256_loadu_si256((const __m256i*)(above + j)));
+					_mm256_storeu_si256((__m256i*)(dst + j), x);
+				}
+				integralRow_scalar(src + j, (above ? above + j : 0), dst + j, n - j, (unsigned int)_mm256_cvtsi256_si32(carry));
+			}
+#endif
+
+			void integralRow(const int * src, const int * above, int * dst, std::size_t n)
+			{
+				switch (level())
+				{
+#if SIMD_X86
+					case AVX2: integralRow_avx2(src, above, dst, n); break;
+					case SSE2: integralRow_sse2(src, above, dst, n); break;
+#endif
+					default: integralRow_scalar(src, above, dst, n, 0); break;
+				}
+			}
+
+			unsigned int dot(const unsigned char * a, const unsigned char * b, std::size_t n)
+			{
+				switch (level())
+				{
+#if SIMD_X86
+					case AVX2: return dot_avx2(a, b, n);
+					case SSE2: return dot_sse2(a, b, n);
+#endif
+					default: return dot_scalar(a, b, n);
+				}
+			}
+
+			void axpy(double a, const double * x, double * y, std::size_t n)
+			{
+				switch (level())
+				{
+#if SIMD_X86
+					case AVX2: axpy_avx2(a, x, y, n); break;
+					case SSE2: axpy_sse2(a, x, y, n); break;
+#endif
+					default: axpy_scalar(a, x, y, n); break;
+				}
+			}
+
+		}
+	}
+}
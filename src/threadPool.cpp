@@ -0,0 +1,97 @@
+/**
+ * \file threadPool.cpp
+ * \ingroup rtslam
+ */
+
+#include "kernel/jafarException.hpp"
+#include "rtslam/threadPool.hpp"
+#include <boost/bind.hpp>
+
+namespace jafar {
+	namespace rtslam {
+
+		ThreadPool::ThreadPool(std::size_t _size) :
+			job_task(NULL), job_size(0), job_next(0), job_pending(0), job_id(0), exiting(false)
+		{
+			for (std::size_t i = 1; i < _size; ++i)
+				workers.push_back(new boost::thread(boost::bind(&ThreadPool::workerLoop, this)));
+		}
+
+		ThreadPool::~ThreadPool()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				exiting = true;
+			}
+			job_condition.notify_all();
+			for (std::size_t i = 0; i < workers.size(); ++i) {
+				workers[i]->join();
+				delete workers[i];
+			}
+		}
+
+		void ThreadPool::runTasks()
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (job_next < job_size)
+			{
+				std::size_t i = job_next++;
+				const task_t & task = *job_task;
+				lock.unlock();
+				// an exception must neither end a worker thread nor leave the job unfinished
+				boost::exception_ptr error;
+				try { task(i); }
+				catch (kernel::Exception & e) { error = boost::copy_exception(e); }
+				catch (...) { error = boost::current_exception(); }
+				lock.lock();
+				if (error && !job_error) job_error = error;
+				if (--job_pending == 0) done_condition.notify_all();
+			}
+		}
+
+		void ThreadPool::workerLoop()
+		{
+			unsigned long last_job = 0;
+			while (true)
+			{
+				{
+					boost::unique_lock<boost::mutex> lock(mutex);
+					while (!exiting && job_id == last_job) job_condition.wait(lock);
+					if (exiting) return;
+					last_job = job_id;
+				}
+				runTasks();
+			}
+		}
+
+		void ThreadPool::parallelFor(std::size_t n, const task_t & task)
+		{
+			if (n == 0) return;
+			if (workers.empty() || n == 1) {
+				for (std::size_t i = 0; i < n; ++i) task(i);
+				return;
+			}
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				job_task = &task;
+				job_size = n;
+				job_next = 0;
+				job_pending = n;
+				job_error = boost::exception_ptr();
+				job_id++;
+			}
+			job_condition.notify_all();
+			runTasks();
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (job_pending > 0) done_condition.wait(lock);
+			job_task = NULL;
+			if (job_error)
+			{
+				boost::exception_ptr error = job_error;
+				job_error = boost::exception_ptr();
+				boost::rethrow_exception(error);
+			}
+		}
+
+	}
+}
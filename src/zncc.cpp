@@ -0,0 +1,120 @@
+/**
+ * \file zncc.cpp
+ * \ingroup rtslam
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "rtslam/zncc.hpp"
+#include "rtslam/simd.hpp"
+
+namespace jafar {
+	namespace rtslam {
+		namespace zncc {
+
+			void IntegralImage::compute(const image::Image & img)
+			{
+				width_ = img.width();
+				height_ = img.height();
+				stride_ = width_ + 1;
+				sum_.assign(stride_ * (height_ + 1), 0);
+				sqsum_.assign(stride_ * (height_ + 1), 0);
+				for (int i = 0; i < height_; ++i)
+				{
+					const unsigned char * pix = img.data() + i * img.step();
+					const unsigned int * sum_up = &sum_[i * stride_];
+					const unsigned int * sqsum_up = &sqsum_[i * stride_];
+					unsigned int * sum_row = &sum_[(i+1) * stride_];
+					unsigned int * sqsum_row = &sqsum_[(i+1) * stride_];
+					unsigned int row_sum = 0, row_sqsum = 0;
+					for (int j = 0; j < width_; ++j)
+					{
+						row_sum += pix[j];
+						row_sqsum += pix[j] * pix[j];
+						sum_row[j+1] = sum_up[j+1] + row_sum;
+						sqsum_row[j+1] = sqsum_up[j+1] + row_sqsum;
+					}
+				}
+			}
+
+
+			void patchSums(const image::Image & patch, unsigned int & sum, unsigned int & squareSum)
+			{
+				sum = squareSum = 0;
+				for (int i = 0; i < patch.height(); ++i)
+				{
+					const unsigned char * pix = patch.data() + i * patch.step();
+					for (int j = 0; j < patch.width(); ++j)
+						{ sum += pix[j]; squareSum += pix[j] * pix[j]; }
+				}
+			}
+
+
+			double score(const image::Image & patch, unsigned int patchSum, unsigned int patchSquareSum,
+				const image::Image & img, const IntegralImage & integral, int x0, int y0)
+			{
+				int w = patch.width(), h = patch.height();
+				double n = w * h;
+				unsigned int cross = 0;
+				const unsigned char * pix = img.data() + y0 * img.step() + x0;
+				for (int i = 0; i < h; ++i)
+					cross += simd::dot(pix + i * img.step(), patch.data() + i * patch.step(), w);
+				double sumI = integral.sum(x0, y0, w, h);
+				double varI = n * integral.squareSum(x0, y0, w, h) - sumI * sumI;
+				double varP = n * patchSquareSum - (double)patchSum * patchSum;
+				if (varI <= 0. || varP <= 0.) return 0.;
+				return (n * cross - sumI * patchSum) / sqrt(varI * varP);
+			}
+
+
+			/*
+			 * Offset of the maximum of the parabola through (-1,s_m) (0,s_0) (1,s_p),
+			 * and its curvature.
+			 */
+			static void interpolatePeak(double s_m, double s_0, double s_p, double & offset, double & curvature)
+			{
+				curvature = 2 * s_0 - s_m - s_p;
+				if (curvature <= 0.) { offset = 0.; return; }
+				offset = 0.5 * (s_p - s_m) / curvature;
+				if (offset > 0.5) offset = 0.5; else if (offset < -0.5) offset = -0.5;
+			}
+
+			double match(const image::Image & patch, unsigned int patchSum, unsigned int patchSquareSum,
+				const image::Image & img, const IntegralImage & integral, const cv::Rect & region,
+				double & x, double & y, double & std_x, double & std_y)
+			{
+				int hw = (patch.width() - 1) / 2, hh = (patch.height() - 1) / 2;
+				// centers such that the patch is inside the image
+				int xMin = std::max(region.x, hw), xMax = std::min(region.x + region.width, img.width() - patch.width() + hw + 1);
+				int yMin = std::max(region.y, hh), yMax = std::min(region.y + region.height, img.height() - patch.height() + hh + 1);
+				if (xMin >= xMax || yMin >= yMax) { x = y = std_x = std_y = 0.; return -1.; }
+
+				double best = -2.;
+				int xBest = xMin, yBest = yMin;
+				for (int yc = yMin; yc < yMax; ++yc)
+					for (int xc = xMin; xc < xMax; ++xc)
+					{
+						double s = score(patch, patchSum, patchSquareSum, img, integral, xc - hw, yc - hh);
+						if (s > best) { best = s; xBest = xc; yBest = yc; }
+					}
+
+				// subpixel position from the scores of the 4 neighbors
+				double dx = 0., dy = 0., cx = 0., cy = 0.;
+				if (xBest > xMin && xBest < xMax-1)
+					interpolatePeak(score(patch, patchSum, patchSquareSum, img, integral, xBest - hw - 1, yBest - hh), best,
+						score(patch, patchSum, patchSquareSum, img, integral, xBest - hw + 1, yBest - hh), dx, cx);
+				if (yBest > yMin && yBest < yMax-1)
+					interpolatePeak(score(patch, patchSum, patchSquareSum, img, integral, xBest - hw, yBest - hh - 1), best,
+						score(patch, patchSum, patchSquareSum, img, integral, xBest - hw, yBest - hh + 1), dy, cy);
+				x = xBest + 0.5 + dx;
+				y = yBest + 0.5 + dy;
+				// distance where the interpolated score drops by 10%, at most one pixel
+				std_x = (cx > 0. && best > 0. ? std::min(1.0, sqrt(0.2 * best / cx)) : 1.0);
+				std_y = (cy > 0. && best > 0. ? std::min(1.0, sqrt(0.2 * best / cy)) : 1.0);
+				return best;
+			}
+
+		}
+	}
+}
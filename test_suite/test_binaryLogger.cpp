@@ -0,0 +1,140 @@
+/**
+ * \file test_binaryLogger.cpp
+ *
+ *  Test the binary log: write records through several buffers, convert the log to text and read it back,
+ *  and measure the time per record on the logging thread.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/binaryLogger.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+class StateLoggable: public Loggable {
+	public:
+		double t;
+		std::vector<double> x;
+		std::string name;
+		StateLoggable(size_t size, std::string name = ""): t(0.), x(size), name(name) {}
+		virtual void logHeader(LogSink & log) const
+		{
+			if (!name.empty()) log.writeComment(name);
+			log.writeLegendTokens("time");
+			for (size_t i = 0; i < x.size(); ++i) { std::ostringstream oss; oss << "x" << i; log.writeLegendTokens(oss.str()); }
+		}
+		virtual void logData(LogSink & log) const
+		{
+			log.writeData(t);
+			for (size_t i = 0; i < x.size(); ++i) log.writeData(x[i]);
+		}
+};
+
+class NoColumnLoggable: public Loggable {
+	public:
+		virtual void logHeader(LogSink & log) const { log.writeComment("no column"); }
+		virtual void logData(LogSink & log) const {}
+};
+
+
+void test_binaryLogger01(void) {
+	const char *binary = "/tmp/test_binaryLogger01.log.bin", *text = "/tmp/test_binaryLogger01.log";
+	StateLoggable state(3, "State"), other(2);
+	const int n = 100;
+	{
+		BinaryLogger logger(binary, 7); // several flushes, and an incomplete last buffer
+		BOOST_CHECK(logger.isOpen());
+		logger.writeComment("options");
+		logger.addLoggable(state);
+		logger.addLoggable(other);
+		for (int k = 0; k < n; ++k)
+		{
+			state.t = other.t = 0.1 * k;
+			for (int i = 0; i < 3; ++i) state.x[i] = k + i / 3.;
+			for (int i = 0; i < 2; ++i) other.x[i] = -k * 1e-7 * (i+1);
+			logger.log();
+		}
+		BOOST_CHECK_EQUAL(logger.recordSize(), 7u);
+		const BinaryLogger::Counters & counters = logger.counters();
+		BOOST_CHECK_EQUAL(counters.n_records, (unsigned)n);
+		BOOST_CHECK_EQUAL(counters.n_flushes, (unsigned)(n / 7));
+	}
+
+	BOOST_CHECK_EQUAL(convertBinaryLog(binary, text), n);
+	std::ifstream f(text);
+	std::string line;
+	std::getline(f, line); BOOST_CHECK_EQUAL(line, "# options");
+	std::getline(f, line); BOOST_CHECK_EQUAL(line, "# State");
+	std::getline(f, line); BOOST_CHECK_EQUAL(line, "time x0 x1 x2 time x0 x1 ");
+	int errors = 0, k = 0;
+	for (; std::getline(f, line); ++k)
+	{
+		std::istringstream iss(line);
+		double v[7];
+		for (int i = 0; i < 7; ++i) iss >> v[i];
+		double expected[7] = { 0.1 * k, (double)k, k + 1/3., k + 2/3., 0.1 * k, -k * 1e-7, -k * 1e-7 * 2 }; // exact with 17 digits
+		for (int i = 0; i < 7; ++i) if (v[i] != expected[i]) ++errors;
+	}
+	BOOST_CHECK_EQUAL(k, n);
+	BOOST_CHECK_EQUAL(errors, 0);
+
+	BOOST_CHECK_EQUAL(convertBinaryLog(text, "/tmp/test_binaryLogger01.none"), -1); // not a binary log
+	remove(binary); remove(text);
+
+	// no loggable, or a loggable without columns: the header is written once, and there are no records
+	NoColumnLoggable noColumn;
+	for (int n_loggables = 0; n_loggables < 2; ++n_loggables)
+	{
+		{
+			BinaryLogger logger(binary, 7);
+			logger.writeComment("empty");
+			if (n_loggables) logger.addLoggable(noColumn);
+			for (int k = 0; k < 3; ++k) logger.log();
+			BOOST_CHECK_EQUAL(logger.recordSize(), 0u);
+			BOOST_CHECK_EQUAL(logger.counters().n_records, 0u);
+		}
+		BOOST_CHECK_EQUAL(convertBinaryLog(binary, text), 0);
+		std::ifstream f(text);
+		std::string line;
+		int n_lines = 0;
+		std::getline(f, line); BOOST_CHECK_EQUAL(line, "# empty");
+		if (n_loggables) { std::getline(f, line); BOOST_CHECK_EQUAL(line, "# no column"); }
+		while (std::getline(f, line)) if (!line.empty()) ++n_lines;
+		BOOST_CHECK_EQUAL(n_lines, 0);
+		remove(binary); remove(text);
+	}
+}
+
+void test_binaryLogger02(void) {
+	// time per record on the logging thread, for the size of an inertial robot state
+	const char *binary = "/tmp/test_binaryLogger02.log.bin";
+	StateLoggable state(19*2);
+	const int n = 20000;
+	BinaryLogger logger(binary);
+	logger.addLoggable(state);
+	for (int k = 0; k < n; ++k) { state.t = k; logger.log(); }
+	const BinaryLogger::Counters & counters = logger.counters();
+	std::cout << "binary log: " << counters.log_time * 1000. / n << " us/record, " << counters.n_flushes << " flushes in "
+		<< counters.flush_time << " ms in background" << std::endl;
+	remove(binary);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_binaryLogger )
+{
+	test_binaryLogger01();
+	test_binaryLogger02();
+}
+
@@ -0,0 +1,198 @@
+/**
+ * \file test_cameraDump.cpp
+ *
+ *  Test the dump of the used images of a camera through a tiny pool: frames dropped
+ *  or queued by each policy, free frames given back after the writes, files numbered
+ *  in the order of the queue with several writing threads, and the counters.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/hardwareSensorCamera.hpp"
+#include "rtslam/rawImage.hpp"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+/*
+ * A camera without acquisition, whose dump is fed by the test.
+ */
+class TestDumpCamera: public hardware::HardwareSensorCamera {
+	private:
+		RawImage raw;
+	public:
+		static const int width = 32, height = 24;
+		TestDumpCamera(kernel::VariableCondition<int> &condition, const std::string & dump_path):
+			hardware::HardwareSensorCamera(condition, cv::Size(width, height), dump_path)
+		{
+			raw.setJafarImage(jafarImage_ptr_t(new image::Image(width, height, CV_8U, JfrImage_CS_GRAY)));
+			std::ostringstream oss; oss << "mkdir -p " << dump_path << " ; rm -f " << dump_path << "/image_*";
+			int r = system(oss.str().c_str());
+			if (!r) {} // don't care
+		}
+		virtual void start() {}
+		virtual double getLastTimestamp() { return 0.; }
+
+		/// start the saveTask thread, that the constructors of the real cameras start
+		void startWriting() { saveTask_thread = new boost::thread(boost::bind(&TestDumpCamera::saveTask, this)); }
+		/// start the thread that pushes the used images, that start() of the real cameras starts
+		void startPushing() { savePushTask_thread = new boost::thread(boost::bind(&TestDumpCamera::savePushTask, this)); }
+		/// dump an image filled with the value k, at date k
+		void push(int k)
+		{
+			for (int i = 0; i < height; ++i) memset(raw.img->data() + i*raw.img->step(), k, width);
+			raw.timestamp = raw.arrival = k;
+			pushDumpFrame(raw);
+		}
+		void pushOtherSize()
+		{
+			RawImage other;
+			other.setJafarImage(jafarImage_ptr_t(new image::Image(width+1, height, CV_8U, JfrImage_CS_GRAY)));
+			pushDumpFrame(other);
+		}
+		bool waitWritten(unsigned n)
+		{
+			for (int t = 0; t < 5000 && dumpCounters().n_written < n; ++t) usleep(1000);
+			return dumpCounters().n_written == n;
+		}
+		size_t freeFrames()
+		{
+			dump_free_cond.lock();
+			size_t n = (dump_free.size() == dump_free_cond.var ? dump_free.size() : (size_t)-1);
+			dump_free_cond.unlock();
+			return n;
+		}
+		size_t extraWriters() { return dump_worker_threads.size(); }
+};
+
+
+static kernel::VariableCondition<int> condition(0);
+
+/// the date and the pixel value of the dumped image file number i, -1 if there is none
+static int dumpedFrame(const std::string & dump_path, int i, const char *ext, int & pixel)
+{
+	std::ostringstream oss; oss << dump_path << "/image_" << std::setw(7) << std::setfill('0') << i;
+	double date = -1.;
+	std::ifstream f((oss.str() + ".time").c_str());
+	if (!(f >> date)) return -1;
+	image::Image img;
+	pixel = (img.load(oss.str() + ext, 0) && img.data() ? img.data()[img.step() + 1] : -1);
+	return (int)date;
+}
+
+
+void test_cameraDump01(void) {
+	// the new image is not dumped when the pool is full
+	const std::string path = "/tmp/test_cameraDump01";
+	TestDumpCamera camera(condition, path);
+	camera.setDumpConfig(2, hardware::HardwareSensorCamera::dpDropNewest);
+	for (int k = 1; k <= 3; ++k) camera.push(k);
+	hardware::HardwareSensorCamera::DumpCounters counters = camera.dumpCounters();
+	BOOST_CHECK_EQUAL(counters.n_queued, 2u);
+	BOOST_CHECK_EQUAL(counters.n_dropped, 1u);
+	BOOST_CHECK_EQUAL(counters.max_queued, 2u);
+	BOOST_CHECK_EQUAL(camera.freeFrames(), 0u);
+	BOOST_CHECK_EQUAL(camera.extraWriters(), 0u);
+
+	camera.startWriting();
+	BOOST_REQUIRE(camera.waitWritten(2));
+	BOOST_CHECK_EQUAL(camera.freeFrames(), 2u);
+	int pixel;
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 0, ".pgm", pixel), 1); BOOST_CHECK_EQUAL(pixel, 1);
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 1, ".pgm", pixel), 2); BOOST_CHECK_EQUAL(pixel, 2);
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 2, ".pgm", pixel), -1);
+
+	// the pool is available again
+	camera.push(4);
+	BOOST_REQUIRE(camera.waitWritten(3));
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 2, ".pgm", pixel), 4); BOOST_CHECK_EQUAL(pixel, 4);
+	BOOST_CHECK_EQUAL(camera.dumpCounters().n_dropped, 1u);
+
+	// an image of another size is dropped without taking a frame
+	camera.pushOtherSize();
+	BOOST_CHECK_EQUAL(camera.dumpCounters().n_dropped, 2u);
+	BOOST_CHECK_EQUAL(camera.dumpCounters().n_queued, 3u);
+	BOOST_CHECK_EQUAL(camera.freeFrames(), 2u);
+
+	// the destruction stops the thread that pushes the used images
+	camera.startPushing();
+}
+
+void test_cameraDump02(void) {
+	// the oldest queued frame is reused for the new image
+	const std::string path = "/tmp/test_cameraDump02";
+	TestDumpCamera camera(condition, path);
+	camera.setDumpConfig(2, hardware::HardwareSensorCamera::dpDropOldest);
+	for (int k = 1; k <= 5; ++k) camera.push(k);
+	hardware::HardwareSensorCamera::DumpCounters counters = camera.dumpCounters();
+	BOOST_CHECK_EQUAL(counters.n_queued, 5u);
+	BOOST_CHECK_EQUAL(counters.n_dropped, 3u);
+	BOOST_CHECK_EQUAL(counters.max_queued, 2u);
+	BOOST_CHECK_EQUAL(camera.freeFrames(), 0u);
+
+	camera.startWriting();
+	BOOST_REQUIRE(camera.waitWritten(2));
+	BOOST_CHECK_EQUAL(camera.freeFrames(), 2u);
+	int pixel;
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 0, ".pgm", pixel), 4); BOOST_CHECK_EQUAL(pixel, 4);
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 1, ".pgm", pixel), 5); BOOST_CHECK_EQUAL(pixel, 5);
+	BOOST_CHECK_EQUAL(dumpedFrame(path, 2, ".pgm", pixel), -1);
+}
+
+void test_cameraDump03(void) {
+	// all the images are dumped, by several threads, and numbered in the order of the queue
+	const std::string path = "/tmp/test_cameraDump03";
+	const int n = 20;
+	{
+		TestDumpCamera camera(condition, path);
+		camera.setDumpConfig(2, hardware::HardwareSensorCamera::dpBlock, 3);
+		camera.startWriting();
+		for (int k = 1; k <= n; ++k) camera.push(k);
+		BOOST_CHECK_EQUAL(camera.extraWriters(), 2u);
+		BOOST_REQUIRE(camera.waitWritten(n));
+		hardware::HardwareSensorCamera::DumpCounters counters = camera.dumpCounters();
+		BOOST_CHECK_EQUAL(counters.n_queued, (unsigned)n);
+		BOOST_CHECK_EQUAL(counters.n_dropped, 0u);
+		BOOST_CHECK(counters.max_queued >= 1u && counters.max_queued <= 2u);
+		BOOST_CHECK_EQUAL(camera.freeFrames(), 2u);
+		// the destruction stops and joins the writing threads
+	}
+	int errors = 0, pixel;
+	for (int i = 0; i < n; ++i)
+		if (dumpedFrame(path, i, ".png", pixel) != i+1 || pixel != i+1) ++errors;
+	BOOST_CHECK_EQUAL(errors, 0);
+	BOOST_CHECK_EQUAL(dumpedFrame(path, n, ".png", pixel), -1);
+
+	// the images still queued at the destruction are written
+	{
+		TestDumpCamera camera(condition, path);
+		camera.setDumpConfig(4, hardware::HardwareSensorCamera::dpDropNewest, 2);
+		for (int k = 1; k <= 4; ++k) camera.push(k);
+		camera.startWriting();
+	}
+	for (int i = 0; i < 4; ++i)
+		if (dumpedFrame(path, i, ".png", pixel) != i+1 || pixel != i+1) ++errors;
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_cameraDump )
+{
+	test_cameraDump01();
+	test_cameraDump02();
+	test_cameraDump03();
+}
+
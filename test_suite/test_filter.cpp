@@ -19,6 +19,9 @@
 
 
 #include "rtslam/kalmanFilter.hpp"
+#include "rtslam/simd.hpp"
+#include "rtslam/threadPool.hpp"
+#include "kernel/timingTools.hpp"
 #include <iostream>
 #include "jmath/matlab.hpp"
 #include "jmath/random.hpp"
@@ -73,8 +76,320 @@ void test_filter01(void) {
 }
 
 
+/*
+ * Check that the BLOCKS covariance engine gives the same results as the INDIRECT one,
+ * on a map with fragmented used states.
+ */
+void test_filter02(void) {
+
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+	using namespace std;
+
+	size_t max_size = 60;
+	ExtendedKalmanFilterIndirect filter1(max_size), filter2(max_size);
+	filter2.setEngine(ExtendedKalmanFilterIndirect::BLOCKS);
+	randVector(filter1.x());
+	randMatrix(filter1.P());
+	filter2.x() = filter1.x();
+	filter2.P() = filter1.P();
+
+	// robot in 0..9, landmarks in 12..17, 20..25 and 40..45 (new landmark)
+	jblas::ind_array iav = ublasExtra::ia_set(0, 10);
+	jblas::ind_array ial = ublasExtra::ia_set(40, 46);
+	jblas::ind_array iax = ublasExtra::ia_union(iav, ublasExtra::ia_union(ublasExtra::ia_set(12, 18), ublasExtra::ia_set(20, 26)));
+
+	// predict
+	jblas::mat F_v(10, 10); randMatrix(F_v);
+	jblas::sym_mat Q(10); randMatrix(Q);
+	filter1.predict(iax, F_v, iav, Q);
+	filter2.predict(iax, F_v, iav, Q);
+	cout << "predict error: " << ublas::norm_frobenius(filter1.P() - filter2.P()) << endl;
+	BOOST_CHECK_SMALL(ublas::norm_frobenius(filter1.P() - filter2.P()), 1e-10);
+
+	// initialize
+	jblas::mat G_rs(6, 10); randMatrix(G_rs);
+	jblas::mat G_y(6, 2); randMatrix(G_y);
+	jblas::sym_mat R(2); randMatrix(R);
+	filter1.initialize(iax, G_rs, iav, ial, G_y, R);
+	filter2.initialize(iax, G_rs, iav, ial, G_y, R);
+	iax = ublasExtra::ia_union(iax, ial);
+	cout << "initialize error: " << ublas::norm_frobenius(filter1.P() - filter2.P()) << endl;
+	BOOST_CHECK_SMALL(ublas::norm_frobenius(filter1.P() - filter2.P()), 1e-10);
+
+	// correct
+	jblas::ind_array iarsl = ublasExtra::ia_union(iav, ublasExtra::ia_set(20, 26));
+	jblas::mat INN_rsl(2, iarsl.size()); randMatrix(INN_rsl);
+	Innovation inn1(2), inn2(2);
+	randVector(inn1.x());
+	inn1.P(jblas::identity_mat(2));
+	inn2.x(inn1.x());
+	inn2.P(inn1.P());
+	filter1.correct(iax, inn1, INN_rsl, iarsl);
+	filter2.correct(iax, inn2, INN_rsl, iarsl);
+	cout << "correct error: " << ublas::norm_frobenius(filter1.P() - filter2.P()) << " "
+			<< ublas::norm_2(filter1.x() - filter2.x()) << endl;
+	BOOST_CHECK_SMALL(ublas::norm_frobenius(filter1.P() - filter2.P()), 1e-10);
+	BOOST_CHECK_SMALL(ublas::norm_2(filter1.x() - filter2.x()), 1e-10);
+}
+
+
+/*
+ * Benchmark of the covariance update of the correction, P(x,x) += K * PJt',
+ * ublas expression against kalman::symRankUpdate() for each available instruction set.
+ */
+void test_filter03(void) {
+
+	using namespace jafar;
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+	using namespace std;
+
+	const size_t nsizes = 3;
+	size_t lmks[nsizes] = { 50, 150, 300 }; // 3d points with inverse depth, 6 states each
+	size_t inns[2] = { 2, 60 }; // one observation, 30 stacked observations
+
+	for (size_t s = 0; s < nsizes; ++s)
+	for (size_t t = 0; t < 2; ++t)
+	{
+		size_t n = 19 + 6 * lmks[s], m = inns[t];
+		jblas::sym_mat P0(n+50), P1, P2;
+		randMatrix(P0);
+		jblas::ind_array iax = ublasExtra::ia_set(0, n);
+		jblas::mat K(n, m), PJt(n, m);
+		randMatrix(K); randMatrix(PJt);
+
+		kernel::Chrono chrono;
+		P1 = P0;
+		chrono.reset();
+		ublas::project(P1, iax, iax) += prod<jblas::sym_mat> (K, trans(PJt));
+		double t_ublas = chrono.elapsedMicrosecond();
+		cout << "n " << n << " m " << m << ": ublas " << t_ublas << " us";
+
+		simd::level_t level = simd::detectedLevel();
+		for (int l = simd::SCALAR; l <= (int)level; ++l)
+		{
+			simd::setLevel((simd::level_t)l);
+			P2 = P0;
+			chrono.reset();
+			kalman::symRankUpdate(P2, iax, K, PJt);
+			double t_kernel = chrono.elapsedMicrosecond();
+			cout << " ; level " << l << " " << t_kernel << " us (x" << t_ublas / t_kernel << ")";
+			BOOST_CHECK_SMALL(ublas::norm_frobenius(P1 - P2) / ublas::norm_frobenius(P1), 1e-12);
+		}
+		simd::setLevel(level);
+		cout << endl;
+	}
+}
+
+
+/*
+ * Covariance operations split among the threads of a pool, against the caller thread only,
+ * on a map of 300 landmarks, for both engines.
+ */
+void test_filter04(void) {
+
+	using namespace jafar;
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+	using namespace std;
+
+	size_t n = 19 + 6 * 300;
+	thread_pool_ptr_t pool(new ThreadPool(4));
+	for (int e = ExtendedKalmanFilterIndirect::INDIRECT; e <= ExtendedKalmanFilterIndirect::BLOCKS; ++e)
+	{
+		ExtendedKalmanFilterIndirect filter1(n), filter2(n);
+		filter1.setEngine((ExtendedKalmanFilterIndirect::engine_t)e);
+		filter2.setEngine((ExtendedKalmanFilterIndirect::engine_t)e);
+		filter2.setThreadPool(pool);
+		randVector(filter1.x());
+		randMatrix(filter1.P());
+		filter2.x() = filter1.x();
+		filter2.P() = filter1.P();
+
+		jblas::ind_array iav = ublasExtra::ia_set(0, 19);
+		jblas::ind_array iax = ublasExtra::ia_set(0, n);
+		jblas::mat F_v(19, 19); randMatrix(F_v);
+		jblas::sym_mat Q(19); randMatrix(Q);
+
+		kernel::Chrono chrono;
+		chrono.reset();
+		filter1.predict(iax, F_v, iav, Q);
+		double t1 = chrono.elapsedMicrosecond();
+		chrono.reset();
+		filter2.predict(iax, F_v, iav, Q);
+		double t2 = chrono.elapsedMicrosecond();
+		cout << "engine " << e << " predict: " << t1 << " us, " << pool->size() << " threads " << t2 << " us ; ";
+		BOOST_CHECK_SMALL(ublas::norm_frobenius(filter1.P() - filter2.P()) / ublas::norm_frobenius(filter1.P()), 1e-12);
+
+		jblas::ind_array iarsl = ublasExtra::ia_union(iav, ublasExtra::ia_set(100, 106));
+		jblas::mat INN_rsl(2, iarsl.size()); randMatrix(INN_rsl);
+		Innovation inn1(2), inn2(2);
+		randVector(inn1.x());
+		inn1.P(jblas::identity_mat(2));
+		inn2.x(inn1.x());
+		inn2.P(inn1.P());
+		chrono.reset();
+		filter1.correct(iax, inn1, INN_rsl, iarsl);
+		t1 = chrono.elapsedMicrosecond();
+		chrono.reset();
+		filter2.correct(iax, inn2, INN_rsl, iarsl);
+		t2 = chrono.elapsedMicrosecond();
+		cout << "correct: " << t1 << " us, " << pool->size() << " threads " << t2 << " us" << endl;
+		BOOST_CHECK_SMALL(ublas::norm_frobenius(filter1.P() - filter2.P()) / ublas::norm_frobenius(filter1.P()), 1e-12);
+		BOOST_CHECK_SMALL(ublas::norm_2(filter1.x() - filter2.x()), 1e-10);
+	}
+}
+
+
+/*
+ * Stack the same nobs 2d observations of landmarks of a map of n states into filter1 and filter2 (if given),
+ * with innovation covariances consistent with P and measurement noise r.
+ * If duplicate, each landmark is observed twice with the same Jacobian, which makes the stacked covariance
+ * close to singular when r is small.
+ */
+static void stackObservations(jafar::rtslam::ExtendedKalmanFilterIndirect & filter1, jafar::rtslam::ExtendedKalmanFilterIndirect * filter2,
+                              size_t n, size_t nobs, double r, bool duplicate)
+{
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+
+	jblas::mat INN_rsl;
+	for (size_t i = 0; i < nobs; ++i)
+	{
+		size_t lmk = (duplicate ? i / 2 : i);
+		JFR_ASSERT(25 + 6 * lmk <= n, "stackObservations: too many observations for the map");
+		jblas::ind_array iarsl = ublasExtra::ia_union(ublasExtra::ia_set(0, 19), ublasExtra::ia_set(19 + 6 * lmk, 25 + 6 * lmk));
+		if (!duplicate || i % 2 == 0) { INN_rsl.resize(2, iarsl.size()); randMatrix(INN_rsl); }
+		Innovation inn(2);
+		randVector(inn.x());
+		jblas::mat S = ublas::prod(INN_rsl, ublas::prod<jblas::mat>(ublas::project(filter1.P(), iarsl, iarsl), ublas::trans(INN_rsl)));
+		S += r * jblas::identity_mat(2);
+		inn.P(jblas::sym_mat(S));
+		filter1.stackCorrection(inn, INN_rsl, iarsl);
+		if (filter2) filter2->stackCorrection(inn, INN_rsl, iarsl);
+	}
+}
+
+/*
+ * Stacked correction with LU inverse against Cholesky factorization and triangular solves:
+ * timing for 1 to 60 observations on a map of 300 landmarks, and stability on a close to singular stack.
+ */
+void test_filter05(void) {
+
+	using namespace jafar;
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+	using namespace std;
+
+	size_t n = 19 + 6 * 300;
+	jblas::ind_array iax = ublasExtra::ia_set(0, n);
+	jblas::sym_mat P0(n);
+	randMatrix(P0);
+	P0 *= 1.0 / n;
+	P0 += jblas::identity_mat(n); // diagonally dominant, so positive definite
+	jblas::vec x0(n);
+	randVector(x0);
+
+	size_t nobs[4] = { 1, 10, 30, 60 };
+	for (size_t s = 0; s < 4; ++s)
+	{
+		ExtendedKalmanFilterIndirect filter1(n), filter2(n);
+		filter2.setStackedSolver(ExtendedKalmanFilterIndirect::CHOLESKY);
+		filter1.P() = P0; filter1.x() = x0;
+		filter2.P() = P0; filter2.x() = x0;
+		stackObservations(filter1, &filter2, n, nobs[s], 1.0, false);
+
+		kernel::Chrono chrono;
+		chrono.reset();
+		filter1.correctAllStacked(iax);
+		double t1 = chrono.elapsedMicrosecond();
+		chrono.reset();
+		filter2.correctAllStacked(iax);
+		double t2 = chrono.elapsedMicrosecond();
+		double errP = ublas::norm_frobenius(filter1.P() - filter2.P()) / ublas::norm_frobenius(filter1.P());
+		double errx = ublas::norm_2(filter1.x() - filter2.x()) / ublas::norm_2(filter1.x() - x0);
+		cout << "stacked " << 2 * nobs[s] << " rows: lu " << t1 << " us, cholesky " << t2 << " us (x" << t1 / t2
+				<< ") ; relative difference P " << errP << " x " << errx << endl;
+		BOOST_CHECK_SMALL(errP, 1e-8);
+		BOOST_CHECK_SMALL(errx, 1e-8);
+	}
+
+	// close to singular: 30 landmarks observed twice each, with tiny noise
+	ExtendedKalmanFilterIndirect filter1(n), filter2(n);
+	filter2.setStackedSolver(ExtendedKalmanFilterIndirect::CHOLESKY);
+	filter1.P() = P0; filter1.x() = x0;
+	filter2.P() = P0; filter2.x() = x0;
+	stackObservations(filter1, &filter2, n, 60, 1e-10, true);
+	filter1.correctAllStacked(iax);
+	filter2.correctAllStacked(iax);
+	double mindiag1 = filter1.P()(0, 0), mindiag2 = filter2.P()(0, 0);
+	for (size_t i = 1; i < n; ++i) {
+		mindiag1 = min(mindiag1, filter1.P()(i, i));
+		mindiag2 = min(mindiag2, filter2.P()(i, i));
+	}
+	cout << "close to singular: min diag(P) lu " << mindiag1 << ", cholesky " << mindiag2 << endl;
+	BOOST_CHECK(mindiag2 > -1e-6);
+}
+
+
+/*
+ * Sequential scalar correction against the usual correction, with diagonal and correlated measurement noise.
+ */
+void test_filter06(void) {
+
+	using namespace jafar;
+	using namespace jafar::rtslam;
+	using namespace jafar::jmath;
+	using namespace std;
+
+	size_t n = 19 + 6 * 40;
+	jblas::ind_array iax = ublasExtra::ia_set(0, n);
+	jblas::ind_array iarsl = ublasExtra::ia_union(ublasExtra::ia_set(0, 19), ublasExtra::ia_set(19 + 6 * 7, 25 + 6 * 7));
+	jblas::mat INN_rsl(2, iarsl.size()); randMatrix(INN_rsl);
+
+	for (int correlated = 0; correlated <= 1; ++correlated)
+	{
+		ExtendedKalmanFilterIndirect filter1(n), filter2(n);
+		randMatrix(filter1.P());
+		filter1.P() *= 1.0 / n;
+		filter1.P() += jblas::identity_mat(n);
+		randVector(filter1.x());
+		filter2.P() = filter1.P();
+		filter2.x() = filter1.x();
+
+		jblas::sym_mat R = jblas::identity_mat(2);
+		if (correlated) R(1, 0) = 0.5;
+		Innovation inn(2);
+		randVector(inn.x());
+		jblas::mat S = ublas::prod(INN_rsl, ublas::prod<jblas::mat>(ublas::project(filter1.P(), iarsl, iarsl), ublas::trans(INN_rsl)));
+		S += R;
+		inn.P(jblas::sym_mat(S));
+
+		kernel::Chrono chrono;
+		chrono.reset();
+		filter1.correct(iax, inn, INN_rsl, iarsl);
+		double t1 = chrono.elapsedMicrosecond();
+		chrono.reset();
+		filter2.correctSequential(iax, inn, INN_rsl, iarsl, R);
+		double t2 = chrono.elapsedMicrosecond();
+		double errP = ublas::norm_frobenius(filter1.P() - filter2.P()) / ublas::norm_frobenius(filter1.P());
+		double errx = ublas::norm_2(filter1.x() - filter2.x());
+		cout << (correlated ? "correlated" : "diagonal") << " noise: correct " << t1 << " us, sequential " << t2
+				<< " us ; difference P " << errP << " x " << errx << endl;
+		BOOST_CHECK_SMALL(errP, 1e-10);
+		BOOST_CHECK_SMALL(errx, 1e-10);
+	}
+}
+
+
 BOOST_AUTO_TEST_CASE( test_filter )
 {
 	test_filter01();
+	test_filter02();
+	test_filter03();
+	test_filter04();
+	test_filter05();
+	test_filter06();
 }
 
@@ -0,0 +1,165 @@
+/**
+ * \file test_hardware.cpp
+ *
+ *  Test the ring buffer shared between the acquisition and the slam threads of hardware sensors.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/ringBuffer.hpp"
+#include "kernel/timingTools.hpp"
+#include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace jafar::rtslam::hardware;
+using namespace jafar;
+
+
+template<class Ring>
+void producer(Ring & ring, std::vector<double> & slots, int n, bool stamp)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		while (ring.isFull()) boost::this_thread::yield();
+		slots[ring.writePos()] = (stamp ? kernel::Clock::getTime() : (double)i);
+		ring.commitWrite();
+	}
+}
+
+/**
+ * Consume n readings, alternating between the two ways of releasing them.
+ * \return the number of readings that were not received in order.
+ */
+template<class Ring>
+int consumeSequence(Ring & ring, std::vector<double> & slots, int n)
+{
+	int expected = 0, errors = 0, batch = 0;
+	while (expected < n)
+	{
+		if (ring.isEmpty()) { boost::this_thread::yield(); continue; }
+		int first = ring.firstUnreadPos(), last = ring.lastUnreadPos();
+		for (int pos = first; ; pos = (pos+1) % ring.size())
+		{
+			if (slots[pos] != (double)expected) ++errors;
+			++expected;
+			if (pos == last) break;
+		}
+		// keep the last reading, as the slam thread does when it is processing it
+		if (++batch % 2) ring.releaseUntil(last); else ring.release(last);
+	}
+	return errors;
+}
+
+template<class Ring>
+int stress(int size, int n)
+{
+	Ring ring(size);
+	std::vector<double> slots(size, -1.);
+	boost::thread writer(boost::bind(&producer<Ring>, boost::ref(ring), boost::ref(slots), n, false));
+	int errors = consumeSequence(ring, slots, n);
+	writer.join();
+	return errors;
+}
+
+/**
+ * Consume n readings one by one, and measure the delay between their commit and their reading.
+ */
+template<class Ring>
+void latency(int size, int n, double & mean, double & max, double & total)
+{
+	Ring ring(size);
+	std::vector<double> slots(size, 0.);
+	mean = max = 0.;
+	kernel::Chrono chrono;
+	boost::thread writer(boost::bind(&producer<Ring>, boost::ref(ring), boost::ref(slots), n, true));
+	for (int i = 0; i < n; )
+	{
+		if (ring.isEmpty()) { boost::this_thread::yield(); continue; }
+		int pos = ring.firstUnreadPos();
+		double delay = kernel::Clock::getTime() - slots[pos];
+		ring.release(pos);
+		mean += delay; if (delay > max) max = delay;
+		++i;
+	}
+	writer.join();
+	total = chrono.elapsedMicrosecond();
+	mean /= n;
+}
+
+
+void test_hardware01(void) {
+	// stress the ring buffer with small and large buffers, so that it is often full or often empty
+	int sizes[] = {2, 3, 16, 1000};
+	for (int k = 0; k < 4; ++k)
+	{
+		BOOST_CHECK_EQUAL(stress<RingIndexSpsc>(sizes[k], 200000), 0);
+		BOOST_CHECK_EQUAL(stress<RingIndexLocked>(sizes[k], 200000), 0);
+	}
+
+	// wrapping of positions and counters, in one thread
+	RingIndexSpsc ring(3);
+	BOOST_CHECK(ring.isEmpty());
+	for (int i = 0; i < 3; ++i) { BOOST_CHECK(!ring.isFull()); ring.commitWrite(); }
+	BOOST_CHECK(ring.isFull());
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 0);
+	BOOST_CHECK_EQUAL(ring.lastUnreadPos(), 2);
+	ring.releaseUntil(1);
+	BOOST_CHECK(!ring.isFull());
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 2);
+	ring.commitWrite();
+	BOOST_CHECK(ring.isFull());
+	BOOST_CHECK_EQUAL(ring.lastUnreadPos(), 0);
+	ring.release(0);
+	BOOST_CHECK(ring.isEmpty());
+	BOOST_CHECK_EQUAL(ring.writePos(), 1);
+
+	// positions that are not written, or already released, do not move the read position
+	ring.setReadPos(1); // the write position, not written yet
+	BOOST_CHECK(ring.isEmpty());
+	BOOST_CHECK(!ring.isFull());
+	ring.commitWrite(); ring.commitWrite();
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 1);
+	ring.setReadPos(0); // released
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 1);
+	BOOST_CHECK(!ring.isFull());
+	ring.setReadPos(ring.writePos());
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 1);
+	BOOST_CHECK(!ring.isFull());
+	ring.releaseUntil(0);
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 1);
+	ring.setReadPos(2);
+	BOOST_CHECK_EQUAL(ring.firstUnreadPos(), 2);
+	ring.release(2);
+	BOOST_CHECK(ring.isEmpty());
+	ring.release(2); // released twice
+	BOOST_CHECK(ring.isEmpty());
+	BOOST_CHECK(!ring.isFull());
+}
+
+void test_hardware02(void) {
+	// latency microbenchmark, lock-free against mutex
+	const int n = 100000, size = 16;
+	double mean, max, total;
+	latency<RingIndexSpsc>(size, n, mean, max, total);
+	std::cout << "ring buffer lock-free: latency mean " << mean*1e6 << " us, max " << max*1e6 << " us, "
+		<< total/n << " us per reading" << std::endl;
+	latency<RingIndexLocked>(size, n, mean, max, total);
+	std::cout << "ring buffer mutex:     latency mean " << mean*1e6 << " us, max " << max*1e6 << " us, "
+		<< total/n << " us per reading" << std::endl;
+}
+
+
+BOOST_AUTO_TEST_CASE( test_hardware )
+{
+	test_hardware01();
+	test_hardware02();
+}
+
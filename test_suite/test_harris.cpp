@@ -0,0 +1,141 @@
+/**
+ * \file test_harris.cpp
+ *
+ *  Test the quick Harris detector against a plain computation (see demo_suite/bench_harris.cpp for its detection time).
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/quickHarrisDetector.hpp"
+#include "rtslam/simd.hpp"
+#include "image/roi.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+/*
+ * Random texture with some bright squares, so that there are corners of all strengths.
+ */
+static void fillScene(image::Image & img)
+{
+	for (int i = 0; i < img.height(); ++i)
+		for (int j = 0; j < img.width(); ++j)
+			img.data()[i*img.step()+j] = (unsigned char)(64 + rand() % 32);
+	for (int k = 0; k < img.width()*img.height()/400; ++k)
+	{
+		int x0 = rand() % img.width(), y0 = rand() % img.height(), size = 3 + rand() % 12, value = 128 + rand() % 128;
+		for (int i = y0; i < std::min(y0+size, img.height()); ++i)
+			for (int j = x0; j < std::min(x0+size, img.width()); ++j)
+				img.data()[i*img.step()+j] = (unsigned char)value;
+	}
+}
+
+/*
+ * Same algorithm as QuickHarrisDetector, with the box sums computed directly.
+ */
+static bool referenceHarris(const image::Image & img, int x0, int y0, int w, int h, int convSize, float threshold, float edge,
+	int pix[2], float & score)
+{
+	int shift = (convSize-1)/2;
+	std::vector<int> xx(w*h), xy(w*h), yy(w*h);
+	for (int ri = 1; ri < h-1; ++ri)
+		for (int rj = 1; rj < w-1; ++rj)
+		{
+			const unsigned char * p = img.data() + (y0+ri)*img.step() + x0+rj;
+			int dx = p[1] - p[-1], dy = p[img.step()] - p[-img.step()];
+			xx[ri*w+rj] = dx*dx; xy[ri*w+rj] = dx*dy; yy[ri*w+rj] = dy*dy;
+		}
+	float low_max = 0.;
+	for (int ri = 1+shift; ri < h-1-shift; ++ri)
+		for (int rj = 1+shift; rj < w-1-shift; ++rj)
+		{
+			int cxx = 0, cxy = 0, cyy = 0;
+			for (int i = ri-shift+1; i <= ri+shift; ++i)
+				for (int j = rj-shift+1; j <= rj+shift; ++j)
+					{ cxx += xx[i*w+j]; cxy += xy[i*w+j]; cyy += yy[i*w+j]; }
+			int sm = cxx + cyy, df = cxx - cyy;
+			float sr = sqrt((double)df*(double)df + 4*(double)cxy*(double)cxy);
+			double high = (double)sm + sr, low = (double)sm - sr;
+			float ratio = high / low;
+			if (ratio < edge && low > low_max) { low_max = low; pix[0] = x0 + rj; pix[1] = y0 + ri; }
+		}
+	score = sqrt(low_max / (double)(convSize*convSize));
+	return (score > threshold);
+}
+
+
+void test_harris01(void) {
+	srand(3);
+	image::Image img(320, 240, CV_8U, JfrImage_CS_GRAY);
+	fillScene(img);
+	QuickHarrisDetector detector(5, 15.0, 10.0);
+
+	simd::level_t levels[] = {simd::SCALAR, simd::SSE2, simd::AVX2};
+	for (int l = 0; l < 3; ++l)
+	{
+		simd::setLevel(levels[l]);
+		// rois of changing sizes, so that the scratch arena is reused smaller and grown again
+		for (int t = 0; t < 60; ++t)
+		{
+			int w = 12 + rand() % 100, h = 12 + rand() % 100;
+			int x0 = 1 + rand() % (img.width()-w-2), y0 = 1 + rand() % (img.height()-h-2);
+			image::ConvexRoi roi(cv::Rect(x0, y0, w, h));
+			feat_img_pnt_ptr_t featPtr(new FeatureImagePoint());
+			bool found = detector.detectIn(img, featPtr, &roi);
+
+			int pix[2] = {0, 0}; float score;
+			bool refFound = referenceHarris(img, x0, y0, w, h, 5, 15.0, 10.0, pix, score);
+			BOOST_CHECK_EQUAL(found, refFound);
+			if (found && refFound)
+			{
+				BOOST_CHECK_EQUAL(featPtr->measurement.x()(0), pix[0] + 0.5);
+				BOOST_CHECK_EQUAL(featPtr->measurement.x()(1), pix[1] + 0.5);
+				BOOST_CHECK_CLOSE(featPtr->measurement.matchScore, (double)score, 1e-4);
+			}
+		}
+
+		// one sweep on the cells of a grid, against one detection per cell
+		std::vector<image::ConvexRoi> rois;
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 5; ++j)
+				if ((i + j) % 3) rois.push_back(image::ConvexRoi(cv::Rect(20 + j*56, 10 + i*52, 56, 52)));
+		std::vector<feat_img_pnt_ptr_t> featPtrs;
+		for (size_t k = 0; k < rois.size(); ++k) featPtrs.push_back(feat_img_pnt_ptr_t(new FeatureImagePoint()));
+		std::vector<bool> found;
+		int nFound = detector.detectIn(img, rois, featPtrs, found);
+		int nRef = 0;
+		for (size_t k = 0; k < rois.size(); ++k)
+		{
+			feat_img_pnt_ptr_t featPtr(new FeatureImagePoint());
+			bool refFound = detector.detectIn(img, featPtr, &rois[k]);
+			if (refFound) ++nRef;
+			BOOST_CHECK_EQUAL(found[k], refFound);
+			if (found[k] && refFound)
+			{
+				BOOST_CHECK_EQUAL(featPtrs[k]->measurement.x()(0), featPtr->measurement.x()(0));
+				BOOST_CHECK_EQUAL(featPtrs[k]->measurement.x()(1), featPtr->measurement.x()(1));
+				BOOST_CHECK_EQUAL(featPtrs[k]->measurement.matchScore, featPtr->measurement.matchScore);
+			}
+		}
+		BOOST_CHECK_EQUAL(nFound, nRef);
+	}
+	simd::setLevel(simd::detectedLevel());
+}
+
+
+BOOST_AUTO_TEST_CASE( test_harris )
+{
+	test_harris01();
+}
+
@@ -66,7 +66,50 @@ void test_inertial01() {
 	}
 }
 
+/*
+ * Check that pre-integrating several IMU readings and doing a single map
+ * prediction gives the same map as one prediction per reading.
+ */
+void test_inertial02() {
+
+	map_ptr_t mapPtr1(new MapAbstract(100));
+	map_ptr_t mapPtr2(new MapAbstract(100));
+	robinertial_ptr_t robPtr1(new RobotInertial(mapPtr1));
+	robinertial_ptr_t robPtr2(new RobotInertial(mapPtr2));
+	robPtr1->linkToParentMap(mapPtr1);
+	robPtr2->linkToParentMap(mapPtr2);
+	mapPtr1->reserveStates(30); // some landmarks to have cross-variances
+	mapPtr2->reserveStates(30);
+
+	mapPtr1->fillRndm();
+	robPtr1->pose.x(quaternion::originFrame());
+	mapPtr2->x() = mapPtr1->x();
+	mapPtr2->P() = mapPtr1->P();
+
+	Perturbation pert(scalar_vector<double>(12, 0.0), sym_mat(scalar_diag_mat(12, 0.01)));
+	robPtr1->set_perturbation(pert);
+	robPtr2->set_perturbation(pert);
+	robPtr1->dt_or_dx = robPtr2->dt_or_dx = 0.005;
+
+	vec u(6);
+	robPtr2->beginPreintegration();
+	for (size_t t = 0; t < 10; t++){
+		randVector(u);
+		u *= 0.1;
+		robPtr1->move(u);
+		robPtr2->move(u);
+	}
+	robPtr2->endPreintegration();
+
+	double err_x = ublas::norm_2(mapPtr1->x() - mapPtr2->x());
+	double err_P = ublas::norm_frobenius(mapPtr1->P() - mapPtr2->P()) / ublas::norm_frobenius(mapPtr1->P());
+	cout << "pre-integration error: x " << err_x << " P " << err_P << endl;
+	BOOST_CHECK_SMALL(err_x, 1e-12);
+	BOOST_CHECK_SMALL(err_P, 1e-10);
+}
+
 BOOST_AUTO_TEST_CASE( test_inertial )
 {
 	test_inertial01();
+	test_inertial02();
 }
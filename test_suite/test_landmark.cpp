@@ -27,6 +27,9 @@
 #include "rtslam/quatTools.hpp"
 
 #include "rtslam/landmarkAnchoredHomogeneousPoint.hpp"
+#include "rtslam/landmarkEuclideanPoint.hpp"
+#include "rtslam/landmarkFactory.hpp"
+#include "rtslam/mapManager.hpp"
 #include "kernel/IdFactory.hpp"
 
 using namespace jafar::rtslam;
@@ -50,7 +53,7 @@ void test_landmark01(void) {
 	cout << "\n% LANDMARK CREATION AND PRINT \n%===========" << endl;
 
 	for (size_t lmk = 0; lmk < 3; lmk++) {
-		jblas::ind_array ial = ia_pushfront(mapPtr->used_states, LandmarkAnchoredHomogeneousPoint::size());
+		jblas::ind_array ial = mapPtr->reserveStates(LandmarkAnchoredHomogeneousPoint::size());
 		Lmks.insert_element(lmk, new LandmarkAnchoredHomogeneousPoint(mapPtr));
 		Lmks(lmk)->id(lmk);
 	}
@@ -121,8 +124,91 @@ void test_landmark01(void) {
 
 }
 
+/*
+ * Map compaction after killing landmarks: states and cross-variances must follow their landmarks.
+ */
+void test_landmark02(void) {
+
+	map_ptr_t mapPtr(new MapAbstract(100));
+	landmark_factory_ptr_t lmkFactory(new LandmarkFactory<LandmarkAnchoredHomogeneousPoint, LandmarkEuclideanPoint>());
+	map_manager_ptr_t mmPtr(new MapManager(lmkFactory));
+	mmPtr->linkToParentMap(mapPtr);
+	std::vector<landmark_ptr_t> lmks;
+	for (size_t i = 0; i < 5; ++i) {
+		landmark_ptr_t lmkPtr = lmkFactory->createInit(mapPtr);
+		lmkPtr->linkToParentMapManager(mmPtr);
+		lmks.push_back(lmkPtr);
+	}
+	mapPtr->fillRndm();
+
+	jblas::vec x2 = lmks[2]->state.x();
+	jblas::sym_mat P2 = lmks[2]->state.P();
+	jblas::mat P24 = project(mapPtr->P(), lmks[2]->state.ia(), lmks[4]->state.ia());
+
+	mmPtr->unregisterLandmark(lmks[0]);
+	mmPtr->unregisterLandmark(lmks[3]);
+	cout << "used states before compaction: " << mapPtr->ia_used_states() << ", fragmentation " << mapPtr->fragmentation() << endl;
+	BOOST_CHECK(mapPtr->fragmentation() > 0.0);
+
+	BOOST_CHECK(mapPtr->compact());
+	cout << "used states after compaction: " << mapPtr->ia_used_states() << ", fragmentation " << mapPtr->fragmentation() << endl;
+	size_t n = mapPtr->ia_used_states().size();
+	BOOST_CHECK_EQUAL(mapPtr->ia_used_states()(n - 1), n - 1);
+	BOOST_CHECK_EQUAL(mapPtr->fragmentation(), 0.0);
+	BOOST_CHECK_EQUAL(lmks[1]->state.ia()(0), 0u);
+	BOOST_CHECK_EQUAL(lmks[2]->state.ia()(0), 7u);
+
+	jblas::vec x2_ = lmks[2]->state.x();
+	jblas::sym_mat P2_ = lmks[2]->state.P();
+	jblas::mat P24_ = project(mapPtr->P(), lmks[2]->state.ia(), lmks[4]->state.ia());
+	BOOST_CHECK_SMALL(norm_inf(x2_ - x2), 1e-15);
+	BOOST_CHECK_SMALL(norm_frobenius(P2_ - P2), 1e-15);
+	BOOST_CHECK_SMALL(norm_frobenius(P24_ - P24), 1e-15);
+
+	BOOST_CHECK(!mapPtr->compact()); // already compact
+	const MapAbstract::CompactionCounters & counters = mapPtr->compactionCounters();
+	cout << "compactions " << counters.n_compactions << ", moved states " << counters.n_moved_states
+			<< ", time " << counters.total_time << " ms" << endl;
+	BOOST_CHECK_EQUAL(counters.n_compactions, 1u);
+	BOOST_CHECK_EQUAL(counters.n_moved_states, 21u);
+}
+
+/*
+ * Growable map: the filter is enlarged when landmarks are added, and the existing states are kept.
+ */
+void test_landmark03(void) {
+
+	map_ptr_t mapPtr(new MapAbstract(100, 10));
+	BOOST_CHECK_EQUAL(mapPtr->capacity(), 10u);
+	landmark_factory_ptr_t lmkFactory(new LandmarkFactory<LandmarkAnchoredHomogeneousPoint, LandmarkEuclideanPoint>());
+	std::vector<landmark_ptr_t> lmks;
+	jblas::vec x0(7);
+	randVector(x0);
+	for (size_t i = 0; i < 5; ++i) {
+		lmks.push_back(lmkFactory->createInit(mapPtr));
+		if (i == 0) { lmks[0]->state.x(x0); lmks[0]->state.std(x0); }
+	}
+	const MapAbstract::GrowthCounters & counters = mapPtr->growthCounters();
+	cout << "capacity " << mapPtr->capacity() << " for " << mapPtr->current_size << " states, "
+			<< counters.n_grows << " grows in " << counters.total_time << " ms" << endl;
+	BOOST_CHECK_EQUAL(mapPtr->capacity(), 40u);
+	BOOST_CHECK_EQUAL(mapPtr->filterPtr->size(), 40u);
+	BOOST_CHECK_EQUAL(counters.n_grows, 2u);
+	BOOST_CHECK_EQUAL(counters.peak_capacity, 40u);
+	BOOST_CHECK_SMALL(norm_inf(lmks[0]->state.x() - x0), 1e-15);
+	BOOST_CHECK_SMALL(lmks[0]->state.P(0, 0) - x0(0) * x0(0), 1e-15);
+	BOOST_CHECK_EQUAL(lmks[4]->state.P(0, 0), 0.0);
+
+	// cannot grow beyond max_size
+	BOOST_CHECK_EQUAL(mapPtr->reserveStates(66).size(), 0u);
+	BOOST_CHECK_EQUAL(mapPtr->reserveStates(65).size(), 65u);
+	BOOST_CHECK_EQUAL(mapPtr->capacity(), 100u);
+}
+
 BOOST_AUTO_TEST_CASE( test_landmark )
 {
 	test_landmark01();
+	test_landmark02();
+	test_landmark03();
 }
 
@@ -0,0 +1,294 @@
+/**
+ * \file test_patchWarp.cpp
+ *
+ *  Test the homographic warping of patches against a plain bilinear interpolation, and measure its time per patch.
+ *  Test the homographic prediction of the appearance of a landmark against the affine one, on poses where
+ *  the affine one is exact, and the cache of the predictions.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/patchWarp.hpp"
+#include "rtslam/descriptorImagePoint.hpp"
+#include "rtslam/robotConstantVelocity.hpp"
+#include "rtslam/sensorPinhole.hpp"
+#include "rtslam/landmarkEuclideanPoint.hpp"
+#include "rtslam/landmarkAnchoredHomogeneousPoint.hpp"
+#include "rtslam/observationPinHoleEuclideanPoint.hpp"
+#include "rtslam/mapManager.hpp"
+#include "kernel/timingTools.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+static void fillSmooth(image::Image & img)
+{
+	for (int i = 0; i < img.height(); ++i)
+		for (int j = 0; j < img.width(); ++j)
+			img.data()[i*img.step()+j] = (unsigned char)(128 + 60*sin(0.4*j + 0.1*i) + 40*cos(0.3*i) + rand() % 16);
+}
+
+/*
+ * Same warp with doubles.
+ */
+static double referencePixel(const image::Image & src, const patchwarp::Homography & H, int wd, int hd, int i, int j)
+{
+	double x, y;
+	H.apply(j + 0.5 - wd * 0.5, i + 0.5 - hd * 0.5, x, y);
+	x += src.width() * 0.5 - 0.5; y += src.height() * 0.5 - 0.5;
+	x = std::min(std::max(x, 0.), src.width() - 1.); y = std::min(std::max(y, 0.), src.height() - 1.);
+	int ix = std::min((int)x, src.width()-2), iy = std::min((int)y, src.height()-2);
+	double ax = x - ix, ay = y - iy;
+	const unsigned char * p = src.data() + iy*src.step() + ix;
+	return (p[0]*(1-ax) + p[1]*ax) * (1-ay) + (p[src.step()]*(1-ax) + p[src.step()+1]*ax) * ay;
+}
+
+static void perspective(double angle, double zoom, double tilt, patchwarp::Homography & H)
+{
+	double c = zoom * cos(angle), s = zoom * sin(angle);
+	double h[9] = { c, -s, 0.2, s, c, -0.3, tilt, -0.5*tilt, 1. };
+	for (int k = 0; k < 9; ++k) H.h[k] = h[k];
+}
+
+/*
+ * A camera in front of a landmark, and a view of the landmark from the origin.
+ * The camera looks along the z axis, so that moving the robot along z only changes the scale of
+ * the landmark patch, and rotating it around z only rotates the patch: the affine prediction is exact.
+ */
+struct PredictionScene {
+	map_ptr_t mapPtr;
+	robconstvel_ptr_t robPtr;
+	pinhole_ptr_t senPtr;
+	eucp_ptr_t lmkPtr;
+	map_manager_ptr_t mmPoint;
+	obs_ph_euc_ptr_t obsPtr;
+	app_img_pnt_ptr_t app_src;
+	FeatureView view;
+	jblas::vec lmk;
+
+	PredictionScene(): lmk(3)
+	{
+		mapPtr.reset(new MapAbstract(100));
+		mapPtr->fillSeq();
+		robPtr.reset(new RobotConstantVelocity(mapPtr));
+		robPtr->linkToParentMap(mapPtr);
+		robPtr->state.clear();
+		senPtr.reset(new SensorPinhole(robPtr, MapObject::UNFILTERED));
+		senPtr->linkToParentRobot(robPtr);
+		jblas::vec7 identity; identity.clear(); identity(3) = 1.;
+		senPtr->pose.x(identity);
+		jblas::vec4 k; k(0) = 320.; k(1) = 240.; k(2) = 500.; k(3) = 500.;
+		jblas::vec d(0);
+		senPtr->params.setImgSize(640, 480);
+		senPtr->params.setIntrinsicCalibration(k, d, 0);
+
+		lmkPtr.reset(new LandmarkEuclideanPoint(mapPtr));
+		landmark_factory_ptr_t lmkFactory(new LandmarkFactory<LandmarkAnchoredHomogeneousPoint, LandmarkEuclideanPoint>());
+		mmPoint.reset(new MapManager(lmkFactory));
+		mmPoint->linkToParentMap(mapPtr);
+		lmkPtr->linkToParentMapManager(mmPoint);
+		lmk.clear(); lmk(2) = 5.;
+		lmkPtr->state.x() = lmk;
+		obsPtr.reset(new ObservationPinHoleEuclideanPoint(senPtr, lmkPtr));
+		obsPtr->linkToPinHole(senPtr);
+		obsPtr->linkToParentEUC(lmkPtr);
+
+		// the view, from the origin
+		moveTo(0., 0.);
+		app_src.reset(new AppearanceImagePoint(41, 41, CV_8U));
+		for (int i = 0; i < 41; ++i)
+			for (int j = 0; j < 41; ++j)
+				app_src->patch.data()[i*app_src->patch.step()+j] = (unsigned char)(128 + 50*sin(0.15*j + 0.05*i) + 40*cos(0.12*i));
+		app_src->offset.x()(0) = 0.3; app_src->offset.x()(1) = -0.2;
+		app_src->offset.P().clear(); app_src->offset.P()(0,0) = app_src->offset.P()(1,1) = 0.1;
+		view.senPose = senPtr->globalPose();
+		view.appearancePtr = app_src;
+		view.obsModelPtr = obsPtr->model;
+		view.used = false;
+	}
+
+	/// robot at z along the optical axis, rotated by angle around it
+	void moveTo(double z, double angle)
+	{
+		jblas::vec7 pose; pose.clear();
+		pose(2) = z; pose(3) = cos(angle/2); pose(6) = sin(angle/2);
+		robPtr->pose.x(pose);
+	}
+};
+
+/*
+ * The prediction functions of the descriptor.
+ */
+class PredictionDescriptor: public DescriptorImagePointMultiView {
+	public:
+		PredictionDescriptor(): DescriptorImagePointMultiView(41, 2., 0.3, ptHomographic) {}
+		using DescriptorImagePointMultiView::predictAffine;
+		using DescriptorImagePointMultiView::predictHomographic;
+		using DescriptorImagePointMultiView::getCachedPrediction;
+		using DescriptorImagePointMultiView::cachePrediction;
+};
+
+static double meanDifference(const image::Image & a, const image::Image & b)
+{
+	double sum = 0.;
+	for (int i = 0; i < a.height(); ++i) for (int j = 0; j < a.width(); ++j)
+		sum += fabs((double)a.data()[i*a.step()+j] - b.data()[i*b.step()+j]);
+	return sum / (a.width() * a.height());
+}
+
+
+void test_patchWarp01(void) {
+	srand(6);
+	// homography from its corners
+	patchwarp::Homography H, R;
+	perspective(0.3, 1.2, 0.02, H);
+	double from[4][2] = {{-7.5,-7.5},{7.5,-7.5},{-7.5,7.5},{7.5,7.5}}, to[4][2];
+	for (int k = 0; k < 4; ++k) H.apply(from[k][0], from[k][1], to[k][0], to[k][1]);
+	BOOST_CHECK(patchwarp::fromCorners(from, to, R));
+	for (int k = 0; k < 9; ++k) BOOST_CHECK_SMALL(R.h[k] - H.h[k], 1e-9);
+	double aligned[4][2] = {{0,0},{1,1},{2,2},{3,5}};
+	BOOST_CHECK(!patchwarp::fromCorners(aligned, to, R));
+
+	image::Image src(41, 41, CV_8U, JfrImage_CS_GRAY);
+	fillSmooth(src);
+
+	// identity on a patch of the same size is a copy
+	patchwarp::Homography I = {{1,0,0, 0,1,0, 0,0,1}};
+	image::Image copy(41, 41, CV_8U, JfrImage_CS_GRAY);
+	patchwarp::warpBilinear(src, I, copy);
+	int diffs = 0;
+	for (int i = 0; i < 41; ++i) for (int j = 0; j < 41; ++j)
+		if (copy.data()[i*copy.step()+j] != src.data()[i*src.step()+j]) ++diffs;
+	BOOST_CHECK_EQUAL(diffs, 0);
+
+	// perspective warps against the plain interpolation, some of them going out of the source patch
+	int sizes[] = {11, 15, 21};
+	for (int k = 0; k < 3; ++k)
+		for (int t = 0; t < 10; ++t)
+		{
+			perspective(0.6 * (rand() / (double)RAND_MAX - 0.5), 0.6 + 1.4 * rand() / (double)RAND_MAX, 0.04 * (rand() / (double)RAND_MAX - 0.5), H);
+			image::Image dst(sizes[k], sizes[k], CV_8U, JfrImage_CS_GRAY);
+			patchwarp::warpBilinear(src, H, dst);
+			double maxError = 0.;
+			for (int i = 0; i < sizes[k]; ++i) for (int j = 0; j < sizes[k]; ++j)
+				maxError = std::max(maxError, fabs(dst.data()[i*dst.step()+j] - referencePixel(src, H, sizes[k], sizes[k], i, j)));
+			BOOST_CHECK(maxError <= 1.5);
+		}
+}
+
+void test_patchWarp02(void) {
+	// time per patch, for the patch sizes of the predicted appearances
+	srand(7);
+	image::Image src(41, 41, CV_8U, JfrImage_CS_GRAY);
+	fillSmooth(src);
+	patchwarp::Homography H;
+	perspective(0.2, 1.1, 0.01, H);
+	kernel::Chrono chrono;
+	const int n = 2000;
+	int sizes[] = {11, 15, 21};
+	for (int k = 0; k < 3; ++k)
+	{
+		image::Image dst(sizes[k], sizes[k], CV_8U, JfrImage_CS_GRAY);
+		chrono.reset();
+		for (int i = 0; i < n; ++i) patchwarp::warpBilinear(src, H, dst);
+		std::cout << "homographic warp " << sizes[k] << "x" << sizes[k] << ": " << chrono.elapsedMicrosecond() / n << " us/patch" << std::endl;
+	}
+}
+
+void test_patchWarp03(void) {
+	PredictionScene scene;
+	PredictionDescriptor desc;
+
+	// from the view itself, the homographic prediction is the center of the view patch
+	app_img_pnt_ptr_t affine(new AppearanceImagePoint(15, 15, CV_8U)), homographic(new AppearanceImagePoint(15, 15, CV_8U));
+	BOOST_CHECK(desc.predictHomographic(scene.obsPtr, scene.view, scene.lmk, scene.app_src, homographic));
+	int diffs = 0;
+	for (int i = 0; i < 15; ++i) for (int j = 0; j < 15; ++j)
+		if (homographic->patch.data()[i*homographic->patch.step()+j] != scene.app_src->patch.data()[(i+13)*scene.app_src->patch.step()+j+13]) ++diffs;
+	BOOST_CHECK_EQUAL(diffs, 0);
+	BOOST_CHECK_SMALL(homographic->offset.x()(0) - 0.3, 1e-6);
+	BOOST_CHECK_SMALL(homographic->offset.x()(1) + 0.2, 1e-6);
+
+	// closer, further and rotated around the optical axis: same prediction as the affine one
+	double poses[4][2] = {{0., 0.}, {1., 0.}, {-1.25, 0.}, {-1.25, 0.5}}; // position along the optical axis, rotation around it
+	for (int k = 0; k < 4; ++k)
+	{
+		scene.moveTo(poses[k][0], poses[k][1]);
+		desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, affine);
+		BOOST_CHECK(desc.predictHomographic(scene.obsPtr, scene.view, scene.lmk, scene.app_src, homographic));
+		double meanError = meanDifference(affine->patch, homographic->patch);
+		BOOST_CHECK_MESSAGE(meanError < 4., "pose " << k << ": mean difference " << meanError);
+		BOOST_CHECK_SMALL(homographic->offset.x()(0) - affine->offset.x()(0), 1e-3);
+		BOOST_CHECK_SMALL(homographic->offset.x()(1) - affine->offset.x()(1), 1e-3);
+	}
+}
+
+void test_patchWarp04(void) {
+	// cache of the predictions, with a tolerance of 5% on the zoom and 0.05 rad on the rotation
+	PredictionScene scene;
+	PredictionDescriptor desc;
+	desc.setPredictionCache(0.05, 0.05);
+	app_img_pnt_ptr_t app(new AppearanceImagePoint(15, 15, CV_8U)), first(new AppearanceImagePoint(15, 15, CV_8U));
+	unsigned long hits = DescriptorImagePointMultiView::predictionCounters().n_hits;
+
+	// first prediction, not cached yet
+	desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, app);
+	BOOST_CHECK_EQUAL(DescriptorImagePointMultiView::predictionCounters().n_hits, hits);
+	app->patch.copy(first->patch, 0, 0, 0, 0);
+	first->offset = app->offset;
+
+	// zoom 1.02 and rotation 0.02: copied from the cache
+	scene.moveTo(0.1, 0.02);
+	desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, app);
+	BOOST_CHECK_EQUAL(DescriptorImagePointMultiView::predictionCounters().n_hits, hits + 1);
+	BOOST_CHECK_EQUAL(meanDifference(app->patch, first->patch), 0.);
+	BOOST_CHECK_EQUAL(app->offset.x()(0), first->offset.x()(0));
+
+	// zoom 0.91: warped again, and cached
+	scene.moveTo(-0.5, 0.);
+	desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, app);
+	BOOST_CHECK_EQUAL(DescriptorImagePointMultiView::predictionCounters().n_hits, hits + 1);
+	BOOST_CHECK(meanDifference(app->patch, first->patch) > 0.);
+
+	// rotation 0.2: warped again, and cached
+	scene.moveTo(-0.5, 0.2);
+	desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, app);
+	BOOST_CHECK_EQUAL(DescriptorImagePointMultiView::predictionCounters().n_hits, hits + 1);
+
+	// rotation 0.23, within the tolerance of the last cached prediction
+	scene.moveTo(-0.5, 0.23);
+	desc.predictAffine(scene.obsPtr, scene.view, scene.lmk, scene.app_src, app);
+	BOOST_CHECK_EQUAL(DescriptorImagePointMultiView::predictionCounters().n_hits, hits + 2);
+
+	// another view, or another patch size, is not in the cache
+	double zoom = 5. / 5.5, rotation = 0.23;
+	appearance_ptr_t other(new AppearanceImagePoint(41, 41, CV_8U));
+	BOOST_CHECK(desc.getCachedPrediction(scene.view.appearancePtr, zoom, rotation, app));
+	BOOST_CHECK(!desc.getCachedPrediction(other, zoom, rotation, app));
+	app_img_pnt_ptr_t bigger(new AppearanceImagePoint(21, 21, CV_8U));
+	BOOST_CHECK(!desc.getCachedPrediction(scene.view.appearancePtr, zoom, rotation, bigger));
+
+	// disabled cache
+	desc.setPredictionCache(0., 0.);
+	BOOST_CHECK(!desc.getCachedPrediction(scene.view.appearancePtr, zoom, rotation, app));
+}
+
+
+BOOST_AUTO_TEST_CASE( test_patchWarp )
+{
+	test_patchWarp01();
+	test_patchWarp02();
+	test_patchWarp03();
+	test_patchWarp04();
+}
+
@@ -0,0 +1,89 @@
+/**
+ * \file test_pipeline.cpp
+ *
+ *  Test the histograms of the frame timings, and the background thread that prepares the next frames.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/framePipeline.hpp"
+#include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+static void slowAppend(std::vector<int> & done, int k)
+{
+	boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+	done.push_back(k);
+}
+
+
+void test_pipeline01(void) {
+	DurationHistogram hist(5., 4);
+	BOOST_CHECK_EQUAL(hist.percentile(0.5), 0.);
+	for (int i = 0; i < 100; ++i) hist.add(i * 0.25); // 20 per bin in [0,25[
+	BOOST_CHECK_EQUAL(hist.count(), 100u);
+	BOOST_CHECK_EQUAL(hist.bins().size(), 5u);
+	BOOST_CHECK_EQUAL(hist.bins()[0], 20u);
+	BOOST_CHECK_EQUAL(hist.bins()[4], 20u); // overflow
+	BOOST_CHECK_CLOSE(hist.mean(), 12.375, 1e-9);
+	BOOST_CHECK_EQUAL(hist.max(), 24.75);
+	BOOST_CHECK_EQUAL(hist.percentile(0.2), 5.);
+	BOOST_CHECK_EQUAL(hist.percentile(0.5), 15.);
+	BOOST_CHECK_EQUAL(hist.percentile(0.99), 24.75);
+	std::cout << "histogram: " << hist << std::endl;
+
+	FrameTiming timing;
+	for (int i = 0; i < 10; ++i) timing.frameDone(i * 0.1, i * 0.1 + 0.022, i * 0.1 - 0.027); // latency 49 ms
+	timing.frameDone(1.0, 1.022);
+	BOOST_CHECK_EQUAL(timing.count(), 11u);
+	BOOST_CHECK_CLOSE(timing.processing().mean(), 22., 1e-6);
+	BOOST_CHECK_CLOSE(timing.latency().percentile(0.5), 49., 1e-6); // bin edge clamped to the max
+	BOOST_CHECK_CLOSE(timing.latency().percentile(0.01), 25., 1e-6); // the frame without arrival date
+	BOOST_CHECK_CLOSE(timing.throughput(), 11 / 1.022, 1e-6);
+}
+
+void test_pipeline02(void) {
+	// tasks run in order in the background thread, and wait() returns when they are all done
+	FramePipeline pipeline;
+	std::vector<int> done;
+	for (int frame = 0; frame < 5; ++frame)
+	{
+		pipeline.wait();
+		BOOST_CHECK_EQUAL(done.size(), (std::size_t)(3*frame));
+		for (int k = 0; k < 3; ++k) pipeline.post(boost::bind(&slowAppend, boost::ref(done), 3*frame + k));
+	}
+	pipeline.wait();
+	BOOST_CHECK_EQUAL(done.size(), 15u);
+	for (std::size_t k = 0; k < done.size(); ++k) BOOST_CHECK_EQUAL(done[k], (int)k);
+	BOOST_CHECK_EQUAL(pipeline.counters().n_tasks, 15u);
+	BOOST_CHECK(pipeline.counters().n_blocked > 0);
+	std::cout << "pipeline: " << pipeline.counters().busy_time << " ms busy, " << pipeline.counters().wait_time << " ms waited" << std::endl;
+
+	// pending tasks are finished before the thread exits
+	std::vector<int> last;
+	{
+		FramePipeline other;
+		other.post(boost::bind(&slowAppend, boost::ref(last), 0));
+	}
+	BOOST_CHECK_EQUAL(last.size(), 1u);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_pipeline )
+{
+	test_pipeline01();
+	test_pipeline02();
+}
+
@@ -70,10 +70,37 @@ void test_raw01(void) {
 
 #endif
 
+void test_raw02(void) {
+	// image pyramid: sizes, values, and rebuild when the image changes
+	jafar::rtslam::RawImage raw;
+	raw.setJafarImage(jafar::rtslam::jafarImage_ptr_t(new jafar::image::Image(64, 48, CV_8U, JfrImage_CS_GRAY)));
+	raw.timestamp = 1.0;
+	for (int i = 0; i < 48; ++i) for (int j = 0; j < 64; ++j)
+		raw.img->data()[i*raw.img->step()+j] = (unsigned char)(2*j + 4*i);
+
+	jafar::rtslam::jafarImage_ptr_t level2 = raw.pyramidLevel(2);
+	BOOST_CHECK_EQUAL(level2->width(), 16);
+	BOOST_CHECK_EQUAL(level2->height(), 12);
+	jafar::rtslam::jafarImage_ptr_t level1 = raw.pyramidLevel(1);
+	BOOST_CHECK_EQUAL(level1->width(), 32);
+	// mean of the 2x2 block starting at row 6, column 10, rounded
+	BOOST_CHECK_EQUAL((int)level1->data()[3*level1->step()+5], (44 + 46 + 48 + 50 + 2) / 4);
+	BOOST_CHECK(raw.pyramidLevel(1) == level1); // cached
+
+	// the levels of the previous frame stay valid after the rebuild
+	raw.timestamp = 2.0;
+	raw.img->data()[6*raw.img->step()+10] = 0;
+	jafar::rtslam::jafarImage_ptr_t newLevel1 = raw.pyramidLevel(1);
+	BOOST_CHECK(newLevel1 != level1);
+	BOOST_CHECK_EQUAL((int)newLevel1->data()[3*newLevel1->step()+5], (0 + 46 + 48 + 50 + 2) / 4);
+	BOOST_CHECK_EQUAL((int)level1->data()[3*level1->step()+5], (44 + 46 + 48 + 50 + 2) / 4);
+}
+
 BOOST_AUTO_TEST_CASE( test_raw )
 {
 	#ifdef HAVE_MODULE_QDISPLAY
 	test_raw01();
 	#endif
+	test_raw02();
 }
 
@@ -0,0 +1,134 @@
+/**
+ * \file test_readingsFile.cpp
+ *
+ *  Test the bulk load of the logs of readings: exact parsing of the dumped values, incomplete
+ *  last line, cache written at the first load and invalidated when the log changes, and the
+ *  load time compared to the stream parsing.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/readingsFile.hpp"
+#include "kernel/timingTools.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+static double readingValue(int k, int i)
+{
+	if (i == 0) return 1302523456.123 + k * 0.005; // date
+	return std::sin(k * 0.1 + i) * std::pow(10., i - 5);
+}
+
+/// write a log as the preload tasks do, with the ublas format of the readings
+static void writeLog(const char *path, int n, int n_columns, bool incomplete)
+{
+	std::ofstream f(path);
+	for (int k = 0; k < n; ++k)
+	{
+		f << "[" << n_columns << "](";
+		for (int i = 0; i < n_columns; ++i) f << (i ? "," : "") << std::setprecision(50) << readingValue(k, i);
+		f << ")" << std::endl;
+	}
+	if (incomplete) f << "[" << n_columns << "](1.5,2.5";
+}
+
+
+void test_readingsFile01(void) {
+	const char *path = "/tmp/test_readingsFile01.log";
+	const std::string cache = std::string(path) + ".cache";
+	const int n = 50, n_columns = 10;
+	remove(cache.c_str());
+	writeLog(path, n, n_columns, true);
+
+	hardware::ReadingsFileReader reader;
+	BOOST_CHECK(reader.load(path, n_columns));
+	BOOST_CHECK(!reader.fromCache());
+	BOOST_CHECK_EQUAL(reader.rows(), (size_t)n);
+	BOOST_CHECK_EQUAL(reader.skipped(), 1u);
+	int errors = 0;
+	for (int k = 0; k < n; ++k) for (int i = 0; i < n_columns; ++i) if (reader.row(k)[i] != readingValue(k, i)) ++errors;
+	BOOST_CHECK_EQUAL(errors, 0);
+
+	// second load from the cache, in background
+	reader.loadInBackground(path, n_columns);
+	BOOST_CHECK(reader.wait());
+	BOOST_CHECK(reader.fromCache());
+	BOOST_CHECK_EQUAL(reader.rows(), (size_t)n);
+	BOOST_CHECK_EQUAL(reader.row(n-1)[n_columns-1], readingValue(n-1, n_columns-1));
+
+	// the cache of another log is not used
+	sleep(1); // another modification date
+	writeLog(path, n-1, n_columns, false);
+	BOOST_CHECK(reader.load(path, n_columns));
+	BOOST_CHECK(!reader.fromCache());
+	BOOST_CHECK_EQUAL(reader.rows(), (size_t)(n-1));
+	BOOST_CHECK_EQUAL(reader.skipped(), 0u);
+
+	// plain numbers, and lines with another number of values
+	{ std::ofstream f(path); f << "1 2 3\n\n4e2 -5.25e-1 6\n7 8\n-0 inf 1e400\n"; }
+	BOOST_CHECK(reader.load(path, 3, false));
+	BOOST_CHECK_EQUAL(reader.rows(), 3u);
+	BOOST_CHECK_EQUAL(reader.skipped(), 1u);
+	BOOST_CHECK_EQUAL(reader.row(1)[0], 400.);
+	BOOST_CHECK_EQUAL(reader.row(1)[1], -0.525);
+	BOOST_CHECK(std::isinf(reader.row(2)[1]) && std::isinf(reader.row(2)[2]));
+
+	BOOST_CHECK(!reader.load("/tmp/test_readingsFile01.none", 3));
+	remove(path); remove(cache.c_str());
+}
+
+void test_readingsFile02(void) {
+	// load time of a quarter of an hour of 200 Hz inertial readings
+	const char *path = "/tmp/test_readingsFile02.log";
+	const std::string cache = std::string(path) + ".cache";
+	const int n = 200000, n_columns = 10;
+	remove(cache.c_str());
+	writeLog(path, n, n_columns, false);
+	kernel::Chrono chrono;
+
+	std::ifstream f(path);
+	std::string line;
+	std::vector<double> row(n_columns);
+	chrono.reset();
+	int n_stream = 0;
+	for (; std::getline(f, line); ++n_stream)
+	{
+		std::istringstream iss(line.substr(line.find('(') + 1));
+		char sep;
+		for (int i = 0; i < n_columns; ++i) iss >> row[i] >> sep;
+	}
+	double stream_time = chrono.elapsed();
+
+	hardware::ReadingsFileReader reader;
+	reader.load(path, n_columns);
+	double text_time = reader.loadTime();
+	reader.load(path, n_columns);
+	std::cout << "readings load: " << n_stream << " readings, " << stream_time << " ms with streams, " << text_time
+		<< " ms from the text, " << reader.loadTime() << " ms from the cache" << std::endl;
+	BOOST_CHECK(reader.fromCache());
+	BOOST_CHECK_EQUAL(reader.rows(), (size_t)n);
+	remove(path); remove(cache.c_str());
+}
+
+
+BOOST_AUTO_TEST_CASE( test_readingsFile )
+{
+	test_readingsFile01();
+	test_readingsFile02();
+}
+
@@ -0,0 +1,208 @@
+/**
+ * \file test_sensorManager.cpp
+ *
+ *  Test the processing of the data of several exteroceptive sensors in groups: formation of the groups
+ *  by getNextDataGroupToUse(), and processGroup() with and without a thread pool, against the processing
+ *  of each data alone by the sensors.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/sensorManager.hpp"
+#include "rtslam/hardwareSensorAbstract.hpp"
+#include "rtslam/dataManagerAbstract.hpp"
+#include "rtslam/mapManager.hpp"
+#include "rtslam/robotConstantVelocity.hpp"
+#include "rtslam/sensorPinhole.hpp"
+#include "rtslam/landmarkEuclideanPoint.hpp"
+#include "rtslam/landmarkAnchoredHomogeneousPoint.hpp"
+#include "rtslam/framePipeline.hpp"
+#include "rtslam/threadPool.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+class TestRaw: public RawAbstract {
+	public:
+		TestRaw(double date) { timestamp = arrival = date; }
+		virtual RawAbstract* clone() { return new TestRaw(timestamp); }
+};
+
+/*
+ * Replay of a list of dates, all available from the start.
+ */
+class TestHardwareSensor: public hardware::HardwareSensorExteroAbstract {
+	private:
+		double last_date;
+	public:
+		TestHardwareSensor(kernel::VariableCondition<int> &condition, const std::vector<double> & dates):
+			hardware::HardwareSensorExteroAbstract(condition, dates.size()), last_date(dates.back())
+		{
+			setTimingInfos(0.1, 0.);
+			for (size_t i = 0; i < dates.size(); ++i)
+			{
+				buffer(getWritePos()).reset(new TestRaw(dates[i]));
+				incWritePos();
+			}
+			no_more_data = true;
+		}
+		virtual void start() {}
+		virtual double getLastTimestamp() { return last_date; }
+};
+
+/*
+ * Writes what it does with which raw to the log of its sensor, and the steps that modify the map
+ * to the log of the map. The candidates are a function of the date of the raw.
+ */
+class TestDataManager: public DataManagerAbstract {
+	private:
+		std::string name;
+		std::vector<std::string> *sensor_log, *map_log;
+		std::set<double> prepared;
+		boost::mutex prepared_mutex;
+		double candidates_date;
+		int candidates;
+		static int candidatesOf(double date) { return (int)(date * 1000. + 0.5) * 7 % 1000; }
+		void write(std::vector<std::string> *log, const std::string & step, double date, int value = 0)
+			{ std::ostringstream oss; oss << name << " " << step << " " << date << " " << value; log->push_back(oss.str()); }
+	public:
+		TestDataManager(const std::string & name, std::vector<std::string> *sensor_log, std::vector<std::string> *map_log):
+			name(name), sensor_log(sensor_log), map_log(map_log), candidates_date(-1.), candidates(0) {}
+		virtual void prepare(raw_ptr_t data)
+			{ boost::unique_lock<boost::mutex> l(prepared_mutex); prepared.insert(data->timestamp); }
+		virtual bool canPrepareAhead() const { return true; }
+		virtual void processKnown(raw_ptr_t data)
+		{
+			bool is_prepared;
+			{ boost::unique_lock<boost::mutex> l(prepared_mutex); is_prepared = (prepared.count(data->timestamp) > 0); }
+			write(sensor_log, "known", data->timestamp, is_prepared);
+			write(map_log, "known", data->timestamp);
+		}
+		virtual void beginDetection(raw_ptr_t data) { candidates_date = -1.; }
+		virtual void detectCandidates(raw_ptr_t data)
+		{
+			usleep(1000); // so that the detections of the sensors overlap
+			candidates = candidatesOf(data->timestamp);
+			candidates_date = data->timestamp;
+		}
+		virtual void detectNew(raw_ptr_t data)
+		{
+			// without the split detection, everything is done here
+			if (candidates_date != data->timestamp) detectCandidates(data);
+			write(sensor_log, "new", data->timestamp, candidates);
+			write(map_log, "new", data->timestamp, candidates);
+		}
+};
+
+
+/*
+ * Two cameras on a robot, and the logs of a run.
+ */
+struct GroupRun {
+	static kernel::VariableCondition<int> condition;
+	map_ptr_t mapPtr;
+	robconstvel_ptr_t robPtr;
+	map_manager_ptr_t mmPtr;
+	pinhole_ptr_t sen[2];
+	std::vector<std::string> groups, sensor_logs[2], map_log;
+
+	/// \param mode 0 processGroup() without pool, 1 with a pool, 2 process() of each data of the groups
+	GroupRun(int mode, bool pipeline)
+	{
+		mapPtr.reset(new MapAbstract(100));
+		mapPtr->fillSeq();
+		robPtr.reset(new RobotConstantVelocity(mapPtr));
+		robPtr->linkToParentMap(mapPtr);
+		landmark_factory_ptr_t lmkFactory(new LandmarkFactory<LandmarkAnchoredHomogeneousPoint, LandmarkEuclideanPoint>());
+		mmPtr.reset(new MapManager(lmkFactory));
+		mmPtr->linkToParentMap(mapPtr);
+
+		double dates[2][4] = {{ 1.00, 1.10, 1.20, 1.25 }, { 1.01, 1.12, 1.27, 1.40 }};
+		for (int s = 0; s < 2; ++s)
+		{
+			sen[s].reset(new SensorPinhole(robPtr, MapObject::UNFILTERED));
+			sen[s]->linkToParentRobot(robPtr);
+			sen[s]->setHardwareSensor(hardware::hardware_sensorext_ptr_t(
+				new TestHardwareSensor(condition, std::vector<double>(dates[s], dates[s] + 4))));
+			if (pipeline) sen[s]->setPipeline(frame_pipeline_ptr_t(new FramePipeline()));
+			boost::shared_ptr<TestDataManager> dmPtr(new TestDataManager(s ? "B" : "A", &sensor_logs[s], &map_log));
+			dmPtr->linkToParentSensor(sen[s]);
+			dmPtr->linkToParentMapManager(mmPtr);
+		}
+
+		SensorManagerReplay manager(mapPtr);
+		ThreadPool pool(4);
+		std::vector<SensorManagerAbstract::ProcessInfo> group;
+		while (true)
+		{
+			manager.getNextDataGroupToUse(group, 0.03);
+			if (group.front().no_more_data || !group.front().sen) break;
+			std::ostringstream oss;
+			for (size_t k = 0; k < group.size(); ++k)
+				oss << (group[k].sen == sen[0] ? "A" : "B") << group[k].sen->getRawTimestamp(group[k].id) << " ";
+			groups.push_back(oss.str());
+			if (mode == 2)
+				for (size_t k = 0; k < group.size(); ++k) group[k].sen->process(group[k].id);
+			else
+				SensorManagerAbstract::processGroup(group, (mode == 1 ? &pool : NULL));
+		}
+	}
+};
+kernel::VariableCondition<int> GroupRun::condition(0);
+
+
+void test_sensorManager01(void) {
+	// groups of data at the same date within 30 ms, in the order of the sensors after the first one
+	GroupRun run(0, false);
+	BOOST_REQUIRE_EQUAL(run.groups.size(), 5u);
+	BOOST_CHECK_EQUAL(run.groups[0], "A1 B1.01 ");
+	BOOST_CHECK_EQUAL(run.groups[1], "A1.1 B1.12 ");
+	BOOST_CHECK_EQUAL(run.groups[2], "A1.2 ");
+	BOOST_CHECK_EQUAL(run.groups[3], "A1.25 B1.27 ");
+	BOOST_CHECK_EQUAL(run.groups[4], "B1.4 ");
+
+	// all the known landmarks are observed by all the sensors of a group before any new landmark
+	BOOST_REQUIRE_EQUAL(run.map_log.size(), 16u);
+	BOOST_CHECK_EQUAL(run.map_log[0].substr(0, 7), "A known");
+	BOOST_CHECK_EQUAL(run.map_log[1].substr(0, 7), "B known");
+	BOOST_CHECK_EQUAL(run.map_log[2].substr(0, 5), "A new");
+	BOOST_CHECK_EQUAL(run.map_log[3].substr(0, 5), "B new");
+}
+
+void test_sensorManager02(void) {
+	// the same result with the steps of the sensors run concurrently, and with the next raws prepared ahead
+	GroupRun sequential(0, false), parallel(1, false), pipelined(1, true);
+	BOOST_CHECK(parallel.groups == sequential.groups);
+	BOOST_CHECK(parallel.map_log == sequential.map_log);
+	BOOST_CHECK(pipelined.groups == sequential.groups);
+	BOOST_CHECK(pipelined.map_log == sequential.map_log);
+
+	// and each sensor does the same as when it processes its data alone
+	GroupRun alone(2, false);
+	BOOST_CHECK(alone.groups == sequential.groups);
+	for (int s = 0; s < 2; ++s)
+	{
+		BOOST_CHECK(parallel.sensor_logs[s] == alone.sensor_logs[s]);
+		BOOST_CHECK(pipelined.sensor_logs[s] == alone.sensor_logs[s]);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE( test_sensorManager )
+{
+	test_sensorManager01();
+	test_sensorManager02();
+}
+
@@ -0,0 +1,117 @@
+/**
+ * \file test_sequence.cpp
+ *
+ *  Test the sequence files of images: write frames, read them back through the mapping,
+ *  ignore an incomplete last frame, and measure the replay time per frame.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/sequenceFile.hpp"
+#include "kernel/timingTools.hpp"
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+static void fillFrame(image::Image & img, int k)
+{
+	for (int i = 0; i < img.height(); ++i)
+		for (int j = 0; j < img.width(); ++j)
+			img.data()[i*img.step()+j] = (unsigned char)(i*7 + j*3 + k*11);
+}
+
+
+void test_sequence01(void) {
+	const char *path = "/tmp/test_sequence01.seq";
+	const int w = 37, h = 21, n = 10;
+	image::Image img(w, h, CV_8U, JfrImage_CS_GRAY);
+
+	hardware::SequenceFileWriter writer;
+	BOOST_CHECK(writer.open(path, w, h, w));
+	for (int k = 0; k < n; ++k)
+	{
+		fillFrame(img, k);
+		BOOST_CHECK(writer.append(img, 0.1 * k, 0.1 * k + 0.01));
+	}
+	image::Image other(w+1, h, CV_8U, JfrImage_CS_GRAY);
+	BOOST_CHECK(!writer.append(other, 1., 1.)); // not the size of the sequence
+	writer.close();
+	BOOST_CHECK_EQUAL(writer.count(), (unsigned)n);
+
+	hardware::SequenceFileReader reader;
+	BOOST_CHECK(reader.open(path));
+	BOOST_CHECK_EQUAL(reader.count(), (unsigned)n);
+	BOOST_CHECK_EQUAL(reader.width(), w);
+	BOOST_CHECK_EQUAL(reader.height(), h);
+	int errors = 0;
+	for (int k = 0; k < n; ++k)
+	{
+		BOOST_CHECK_EQUAL(reader.timestamp(k), 0.1 * k);
+		BOOST_CHECK_EQUAL(reader.arrival(k), 0.1 * k + 0.01);
+		BOOST_CHECK_EQUAL((size_t)reader.pixels(k) % 16, 0u);
+		fillFrame(img, k);
+		for (int i = 0; i < h; ++i) for (int j = 0; j < w; ++j)
+			if (reader.pixels(k)[i*reader.step()+j] != img.data()[i*img.step()+j]) ++errors;
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+	// writing to the images does not change the file
+	reader.pixels(0)[0] = 255 - reader.pixels(0)[0];
+	reader.close();
+
+	// a frame that was not completely written is ignored
+	BOOST_CHECK_EQUAL(truncate(path, 64 + (off_t)(n - 0.5) * ((16 + w*h + 15) & ~15)), 0);
+	BOOST_CHECK(reader.open(path));
+	BOOST_CHECK_EQUAL(reader.count(), (unsigned)(n-1));
+	fillFrame(img, 0);
+	BOOST_CHECK_EQUAL(reader.pixels(0)[0], img.data()[0]);
+	reader.close();
+
+	FILE *f = fopen(path, "wb"); fputs("not a sequence file, but long enough to hold a header......", f); fclose(f);
+	BOOST_CHECK(!reader.open(path));
+	BOOST_CHECK(!reader.open("/tmp/test_sequence01.none"));
+	remove(path);
+}
+
+void test_sequence02(void) {
+	// write and replay time per frame, for VGA images
+	const char *path = "/tmp/test_sequence02.seq";
+	const int w = 640, h = 480, n = 200;
+	image::Image img(w, h, CV_8U, JfrImage_CS_GRAY);
+	kernel::Chrono chrono;
+
+	hardware::SequenceFileWriter writer;
+	writer.open(path, w, h, w);
+	chrono.reset();
+	for (int k = 0; k < n; ++k) { fillFrame(img, k); writer.append(img, k, k); }
+	writer.close();
+	std::cout << "sequence write: " << chrono.elapsedMicrosecond() / n << " us/frame" << std::endl;
+
+	hardware::SequenceFileReader reader;
+	chrono.reset();
+	reader.open(path);
+	unsigned sum = 0;
+	for (unsigned k = 0; k < reader.count(); ++k)
+		for (int i = 0; i < h; i += 8) sum += reader.pixels(k)[i*reader.step()]; // touch the pages of the frame
+	std::cout << "sequence replay: " << chrono.elapsedMicrosecond() / n << " us/frame (" << sum << ")" << std::endl;
+	BOOST_CHECK_EQUAL(reader.count(), (unsigned)n);
+	reader.close();
+	remove(path);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_sequence )
+{
+	test_sequence01();
+	test_sequence02();
+}
+
@@ -0,0 +1,89 @@
+/**
+ * \file test_threadPool.cpp
+ *
+ *  Test the thread pool: all the tasks of a job are run, and a task that throws,
+ *  on the caller thread or on a worker thread, is reported by parallelFor() without
+ *  stopping the pool.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/threadPool.hpp"
+#include <boost/ref.hpp>
+#include <stdexcept>
+#include <vector>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+struct CountTask {
+	std::vector<int> *done;
+	std::size_t throw_every; ///< task i throws if i % throw_every == 0, never if 0
+	void operator()(std::size_t i) const
+	{
+		(*done)[i]++;
+		if (throw_every && i % throw_every == 0) throw std::runtime_error("task failed");
+	}
+};
+
+
+void test_threadPool01(void) {
+	const std::size_t n = 200;
+	ThreadPool pool(4);
+	std::vector<int> done(n, 0);
+	CountTask task = { &done, 0 };
+	pool.parallelFor(n, boost::ref(task));
+	int missing = 0;
+	for (std::size_t i = 0; i < n; ++i) if (done[i] != 1) ++missing;
+	BOOST_CHECK_EQUAL(missing, 0);
+}
+
+void test_threadPool02(void) {
+	const std::size_t n = 200;
+	ThreadPool pool(4);
+	std::vector<int> done(n, 0);
+
+	// every task throws, so that some throw on the worker threads and some on the caller thread
+	CountTask task = { &done, 1 };
+	bool thrown = false;
+	try { pool.parallelFor(n, boost::ref(task)); }
+	catch (std::runtime_error & e) { thrown = true; }
+	BOOST_CHECK(thrown);
+	int missing = 0;
+	for (std::size_t i = 0; i < n; ++i) if (done[i] != 1) ++missing;
+	BOOST_CHECK_EQUAL(missing, 0); // the job was finished before parallelFor returned
+
+	// the pool is still usable, and the error is not reported again
+	std::fill(done.begin(), done.end(), 0);
+	task.throw_every = 0;
+	thrown = false;
+	try { pool.parallelFor(n, boost::ref(task)); }
+	catch (...) { thrown = true; }
+	BOOST_CHECK(!thrown);
+	missing = 0;
+	for (std::size_t i = 0; i < n; ++i) if (done[i] != 1) ++missing;
+	BOOST_CHECK_EQUAL(missing, 0);
+
+	// a single failing task
+	std::fill(done.begin(), done.end(), 0);
+	task.throw_every = n - 1;
+	thrown = false;
+	try { pool.parallelFor(n, boost::ref(task)); }
+	catch (std::runtime_error & e) { thrown = true; }
+	BOOST_CHECK(thrown);
+}
+
+
+BOOST_AUTO_TEST_CASE( test_threadPool )
+{
+	test_threadPool01();
+	test_threadPool02();
+}
+
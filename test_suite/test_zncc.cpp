@@ -0,0 +1,217 @@
+/**
+ * \file test_zncc.cpp
+ *
+ *  Test the zncc engine with integral images, and compare its throughput with the correl matcher.
+ *  Check that matches run by a thread pool give the same results as in one thread.
+ *
+ * \ingroup rtslam
+ */
+
+// boost unit test includes
+#include <boost/test/auto_unit_test.hpp>
+
+// jafar debug include
+#include "kernel/jafarDebug.hpp"
+
+#include "rtslam/zncc.hpp"
+#include "rtslam/simd.hpp"
+#include "rtslam/threadPool.hpp"
+#include "kernel/timingTools.hpp"
+#include "image/roi.hpp"
+#include "correl/explorer.hpp"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <cmath>
+
+using namespace jafar::rtslam;
+using namespace jafar;
+
+
+static void fillRandom(image::Image & img)
+{
+	for (int i = 0; i < img.height(); ++i)
+		for (int j = 0; j < img.width(); ++j)
+			img.data()[i*img.step()+j] = (unsigned char)(rand() % 256);
+}
+
+static void extract(const image::Image & img, int x0, int y0, image::Image & patch)
+{
+	for (int i = 0; i < patch.height(); ++i)
+		for (int j = 0; j < patch.width(); ++j)
+			patch.data()[i*patch.step()+j] = img.data()[(y0+i)*img.step()+x0+j];
+}
+
+static double naiveZncc(const image::Image & img, int x0, int y0, const image::Image & patch)
+{
+	double n = patch.width() * patch.height(), si = 0., sp = 0., sii = 0., spp = 0., sip = 0.;
+	for (int i = 0; i < patch.height(); ++i)
+		for (int j = 0; j < patch.width(); ++j)
+		{
+			double a = img.data()[(y0+i)*img.step()+x0+j], b = patch.data()[i*patch.step()+j];
+			si += a; sp += b; sii += a*a; spp += b*b; sip += a*b;
+		}
+	return (n*sip - si*sp) / sqrt((n*sii - si*si) * (n*spp - sp*sp));
+}
+
+
+void test_zncc01(void) {
+	srand(1);
+	image::Image img(160, 120, CV_8U, JfrImage_CS_GRAY);
+	fillRandom(img);
+	zncc::IntegralImage integral;
+	integral.compute(img);
+
+	// window sums
+	unsigned int sum = 0, squareSum = 0;
+	for (int i = 17; i < 17+21; ++i) for (int j = 33; j < 33+19; ++j)
+		{ unsigned int p = img.data()[i*img.step()+j]; sum += p; squareSum += p*p; }
+	BOOST_CHECK_EQUAL(integral.sum(33, 17, 19, 21), sum);
+	BOOST_CHECK_EQUAL(integral.squareSum(33, 17, 19, 21), squareSum);
+
+	int sizes[] = {11, 15, 21};
+	simd::level_t levels[] = {simd::SCALAR, simd::SSE2, simd::AVX2};
+
+	// sum of absolute differences on rows of all lengths
+	for (int l = 0; l < 3; ++l)
+	{
+		simd::setLevel(levels[l]);
+		for (int n = 0; n < 70; ++n)
+		{
+			const unsigned char * a = img.data() + 3*img.step(), * b = img.data() + 7*img.step() + 5;
+			unsigned int sad = 0;
+			for (int j = 0; j < n; ++j) sad += std::abs((int)a[j] - (int)b[j]);
+			BOOST_CHECK_EQUAL(simd::sad(a, b, n), sad);
+		}
+	}
+	simd::setLevel(simd::detectedLevel());
+	for (int k = 0; k < 3; ++k)
+	{
+		int size = sizes[k], half = (size-1)/2;
+		image::Image patch(size, size, CV_8U, JfrImage_CS_GRAY);
+		extract(img, 70-half, 50-half, patch);
+		unsigned int patchSum, patchSquareSum;
+		zncc::patchSums(patch, patchSum, patchSquareSum);
+
+		for (int l = 0; l < 3; ++l)
+		{
+			simd::setLevel(levels[l]);
+			// scores against a plain computation
+			for (int t = 0; t < 20; ++t)
+			{
+				int x0 = rand() % (img.width() - size), y0 = rand() % (img.height() - size);
+				BOOST_CHECK_SMALL(zncc::score(patch, patchSum, patchSquareSum, img, integral, x0, y0) - naiveZncc(img, x0, y0, patch), 1e-9);
+			}
+			// find the patch back
+			double x, y, std_x, std_y;
+			double score = zncc::match(patch, patchSum, patchSquareSum, img, integral, cv::Rect(55, 35, 31, 31), x, y, std_x, std_y);
+			BOOST_CHECK_CLOSE(score, 1.0, 1e-6);
+			BOOST_CHECK_SMALL(x - 70.5, 0.5);
+			BOOST_CHECK_SMALL(y - 50.5, 0.5);
+			// region outside of the image
+			BOOST_CHECK_EQUAL(zncc::match(patch, patchSum, patchSquareSum, img, integral, cv::Rect(-40, -40, 30, 30), x, y, std_x, std_y), -1.);
+		}
+		simd::setLevel(simd::detectedLevel());
+	}
+}
+
+void test_zncc02(void) {
+	// throughput of both engines, on a search region of 41x41 pixels
+	srand(2);
+	image::Image img(640, 480, CV_8U, JfrImage_CS_GRAY);
+	fillRandom(img);
+	kernel::Chrono chrono;
+	zncc::IntegralImage integral;
+	integral.compute(img);
+	std::cout << "zncc: integral images of 640x480 in " << chrono.elapsedMicrosecond() << " us" << std::endl;
+
+	correl::FastTranslationMatcherZncc matcher(0.8, 0.1);
+	const int n = 200;
+	int sizes[] = {11, 15, 21};
+	for (int k = 0; k < 3; ++k)
+	{
+		int size = sizes[k], half = (size-1)/2;
+		image::Image patch(size, size, CV_8U, JfrImage_CS_GRAY);
+		extract(img, 320-half, 240-half, patch);
+		unsigned int patchSum, patchSquareSum;
+		zncc::patchSums(patch, patchSum, patchSquareSum);
+		cv::Rect region(300, 220, 41, 41);
+		double x, y, std_x, std_y;
+
+		chrono.reset();
+		for (int i = 0; i < n; ++i)
+			zncc::match(patch, patchSum, patchSquareSum, img, integral, region, x, y, std_x, std_y);
+		double t_integral = chrono.elapsedMicrosecond();
+
+		simd::setLevel(simd::SCALAR);
+		chrono.reset();
+		for (int i = 0; i < n; ++i)
+			zncc::match(patch, patchSum, patchSquareSum, img, integral, region, x, y, std_x, std_y);
+		double t_scalar = chrono.elapsedMicrosecond();
+		simd::setLevel(simd::detectedLevel());
+
+		image::ConvexRoi roi(region);
+		chrono.reset();
+		for (int i = 0; i < n; ++i)
+			matcher.match(patch, img, roi, x, y, std_x, std_y);
+		double t_correl = chrono.elapsedMicrosecond();
+
+		std::cout << "zncc " << size << "x" << size << ": integral " << n / t_integral * 1e6 << " matches/s, integral scalar "
+			<< n / t_scalar * 1e6 << " matches/s, correl " << n / t_correl * 1e6 << " matches/s" << std::endl;
+	}
+}
+
+struct MatchTask {
+	const image::Image * img;
+	const zncc::IntegralImage * integral;
+	const std::vector<image::Image*> * patches;
+	std::vector<double> * results; ///< score, x, y for each patch
+	void operator()(std::size_t k) const
+	{
+		const image::Image & patch = *(*patches)[k];
+		unsigned int patchSum, patchSquareSum;
+		zncc::patchSums(patch, patchSum, patchSquareSum);
+		int x0 = (int)(k * 53) % (img->width() - 60), y0 = (int)(k * 31) % (img->height() - 60);
+		double std_x, std_y;
+		(*results)[3*k] = zncc::match(patch, patchSum, patchSquareSum, *img, *integral, cv::Rect(x0, y0, 41, 41),
+			(*results)[3*k+1], (*results)[3*k+2], std_x, std_y);
+	}
+};
+
+void test_zncc03(void) {
+	// the matches of the data managers are split among a thread pool, and must not depend on it
+	srand(5);
+	image::Image img(320, 240, CV_8U, JfrImage_CS_GRAY);
+	fillRandom(img);
+	zncc::IntegralImage integral;
+	integral.compute(img);
+
+	const std::size_t n = 64;
+	std::vector<image::Image*> patches;
+	for (std::size_t k = 0; k < n; ++k)
+	{
+		patches.push_back(new image::Image(15, 15, CV_8U, JfrImage_CS_GRAY));
+		extract(img, (int)(k * 53) % (img.width() - 60) + 10 + rand() % 20, (int)(k * 31) % (img.height() - 60) + 10 + rand() % 20, *patches[k]);
+	}
+
+	std::vector<double> serial(3*n), parallel(3*n);
+	MatchTask task = { &img, &integral, &patches, &serial };
+	for (std::size_t k = 0; k < n; ++k) task(k);
+
+	ThreadPool pool(4);
+	task.results = &parallel;
+	pool.parallelFor(n, boost::ref(task));
+	for (std::size_t i = 0; i < 3*n; ++i)
+		BOOST_CHECK_EQUAL(serial[i], parallel[i]);
+
+	for (std::size_t k = 0; k < n; ++k) delete patches[k];
+}
+
+
+BOOST_AUTO_TEST_CASE( test_zncc )
+{
+	test_zncc01();
+	test_zncc02();
+	test_zncc03();
+}